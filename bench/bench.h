@@ -0,0 +1,190 @@
+#pragma once
+
+#include <functional>
+#include "ftwt.h"
+#include "nn.h"
+#include "graphio.h"
+#include "timer.h"
+#include "benchmark.h"
+
+struct BenchParams
+{
+    uint32_t warmupReps;
+    uint32_t reps;
+    uint32_t seed;
+};
+
+struct BenchContext
+{
+    BenchParams params;
+    vector<BenchRecord> records;
+    uint32_t numFailedChecks;
+
+    /**
+     * BenchContext::Measure - Time a kernel. Run warmup repetitions, then time each
+     * repetition individually, report min/median/max and keep the samples for baseline
+     * comparison.
+     *
+     * @param name Measurement name.
+     * @param fn   Kernel to time.
+     */
+
+    void Measure(const string& name, function<void()> fn)
+    {
+        for (uint32_t i = 0; i < params.warmupReps; i++) fn();
+
+        vector<double> samples(params.reps);
+
+        for (uint32_t i = 0; i < params.reps; i++)
+        {
+            CycleTimer timer;
+            fn();
+            samples[i] = timer.Seconds();
+        }
+
+        SampleStats stats = ComputeSampleStats(samples);
+
+        printf("%-40s min %10.3f ms  median %10.3f ms  max %10.3f ms\n", name.c_str(),
+            1e3 * stats.min, 1e3 * stats.median, 1e3 * stats.max);
+
+        records.push_back({ name, { { "time", "s", false, true, samples } } });
+    }
+
+    /**
+     * BenchContext::Check - Compare a kernel's results against a reference path. Prints the
+     * difference and counts it as a failure if it exceeds the tolerance, failed checks make
+     * FTWTBench exit nonzero.
+     *
+     * @param  name Check name.
+     * @param  diff Largest difference from the reference.
+     * @param  tol  Largest difference allowed.
+     * @return      True if within tolerance.
+     */
+
+    bool Check(const string& name, double diff, double tol)
+    {
+        bool bOk = diff <= tol;
+
+        printf("%-40s max diff %10.3g  tol %10.3g  %s\n", name.c_str(), diff, tol, bOk ? "ok" : "FAILED");
+        if (!bOk) numFailedChecks++;
+
+        return bOk;
+    }
+};
+
+/**
+ * MaxAbsDiff - Largest absolute elementwise difference between two result vectors. A size
+ * mismatch or a NaN on either side counts as an infinite difference.
+ *
+ * @param  a First vector.
+ * @param  b Second vector.
+ * @return   Max |a[i] - b[i]|.
+ */
+
+template<class T>
+inline double MaxAbsDiff(const vector<T>& a, const vector<T>& b)
+{
+    if (a.size() != b.size()) return INFINITY;
+
+    double maxDiff = 0;
+
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        double diff = abs((double)a[i] - (double)b[i]);
+        if (diff != diff) return INFINITY;
+
+        maxDiff = max(maxDiff, diff);
+    }
+
+    return maxDiff;
+}
+
+/**
+ * MaxRelDiff - Largest absolute difference from a reference vector relative to the
+ * reference's largest magnitude (at least 1), for sums whose rounding grows with their size.
+ *
+ * @param  a   Vector to check.
+ * @param  ref Reference vector.
+ * @return     Max |a[i] - ref[i]| / max(1, max |ref[i]|).
+ */
+
+template<class T>
+inline double MaxRelDiff(const vector<T>& a, const vector<T>& ref)
+{
+    double maxRef = 1;
+    for (auto& v : ref) maxRef = max(maxRef, abs((double)v));
+
+    return MaxAbsDiff(a, ref) / maxRef;
+}
+
+/**
+ * MaxCSCDiff - Largest absolute difference between the values of two matrices with the
+ * same sparsity pattern. A pattern mismatch counts as an infinite difference.
+ *
+ * @param  a First matrix.
+ * @param  b Second matrix.
+ * @return   Max |a.vals[i] - b.vals[i]|.
+ */
+
+template<class T>
+inline double MaxCSCDiff(const CSCMat<T>& a, const CSCMat<T>& b)
+{
+    if (a.n != b.n || a.m != b.m || a.offsets != b.offsets || a.colIdcs != b.colIdcs) return INFINITY;
+    return MaxAbsDiff(a.vals, b.vals);
+}
+
+typedef void(*PfnBench)(BenchContext&);
+
+struct BenchCase
+{
+    PfnBench pfnBench;
+    string desc;
+};
+
+/**
+ * GenerateBenchSynapses - Build a random synapse list with a skewed (roughly power law)
+ * in-degree distribution, similar to what pruned random graphs end up looking like.
+ * Much faster than RandomGraph for large nets since it doesn't visit every vertex pair.
+ *
+ * @param  numNeurons  Number of neurons.
+ * @param  numSynapses Approximate number of synapses to generate.
+ * @param  seed        RNG seed.
+ * @return             Synapse (row, col, weight) triples, may contain duplicates.
+ */
+
+inline vector<Triplet<double>> GenerateBenchSynapses(uint32_t numNeurons, uint64_t numSynapses, uint32_t seed)
+{
+    srand(seed);
+
+    vector<Triplet<double>> synapses;
+    synapses.reserve(numSynapses);
+
+    double avgDegree = (double)numSynapses / (double)numNeurons;
+
+    for (uint32_t r = 0; r < numNeurons && synapses.size() < numSynapses; r++)
+    {
+        double u        = ((double)rand() + 1.0) / ((double)RAND_MAX + 2.0);
+        uint32_t degree = (uint32_t)min((double)numNeurons, avgDegree * 0.5 / sqrt(u));
+
+        for (uint32_t i = 0; i < degree && synapses.size() < numSynapses; i++)
+        {
+            uint32_t c = (uint32_t)(((uint64_t)rand() * (RAND_MAX + 1ULL) + rand()) % numNeurons);
+            double w   = (double)rand() / (double)RAND_MAX;
+            synapses.push_back({ r, c, w });
+        }
+    }
+
+    return synapses;
+}
+
+void KernelBenches(BenchContext& ctx);
+void SpMVBenches(BenchContext& ctx);
+void SELLBenches(BenchContext& ctx);
+void FormatBenches(BenchContext& ctx);
+void IndexBenches(BenchContext& ctx);
+void ReorderBenches(BenchContext& ctx);
+void DynamicBenches(BenchContext& ctx);
+void GraphIOBenches(BenchContext& ctx);
+void SpGEMMBenches(BenchContext& ctx);
+void EigenBenches(BenchContext& ctx);
+void PulseBenches(BenchContext& ctx);
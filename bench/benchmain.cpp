@@ -0,0 +1,111 @@
+#include "bench.h"
+#include "roofline.h"
+#include "perfcounters.h"
+
+map<string, BenchCase> benches =
+{
+    { "Dynamic", { DynamicBenches, "Dynamic - Synapse growth in row slack storage vs triplet rebuilds, and its kernel cost." } },
+    { "Eigen", { EigenBenches, "Eigen - Hand rolled CSR synapse kernels vs the Eigen::SparseMatrix backend." } },
+    { "Formats", { FormatBenches, "Formats - CSR vs SELL vs BSR vs dense synapse storage on dense nets." } },
+    { "GraphIO", { GraphIOBenches, "GraphIO - Parallel Matrix Market and binary edge list import/export vs a serial reader, NN save/load." } },
+    { "Index", { IndexBenches, "Index - 32-bit vs 16-bit vs delta encoded column indices for SpMV and pairing." } },
+    { "Kernels", { KernelBenches, "Kernels - Synapse kernel microbenchmarks on a synthetic network." } },
+    { "Pulse", { PulseBenches, "Pulse - Multi-pulse propagation, frontier push through the column index vs SpMV per pulse." } },
+    { "Reorder", { ReorderBenches, "Reorder - RCM and multilevel partition neuron renumbering, miss rates and SpMV/pairing speedup." } },
+    { "SpGEMM", { SpGEMMBenches, "SpGEMM - Gustavson sparse matrix * sparse matrix for k-hop connectivity vs triplet expansion." } },
+    { "SpMV", { SpMVBenches, "SpMV - Thread scaling of sparse matrix * vector from 10^4 to 10^7 synapses." } },
+    { "SELL", { SELLBenches, "SELL - CSR vs SELL-C-sigma SpMV and pairing on skewed and uniform graphs." } }
+};
+
+/**
+ * DisplayBenches - Display list of available benchmarks.
+ */
+
+void DisplayBenches()
+{
+    printf("Available Benchmarks:\n\n");
+
+    for (auto& bench : benches)
+    {
+        printf("%s: %s\n", bench.first.c_str(), bench.second.desc.c_str());
+    }
+
+    printf("\n");
+}
+
+/**
+ * main - Run the benchmark named on the command line, or all of them.
+ *
+ * Usage: FTWTBench [name|all] [--reps N] [--warmup N] [--seed N] [--threads N] [--roofline] [--perf] [--json file]
+ *                  [--save-baseline file] [--compare file] [--threshold pct] [--alpha p]
+ *
+ * @param  argc Number of command line args.
+ * @param  argv Array of command args.
+ * @return      Zero on success, nonzero on regressions against the baseline or failed result
+ *              checks.
+ */
+
+int main(int argc, char** argv)
+{
+    BenchContext ctx;
+    ctx.params.warmupReps   = 1;
+    ctx.params.reps         = 5;
+    ctx.params.seed         = 1234;
+    ctx.numFailedChecks     = 0;
+
+    BenchGateOptions gate;
+    string benchStr = "all";
+    bool bRoofline  = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+
+        if (arg == "--reps" && i + 1 < argc) ctx.params.reps = (uint32_t)atoi(argv[++i]);
+        else if (arg == "--warmup" && i + 1 < argc) ctx.params.warmupReps = (uint32_t)atoi(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc) ctx.params.seed = (uint32_t)atoi(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc) SetNumThreads((uint32_t)atoi(argv[++i]));
+        else if (arg == "--roofline") bRoofline = true;
+        else if (arg == "--perf") EnablePerfCounters(true);
+        else if (ParseBenchGateArg(argc, argv, i, gate)) continue;
+        else benchStr = arg;
+    }
+
+    if (ctx.params.reps == 0) ctx.params.reps = 1;
+
+    if (benchStr != "all" && benches.count(benchStr) == 0)
+    {
+        printf("Invalid benchmark specified: %s\n\n", benchStr.c_str());
+        DisplayBenches();
+        return 1;
+    }
+
+    for (auto& bench : benches)
+    {
+        if (benchStr != "all" && bench.first != benchStr) continue;
+        bench.second.pfnBench(ctx);
+    }
+
+    PrintProfileReport();
+    PrintPerfCounterReport();
+    if (bRoofline) PrintRooflineReport(MeasureRoofline(GetNumThreads()));
+
+    map<string, string> config =
+    {
+        { "bench", benchStr },
+        { "reps", to_string(ctx.params.reps) },
+        { "warmup_reps", to_string(ctx.params.warmupReps) },
+        { "seed", to_string(ctx.params.seed) },
+        { "threads", to_string(GetNumThreads()) }
+    };
+
+    int exitCode = RunBenchGate(ctx.records, config, gate);
+
+    if (ctx.numFailedChecks)
+    {
+        printf("%u result checks failed\n", ctx.numFailedChecks);
+        return 3;
+    }
+
+    return exitCode;
+}
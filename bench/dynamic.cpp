@@ -0,0 +1,118 @@
+#include "bench.h"
+
+static const uint32_t dynBenchNeurons       = 200000;
+static const uint64_t dynBenchSynapses      = 3200000;
+static const uint32_t dynBenchBatch         = 4;
+static const uint32_t dynBenchSingleOps     = 10000;
+
+/**
+ * RebuildWithEdges - Baseline for adding synapses to a packed matrix, back to triplets,
+ * append, sort everything again.
+ *
+ * @param  csc   Packed matrix.
+ * @param  edges Synapses to add.
+ * @return       Packed matrix with the new synapses.
+ */
+
+static CSCMat<double> RebuildWithEdges(CSCMat<double>& csc, const vector<Triplet<double>>& edges)
+{
+    TripletMat<double> trip = csc.toTriplet();
+    for (auto& edge : edges) trip.insert(edge);
+    return trip.toCSC();
+}
+
+/**
+ * DynamicBenches - Growing a synapse matrix: batched insertion into row slack storage vs
+ * a triplet rebuild, single inserts and deletes, compaction, and the kernel cost of the
+ * slack layout next to packed CSR, whose results it is checked against.
+ *
+ * @param ctx Benchmark context.
+ */
+
+void DynamicBenches(BenchContext& ctx)
+{
+    TripletMat<double> trip(dynBenchNeurons, dynBenchNeurons, "Dynamic Bench");
+    trip.entries = GenerateBenchSynapses(dynBenchNeurons, dynBenchSynapses, ctx.params.seed);
+
+    CSCMat<double> csc = trip.toCSC();
+    DynamicMat<double> dyn(csc);
+
+    printf("Dynamic benches: %u neurons, %zu synapses, %zu slots\n\n", dynBenchNeurons, csc.vals.size(),
+        dyn.vals.size());
+
+    // Batches of new synapses at 0.1% and 1% of the matrix.
+
+    for (double frac : { 0.001, 0.01 })
+    {
+        vector<Triplet<double>> edges((size_t)(frac * csc.vals.size()));
+
+        for (auto& edge : edges)
+        {
+            edge = { (uint32_t)rand() % dynBenchNeurons, (uint32_t)rand() % dynBenchNeurons, 0.01 };
+        }
+
+        string label = to_string(edges.size()) + " edges";
+
+        ctx.Measure("TripletMat rebuild " + label, [&]() { CSCMat<double> grown = RebuildWithEdges(csc, edges); });
+
+        // insertBatch works in place, so each repetition grows a fresh copy. The copy is timed
+        // on its own to subtract.
+
+        ctx.Measure("DynamicMat copy", [&]() { DynamicMat<double> grown = dyn; });
+
+        ctx.Measure("DynamicMat::insertBatch + copy " + label, [&]()
+        {
+            DynamicMat<double> grown = dyn;
+            grown.insertBatch(edges);
+        });
+    }
+
+    // Net zero insert/erase pairs, so the matrix is the same every repetition.
+
+    vector<pair<uint32_t, uint32_t>> singles(dynBenchSingleOps);
+    for (auto& edge : singles) edge = { (uint32_t)rand() % dynBenchNeurons, (uint32_t)rand() % dynBenchNeurons };
+
+    ctx.Measure("DynamicMat::insert + erase x" + to_string(dynBenchSingleOps), [&]()
+    {
+        for (auto& edge : singles)
+        {
+            if (dyn.insert(edge.first, edge.second, 0.01)) dyn.erase(edge.first, edge.second);
+        }
+    });
+
+    printf("After single ops: %zu slots, %zu in holes\n", dyn.vals.size(), dyn.holeSlots);
+
+    ctx.Measure("DynamicMat::compact", [&]() { dyn.compact(); });
+    ctx.Measure("DynamicMat::toCSC", [&]() { CSCMat<double> packed = dyn.toCSC(); });
+
+    vector<double> x(dynBenchNeurons);
+    vector<double> y(dynBenchNeurons);
+    vector<vector<double>> pre(dynBenchBatch, vector<double>(dynBenchNeurons));
+    vector<vector<double>> post(dynBenchBatch, vector<double>(dynBenchNeurons));
+    vector<double> pairings;
+
+    for (auto& v : x) v = (double)rand() / (double)RAND_MAX;
+
+    for (uint32_t bat = 0; bat < dynBenchBatch; bat++)
+    {
+        for (auto& v : pre[bat]) v = (double)rand() / (double)RAND_MAX;
+        for (auto& v : post[bat]) v = (double)rand() / (double)RAND_MAX;
+    }
+
+    vector<double> yDyn(dynBenchNeurons);
+    vector<double> pairingsDyn;
+
+    ctx.Measure("CSR multiply", [&]() { csc.multiply(x.data(), y.data()); });
+    ctx.Measure("DynamicMat::multiply", [&]() { dyn.multiply(x.data(), yDyn.data()); });
+    ctx.Measure("CSR pairings", [&]() { csc.computePairings(pre, post, pairings); });
+    ctx.Measure("DynamicMat::computePairings", [&]() { dyn.computePairings(pre, post, pairingsDyn); });
+
+    // The single ops were net zero, so the slack matrix still holds the packed one. Pairings
+    // are in slot order and are compared as updated weights.
+
+    csc.updateRows(pairings, 0.01);
+    dyn.updateRows(pairingsDyn, 0.01);
+
+    ctx.Check("DynamicMat::multiply vs CSR", MaxRelDiff(yDyn, y), 1e-12);
+    ctx.Check("DynamicMat update vs CSR", MaxCSCDiff(dyn.toCSC(), csc), 1e-12);
+}
@@ -0,0 +1,95 @@
+#include "bench.h"
+
+static const uint32_t eigenBenchNeurons     = 200000;
+static const uint64_t eigenBenchSynapses    = 3200000;
+static const uint32_t eigenBenchBatch       = 4;
+static const uint32_t eigenBenchBlock       = 16;
+static const double eigenBenchCullThresh    = 1e-3;
+
+/**
+ * EigenBenches - The hand rolled CSR synapse kernels next to the Eigen::SparseMatrix
+ * backend on the same skewed graph: construction from triplets, SpMV, blocked SpMV,
+ * pairing, update with renormalization, and prune. Results are checked against each
+ * other so the Eigen path is a true drop-in.
+ *
+ * @param ctx Benchmark context.
+ */
+
+void EigenBenches(BenchContext& ctx)
+{
+    TripletMat<double> trip(eigenBenchNeurons, eigenBenchNeurons, "Eigen Bench");
+    trip.entries = GenerateBenchSynapses(eigenBenchNeurons, eigenBenchSynapses, ctx.params.seed);
+
+    SynapseStore<double> csr;
+    SynapseStore<double> eigen;
+
+    ctx.Measure("TripletMat::toCSC", [&]() { csr.build(trip.toCSC(), SPARSE_CSR); });
+    ctx.Measure("EigenMat::fromTriplets", [&]() { eigen.eigen.fromTriplets(trip); });
+
+    eigen.build(csr.toCSC(), SPARSE_EIGEN);
+
+    printf("Eigen benches: %u neurons, %zu synapses (Eigen %zu), %u threads\n\n", eigenBenchNeurons, csr.nnz(),
+        eigen.nnz(), GetNumThreads());
+
+    vector<double> x(eigenBenchNeurons);
+    vector<double> y(eigenBenchNeurons);
+    vector<double> yEigen(eigenBenchNeurons);
+    vector<double> xBlock((size_t)eigenBenchNeurons * eigenBenchBlock);
+    vector<double> yBlock((size_t)eigenBenchNeurons * eigenBenchBlock);
+    vector<double> yBlockEigen((size_t)eigenBenchNeurons * eigenBenchBlock);
+    vector<vector<double>> pre(eigenBenchBatch, vector<double>(eigenBenchNeurons));
+    vector<vector<double>> post(eigenBenchBatch, vector<double>(eigenBenchNeurons));
+    vector<double> pairings;
+    vector<double> pairingsEigen;
+
+    for (auto& v : x) v = (double)rand() / (double)RAND_MAX;
+    for (auto& v : xBlock) v = (double)rand() / (double)RAND_MAX;
+
+    for (uint32_t bat = 0; bat < eigenBenchBatch; bat++)
+    {
+        for (auto& v : pre[bat]) v = (double)rand() / (double)RAND_MAX;
+        for (auto& v : post[bat]) v = (double)rand() / (double)RAND_MAX;
+    }
+
+    ctx.Measure("CSR multiply", [&]() { csr.multiply(x.data(), y.data()); });
+    ctx.Measure("Eigen multiply", [&]() { eigen.multiply(x.data(), yEigen.data()); });
+
+    ctx.Check("Eigen multiply vs CSR", MaxRelDiff(yEigen, y), 1e-12);
+
+    ctx.Measure("CSR multiplyBlock 16", [&]() { csr.multiplyBlock(xBlock.data(), yBlock.data(), eigenBenchBlock); });
+    ctx.Measure("Eigen multiplyBlock 16", [&]()
+    {
+        eigen.multiplyBlock(xBlock.data(), yBlockEigen.data(), eigenBenchBlock);
+    });
+
+    ctx.Check("Eigen multiplyBlock vs CSR", MaxRelDiff(yBlockEigen, yBlock), 1e-12);
+
+    ctx.Measure("CSR pairings", [&]() { csr.computePairings(pre, post, pairings); });
+    ctx.Measure("Eigen pairings", [&]() { eigen.computePairings(pre, post, pairingsEigen); });
+
+    ctx.Check("Eigen pairings vs CSR", MaxAbsDiff(pairingsEigen, pairings), 1e-12);
+
+    ctx.Measure("CSR update", [&]() { csr.update(pairings, 0.01); });
+    ctx.Measure("Eigen update", [&]() { eigen.update(pairingsEigen, 0.01); });
+
+    ctx.Check("Eigen update vs CSR", MaxCSCDiff(eigen.toCSC(), csr.toCSC()), 1e-12);
+
+    // Cull works in place, so each repetition culls a fresh copy.
+
+    ctx.Measure("CSR copy + cull", [&]()
+    {
+        SynapseStore<double> culled = csr;
+        culled.cull(eigenBenchCullThresh);
+    });
+
+    ctx.Measure("Eigen copy + cull", [&]()
+    {
+        SynapseStore<double> culled = eigen;
+        culled.cull(eigenBenchCullThresh);
+    });
+
+    csr.cull(eigenBenchCullThresh);
+    eigen.cull(eigenBenchCullThresh);
+
+    ctx.Check("Eigen cull vs CSR", MaxCSCDiff(eigen.toCSC(), csr.toCSC()), 1e-12);
+}
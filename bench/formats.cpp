@@ -0,0 +1,164 @@
+#include "bench.h"
+
+static const uint32_t formatBenchInputs     = 784;
+static const uint32_t formatBenchOutputs    = 10;
+static const uint32_t formatBenchNeurons    = 2000;
+static const double formatBenchEdgeProb     = 0.7;
+static const uint32_t formatBenchBatch      = 10;
+static const uint32_t formatBenchBlock      = 64;
+static const double formatBenchFixedTol     = 5e-3;
+
+/**
+ * GenerateBipartiteSynapses - Every input neuron connected to every output neuron, the
+ * MNIST digit net layout.
+ *
+ * @param  numInputs  Number of input neurons.
+ * @param  numOutputs Number of output neurons, numbered after the inputs.
+ * @return            Synapse (row, col, weight) triples.
+ */
+
+static vector<Triplet<double>> GenerateBipartiteSynapses(uint32_t numInputs, uint32_t numOutputs)
+{
+    vector<Triplet<double>> synapses;
+    synapses.reserve((size_t)numInputs * numOutputs);
+
+    for (uint32_t r = numInputs; r < numInputs + numOutputs; r++)
+    {
+        for (uint32_t c = 0; c < numInputs; c++) synapses.push_back({ r, c, (double)rand() / (double)RAND_MAX });
+    }
+
+    return synapses;
+}
+
+/**
+ * GenerateDenseRandomSynapses - Random graph where each neuron pair is connected with a
+ * fixed probability, the high density end of the MNISTRandTest sweep.
+ *
+ * @param  numNeurons Number of neurons.
+ * @param  edgeProb   Connection probability.
+ * @return            Synapse (row, col, weight) triples.
+ */
+
+static vector<Triplet<double>> GenerateDenseRandomSynapses(uint32_t numNeurons, double edgeProb)
+{
+    vector<Triplet<double>> synapses;
+    synapses.reserve((size_t)(edgeProb * numNeurons * numNeurons));
+
+    for (uint32_t r = 0; r < numNeurons; r++)
+    {
+        for (uint32_t c = 0; c < numNeurons; c++)
+        {
+            if ((double)rand() / (double)RAND_MAX < edgeProb) synapses.push_back({ r, c, (double)rand() / (double)RAND_MAX });
+        }
+    }
+
+    return synapses;
+}
+
+/**
+ * BenchFormatGraph - Time SpMV, blocked SpMM and a training step for each synapse storage
+ * format on one graph, and check every format's results against CSR's.
+ *
+ * @param ctx        Benchmark context.
+ * @param label      Graph label used in measurement names.
+ * @param numNeurons Number of neurons.
+ * @param synapses   Synapse list.
+ */
+
+static void BenchFormatGraph(BenchContext& ctx, const string& label, uint32_t numNeurons,
+    vector<Triplet<double>>& synapses)
+{
+    NNCreateParams<double> params;
+    params.name         = "Format Bench " + label;
+    params.numNeurons   = numNeurons;
+    params.batchSize    = formatBenchBatch;
+    params.learnRate    = 0.01;
+    params.cullThresh   = 1e-8;
+    params.synapsesIn   = synapses;
+
+    vector<double> x(numNeurons);
+    vector<double> y(numNeurons);
+    vector<double> xBlock((size_t)numNeurons * formatBenchBlock);
+    vector<double> yBlock((size_t)numNeurons * formatBenchBlock);
+
+    for (auto& v : x) v = (double)rand() / (double)RAND_MAX;
+    for (auto& v : xBlock) v = (double)rand() / (double)RAND_MAX;
+
+    vector<vector<pair<uint32_t, double>>> assocPre(formatBenchBatch);
+    vector<vector<pair<uint32_t, double>>> assocPost(formatBenchBatch);
+
+    for (uint32_t i = 0; i < formatBenchBatch; i++)
+    {
+        for (uint32_t j = 0; j < numNeurons / 2; j++) assocPre[i].push_back({ (uint32_t)rand() % numNeurons, 1.0 });
+        assocPost[i].push_back({ (uint32_t)rand() % numNeurons, 1.0 });
+    }
+
+    TripletMat<double> trip(numNeurons, numNeurons, params.name);
+    trip.entries        = synapses;
+    CSCMat<double> csc  = trip.toCSC();
+
+    printf("Format bench %s: %zu synapses, density %.3f, BSR fill %.3f, auto picks %s\n", label.c_str(),
+        csc.vals.size(), (double)csc.vals.size() / ((double)numNeurons * numNeurons), BSRFillRatio(csc),
+        SparseFormatName(ChooseSynapseFormat(csc)));
+
+    vector<SparseFormat> formats = { SPARSE_CSR, SPARSE_SELL, SPARSE_BSR, SPARSE_DENSE, SPARSE_FIXED16,
+        SPARSE_FIXED16_I32 };
+
+    // CSR runs first and its results are the reference for the other formats. The fixed point
+    // formats round weights to 16 bits, so they get a looser tolerance.
+
+    vector<double> yRef;
+    vector<double> yBlockRef;
+    CSCMat<double> trainedRef;
+
+    for (auto format : formats)
+    {
+        params.format = format;
+        NN<double> nn(params);
+        nn.applyAssocs(assocPre, assocPost, 1);
+
+        string name = string(SparseFormatName(format)) + " " + label;
+
+        ctx.Measure(name + " multiply", [&]() { nn.synapses.multiply(x.data(), y.data()); });
+        ctx.Measure(name + " multiplyBlock 64", [&]()
+        {
+            nn.synapses.multiplyBlock(xBlock.data(), yBlock.data(), formatBenchBlock);
+        });
+
+        ctx.Measure(name + " train step", [&]() { nn.updateSynapses(); });
+
+        if (format == SPARSE_CSR)
+        {
+            yRef        = y;
+            yBlockRef   = yBlock;
+            trainedRef  = nn.synapses.toCSC();
+            continue;
+        }
+
+        double tol = format == SPARSE_FIXED16 || format == SPARSE_FIXED16_I32 ? formatBenchFixedTol : 1e-12;
+
+        ctx.Check(name + " multiply vs CSR", MaxRelDiff(y, yRef), tol);
+        ctx.Check(name + " multiplyBlock vs CSR", MaxRelDiff(yBlock, yBlockRef), tol);
+        ctx.Check(name + " train step vs CSR", MaxCSCDiff(nn.synapses.toCSC(), trainedRef), tol);
+    }
+
+    printf("\n");
+}
+
+/**
+ * FormatBenches - CSR vs SELL vs 4x8 BSR vs dense vs 16-bit fixed point synapse storage on
+ * the MNIST bipartite net and a 0.7 density random net.
+ *
+ * @param ctx Benchmark context.
+ */
+
+void FormatBenches(BenchContext& ctx)
+{
+    srand(ctx.params.seed);
+
+    vector<Triplet<double>> bipartite   = GenerateBipartiteSynapses(formatBenchInputs, formatBenchOutputs);
+    vector<Triplet<double>> dense       = GenerateDenseRandomSynapses(formatBenchNeurons, formatBenchEdgeProb);
+
+    BenchFormatGraph(ctx, "bipartite", formatBenchInputs + formatBenchOutputs, bipartite);
+    BenchFormatGraph(ctx, "random 0.7", formatBenchNeurons, dense);
+}
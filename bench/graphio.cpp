@@ -0,0 +1,239 @@
+#include "bench.h"
+
+static const uint32_t ioBenchNeurons    = 1000000;
+static const uint64_t ioBenchSynapses   = 16000000;
+static const string ioBenchMtxFile      = "graphio_bench.mtx";
+static const string ioBenchEdgeFile     = "graphio_bench.edges";
+static const uint32_t nnFileNeurons     = 20000;
+static const uint64_t nnFileSynapses    = 400000;
+static const uint32_t nnFileBatch       = 16;
+static const string nnFileBenchFile     = "graphio_bench.ftwtnn";
+static const string nnFileBadFile       = "graphio_bench_bad.ftwtnn";
+
+/**
+ * ReadMatrixMarketSerial - Baseline Matrix Market reader, one fscanf per entry on a single
+ * thread, then the serial comparison sort build.
+ *
+ * @param  path Input file path.
+ * @return      Parsed matrix, empty if the file can't be read.
+ */
+
+static CSCMat<double> ReadMatrixMarketSerial(const string& path)
+{
+    FILE* f = fopen(path.c_str(), "r");
+    if (f == NULL) return CSCMat<double>();
+
+    char line[256];
+    if (fgets(line, sizeof(line), f) == NULL) line[0] = '\0';
+
+    uint32_t n      = 0;
+    uint32_t m      = 0;
+    size_t nnz      = 0;
+
+    if (fscanf(f, "%u %u %zu", &n, &m, &nnz) != 3) nnz = 0;
+
+    TripletMat<double> trip(n, m, path);
+    trip.entries.reserve(nnz);
+
+    Triplet<double> e;
+
+    while (trip.entries.size() < nnz && fscanf(f, "%u %u %lf", &e.r, &e.c, &e.val) == 3)
+    {
+        e.r--;
+        e.c--;
+        trip.entries.push_back(e);
+    }
+
+    fclose(f);
+    return trip.toCSCSorted();
+}
+
+/**
+ * NNFileBenches - Save a trained, renumbered network and load it back through the mapped
+ * file path. The loaded network must have the same synapses, neuron ordering and responses
+ * bit for bit. Truncated and corrupted copies of the file must be rejected with an error,
+ * leaving the network they were loaded into untouched.
+ *
+ * @param ctx Benchmark context.
+ */
+
+static void NNFileBenches(BenchContext& ctx)
+{
+    NNCreateParams<double> params;
+    params.name         = "NN File Bench";
+    params.numNeurons   = nnFileNeurons;
+    params.batchSize    = nnFileBatch;
+    params.learnRate    = 0.01;
+    params.format       = SPARSE_CSR;
+    params.order        = ORDER_RCM;
+    params.synapsesIn   = GenerateBenchSynapses(nnFileNeurons, nnFileSynapses, ctx.params.seed);
+
+    NN<double> nn(params);
+
+    vector<vector<pair<uint32_t, double>>> assocPre(nnFileBatch);
+    vector<vector<pair<uint32_t, double>>> assocPost(nnFileBatch);
+
+    for (uint32_t step = 0; step < 4; step++)
+    {
+        for (uint32_t i = 0; i < nnFileBatch; i++)
+        {
+            assocPre[i].clear();
+            assocPost[i].clear();
+
+            for (uint32_t j = 0; j < 784; j++) assocPre[i].push_back({ (uint32_t)rand() % nnFileNeurons, 1.0 });
+            assocPost[i].push_back({ (uint32_t)rand() % nnFileNeurons, 1.0 });
+        }
+
+        nn.applyAssocs(assocPre, assocPost, 1);
+        nn.updateSynapses();
+    }
+
+    // The file holds weights with the lazy row scales folded in. Fold them here too, so
+    // responses are computed the same way and must match exactly.
+
+    nn.synapses.foldRowScales();
+
+    string err;
+    NN<double> loaded;
+    bool bSaved     = false;
+    bool bLoaded    = false;
+
+    ctx.Measure("NN::save", [&]() { bSaved = nn.save(nnFileBenchFile, err); });
+    ctx.Measure("NN::load", [&]() { bLoaded = loaded.load(nnFileBenchFile, err); });
+
+    if (!bSaved || !bLoaded) printf("NN file round trip failed: %s\n", err.c_str());
+
+    vector<double> input(nnFileNeurons);
+    for (auto& x : input) x = (double)rand() / (double)RAND_MAX;
+
+    vector<double> res     = nn.applyInput(input);
+    vector<double> resLoaded;
+    loaded.applyInput(input, resLoaded);
+
+    ctx.Check("NN::load synapses round trip", MaxCSCDiff(loaded.synapses.toCSC(), nn.synapses.toCSC()), 0);
+    ctx.Check("NN::load neuronPerm round trip", loaded.neuronPerm == nn.neuronPerm ? 0 : INFINITY, 0);
+    ctx.Check("NN::load applyInput round trip", MaxAbsDiff(resLoaded, res), 0);
+
+    // Damaged copies of the saved file. Each must fail to load with a message and leave the
+    // previously loaded network as it was.
+
+    vector<uint8_t> file;
+    FILE* f = fopen(nnFileBenchFile.c_str(), "rb");
+
+    if (f != NULL)
+    {
+        fseek(f, 0, SEEK_END);
+        file.resize((size_t)ftell(f));
+        fseek(f, 0, SEEK_SET);
+        if (fread(file.data(), 1, file.size(), f) != file.size()) file.clear();
+        fclose(f);
+    }
+
+    if (file.size() < sizeof(NNFileHeader))
+    {
+        ctx.Check("NN::load read back saved file", INFINITY, 0);
+        remove(nnFileBenchFile.c_str());
+        return;
+    }
+
+    NNFileHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+
+    auto checkRejected = [&](const string& name, const vector<uint8_t>& bad)
+    {
+        f               = fopen(nnFileBadFile.c_str(), "wb");
+        bool bWritten   = f != NULL && fwrite(bad.data(), 1, bad.size(), f) == bad.size();
+        if (f != NULL) bWritten = fclose(f) == 0 && bWritten;
+
+        if (!bWritten)
+        {
+            ctx.Check("NN::load write " + name, INFINITY, 0);
+            return;
+        }
+
+        err.clear();
+        bool bRejected = !loaded.load(nnFileBadFile, err) && !err.empty();
+        if (bRejected) printf("%s: %s\n", name.c_str(), err.c_str());
+
+        loaded.applyInput(input, resLoaded);
+        bool bUntouched = loaded.neuronPerm == nn.neuronPerm && MaxAbsDiff(resLoaded, res) == 0;
+
+        ctx.Check("NN::load rejects " + name, bRejected && bUntouched ? 0 : INFINITY, 0);
+    };
+
+    auto corrupt = [&](uint64_t offset, uint32_t val)
+    {
+        vector<uint8_t> bad = file;
+        memcpy(&bad[(size_t)offset], &val, sizeof(val));
+        return bad;
+    };
+
+    uint64_t permOffset = header.sections[NN_SECTION_NEURON_PERM].offset;
+    uint32_t firstPerm  = nn.neuronPerm.empty() ? 0 : nn.neuronPerm[0];
+
+    checkRejected("truncated header", vector<uint8_t>(file.begin(), file.begin() + sizeof(header) - 1));
+    checkRejected("truncated sections", vector<uint8_t>(file.begin(), file.begin() + file.size() / 2));
+    checkRejected("truncated last byte", vector<uint8_t>(file.begin(), file.end() - 1));
+    checkRejected("bad magic", corrupt(0, 0));
+    checkRejected("section past end", corrupt(offsetof(NNFileHeader, sections) +
+        NN_SECTION_VALS * sizeof(NNFileSection), (uint32_t)file.size()));
+    checkRejected("column out of range", corrupt(header.sections[NN_SECTION_COL_IDCS].offset, nnFileNeurons));
+    checkRejected("row offsets decreasing", corrupt(header.sections[NN_SECTION_OFFSETS].offset +
+        sizeof(uint32_t), UINT32_MAX));
+    checkRejected("neuronPerm repeated", corrupt(permOffset + sizeof(uint32_t), firstPerm));
+
+    printf("\n");
+
+    remove(nnFileBenchFile.c_str());
+    remove(nnFileBadFile.c_str());
+}
+
+/**
+ * GraphIOBenches - Synapse graph import and export: parallel Matrix Market parse into the
+ * parallel CSC build against a serial fscanf reader, with full precision and with short
+ * weights, Matrix Market and binary edge list writes, and binary edge list reads. Every
+ * read must give back the written matrix exactly. Then binary network save and mapped load,
+ * see NNFileBenches. Files go to the working directory and are removed afterwards.
+ *
+ * @param ctx Benchmark context.
+ */
+
+void GraphIOBenches(BenchContext& ctx)
+{
+    TripletMat<double> trip(ioBenchNeurons, ioBenchNeurons, "GraphIO Bench");
+    trip.entries = GenerateBenchSynapses(ioBenchNeurons, ioBenchSynapses, ctx.params.seed);
+
+    CSCMat<double> csc = trip.toCSC();
+    string err;
+
+    printf("GraphIO benches: %u neurons, %zu synapses, %u threads\n\n", ioBenchNeurons, csc.vals.size(),
+        GetNumThreads());
+
+    ctx.Measure("WriteMatrixMarket", [&]() { WriteMatrixMarket(ioBenchMtxFile, csc, err); });
+    ctx.Measure("WriteEdgeList", [&]() { WriteEdgeList(ioBenchEdgeFile, csc, err); });
+
+    CSCMat<double> loaded;
+
+    ctx.Measure("ReadMatrixMarketSerial", [&]() { loaded = ReadMatrixMarketSerial(ioBenchMtxFile); });
+    ctx.Check("ReadMatrixMarketSerial round trip", MaxCSCDiff(loaded, csc), 0);
+
+    ctx.Measure("ReadSynapseGraph mtx", [&]() { ReadSynapseGraph(ioBenchMtxFile, loaded, err); });
+    ctx.Check("ReadSynapseGraph mtx round trip", MaxCSCDiff(loaded, csc), 0);
+
+    ctx.Measure("ReadSynapseGraph edges", [&]() { ReadSynapseGraph(ioBenchEdgeFile, loaded, err); });
+    ctx.Check("ReadSynapseGraph edges round trip", MaxCSCDiff(loaded, csc), 0);
+
+    // Weights with a few decimals, like hand designed connectomes, hit the parser's fast path.
+
+    for (auto& val : csc.vals) val = round(val * 1000.0) / 1000.0;
+    WriteMatrixMarket(ioBenchMtxFile, csc, err);
+
+    ctx.Measure("ReadMatrixMarketSerial short values", [&]() { loaded = ReadMatrixMarketSerial(ioBenchMtxFile); });
+    ctx.Measure("ReadSynapseGraph mtx short values", [&]() { ReadSynapseGraph(ioBenchMtxFile, loaded, err); });
+    ctx.Check("ReadSynapseGraph mtx short values round trip", MaxCSCDiff(loaded, csc), 0);
+
+    remove(ioBenchMtxFile.c_str());
+    remove(ioBenchEdgeFile.c_str());
+
+    NNFileBenches(ctx);
+}
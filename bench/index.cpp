@@ -0,0 +1,133 @@
+#include "bench.h"
+
+static const uint32_t indexBenchNeurons     = 20000;
+static const uint64_t indexBenchSynapses    = 2000000;
+static const uint32_t indexBenchBatch       = 10;
+static const uint32_t indexBenchBand        = 512;
+
+/**
+ * GenerateBandedSynapses - Random synapse list where every neuron connects to neurons
+ * within a fixed index distance, the locality a bandwidth reducing renumbering gives.
+ *
+ * @param  numNeurons  Number of neurons.
+ * @param  numSynapses Approximate number of synapses to generate.
+ * @param  band        Largest index distance between connected neurons.
+ * @param  seed        RNG seed.
+ * @return             Synapse (row, col, weight) triples, may contain duplicates.
+ */
+
+static vector<Triplet<double>> GenerateBandedSynapses(uint32_t numNeurons, uint64_t numSynapses, uint32_t band,
+    uint32_t seed)
+{
+    srand(seed);
+
+    vector<Triplet<double>> synapses;
+    synapses.reserve(numSynapses);
+
+    uint32_t degree = (uint32_t)(numSynapses / numNeurons);
+
+    for (uint32_t r = 0; r < numNeurons; r++)
+    {
+        uint32_t lo = r > band ? r - band : 0;
+        uint32_t hi = min(numNeurons - 1, r + band);
+
+        for (uint32_t i = 0; i < degree; i++)
+        {
+            uint32_t c = lo + (uint32_t)rand() % (hi - lo + 1);
+            synapses.push_back({ r, c, (double)rand() / (double)RAND_MAX });
+        }
+    }
+
+    return synapses;
+}
+
+/**
+ * BenchIndexVariant - Time SpMV and pairing for one index layout of a matrix.
+ *
+ * @param ctx      Benchmark context.
+ * @param name     Measurement name prefix.
+ * @param mat      Matrix to time.
+ * @param x        Input vector.
+ * @param y        Output vector.
+ * @param pre      Presynaptic activations per batch entry.
+ * @param post     Postsynaptic activations per batch entry.
+ * @param pairings Output pairings.
+ */
+
+template<class IdxT, class OffT>
+static void BenchIndexVariant(BenchContext& ctx, const string& name, const CSCMat<double, IdxT, OffT>& mat,
+    vector<double>& x, vector<double>& y, vector<vector<double>>& pre, vector<vector<double>>& post,
+    vector<double>& pairings)
+{
+    printf("%s: %.2f index bytes per nnz\n", name.c_str(), (double)mat.indexBytes() / (double)mat.vals.size());
+
+    ctx.Measure(name + " multiply", [&]() { mat.multiply(x.data(), y.data()); });
+    ctx.Measure(name + " pairings", [&]() { mat.computePairings(pre, post, pairings); });
+}
+
+/**
+ * BenchIndexGraph - Compare 32-bit, 16-bit and delta encoded column indices on one graph.
+ *
+ * @param ctx      Benchmark context.
+ * @param label    Graph label used in measurement names.
+ * @param synapses Synapse list.
+ */
+
+static void BenchIndexGraph(BenchContext& ctx, const string& label, vector<Triplet<double>>& synapses)
+{
+    TripletMat<double> trip(indexBenchNeurons, indexBenchNeurons, "Index Bench " + label);
+    trip.entries = synapses;
+
+    CSCMat<double> mat32                        = trip.toCSC();
+    CSCMat<double, uint16_t, uint32_t> mat16    = mat32.convertIndices<uint16_t, uint32_t>();
+    CSCMat<double> matDelta                     = mat32;
+    matDelta.encodeColDeltas();
+
+    vector<double> x(indexBenchNeurons);
+    vector<double> y(indexBenchNeurons);
+    vector<double> yRef(indexBenchNeurons);
+    for (auto& v : x) v = (double)rand() / (double)RAND_MAX;
+
+    vector<vector<double>> pre(indexBenchBatch, vector<double>(indexBenchNeurons));
+    vector<vector<double>> post(indexBenchBatch, vector<double>(indexBenchNeurons));
+
+    for (uint32_t i = 0; i < indexBenchBatch; i++)
+    {
+        for (auto& v : pre[i]) v = (double)rand() / (double)RAND_MAX;
+        for (auto& v : post[i]) v = (double)rand() / (double)RAND_MAX;
+    }
+
+    printf("Index bench %s: %zu synapses\n", label.c_str(), mat32.vals.size());
+
+    vector<double> pairings;
+    vector<double> pairingsRef;
+
+    BenchIndexVariant(ctx, "uint32 " + label, mat32, x, yRef, pre, post, pairingsRef);
+
+    BenchIndexVariant(ctx, "uint16 " + label, mat16, x, y, pre, post, pairings);
+    ctx.Check("uint16 multiply vs uint32 " + label, MaxRelDiff(y, yRef), 1e-12);
+    ctx.Check("uint16 pairings vs uint32 " + label, MaxAbsDiff(pairings, pairingsRef), 1e-12);
+
+    BenchIndexVariant(ctx, "delta " + label, matDelta, x, y, pre, post, pairings);
+    ctx.Check("delta multiply vs uint32 " + label, MaxRelDiff(y, yRef), 1e-12);
+    ctx.Check("delta pairings vs uint32 " + label, MaxAbsDiff(pairings, pairingsRef), 1e-12);
+
+    printf("\n");
+}
+
+/**
+ * IndexBenches - Column index width and delta encoding on a skewed random graph and a
+ * banded graph.
+ *
+ * @param ctx Benchmark context.
+ */
+
+void IndexBenches(BenchContext& ctx)
+{
+    vector<Triplet<double>> skewed = GenerateBenchSynapses(indexBenchNeurons, indexBenchSynapses, ctx.params.seed);
+    vector<Triplet<double>> banded = GenerateBandedSynapses(indexBenchNeurons, indexBenchSynapses, indexBenchBand,
+        ctx.params.seed);
+
+    BenchIndexGraph(ctx, "skewed", skewed);
+    BenchIndexGraph(ctx, "banded", banded);
+}
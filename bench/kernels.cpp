@@ -0,0 +1,330 @@
+#include "bench.h"
+
+static const uint32_t benchNeurons  = 20000;
+static const uint64_t benchSynapses = 2000000;
+static const uint32_t benchBatch    = 100;
+static const uint32_t benchBlock    = 64;
+
+/**
+ * ReferencePairings - Batch averaged pairings the direct way, one batch entry at a time
+ * over every synapse.
+ *
+ * @param  mat  Synapse matrix.
+ * @param  pre  Presynaptic activations per batch entry.
+ * @param  post Postsynaptic activations per batch entry.
+ * @return      Pairing per synapse.
+ */
+
+static vector<double> ReferencePairings(const CSCMat<double>& mat, const vector<vector<double>>& pre,
+    const vector<vector<double>>& post)
+{
+    vector<double> pairings(mat.vals.size(), 0);
+
+    for (uint32_t bat = 0; bat < pre.size(); bat++)
+    {
+        for (uint32_t r = 0; r < mat.n; r++)
+        {
+            for (uint32_t i = mat.offsets[r]; i < mat.offsets[r + 1]; i++)
+            {
+                pairings[i] += post[bat][r] * pre[bat][mat.colIdcs[i]];
+            }
+        }
+    }
+
+    for (auto& p : pairings) p /= (double)pre.size();
+
+    return pairings;
+}
+
+/**
+ * KernelBenches - Microbenchmarks for the FTWT synapse kernels on a synthetic network:
+ * triplet to CSC conversion (counting sort and comparison sort), SpMV, blocked SpMM, sparse
+ * add, pairing and update as separate passes and fused (one-hot and dense post
+ * activations) and cull (no-op and half the synapses). Fast paths are checked against their
+ * reference paths.
+ *
+ * @param ctx Benchmark context.
+ */
+
+void KernelBenches(BenchContext& ctx)
+{
+    NNCreateParams<double> params;
+    params.name         = "Bench Net";
+    params.numNeurons   = benchNeurons;
+    params.batchSize    = benchBatch;
+    params.learnRate    = 0.01;
+    params.cullThresh   = 1e-8;
+    params.format       = SPARSE_CSR;
+    params.synapsesIn   = GenerateBenchSynapses(benchNeurons, benchSynapses, ctx.params.seed);
+
+    printf("Kernel benches: %u neurons, %zu synapses, batch %u\n\n",
+        benchNeurons, params.synapsesIn.size(), benchBatch);
+
+    ctx.Measure("TripletMat::toCSC", [&]()
+    {
+        TripletMat<double> trip(benchNeurons, benchNeurons, params.name);
+        trip.entries = params.synapsesIn;
+        CSCMat<double> csc = trip.toCSC();
+    });
+
+    ctx.Measure("TripletMat::toCSCSorted", [&]()
+    {
+        TripletMat<double> trip(benchNeurons, benchNeurons, params.name);
+        trip.entries = params.synapsesIn;
+        CSCMat<double> csc = trip.toCSCSorted();
+    });
+
+    {
+        TripletMat<double> trip(benchNeurons, benchNeurons, params.name);
+        trip.entries = params.synapsesIn;
+
+        CSCMat<double> counted  = trip.toCSC();
+        CSCMat<double> sorted   = trip.toCSCSorted();
+        bool bSameIdcs          = counted.colIdcs == sorted.colIdcs && counted.offsets == sorted.offsets;
+
+        ctx.Check("TripletMat::toCSC vs toCSCSorted", bSameIdcs ? MaxAbsDiff(counted.vals, sorted.vals) : INFINITY,
+            1e-12);
+    }
+
+    NN<double> nn(params);
+
+    vector<double> input(benchNeurons);
+    for (auto& x : input) x = (double)rand() / (double)RAND_MAX;
+
+    vector<double> res(benchNeurons);
+
+    ctx.Measure("CSCMat::multiply", [&]() { nn.synapses.multiply(input.data(), res.data()); });
+
+    // Same number of input vectors evaluated one at a time vs as a row-major block.
+
+    vector<double> inputBlock((size_t)benchNeurons * benchBlock);
+    vector<double> resBlock((size_t)benchNeurons * benchBlock);
+    for (auto& x : inputBlock) x = (double)rand() / (double)RAND_MAX;
+
+    ctx.Measure("CSCMat::multiply x64", [&]()
+    {
+        for (uint32_t k = 0; k < benchBlock; k++) nn.synapses.multiply(input.data(), res.data());
+    });
+
+    ctx.Measure("CSCMat::multiplyBlock 64", [&]()
+    {
+        nn.synapses.multiplyBlock(inputBlock.data(), resBlock.data(), benchBlock);
+    });
+
+    {
+        vector<double> col(benchNeurons);
+        vector<double> colRes(benchNeurons);
+        double maxDiff  = 0;
+        double maxRef   = 1;
+
+        for (uint32_t k = 0; k < benchBlock; k++)
+        {
+            for (uint32_t c = 0; c < benchNeurons; c++) col[c] = inputBlock[(size_t)c * benchBlock + k];
+            nn.synapses.multiply(col.data(), colRes.data());
+
+            for (uint32_t r = 0; r < benchNeurons; r++)
+            {
+                maxDiff = max(maxDiff, abs(colRes[r] - resBlock[(size_t)r * benchBlock + k]));
+                maxRef  = max(maxRef, abs(colRes[r]));
+            }
+        }
+
+        ctx.Check("CSCMat::multiplyBlock vs multiply", maxDiff / maxRef, 1e-12);
+    }
+
+    // Sum with a matrix sharing the synapse pattern (in-place path), and with an independent
+    // random matrix (merge path). The merge case copies the lhs each repetition.
+
+    CSCMat<double> subsetMat = nn.synapses.csr;
+    CSCMat<double> mergeMat;
+
+    {
+        TripletMat<double> trip(benchNeurons, benchNeurons, "Merge");
+        trip.entries = GenerateBenchSynapses(benchNeurons, benchSynapses, ctx.params.seed + 1);
+        mergeMat = trip.toCSC();
+    }
+
+    ctx.Measure("CSCMat::operator+= subset", [&]() { subsetMat += nn.synapses.csr; });
+
+    ctx.Measure("CSCMat::operator+= merge", [&]()
+    {
+        CSCMat<double> sum = nn.synapses.csr;
+        sum += mergeMat;
+    });
+
+    // Both paths against summing the operands' triplets, toCSC adds up the duplicates.
+
+    {
+        CSCMat<double> lhs          = nn.synapses.csr;
+        TripletMat<double> lhsTrip  = lhs.toTriplet();
+        TripletMat<double> rhsTrip  = mergeMat.toTriplet();
+        TripletMat<double> refTrip  = lhsTrip;
+
+        refTrip.entries.insert(refTrip.entries.end(), lhsTrip.entries.begin(), lhsTrip.entries.end());
+
+        CSCMat<double> sum = lhs;
+        sum += lhs;
+
+        ctx.Check("CSCMat::operator+= subset vs triplets", MaxCSCDiff(sum, refTrip.toCSC()), 1e-12);
+
+        refTrip = lhsTrip;
+        refTrip.entries.insert(refTrip.entries.end(), rhsTrip.entries.begin(), rhsTrip.entries.end());
+
+        sum = lhs;
+        sum += mergeMat;
+
+        ctx.Check("CSCMat::operator+= merge vs triplets", MaxCSCDiff(sum, refTrip.toCSC()), 1e-12);
+    }
+
+    vector<vector<pair<uint32_t, double>>> assocPre(benchBatch);
+    vector<vector<pair<uint32_t, double>>> assocPost(benchBatch);
+
+    for (uint32_t i = 0; i < benchBatch; i++)
+    {
+        for (uint32_t j = 0; j < 784; j++) assocPre[i].push_back({ (uint32_t)rand() % benchNeurons, 1.0 });
+        assocPost[i].push_back({ (uint32_t)rand() % benchNeurons, 1.0 });
+    }
+
+    nn.applyAssocs(assocPre, assocPost, 1);
+
+    vector<double> pairings;
+
+    ctx.Measure("CSCMat::computePairings", [&]()
+    {
+        nn.synapses.computePairings(nn.activationsPre, nn.activeRowsPost, pairings);
+    });
+
+    ctx.Check("CSCMat::computePairings vs reference", MaxAbsDiff(pairings,
+        ReferencePairings(nn.synapses.csr, nn.activationsPre, nn.activationsPost)), 1e-12);
+
+    ctx.Measure("CSCMat::updateRows", [&]() { nn.synapses.update(pairings, 0.01); });
+    ctx.Measure("NN::updateSynapses", [&]() { nn.updateSynapses(); });
+
+    // Every neuron active in every batch entry, the dense pairing path. The separate
+    // pairing and update passes vs the fused kernel.
+
+    vector<vector<double>> densePost(benchBatch, vector<double>(benchNeurons));
+
+    for (auto& post : densePost)
+    {
+        for (auto& x : post) x = (double)rand() / (double)RAND_MAX;
+    }
+
+    ctx.Measure("CSCMat::computePairings dense", [&]()
+    {
+        nn.synapses.computePairings(nn.activationsPre, densePost, pairings);
+    });
+
+    ctx.Check("CSCMat::computePairings dense vs reference", MaxAbsDiff(pairings,
+        ReferencePairings(nn.synapses.csr, nn.activationsPre, densePost)), 1e-12);
+
+    ctx.Measure("CSCMat::hebbianUpdate dense", [&]()
+    {
+        nn.synapses.hebbianUpdate(nn.activationsPre, densePost, 0.01);
+    });
+
+    // The fused kernel against separate pairing and update passes, sparse post and dense post.
+    // The dense batch is cut to 32 entries so its transposed tiles stay under pairFusedBytes
+    // and the fused path runs rather than its fallback.
+
+    {
+        vector<vector<double>> pre32(nn.activationsPre.begin(), nn.activationsPre.begin() + 32);
+        vector<vector<double>> post32(densePost.begin(), densePost.begin() + 32);
+
+        CSCMat<double> fused    = nn.synapses.toCSC();
+        CSCMat<double> separate = fused;
+
+        fused.hebbianUpdate(nn.activationsPre, nn.activeRowsPost, 0.01);
+        separate.computePairings(nn.activationsPre, nn.activeRowsPost, pairings);
+        separate.updateRows(pairings, 0.01);
+
+        ctx.Check("CSCMat::hebbianUpdate vs separate passes", MaxCSCDiff(fused, separate), 1e-12);
+
+        fused.hebbianUpdate(pre32, post32, 0.01);
+        separate.computePairings(pre32, post32, pairings);
+        separate.updateRows(pairings, 0.01);
+
+        ctx.Check("CSCMat::hebbianUpdate dense vs separate passes", MaxCSCDiff(fused, separate), 1e-12);
+    }
+
+    // Lazily normalized rows against eager normalization, on a copy with every 64th row and
+    // the first active post row emptied. Empty rows have no norm and must keep unit scale.
+
+    {
+        TripletMat<double> trip = nn.synapses.toCSC().toTriplet();
+        uint32_t emptyRow       = nn.activeRowsPost.rows[0];
+
+        trip.entries.erase(remove_if(trip.entries.begin(), trip.entries.end(), [&](const Triplet<double>& e)
+        {
+            return e.r % 64 == 0 || e.r == emptyRow;
+        }), trip.entries.end());
+
+        CSCMat<double> eager = trip.toCSC();
+        SynapseStore<double> lazy;
+        lazy.build(eager, SPARSE_CSR);
+
+        for (uint32_t step = 0; step < 3; step++)
+        {
+            eager.hebbianUpdate(nn.activationsPre, nn.activeRowsPost, 0.01);
+            lazy.hebbianUpdate(nn.activationsPre, nn.activeRowsPost, 0.01);
+        }
+
+        vector<double> resLazy(benchNeurons);
+        eager.multiply(input.data(), res.data());
+        lazy.multiply(input.data(), resLazy.data());
+
+        ctx.Check("SynapseStore lazy rows multiply vs eager", MaxRelDiff(resLazy, res), 1e-12);
+        ctx.Check("SynapseStore lazy rows weights vs eager", MaxCSCDiff(lazy.toCSC(), eager), 1e-12);
+    }
+
+    ctx.Measure("NN::cull", [&]() { nn.cull(); });
+
+    // Cull that removes about half the synapses, threshold at the median weight. Copies the
+    // matrix each repetition, like the merge case above.
+
+    vector<double> mags(nn.synapses.csr.vals.size());
+    for (size_t i = 0; i < mags.size(); i++) mags[i] = abs(nn.synapses.csr.vals[i]);
+    nth_element(mags.begin(), mags.begin() + mags.size() / 2, mags.end());
+
+    double halfThresh   = mags[mags.size() / 2];
+    size_t numCulled    = 0;
+
+    ctx.Measure("CSCMat::cull half", [&]()
+    {
+        CSCMat<double> culled   = nn.synapses.csr;
+        numCulled               = culled.cull(halfThresh);
+    });
+
+    printf("CSCMat::cull half removed %zu of %zu synapses\n", numCulled, mags.size());
+
+    // In-place compaction against filtering the triplets, on the bench matrix (split into a
+    // row range per thread) and on a slice of its first rows under spmvParallelNnz (one range).
+
+    auto checkCull = [&](const char* name, const CSCMat<double>& mat)
+    {
+        CSCMat<double> culled   = mat;
+        TripletMat<double> trip = culled.toTriplet();
+
+        culled.cull(halfThresh);
+
+        trip.entries.erase(remove_if(trip.entries.begin(), trip.entries.end(), [&](const Triplet<double>& e)
+        {
+            return abs(e.val) < halfThresh;
+        }), trip.entries.end());
+
+        ctx.Check(name, MaxCSCDiff(culled, trip.toCSC()), 0.0);
+    };
+
+    checkCull("CSCMat::cull half vs triplet filter", nn.synapses.csr);
+
+    {
+        TripletMat<double> slice = nn.synapses.toCSC().toTriplet();
+
+        slice.entries.erase(remove_if(slice.entries.begin(), slice.entries.end(), [&](const Triplet<double>& e)
+        {
+            return e.r >= benchNeurons / 64;
+        }), slice.entries.end());
+
+        checkCull("CSCMat::cull half small vs triplet filter", slice.toCSC());
+    }
+}
@@ -0,0 +1,96 @@
+#include "bench.h"
+
+static const uint32_t pulseBenchNeurons     = 200000;
+static const uint64_t pulseBenchSynapses    = 2000000;
+static const uint32_t pulseBenchBatch       = 16;
+static const uint32_t pulseBenchInputs      = 784;
+static const double pulseBenchThresh        = 0.5;
+
+/**
+ * AvgActivePre - Average number of active presynaptic neurons per batch entry.
+ *
+ * @param  nn Network after applyAssocs.
+ * @return    Average active count.
+ */
+
+static double AvgActivePre(const NN<double>& nn)
+{
+    size_t total = 0;
+    for (auto& active : nn.activePre) total += active.size();
+
+    return (double)total / (double)nn.batchSize;
+}
+
+/**
+ * PulseBenches - Multi-pulse propagation in applyAssocs on a large skewed network with a
+ * few hundred active inputs per batch entry. CSR storage pushes each pulse's frontier
+ * through the column index, SELL storage falls back to a full SpMV per pulse, both must
+ * reach the same neurons.
+ *
+ * @param ctx Benchmark context.
+ */
+
+void PulseBenches(BenchContext& ctx)
+{
+    NNCreateParams<double> params;
+    params.name             = "Pulse Bench";
+    params.numNeurons       = pulseBenchNeurons;
+    params.batchSize        = pulseBenchBatch;
+    params.format           = SPARSE_CSR;
+    params.pulseActivation  = PULSE_CLAMP;
+    params.pulseThresh      = pulseBenchThresh;
+    params.synapsesIn       = GenerateBenchSynapses(pulseBenchNeurons, pulseBenchSynapses, ctx.params.seed);
+
+    NN<double> csr(params);
+
+    params.format = SPARSE_SELL;
+    NN<double> sell(params);
+
+    printf("Pulse benches: %u neurons, %zu synapses, batch %u, %u inputs, %u threads\n\n", pulseBenchNeurons,
+        csr.synapses.nnz(), pulseBenchBatch, pulseBenchInputs, GetNumThreads());
+
+    vector<vector<pair<uint32_t, double>>> assocPre(pulseBenchBatch);
+    vector<vector<pair<uint32_t, double>>> assocPost(pulseBenchBatch);
+
+    for (uint32_t i = 0; i < pulseBenchBatch; i++)
+    {
+        for (uint32_t j = 0; j < pulseBenchInputs; j++)
+        {
+            assocPre[i].push_back({ (uint32_t)(((uint64_t)rand() * (RAND_MAX + 1ULL) + rand()) % pulseBenchNeurons), 1.0 });
+        }
+
+        assocPost[i].push_back({ (uint32_t)rand() % pulseBenchNeurons, 1.0 });
+    }
+
+    for (uint32_t numPulses : { 1u, 2u, 4u, 8u })
+    {
+        string label = to_string(numPulses) + (numPulses == 1 ? " pulse" : " pulses");
+
+        ctx.Measure("CSR frontier " + label, [&]() { csr.applyAssocs(assocPre, assocPost, numPulses); });
+        printf("  %.0f active neurons per batch entry\n", AvgActivePre(csr));
+    }
+
+    // The SpMV fallback runs a full multiply per pulse and batch entry, far slower.
+
+    for (uint32_t numPulses : { 2u, 4u })
+    {
+        ctx.Measure("SELL SpMV " + to_string(numPulses) + " pulses", [&]()
+        {
+            sell.applyAssocs(assocPre, assocPost, numPulses);
+        });
+
+        printf("  %.0f active neurons per batch entry\n", AvgActivePre(sell));
+    }
+
+    csr.applyAssocs(assocPre, assocPost, 4);
+
+    double maxDiff = 0;
+
+    for (uint32_t i = 0; i < pulseBenchBatch; i++)
+    {
+        maxDiff = max(maxDiff, MaxAbsDiff(csr.activationsPre[i], sell.activationsPre[i]));
+    }
+
+    printf("\n");
+    ctx.Check("CSR frontier vs SELL SpMV 4 pulses", maxDiff, 1e-12);
+}
@@ -0,0 +1,256 @@
+#include "bench.h"
+#include "reorder.h"
+
+static const uint32_t reorderBenchNeurons   = 1 << 20;
+static const uint32_t reorderBenchDegree    = 8;
+static const uint32_t reorderBenchWindow    = 256;
+static const uint32_t reorderBenchBatch     = 4;
+static const uint32_t reorderCheckNeurons   = 1 << 16;
+static const uint32_t reorderCheckBlock     = 8;
+static const uint32_t cacheLineBytes        = 64;
+
+/**
+ * GenerateShuffledLocalSynapses - Ring lattice where every neuron connects to neurons
+ * within a small window of it, with neuron labels shuffled afterwards. The structure a
+ * reordering can recover, like a spatially wired net whose neurons were numbered at random.
+ *
+ * @param  numNeurons Number of neurons.
+ * @param  degree     Synapses per neuron.
+ * @param  window     Largest ring distance of a synapse.
+ * @return            Synapse (row, col, weight) triples.
+ */
+
+static vector<Triplet<double>> GenerateShuffledLocalSynapses(uint32_t numNeurons, uint32_t degree, uint32_t window)
+{
+    vector<uint32_t> labels(numNeurons);
+    for (uint32_t i = 0; i < numNeurons; i++) labels[i] = i;
+
+    for (uint32_t i = numNeurons - 1; i > 0; i--)
+    {
+        uint32_t j = (uint32_t)(((uint64_t)rand() * (RAND_MAX + 1ULL) + rand()) % (i + 1));
+        swap(labels[i], labels[j]);
+    }
+
+    vector<Triplet<double>> synapses;
+    synapses.reserve((size_t)numNeurons * degree);
+
+    for (uint32_t r = 0; r < numNeurons; r++)
+    {
+        for (uint32_t i = 0; i < degree; i++)
+        {
+            int64_t offset  = (int64_t)(rand() % (2 * window + 1)) - (int64_t)window;
+            uint32_t c      = (uint32_t)(((int64_t)r + offset + numNeurons) % numNeurons);
+            synapses.push_back({ labels[r], labels[c], (double)rand() / (double)RAND_MAX });
+        }
+    }
+
+    return synapses;
+}
+
+/**
+ * SimulateGatherMissRate - Miss rate of the x[colIdcs[i]] gathers of one SpMV pass through
+ * a set associative LRU cache of double precision activations. Matrix values and indices
+ * stream and aren't modeled. Works without hardware counters; with --perf the profiler also
+ * reports measured LLC misses per kernel.
+ *
+ * @param  csc        Matrix.
+ * @param  cacheBytes Cache capacity.
+ * @param  ways       Associativity.
+ * @return            Fraction of gathers that miss.
+ */
+
+static double SimulateGatherMissRate(const CSCMat<double>& csc, uint32_t cacheBytes, uint32_t ways)
+{
+    uint32_t numSets = cacheBytes / cacheLineBytes / ways;
+    vector<uint64_t> tags((size_t)numSets * ways, UINT64_MAX);
+    vector<uint64_t> lastUse((size_t)numSets * ways, 0);
+    uint64_t clock  = 0;
+    uint64_t misses = 0;
+
+    for (size_t i = 0; i < csc.colIdcs.size(); i++)
+    {
+        uint64_t line   = (uint64_t)csc.colIdcs[i] * sizeof(double) / cacheLineBytes;
+        size_t set      = (size_t)(line % numSets) * ways;
+        size_t victim   = set;
+        bool bHit       = false;
+
+        clock++;
+
+        for (size_t w = set; w < set + ways; w++)
+        {
+            if (tags[w] == line)
+            {
+                lastUse[w]  = clock;
+                bHit        = true;
+                break;
+            }
+
+            if (lastUse[w] < lastUse[victim]) victim = w;
+        }
+
+        if (bHit) continue;
+
+        misses++;
+        tags[victim]    = line;
+        lastUse[victim] = clock;
+    }
+
+    return csc.colIdcs.empty() ? 0.0 : (double)misses / (double)csc.colIdcs.size();
+}
+
+/**
+ * BenchReorderGraph - Compute each neuron ordering for a graph, report its cost, bandwidth
+ * and simulated gather miss rates, then time CSR SpMV and pairings on the renumbered matrix.
+ *
+ * @param ctx      Benchmark context.
+ * @param label    Graph label used in measurement names.
+ * @param synapses Synapse list.
+ */
+
+static void BenchReorderGraph(BenchContext& ctx, const string& label, vector<Triplet<double>>& synapses)
+{
+    TripletMat<double> trip(reorderBenchNeurons, reorderBenchNeurons, "Reorder Bench " + label);
+    trip.entries = synapses;
+    CSCMat<double> base = trip.toCSC();
+
+    vector<double> x(reorderBenchNeurons);
+    vector<double> y(reorderBenchNeurons);
+    vector<vector<double>> pre(reorderBenchBatch, vector<double>(reorderBenchNeurons));
+    vector<vector<double>> post(reorderBenchBatch, vector<double>(reorderBenchNeurons));
+    vector<double> pairings;
+
+    for (auto& v : x) v = (double)rand() / (double)RAND_MAX;
+
+    for (uint32_t bat = 0; bat < reorderBenchBatch; bat++)
+    {
+        for (auto& v : pre[bat]) v = (double)rand() / (double)RAND_MAX;
+        for (auto& v : post[bat]) v = (double)rand() / (double)RAND_MAX;
+    }
+
+    printf("Reorder bench %s: %u neurons, %zu synapses\n", label.c_str(), reorderBenchNeurons, base.vals.size());
+
+    vector<NeuronOrder> orders = { ORDER_NONE, ORDER_RCM, ORDER_PARTITION };
+    double baseSpMV     = 0.0;
+    double basePairings = 0.0;
+
+    for (auto order : orders)
+    {
+        CSCMat<double> csc = base;
+        CycleTimer timer;
+
+        vector<uint32_t> perm = ComputeNeuronOrder(csc, order);
+        if (!perm.empty()) csc.permute(perm);
+
+        double orderTime = timer.Seconds();
+        double meanDist;
+        uint32_t maxDist;
+        MatrixBandwidth(csc, meanDist, maxDist);
+
+        printf("  %-10s order %8.3f s, mean |r - c| %10.1f, max %8u, sim miss L1 48K %.3f, L2 1M %.3f\n",
+            NeuronOrderName(order), orderTime, meanDist, maxDist,
+            SimulateGatherMissRate(csc, 48 * 1024, 12), SimulateGatherMissRate(csc, 1024 * 1024, 16));
+
+        string name = string(NeuronOrderName(order)) + " " + label;
+
+        ctx.Measure("CSR multiply " + name, [&]() { csc.multiply(x.data(), y.data()); });
+        ctx.Measure("CSR pairings " + name, [&]() { csc.computePairings(pre, post, pairings); });
+
+        double spmv     = ComputeSampleStats(ctx.records[ctx.records.size() - 2].metrics[0].samples).median;
+        double pairTime = ComputeSampleStats(ctx.records.back().metrics[0].samples).median;
+
+        if (order == ORDER_NONE)
+        {
+            baseSpMV        = spmv;
+            basePairings    = pairTime;
+        }
+        else
+        {
+            printf("  %-10s speedup SpMV %.2fx, pairings %.2fx\n", NeuronOrderName(order), baseSpMV / spmv,
+                basePairings / pairTime);
+        }
+    }
+
+    printf("\n");
+}
+
+/**
+ * CheckReorderedNN - Renumbering must not change what a network computes. Build a network
+ * for each ordering from the same synapses and check its applyInput and applyInputBlock
+ * responses, which map neurons back through neuronPerm, against the unpermuted network.
+ *
+ * @param ctx      Benchmark context.
+ * @param label    Graph label used in check names.
+ * @param synapses Synapse list.
+ */
+
+static void CheckReorderedNN(BenchContext& ctx, const string& label, const vector<Triplet<double>>& synapses)
+{
+    NNCreateParams<double> params;
+    params.name         = "Reorder Check " + label;
+    params.numNeurons   = reorderCheckNeurons;
+    params.format       = SPARSE_CSR;
+    params.synapsesIn   = synapses;
+
+    NN<double> plain(params);
+
+    vector<double> input(reorderCheckNeurons);
+    vector<double> inputs((size_t)reorderCheckNeurons * reorderCheckBlock);
+    vector<double> ref;
+    vector<double> refBlock;
+    vector<double> res;
+    vector<double> resBlock;
+
+    for (auto& v : input) v = (double)rand() / (double)RAND_MAX;
+    for (auto& v : inputs) v = (double)rand() / (double)RAND_MAX;
+
+    plain.applyInput(input, ref);
+    plain.applyInputBlock(inputs, refBlock, reorderCheckBlock);
+
+    vector<NeuronOrder> orders = { ORDER_RCM, ORDER_PARTITION };
+
+    for (auto order : orders)
+    {
+        params.order = order;
+        NN<double> permuted(params);
+
+        permuted.applyInput(input, res);
+        permuted.applyInputBlock(inputs, resBlock, reorderCheckBlock);
+
+        string name = string(NeuronOrderName(order)) + " " + label;
+
+        ctx.Check("NN::applyInput " + name, MaxRelDiff(res, ref), 1e-12);
+        ctx.Check("NN::applyInputBlock " + name, MaxRelDiff(resBlock, refBlock), 1e-12);
+    }
+
+    printf("\n");
+}
+
+/**
+ * ReorderBenches - Neuron renumbering (RCM, multilevel partition) on a shuffled locally
+ * wired graph, where there is locality to recover, and a skewed random graph, where there
+ * isn't. Renumbered networks are checked against unpermuted ones on smaller graphs.
+ *
+ * @param ctx Benchmark context.
+ */
+
+void ReorderBenches(BenchContext& ctx)
+{
+    srand(ctx.params.seed);
+
+    vector<Triplet<double>> local = GenerateShuffledLocalSynapses(reorderBenchNeurons, reorderBenchDegree,
+        reorderBenchWindow);
+    BenchReorderGraph(ctx, "shuffled local", local);
+    local.clear();
+    local.shrink_to_fit();
+
+    vector<Triplet<double>> random = GenerateBenchSynapses(reorderBenchNeurons,
+        (uint64_t)reorderBenchNeurons * reorderBenchDegree, ctx.params.seed);
+    BenchReorderGraph(ctx, "random", random);
+    random.clear();
+    random.shrink_to_fit();
+
+    CheckReorderedNN(ctx, "shuffled local", GenerateShuffledLocalSynapses(reorderCheckNeurons, reorderBenchDegree,
+        reorderBenchWindow));
+    CheckReorderedNN(ctx, "random", GenerateBenchSynapses(reorderCheckNeurons,
+        (uint64_t)reorderCheckNeurons * reorderBenchDegree, ctx.params.seed));
+}
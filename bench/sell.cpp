@@ -0,0 +1,129 @@
+#include "bench.h"
+#include "sellmat.h"
+
+static const uint32_t sellBenchNeurons  = 20000;
+static const uint64_t sellBenchSynapses = 2000000;
+static const uint32_t sellBenchBatch    = 100;
+
+/**
+ * GenerateUniformSynapses - Random synapse list where every neuron has close to the same
+ * out-degree, the case where CSR already vectorizes well.
+ *
+ * @param  numNeurons  Number of neurons.
+ * @param  numSynapses Approximate number of synapses to generate.
+ * @param  seed        RNG seed.
+ * @return             Synapse (row, col, weight) triples, may contain duplicates.
+ */
+
+static vector<Triplet<double>> GenerateUniformSynapses(uint32_t numNeurons, uint64_t numSynapses, uint32_t seed)
+{
+    srand(seed);
+
+    vector<Triplet<double>> synapses;
+    synapses.reserve(numSynapses);
+
+    uint32_t avgDegree = (uint32_t)(numSynapses / numNeurons);
+
+    for (uint32_t r = 0; r < numNeurons; r++)
+    {
+        uint32_t degree = avgDegree - avgDegree / 8 + (uint32_t)rand() % (avgDegree / 4 + 1);
+
+        for (uint32_t i = 0; i < degree; i++)
+        {
+            uint32_t c = (uint32_t)(((uint64_t)rand() * (RAND_MAX + 1ULL) + rand()) % numNeurons);
+            synapses.push_back({ r, c, (double)rand() / (double)RAND_MAX });
+        }
+    }
+
+    return synapses;
+}
+
+/**
+ * BenchSELLGraph - Compare CSR and SELL-C-sigma SpMV and pairing kernels on one graph and
+ * check that both formats compute the same results.
+ *
+ * @param ctx      Benchmark context.
+ * @param label    Graph label used in measurement names.
+ * @param synapses Synapse list.
+ */
+
+static void BenchSELLGraph(BenchContext& ctx, const string& label, vector<Triplet<double>>& synapses)
+{
+    NNCreateParams<double> params;
+    params.name         = "SELL Bench " + label;
+    params.numNeurons   = sellBenchNeurons;
+    params.batchSize    = sellBenchBatch;
+    params.learnRate    = 0.01;
+    params.cullThresh   = 1e-8;
+    params.format       = SPARSE_CSR;
+    params.synapsesIn   = synapses;
+
+    NN<double> nn(params);
+    SELLMat<double> sell(nn.synapses.csr);
+
+    printf("SELL bench %s: %zu synapses, SELL-%u-%u fill %.3f, heuristic picks %s\n", label.c_str(),
+        nn.synapses.csr.vals.size(), sell.C, sell.sigma, SELLFillRatio(nn.synapses.csr),
+        ChooseSparseFormat(nn.synapses.csr) == SPARSE_SELL ? "SELL" : "CSR");
+
+    ctx.Measure("SELLMat::fromCSC " + label, [&]() { SELLMat<double> tmp(nn.synapses.csr); });
+    ctx.Measure("SELLMat::toCSC " + label, [&]() { CSCMat<double> tmp = sell.toCSC(); });
+
+    vector<double> x(sellBenchNeurons);
+    vector<double> y(sellBenchNeurons);
+    vector<double> ySell(sellBenchNeurons);
+    for (auto& v : x) v = (double)rand() / (double)RAND_MAX;
+
+    ctx.Measure("CSR multiply " + label, [&]() { nn.synapses.multiply(x.data(), y.data()); });
+    ctx.Measure("SELL multiply " + label, [&]() { sell.multiply(x.data(), ySell.data()); });
+
+    vector<vector<pair<uint32_t, double>>> assocPre(sellBenchBatch);
+    vector<vector<pair<uint32_t, double>>> assocPost(sellBenchBatch);
+
+    for (uint32_t i = 0; i < sellBenchBatch; i++)
+    {
+        for (uint32_t j = 0; j < 784; j++) assocPre[i].push_back({ (uint32_t)rand() % sellBenchNeurons, 1.0 });
+        assocPost[i].push_back({ (uint32_t)rand() % sellBenchNeurons, 1.0 });
+    }
+
+    nn.applyAssocs(assocPre, assocPost, 1);
+
+    vector<double> pairings;
+    vector<double> pairingsSell;
+
+    ctx.Measure("CSR pairings " + label, [&]()
+    {
+        nn.synapses.computePairings(nn.activationsPre, nn.activeRowsPost, pairings);
+    });
+    ctx.Measure("SELL pairings " + label, [&]()
+    {
+        sell.computePairings(nn.activationsPre, nn.activationsPost, pairingsSell);
+    });
+
+    // SELL pairings are in slot order, so both are compared as updated weights in CSR form.
+
+    CSCMat<double> updated      = nn.synapses.csr;
+    SELLMat<double> updatedSell = sell;
+
+    updated.updateRows(pairings, 0.01);
+    updatedSell.updateRows(pairingsSell, 0.01);
+
+    ctx.Check("SELL multiply vs CSR " + label, MaxRelDiff(ySell, y), 1e-12);
+    ctx.Check("SELL update vs CSR " + label, MaxCSCDiff(updatedSell.toCSC(), updated), 1e-12);
+
+    printf("\n");
+}
+
+/**
+ * SELLBenches - CSR vs SELL-C-sigma on a skewed degree graph and a uniform degree graph.
+ *
+ * @param ctx Benchmark context.
+ */
+
+void SELLBenches(BenchContext& ctx)
+{
+    vector<Triplet<double>> skewed  = GenerateBenchSynapses(sellBenchNeurons, sellBenchSynapses, ctx.params.seed);
+    vector<Triplet<double>> uniform = GenerateUniformSynapses(sellBenchNeurons, sellBenchSynapses, ctx.params.seed);
+
+    BenchSELLGraph(ctx, "skewed", skewed);
+    BenchSELLGraph(ctx, "uniform", uniform);
+}
@@ -0,0 +1,74 @@
+#include "bench.h"
+
+static const uint32_t spgemmBenchNeurons    = 50000;
+static const uint64_t spgemmBenchSynapses   = 400000;
+static const double spgemmBenchPrune        = 0.05;
+
+/**
+ * MultiplyByExpansion - Baseline sparse product, every partial product becomes a triplet
+ * and TripletMat::toCSC sums the duplicates.
+ *
+ * @param  a Left matrix.
+ * @param  b Right matrix.
+ * @return   a * b.
+ */
+
+static CSCMat<double> MultiplyByExpansion(const CSCMat<double>& a, const CSCMat<double>& b)
+{
+    TripletMat<double> trip(a.n, b.m, "expanded");
+
+    for (uint32_t r = 0; r < a.n; r++)
+    {
+        for (uint32_t i = a.offsets[r]; i < a.offsets[r + 1]; i++)
+        {
+            uint32_t k = a.colIdcs[i];
+
+            for (uint32_t j = b.offsets[k]; j < b.offsets[k + 1]; j++)
+            {
+                trip.entries.push_back({ r, b.colIdcs[j], a.vals[i] * b.vals[j] });
+            }
+        }
+    }
+
+    return trip.toCSC();
+}
+
+/**
+ * SpGEMMBenches - Sparse matrix * sparse matrix on a synthetic synapse matrix: two hop
+ * connectivity W^2 with Gustavson's method against expanding every partial product into
+ * triplets, whose result it is checked against, then pruned W^2, checked against culling
+ * the full product, and pruned W^3.
+ *
+ * @param ctx Benchmark context.
+ */
+
+void SpGEMMBenches(BenchContext& ctx)
+{
+    TripletMat<double> trip(spgemmBenchNeurons, spgemmBenchNeurons, "SpGEMM Bench");
+    trip.entries = GenerateBenchSynapses(spgemmBenchNeurons, spgemmBenchSynapses, ctx.params.seed);
+
+    CSCMat<double> w = trip.toCSC();
+    CSCMat<double> res;
+
+    printf("SpGEMM benches: %u neurons, %zu synapses, %u threads\n\n", spgemmBenchNeurons, w.vals.size(),
+        GetNumThreads());
+
+    CSCMat<double> expanded;
+
+    ctx.Measure("W^2 triplet expansion", [&]() { expanded = MultiplyByExpansion(w, w); });
+    ctx.Measure("CSCMat::multiplyMat W^2", [&]() { res = w.multiplyMat(w); });
+    printf("W^2 nnz: %zu (expansion %zu)\n", res.vals.size(), expanded.vals.size());
+
+    ctx.Check("CSCMat::multiplyMat W^2 vs expansion", MaxCSCDiff(res, expanded), 1e-12);
+
+    ctx.Measure("CSCMat::multiplyMat W^2 pruned", [&]() { res = w.multiplyMat(w, spgemmBenchPrune); });
+    printf("W^2 pruned nnz: %zu\n", res.vals.size());
+
+    CSCMat<double> culled = w.multiplyMat(w);
+    culled.cull(spgemmBenchPrune);
+
+    ctx.Check("CSCMat::multiplyMat W^2 pruned vs cull", MaxCSCDiff(res, culled), 0.0);
+
+    ctx.Measure("CSCMat::power W^3 pruned", [&]() { res = w.power(3, spgemmBenchPrune); });
+    printf("W^3 pruned nnz: %zu\n", res.vals.size());
+}
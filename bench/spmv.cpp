@@ -0,0 +1,55 @@
+#include "bench.h"
+
+static const uint64_t spmvSizes[]       = { 10000, 100000, 1000000, 10000000 };
+static const uint32_t spmvAvgDegree     = 32;
+static const uint32_t spmvMinNeurons    = 1000;
+
+/**
+ * SpMVBenches - Strong scaling of CSCMat::multiply on synthetic skewed graphs from 10^4 to
+ * 10^7 synapses, at powers of two kernel threads up to the configured count. Prints the
+ * effective bandwidth of each run using the kernel's compulsory traffic.
+ *
+ * @param ctx Benchmark context.
+ */
+
+void SpMVBenches(BenchContext& ctx)
+{
+    uint32_t maxThreads = GetNumThreads();
+
+    for (uint64_t numSynapses : spmvSizes)
+    {
+        uint32_t numNeurons = (uint32_t)max((uint64_t)spmvMinNeurons, numSynapses / spmvAvgDegree);
+
+        TripletMat<double> trip(numNeurons, numNeurons, "SpMV Bench");
+        trip.entries        = GenerateBenchSynapses(numNeurons, numSynapses, ctx.params.seed);
+        CSCMat<double> mat  = trip.toCSC();
+
+        vector<double> x(numNeurons);
+        vector<double> y(numNeurons);
+        for (auto& v : x) v = (double)rand() / (double)RAND_MAX;
+
+        double bytes = (double)mat.vals.size() * (sizeof(double) + sizeof(uint32_t)) +
+            (double)(numNeurons + 1) * sizeof(uint32_t) + 2.0 * numNeurons * sizeof(double);
+
+        printf("SpMV: %u neurons, %zu synapses\n", numNeurons, mat.vals.size());
+
+        for (uint32_t threads = 1; ; threads = min(2 * threads, maxThreads))
+        {
+            SetNumThreads(threads);
+
+            char name[64];
+            snprintf(name, sizeof(name), "SpMV %.0e syn %u thr", (double)numSynapses, threads);
+
+            ctx.Measure(name, [&]() { mat.multiply(x.data(), y.data()); });
+
+            double median = ComputeSampleStats(ctx.records.back().metrics[0].samples).median;
+            printf("%-40s effective %.2f GB/s\n", "", 1e-9 * bytes / median);
+
+            if (threads == maxThreads) break;
+        }
+
+        printf("\n");
+    }
+
+    SetNumThreads(maxThreads);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <map>
+#include "json.h"
+
+using namespace std;
+
+static const uint32_t benchBaselineVersion = 1;
+
+struct SampleStats
+{
+    double min;
+    double max;
+    double mean;
+    double median;
+    double stddev;
+};
+
+struct BenchMetric
+{
+    string name;
+    string unit;
+    bool bHigherIsBetter;
+    bool bGated;
+    vector<double> samples;
+};
+
+struct BenchRecord
+{
+    string name;
+    vector<BenchMetric> metrics;
+
+    BenchMetric& GetMetric(const string& metricName, const string& unit, bool bHigherIsBetter, bool bGated = true);
+};
+
+struct BenchGateOptions
+{
+    string jsonPath;
+    string saveBaselinePath;
+    string comparePath;
+    double threshold;
+    double alpha;
+
+    BenchGateOptions() : threshold(0.05), alpha(0.05) {}
+};
+
+SampleStats ComputeSampleStats(const vector<double>& samples);
+double MannWhitneyPValue(const vector<double>& baseline, const vector<double>& current, bool bHigherIsWorse);
+string GetMachineFingerprint();
+
+void PrintBenchTable(const vector<BenchRecord>& records);
+bool WriteBenchJson(const string& path, const vector<BenchRecord>& records, const map<string, string>& config);
+bool SaveBenchBaseline(const string& path, const vector<BenchRecord>& records, const map<string, string>& config);
+int CompareBenchBaseline(const string& path, const vector<BenchRecord>& records, double threshold, double alpha);
+
+bool ParseBenchGateArg(int argc, char** argv, int& i, BenchGateOptions& options);
+int RunBenchGate(const vector<BenchRecord>& records, const map<string, string>& config, const BenchGateOptions& options);
@@ -0,0 +1,585 @@
+#pragma once
+
+#include "matrix.h"
+#include "simd.h"
+
+static const uint32_t bsrBlockRows  = 4;
+static const uint32_t bsrBlockCols  = 8;
+static const uint32_t bsrBlockSize  = bsrBlockRows * bsrBlockCols;
+static const uint32_t bsrRowGrain   = 64;
+static const double bsrMinFill      = 0.7;
+
+#ifdef FTWT_HAS_AVX2_PATH
+void BSRSpMVBlockRowsAVX2(const double* vals, const uint32_t* blockCols, const uint32_t* blockOffsets,
+    uint32_t n, uint32_t m, const double* x, double* y, uint32_t brBegin, uint32_t brEnd);
+#endif
+
+/**
+ * BSRSpMVBlockRows - y = A * x over a range of 4x8 block rows. Blocks are row-major, so
+ * each block row of a block is a dense 8-wide dot product with a contiguous slice of x.
+ * Blocks hanging off the right or bottom edge of the matrix use bounds-checked loops.
+ *
+ * @param vals         Block values, bsrBlockSize per block.
+ * @param blockCols    Block column of each block.
+ * @param blockOffsets Block offsets of each block row.
+ * @param n            Rows in matrix.
+ * @param m            Columns in matrix.
+ * @param x            Input vector.
+ * @param y            Output vector, rows of the block row range are overwritten.
+ * @param brBegin      First block row.
+ * @param brEnd        One past last block row.
+ */
+
+template<class T>
+inline void BSRSpMVBlockRows(const T* vals, const uint32_t* blockCols, const uint32_t* blockOffsets,
+    uint32_t n, uint32_t m, const T* x, T* y, uint32_t brBegin, uint32_t brEnd)
+{
+    for (uint32_t br = brBegin; br < brEnd; br++)
+    {
+        T acc[bsrBlockRows] = {};
+
+        for (uint32_t b = blockOffsets[br]; b < blockOffsets[br + 1]; b++)
+        {
+            const T* blk    = vals + (size_t)b * bsrBlockSize;
+            uint32_t c0     = blockCols[b] * bsrBlockCols;
+            uint32_t cnt    = min(bsrBlockCols, m - c0);
+
+            for (uint32_t i = 0; i < bsrBlockRows; i++)
+            {
+                for (uint32_t j = 0; j < cnt; j++) acc[i] += blk[i * bsrBlockCols + j] * x[c0 + j];
+            }
+        }
+
+        uint32_t r0 = br * bsrBlockRows;
+        for (uint32_t i = 0; i < bsrBlockRows && r0 + i < n; i++) y[r0 + i] = acc[i];
+    }
+}
+
+template<class T>
+struct BSRMat
+{
+    vector<T> vals;
+    vector<uint32_t> masks;
+    vector<uint32_t> blockCols;
+    vector<uint32_t> blockOffsets;
+
+    uint32_t n;
+    uint32_t m;
+    uint32_t numBlockRows;
+    string name;
+
+    /**
+     * BSRMat::BSRMat - Block sparse row matrix default constructor. Entries are grouped in
+     * dense 4x8 blocks stored row-major, and a 32-bit mask per block marks which block
+     * entries are real so structural zeros never turn into synapses.
+     */
+
+    BSRMat() : n(0), m(0), numBlockRows(0), name("") {}
+
+    /**
+     * BSRMat::BSRMat - Build a BSR matrix from a CSC matrix.
+     *
+     * @param csc Matrix to convert.
+     */
+
+    BSRMat(const CSCMat<T>& csc) { fromCSC(csc); }
+
+    /**
+     * BSRMat::nnz - Number of real entries.
+     *
+     * @return Nonzero count.
+     */
+
+    size_t nnz() const
+    {
+        size_t cnt = 0;
+        for (auto mask : masks) cnt += BitCount(mask);
+        return cnt;
+    }
+
+    /**
+     * BSRMat::fromCSC - Convert a CSC matrix. Count distinct block columns per block row,
+     * prefix sum them into block offsets, then fill block rows in parallel.
+     *
+     * @param csc Matrix to convert.
+     */
+
+    void fromCSC(const CSCMat<T>& csc)
+    {
+        PROFILE_ZONE_WORK("BSRMat::fromCSC", csc.vals.size(), "nnz");
+
+        n               = csc.n;
+        m               = csc.m;
+        name            = csc.name;
+        numBlockRows    = (n + bsrBlockRows - 1) / bsrBlockRows;
+
+        blockOffsets.assign(numBlockRows + 1, 0);
+
+        ParallelFor(0, numBlockRows, bsrRowGrain, [&](uint32_t brBegin, uint32_t brEnd)
+        {
+            for (uint32_t br = brBegin; br < brEnd; br++)
+            {
+                blockOffsets[br] = MergeBlockRow(csc, br, nullptr);
+            }
+        });
+
+        uint32_t numBlocks = ExclusiveScan(&blockOffsets[0], numBlockRows + 1);
+
+        vals.assign((size_t)numBlocks * bsrBlockSize, 0);
+        masks.assign(numBlocks, 0);
+        blockCols.resize(numBlocks);
+
+        ParallelFor(0, numBlockRows, bsrRowGrain, [&](uint32_t brBegin, uint32_t brEnd)
+        {
+            for (uint32_t br = brBegin; br < brEnd; br++)
+            {
+                uint32_t first = blockOffsets[br];
+                MergeBlockRow(csc, br, blockCols.data() + first);
+
+                for (uint32_t i = 0; i < bsrBlockRows && br * bsrBlockRows + i < n; i++)
+                {
+                    uint32_t r = br * bsrBlockRows + i;
+                    uint32_t b = first;
+
+                    for (uint32_t k = csc.offsets[r]; k < csc.offsets[r + 1]; k++)
+                    {
+                        uint32_t c = csc.colIdcs[k];
+                        while (blockCols[b] != c / bsrBlockCols) b++;
+
+                        uint32_t slot                           = i * bsrBlockCols + c % bsrBlockCols;
+                        vals[(size_t)b * bsrBlockSize + slot]   = csc.vals[k];
+                        masks[b]                                |= 1u << slot;
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * BSRMat::toCSC - Convert back to CSC form, keeping only masked entries.
+     *
+     * @return Compressed sparse representation of this matrix.
+     */
+
+    CSCMat<T> toCSC() const
+    {
+        PROFILE_ZONE_WORK("BSRMat::toCSC", vals.size(), "slot");
+        CSCMat<T> csc(n, m, name);
+
+        csc.offsets.assign((size_t)n + 1, 0);
+
+        ParallelFor(0, numBlockRows, bsrRowGrain, [&](uint32_t brBegin, uint32_t brEnd)
+        {
+            for (uint32_t br = brBegin; br < brEnd; br++)
+            {
+                for (uint32_t i = 0; i < bsrBlockRows && br * bsrBlockRows + i < n; i++)
+                {
+                    uint32_t cnt = 0;
+
+                    for (uint32_t b = blockOffsets[br]; b < blockOffsets[br + 1]; b++)
+                    {
+                        cnt += BitCount((masks[b] >> (i * bsrBlockCols)) & 0xff);
+                    }
+
+                    csc.offsets[br * bsrBlockRows + i] = cnt;
+                }
+            }
+        });
+
+        uint32_t cscNnz = ExclusiveScan(&csc.offsets[0], (size_t)n + 1);
+
+        csc.vals.resize(cscNnz);
+        csc.colIdcs.resize(cscNnz);
+
+        ParallelFor(0, numBlockRows, bsrRowGrain, [&](uint32_t brBegin, uint32_t brEnd)
+        {
+            for (uint32_t br = brBegin; br < brEnd; br++)
+            {
+                for (uint32_t i = 0; i < bsrBlockRows && br * bsrBlockRows + i < n; i++)
+                {
+                    uint32_t out = csc.offsets[br * bsrBlockRows + i];
+
+                    for (uint32_t b = blockOffsets[br]; b < blockOffsets[br + 1]; b++)
+                    {
+                        for (uint32_t j = 0; j < bsrBlockCols; j++)
+                        {
+                            uint32_t slot = i * bsrBlockCols + j;
+                            if (!(masks[b] & (1u << slot))) continue;
+
+                            csc.colIdcs[out]    = blockCols[b] * bsrBlockCols + j;
+                            csc.vals[out]       = vals[(size_t)b * bsrBlockSize + slot];
+                            out++;
+                        }
+                    }
+                }
+            }
+        });
+
+        return csc;
+    }
+
+    /**
+     * BSRMat::multiply - Do BSR matrix * vector multiply into a caller provided buffer,
+     * block rows split across kernel threads. Doubles use the AVX2 kernel.
+     *
+     * @param x Vector to multiply by this matrix (m entries).
+     * @param y Result vector (n entries), overwritten.
+     */
+
+    void multiply(const T* x, T* y) const
+    {
+        PROFILE_KERNEL("BSRMat::multiply", 2 * vals.size(),
+            vals.size() * sizeof(T) + blockCols.size() * sizeof(uint32_t) + (n + m) * sizeof(T),
+            vals.size(), "slot");
+
+        uint32_t grain = vals.size() < spmvParallelNnz ? numBlockRows : bsrRowGrain;
+
+        ParallelFor(0, numBlockRows, grain, [&](uint32_t brBegin, uint32_t brEnd)
+        {
+            multiplyBlockRows(x, y, brBegin, brEnd);
+        });
+    }
+
+    /**
+     * BSRMat::multiplyBlock - Multiply a row-major block of k vectors, Y = A * X.
+     *
+     * @param x Input block (m x k, row-major).
+     * @param y Result block (n x k, row-major), overwritten.
+     * @param k Number of vectors in the block.
+     */
+
+    void multiplyBlock(const T* x, T* y, uint32_t k) const
+    {
+        PROFILE_KERNEL("BSRMat::multiplyBlock", 2 * vals.size() * k,
+            vals.size() * sizeof(T) + blockCols.size() * sizeof(uint32_t) + (size_t)(n + m) * k * sizeof(T),
+            vals.size() * k, "slot");
+
+        ParallelFor(0, numBlockRows, bsrRowGrain, [&](uint32_t brBegin, uint32_t brEnd)
+        {
+            for (uint32_t br = brBegin; br < brEnd; br++)
+            {
+                uint32_t r0     = br * bsrBlockRows;
+                uint32_t rows   = min(bsrBlockRows, n - r0);
+
+                for (size_t i = (size_t)r0 * k; i < (size_t)(r0 + rows) * k; i++) y[i] = 0;
+
+                for (uint32_t b = blockOffsets[br]; b < blockOffsets[br + 1]; b++)
+                {
+                    const T* blk    = &vals[(size_t)b * bsrBlockSize];
+                    uint32_t c0     = blockCols[b] * bsrBlockCols;
+                    uint32_t cnt    = min(bsrBlockCols, m - c0);
+
+                    for (uint32_t i = 0; i < rows; i++)
+                    {
+                        T* yRow = y + (size_t)(r0 + i) * k;
+
+                        for (uint32_t j = 0; j < cnt; j++)
+                        {
+                            T val = blk[i * bsrBlockCols + j];
+                            if (val == 0) continue;
+
+                            Axpy(val, x + (size_t)(c0 + j) * k, yRow, k);
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * BSRMat::computePairings - Batch averaged pairings for every block slot. Block rows
+     * whose four post activations are all zero for a batch entry are skipped.
+     *
+     * @param pre      Presynaptic activations per batch entry (m entries each).
+     * @param post     Postsynaptic activations per batch entry (n entries each).
+     * @param pairings Output pairings, resized to the block slot count.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const vector<vector<T>>& post, vector<T>& pairings) const
+    {
+        uint32_t batchSize = (uint32_t)pre.size();
+
+        PROFILE_KERNEL("BSRMat::computePairings", (2 * batchSize + 1) * vals.size(),
+            2 * vals.size() * sizeof(T) + batchSize * (n + m) * sizeof(T), batchSize * vals.size(), "slot");
+
+        pairings.assign(vals.size(), 0);
+        T batchSizeInv = (T)1 / (T)batchSize;
+
+        ParallelFor(0, numBlockRows, bsrRowGrain, [&](uint32_t brBegin, uint32_t brEnd)
+        {
+            for (uint32_t br = brBegin; br < brEnd; br++)
+            {
+                uint32_t r0     = br * bsrBlockRows;
+                uint32_t rows   = min(bsrBlockRows, n - r0);
+
+                for (uint32_t bat = 0; bat < batchSize; bat++)
+                {
+                    T postRow[bsrBlockRows] = {};
+                    bool bActive            = false;
+
+                    for (uint32_t i = 0; i < rows; i++)
+                    {
+                        postRow[i]  = post[bat][r0 + i];
+                        bActive     |= postRow[i] != 0;
+                    }
+
+                    if (!bActive) continue;
+
+                    const T* pPre = pre[bat].data();
+
+                    for (uint32_t b = blockOffsets[br]; b < blockOffsets[br + 1]; b++)
+                    {
+                        T* blk          = &pairings[(size_t)b * bsrBlockSize];
+                        uint32_t c0     = blockCols[b] * bsrBlockCols;
+                        uint32_t cnt    = min(bsrBlockCols, m - c0);
+
+                        for (uint32_t i = 0; i < rows; i++)
+                        {
+                            for (uint32_t j = 0; j < cnt; j++) blk[i * bsrBlockCols + j] += postRow[i] * pPre[c0 + j];
+                        }
+                    }
+                }
+
+                for (size_t s = (size_t)blockOffsets[br] * bsrBlockSize; s < (size_t)blockOffsets[br + 1] * bsrBlockSize; s++)
+                {
+                    pairings[s] *= batchSizeInv;
+                }
+            }
+        });
+    }
+
+    /**
+     * BSRMat::computePairings - Batch averaged pairings from sparse post activations, only
+     * the block rows holding an active post neuron are walked, and within them only that
+     * neuron's row of each block.
+     *
+     * @param pre      Presynaptic activations per batch entry (m entries each).
+     * @param post     Active postsynaptic neurons of the batch.
+     * @param pairings Output pairings, resized to the block slot count.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const ActiveRows<T>& post, vector<T>& pairings) const
+    {
+        PROFILE_ZONE_WORK("BSRMat::computePairings sparse", post.entries.size(), "entry");
+
+        pairings.assign(vals.size(), 0);
+        T batchSizeInv = (T)1 / (T)post.batchSize;
+
+        ParallelFor(0, post.size(), activeRowGrain, [&](uint32_t aBegin, uint32_t aEnd)
+        {
+            for (uint32_t a = aBegin; a < aEnd; a++)
+            {
+                uint32_t br     = post.rows[a] / bsrBlockRows;
+                uint32_t i      = post.rows[a] % bsrBlockRows;
+
+                for (uint32_t b = blockOffsets[br]; b < blockOffsets[br + 1]; b++)
+                {
+                    T* blkRow       = &pairings[(size_t)b * bsrBlockSize + i * bsrBlockCols];
+                    uint32_t c0     = blockCols[b] * bsrBlockCols;
+                    uint32_t cnt    = min(bsrBlockCols, m - c0);
+
+                    for (uint32_t e = post.offsets[a]; e < post.offsets[a + 1]; e++)
+                    {
+                        const T* pPre   = pre[post.entries[e].first].data();
+                        T postAct       = post.entries[e].second;
+
+                        for (uint32_t j = 0; j < cnt; j++) blkRow[j] += postAct * pPre[c0 + j];
+                    }
+
+                    for (uint32_t j = 0; j < cnt; j++) blkRow[j] *= batchSizeInv;
+                }
+            }
+        });
+    }
+
+    /**
+     * BSRMat::updateRows - Add scaled pairings to masked entries, then normalize each row to
+     * unit L2 norm. Updates are multiplied by the mask bit instead of branching on it, so
+     * unmasked block entries stay zero and the block loops vectorize.
+     *
+     * @param pairings   Pairing per block slot.
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     */
+
+    void updateRows(const vector<T>& pairings, T learnRate, bool bNormalize = true)
+    {
+        PROFILE_KERNEL("BSRMat::updateRows", 5 * vals.size() + n, 5 * vals.size() * sizeof(T), vals.size(), "slot");
+
+        ParallelFor(0, numBlockRows, bsrRowGrain, [&](uint32_t brBegin, uint32_t brEnd)
+        {
+            for (uint32_t br = brBegin; br < brEnd; br++)
+            {
+                T totals[bsrBlockRows] = {};
+
+                for (uint32_t b = blockOffsets[br]; b < blockOffsets[br + 1]; b++)
+                {
+                    T* blk          = &vals[(size_t)b * bsrBlockSize];
+                    const T* pair   = &pairings[(size_t)b * bsrBlockSize];
+
+                    for (uint32_t i = 0; i < bsrBlockRows; i++)
+                    {
+                        for (uint32_t j = 0; j < bsrBlockCols; j++)
+                        {
+                            uint32_t s  = i * bsrBlockCols + j;
+                            T w         = (blk[s] + learnRate * pair[s]) * (T)((masks[b] >> s) & 1);
+                            totals[i]   += w * w;
+                            blk[s]      = w;
+                        }
+                    }
+                }
+
+                if (!bNormalize) continue;
+
+                // Rows with no entries would divide their zero slots by zero.
+
+                for (uint32_t i = 0; i < bsrBlockRows; i++) totals[i] = totals[i] == 0 ? 1 : sqrt(totals[i]);
+
+                for (uint32_t b = blockOffsets[br]; b < blockOffsets[br + 1]; b++)
+                {
+                    T* blk = &vals[(size_t)b * bsrBlockSize];
+
+                    for (uint32_t i = 0; i < bsrBlockRows; i++)
+                    {
+                        for (uint32_t j = 0; j < bsrBlockCols; j++) blk[i * bsrBlockCols + j] /= totals[i];
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * BSRMat::cull - Remove entries with magnitude below a threshold by clearing their mask
+     * bits. Blocks that end up empty are kept until the matrix is rebuilt.
+     *
+     * @param thresh Smallest magnitude kept.
+     */
+
+    void cull(T thresh)
+    {
+        PROFILE_ZONE_WORK("BSRMat::cull", vals.size(), "slot");
+
+        ParallelFor(0, (uint32_t)masks.size(), bsrRowGrain, [&](uint32_t bBegin, uint32_t bEnd)
+        {
+            for (uint32_t b = bBegin; b < bEnd; b++)
+            {
+                for (uint32_t s = 0; s < bsrBlockSize; s++)
+                {
+                    T& val = vals[(size_t)b * bsrBlockSize + s];
+
+                    if ((masks[b] & (1u << s)) && abs(val) < thresh)
+                    {
+                        masks[b]    &= ~(1u << s);
+                        val         = 0;
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * BSRMat::BitCount - Number of set bits in a block mask.
+     */
+
+    static uint32_t BitCount(uint32_t mask)
+    {
+        uint32_t cnt = 0;
+        for (; mask; mask &= mask - 1) cnt++;
+        return cnt;
+    }
+
+    /**
+     * BSRMat::MergeBlockRow - Merge the sorted block columns of a block row's CSC rows.
+     *
+     * @param  csc       Source matrix.
+     * @param  br        Block row.
+     * @param  blockCols Output for distinct block columns in order, or null to only count.
+     * @return           Number of distinct block columns.
+     */
+
+    static uint32_t MergeBlockRow(const CSCMat<T>& csc, uint32_t br, uint32_t* blockCols)
+    {
+        uint32_t pos[bsrBlockRows];
+        uint32_t end[bsrBlockRows];
+        uint32_t rows   = min(bsrBlockRows, csc.n - br * bsrBlockRows);
+        uint32_t cnt    = 0;
+
+        for (uint32_t i = 0; i < rows; i++)
+        {
+            pos[i] = csc.offsets[br * bsrBlockRows + i];
+            end[i] = csc.offsets[br * bsrBlockRows + i + 1];
+        }
+
+        while (true)
+        {
+            uint32_t next = 0xffffffff;
+
+            for (uint32_t i = 0; i < rows; i++)
+            {
+                if (pos[i] < end[i]) next = min(next, csc.colIdcs[pos[i]] / bsrBlockCols);
+            }
+
+            if (next == 0xffffffff) break;
+
+            for (uint32_t i = 0; i < rows; i++)
+            {
+                while (pos[i] < end[i] && csc.colIdcs[pos[i]] / bsrBlockCols == next) pos[i]++;
+            }
+
+            if (blockCols) blockCols[cnt] = next;
+            cnt++;
+        }
+
+        return cnt;
+    }
+
+private:
+
+    /**
+     * BSRMat::multiplyBlockRows - Pick the SpMV block row kernel.
+     */
+
+    void multiplyBlockRows(const T* x, T* y, uint32_t brBegin, uint32_t brEnd) const
+    {
+        BSRSpMVBlockRows(vals.data(), blockCols.data(), blockOffsets.data(), n, m, x, y, brBegin, brEnd);
+    }
+};
+
+#ifdef FTWT_HAS_AVX2_PATH
+
+/**
+ * BSRMat<double>::multiplyBlockRows - Double precision, AVX2 when the CPU has it.
+ */
+
+template<>
+inline void BSRMat<double>::multiplyBlockRows(const double* x, double* y, uint32_t brBegin, uint32_t brEnd) const
+{
+    if (CpuHasAVX2())
+    {
+        BSRSpMVBlockRowsAVX2(vals.data(), blockCols.data(), blockOffsets.data(), n, m, x, y, brBegin, brEnd);
+        return;
+    }
+
+    BSRSpMVBlockRows(vals.data(), blockCols.data(), blockOffsets.data(), n, m, x, y, brBegin, brEnd);
+}
+
+#endif
+
+/**
+ * BSRFillRatio - Fraction of 4x8 block slots that would hold real entries, without
+ * building the matrix.
+ *
+ * @param  csc Matrix to check.
+ * @return     Nonzeros / block slots, 1 for an empty matrix.
+ */
+
+template<class T>
+inline double BSRFillRatio(const CSCMat<T>& csc)
+{
+    uint32_t numBlockRows   = (csc.n + bsrBlockRows - 1) / bsrBlockRows;
+    uint64_t numBlocks      = 0;
+
+    for (uint32_t br = 0; br < numBlockRows; br++) numBlocks += BSRMat<T>::MergeBlockRow(csc, br, nullptr);
+
+    return numBlocks ? (double)csc.vals.size() / (double)(numBlocks * bsrBlockSize) : 1.0;
+}
@@ -0,0 +1,373 @@
+#pragma once
+
+#include "matrix.h"
+
+static const double denseMinDensity = 0.5;
+
+#ifdef FTWT_HAS_AVX2_PATH
+void DenseMVRowsAVX2(const double* vals, uint32_t m, const double* x, double* y, uint32_t rBegin, uint32_t rEnd);
+#endif
+
+/**
+ * DenseMVRows - y = A * x for a range of dense row-major rows, four accumulators per row.
+ *
+ * @param vals   Row-major values, m per row.
+ * @param m      Columns in matrix.
+ * @param x      Input vector.
+ * @param y      Output vector, rows [rBegin, rEnd) are overwritten.
+ * @param rBegin First row.
+ * @param rEnd   One past last row.
+ */
+
+template<class T>
+inline void DenseMVRows(const T* vals, uint32_t m, const T* x, T* y, uint32_t rBegin, uint32_t rEnd)
+{
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        const T* row    = vals + (size_t)r * m;
+        T acc0          = 0;
+        T acc1          = 0;
+        T acc2          = 0;
+        T acc3          = 0;
+        uint32_t c      = 0;
+
+        for (; c + 4 <= m; c += 4)
+        {
+            acc0 += row[c + 0] * x[c + 0];
+            acc1 += row[c + 1] * x[c + 1];
+            acc2 += row[c + 2] * x[c + 2];
+            acc3 += row[c + 3] * x[c + 3];
+        }
+
+        for (; c < m; c++) acc0 += row[c] * x[c];
+
+        y[r] = (acc0 + acc1) + (acc2 + acc3);
+    }
+}
+
+/**
+ * DenseMVRows - Double precision rows, uses the AVX2 kernel when the CPU has it.
+ */
+
+inline void DenseMVRows(const double* vals, uint32_t m, const double* x, double* y, uint32_t rBegin, uint32_t rEnd)
+{
+#ifdef FTWT_HAS_AVX2_PATH
+    if (CpuHasAVX2())
+    {
+        DenseMVRowsAVX2(vals, m, x, y, rBegin, rEnd);
+        return;
+    }
+#endif
+
+    DenseMVRows<double>(vals, m, x, y, rBegin, rEnd);
+}
+
+template<class T>
+struct DenseMat
+{
+    vector<T> vals;
+    vector<uint8_t> mask;
+
+    uint32_t n;
+    uint32_t m;
+    string name;
+
+    /**
+     * DenseMat::DenseMat - Dense row-major matrix default constructor. A byte mask per entry
+     * marks which entries are real, so updates and culls keep the sparse semantics of the
+     * other synapse formats while kernels run over contiguous rows with no index loads.
+     */
+
+    DenseMat() : n(0), m(0), name("") {}
+
+    /**
+     * DenseMat::DenseMat - Build a dense matrix from a CSC matrix.
+     *
+     * @param csc Matrix to convert.
+     */
+
+    DenseMat(const CSCMat<T>& csc) { fromCSC(csc); }
+
+    /**
+     * DenseMat::nnz - Number of real entries.
+     *
+     * @return Nonzero count.
+     */
+
+    size_t nnz() const
+    {
+        size_t cnt = 0;
+        for (auto bit : mask) cnt += bit;
+        return cnt;
+    }
+
+    /**
+     * DenseMat::fromCSC - Scatter a CSC matrix into dense rows.
+     *
+     * @param csc Matrix to convert.
+     */
+
+    void fromCSC(const CSCMat<T>& csc)
+    {
+        PROFILE_ZONE_WORK("DenseMat::fromCSC", csc.vals.size(), "nnz");
+
+        n       = csc.n;
+        m       = csc.m;
+        name    = csc.name;
+
+        vals.assign((size_t)n * m, 0);
+        mask.assign((size_t)n * m, 0);
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                for (uint32_t i = csc.offsets[r]; i < csc.offsets[r + 1]; i++)
+                {
+                    size_t idx  = (size_t)r * m + csc.colIdcs[i];
+                    vals[idx]   = csc.vals[i];
+                    mask[idx]   = 1;
+                }
+            }
+        });
+    }
+
+    /**
+     * DenseMat::toCSC - Convert back to CSC form, keeping only masked entries.
+     *
+     * @return Compressed sparse representation of this matrix.
+     */
+
+    CSCMat<T> toCSC() const
+    {
+        PROFILE_ZONE_WORK("DenseMat::toCSC", vals.size(), "entry");
+        CSCMat<T> csc(n, m, name);
+
+        csc.offsets.assign((size_t)n + 1, 0);
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                uint32_t cnt = 0;
+                for (uint32_t c = 0; c < m; c++) cnt += mask[(size_t)r * m + c];
+                csc.offsets[r] = cnt;
+            }
+        });
+
+        uint32_t cscNnz = ExclusiveScan(&csc.offsets[0], (size_t)n + 1);
+
+        csc.vals.resize(cscNnz);
+        csc.colIdcs.resize(cscNnz);
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                uint32_t out = csc.offsets[r];
+
+                for (uint32_t c = 0; c < m; c++)
+                {
+                    if (!mask[(size_t)r * m + c]) continue;
+
+                    csc.colIdcs[out]    = c;
+                    csc.vals[out]       = vals[(size_t)r * m + c];
+                    out++;
+                }
+            }
+        });
+
+        return csc;
+    }
+
+    /**
+     * DenseMat::multiply - Do dense matrix * vector multiply into a caller provided buffer,
+     * rows split across kernel threads. Unmasked entries are zero so the mask isn't read.
+     *
+     * @param x Vector to multiply by this matrix (m entries).
+     * @param y Result vector (n entries), overwritten.
+     */
+
+    void multiply(const T* x, T* y) const
+    {
+        PROFILE_KERNEL("DenseMat::multiply", 2 * vals.size(), (vals.size() + n + m) * sizeof(T), vals.size(), "entry");
+
+        uint32_t grain = vals.size() < spmvParallelNnz ? n : rowGrain;
+
+        ParallelFor(0, n, grain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            DenseMVRows(vals.data(), m, x, y, rBegin, rEnd);
+        });
+    }
+
+    /**
+     * DenseMat::multiplyBlock - Multiply a row-major block of k vectors, Y = A * X.
+     *
+     * @param x Input block (m x k, row-major).
+     * @param y Result block (n x k, row-major), overwritten.
+     * @param k Number of vectors in the block.
+     */
+
+    void multiplyBlock(const T* x, T* y, uint32_t k) const
+    {
+        PROFILE_KERNEL("DenseMat::multiplyBlock", 2 * vals.size() * k,
+            (vals.size() + (size_t)(n + m) * k) * sizeof(T), vals.size() * k, "entry");
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                const T* row    = &vals[(size_t)r * m];
+                T* yRow         = y + (size_t)r * k;
+
+                for (uint32_t j = 0; j < k; j++) yRow[j] = 0;
+
+                for (uint32_t c = 0; c < m; c++)
+                {
+                    if (row[c] != 0) Axpy(row[c], x + (size_t)c * k, yRow, k);
+                }
+            }
+        });
+    }
+
+    /**
+     * DenseMat::computePairings - Batch averaged pairings for every entry slot. A row only
+     * gets work for batch entries where its post activation is nonzero.
+     *
+     * @param pre      Presynaptic activations per batch entry (m entries each).
+     * @param post     Postsynaptic activations per batch entry (n entries each).
+     * @param pairings Output pairings, resized to n * m. Unmasked slots are ignored.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const vector<vector<T>>& post, vector<T>& pairings) const
+    {
+        uint32_t batchSize = (uint32_t)pre.size();
+
+        PROFILE_KERNEL("DenseMat::computePairings", (2 * batchSize + 1) * vals.size(),
+            2 * vals.size() * sizeof(T) + batchSize * (n + m) * sizeof(T), batchSize * vals.size(), "entry");
+
+        pairings.assign(vals.size(), 0);
+        T batchSizeInv = (T)1 / (T)batchSize;
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                T* pairRow  = &pairings[(size_t)r * m];
+                bool bAny   = false;
+
+                for (uint32_t bat = 0; bat < batchSize; bat++)
+                {
+                    T postAct = post[bat][r];
+                    if (postAct == 0) continue;
+
+                    const T* pPre = pre[bat].data();
+                    for (uint32_t c = 0; c < m; c++) pairRow[c] += postAct * pPre[c];
+                    bAny = true;
+                }
+
+                if (!bAny) continue;
+                for (uint32_t c = 0; c < m; c++) pairRow[c] *= batchSizeInv;
+            }
+        });
+    }
+
+    /**
+     * DenseMat::computePairings - Batch averaged pairings from sparse post activations,
+     * only rows with an active post neuron are walked.
+     *
+     * @param pre      Presynaptic activations per batch entry (m entries each).
+     * @param post     Active postsynaptic neurons of the batch.
+     * @param pairings Output pairings, resized to n * m. Unmasked slots are ignored.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const ActiveRows<T>& post, vector<T>& pairings) const
+    {
+        PROFILE_ZONE_WORK("DenseMat::computePairings sparse", post.entries.size(), "entry");
+
+        pairings.assign(vals.size(), 0);
+        T batchSizeInv = (T)1 / (T)post.batchSize;
+
+        ParallelFor(0, post.size(), activeRowGrain, [&](uint32_t aBegin, uint32_t aEnd)
+        {
+            for (uint32_t a = aBegin; a < aEnd; a++)
+            {
+                T* pairRow = &pairings[(size_t)post.rows[a] * m];
+
+                for (uint32_t e = post.offsets[a]; e < post.offsets[a + 1]; e++)
+                {
+                    const T* pPre   = pre[post.entries[e].first].data();
+                    T postAct       = post.entries[e].second;
+
+                    for (uint32_t c = 0; c < m; c++) pairRow[c] += postAct * pPre[c];
+                }
+
+                for (uint32_t c = 0; c < m; c++) pairRow[c] *= batchSizeInv;
+            }
+        });
+    }
+
+    /**
+     * DenseMat::updateRows - Add scaled pairings to masked entries, then normalize each row to
+     * unit L2 norm. Updates are multiplied by the mask byte instead of branching on it, so
+     * unmasked entries stay zero and the row loops vectorize.
+     *
+     * @param pairings   Pairing per entry slot.
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     */
+
+    void updateRows(const vector<T>& pairings, T learnRate, bool bNormalize = true)
+    {
+        PROFILE_KERNEL("DenseMat::updateRows", 5 * vals.size() + n, 5 * vals.size() * sizeof(T), vals.size(), "entry");
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                T* row              = &vals[(size_t)r * m];
+                const T* pairRow    = &pairings[(size_t)r * m];
+                const uint8_t* bits = &mask[(size_t)r * m];
+                T total             = 0;
+
+                for (uint32_t c = 0; c < m; c++)
+                {
+                    T w     = (row[c] + learnRate * pairRow[c]) * (T)bits[c];
+                    total   += w * w;
+                    row[c]  = w;
+                }
+
+                if (!bNormalize) continue;
+
+                // Rows with no entries would divide their zero slots by zero.
+
+                total = total == 0 ? 1 : sqrt(total);
+                for (uint32_t c = 0; c < m; c++) row[c] /= total;
+            }
+        });
+    }
+
+    /**
+     * DenseMat::cull - Remove entries with magnitude below a threshold by clearing their
+     * mask bytes.
+     *
+     * @param thresh Smallest magnitude kept.
+     */
+
+    void cull(T thresh)
+    {
+        PROFILE_ZONE_WORK("DenseMat::cull", vals.size(), "entry");
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (size_t i = (size_t)rBegin * m; i < (size_t)rEnd * m; i++)
+            {
+                if (mask[i] && abs(vals[i]) < thresh)
+                {
+                    mask[i] = 0;
+                    vals[i] = 0;
+                }
+            }
+        });
+    }
+};
@@ -0,0 +1,686 @@
+#pragma once
+
+#include "matrix.h"
+
+static const double dynSlackFrac    = 0.25;
+static const uint32_t dynMinSlack   = 4;
+static const double dynMaxWaste     = 0.5;
+
+/**
+ * DynSpMVRows - y = A * x for a range of rows stored at arbitrary starts, four accumulators
+ * per row like SpMVRows.
+ *
+ * @param vals      Values.
+ * @param colIdcs   Column index of each value.
+ * @param rowStarts Slot of each row's first entry.
+ * @param rowLens   Entries in each row.
+ * @param x         Input vector.
+ * @param y         Output vector, rows [rBegin, rEnd) are overwritten.
+ * @param rBegin    First row.
+ * @param rEnd      One past last row.
+ */
+
+template<class T>
+inline void DynSpMVRows(const T* vals, const uint32_t* colIdcs, const uint32_t* rowStarts, const uint32_t* rowLens,
+    const T* x, T* y, uint32_t rBegin, uint32_t rEnd)
+{
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        uint32_t i      = rowStarts[r];
+        uint32_t end    = i + rowLens[r];
+        T acc0          = 0;
+        T acc1          = 0;
+        T acc2          = 0;
+        T acc3          = 0;
+
+        for (; i + 4 <= end; i += 4)
+        {
+            acc0 += vals[i + 0] * x[colIdcs[i + 0]];
+            acc1 += vals[i + 1] * x[colIdcs[i + 1]];
+            acc2 += vals[i + 2] * x[colIdcs[i + 2]];
+            acc3 += vals[i + 3] * x[colIdcs[i + 3]];
+        }
+
+        for (; i < end; i++) acc0 += vals[i] * x[colIdcs[i]];
+
+        y[r] = (acc0 + acc1) + (acc2 + acc3);
+    }
+}
+
+template<class T>
+struct DynamicMat
+{
+    vector<T> vals;
+    vector<uint32_t> colIdcs;
+    vector<uint32_t> rowStarts;
+    vector<uint32_t> rowLens;
+    vector<uint32_t> rowCaps;
+
+    size_t numEntries;
+    size_t holeSlots;
+    uint32_t n;
+    uint32_t m;
+    string name;
+
+    /**
+     * DynamicMat::DynamicMat - Row slack sparse matrix default constructor. Rows are sorted
+     * by column like CSR, but each row owns a slot range with spare capacity past its
+     * entries, so inserting or deleting a synapse only shifts the rest of its row. A row that
+     * outgrows its range moves to the end of the arrays with double the capacity, leaving a
+     * hole that compact() reclaims.
+     */
+
+    DynamicMat() : numEntries(0), holeSlots(0), n(0), m(0), name("") {}
+
+    /**
+     * DynamicMat::DynamicMat - Build a dynamic matrix from a CSC matrix.
+     *
+     * @param csc Matrix to convert.
+     */
+
+    DynamicMat(const CSCMat<T>& csc) { fromCSC(csc); }
+
+    /**
+     * DynamicMat::nnz - Number of entries.
+     *
+     * @return Nonzero count.
+     */
+
+    size_t nnz() const { return numEntries; }
+
+    /**
+     * DynamicMat::RowCapacity - Slots given to a row of some length on (re)layout.
+     */
+
+    static uint32_t RowCapacity(uint32_t len)
+    {
+        return len + max(dynMinSlack, (uint32_t)(len * dynSlackFrac));
+    }
+
+    /**
+     * DynamicMat::fromCSC - Lay out a CSC matrix's rows with fresh slack.
+     *
+     * @param csc Matrix to convert.
+     */
+
+    void fromCSC(const CSCMat<T>& csc)
+    {
+        PROFILE_ZONE_WORK("DynamicMat::fromCSC", csc.vals.size(), "nnz");
+
+        n           = csc.n;
+        m           = csc.m;
+        name        = csc.name;
+        numEntries  = csc.vals.size();
+        holeSlots   = 0;
+
+        rowLens.resize(n);
+        rowCaps.resize(n);
+        rowStarts.resize((size_t)n + 1);
+
+        for (uint32_t r = 0; r < n; r++)
+        {
+            rowLens[r]      = csc.offsets[r + 1] - csc.offsets[r];
+            rowCaps[r]      = RowCapacity(rowLens[r]);
+            rowStarts[r]    = rowCaps[r];
+        }
+
+        rowStarts[n]        = 0;
+        uint32_t totalSlots = ExclusiveScan(rowStarts.data(), (size_t)n + 1);
+
+        vals.assign(totalSlots, 0);
+        colIdcs.assign(totalSlots, 0);
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                copy_n(csc.vals.data() + csc.offsets[r], rowLens[r], vals.data() + rowStarts[r]);
+                copy_n(csc.colIdcs.data() + csc.offsets[r], rowLens[r], colIdcs.data() + rowStarts[r]);
+            }
+        });
+
+        rowStarts.resize(n);
+    }
+
+    /**
+     * DynamicMat::toCSC - Pack the rows back into a CSC matrix, for the fast static
+     * kernels.
+     *
+     * @return Compressed sparse copy of this matrix.
+     */
+
+    CSCMat<T> toCSC() const
+    {
+        PROFILE_ZONE_WORK("DynamicMat::toCSC", numEntries, "nnz");
+        CSCMat<T> csc(n, m, name);
+
+        csc.offsets.resize((size_t)n + 1);
+        for (uint32_t r = 0; r < n; r++) csc.offsets[r] = rowLens[r];
+        csc.offsets[n] = 0;
+
+        uint32_t cscNnz = ExclusiveScan(csc.offsets.data(), (size_t)n + 1);
+
+        csc.vals.resize(cscNnz);
+        csc.colIdcs.resize(cscNnz);
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                copy_n(vals.data() + rowStarts[r], rowLens[r], csc.vals.data() + csc.offsets[r]);
+                copy_n(colIdcs.data() + rowStarts[r], rowLens[r], csc.colIdcs.data() + csc.offsets[r]);
+            }
+        });
+
+        return csc;
+    }
+
+    /**
+     * DynamicMat::compact - Re-lay rows in order with fresh slack, dropping the holes left
+     * by moved rows and slack that inserts used up or deletes freed.
+     */
+
+    void compact()
+    {
+        PROFILE_ZONE_WORK("DynamicMat::compact", numEntries, "nnz");
+        fromCSC(toCSC());
+    }
+
+    /**
+     * DynamicMat::needsCompact - Whether moved rows have left enough holes that a compact
+     * is worth its cost.
+     *
+     * @return True if over dynMaxWaste of the slots are holes.
+     */
+
+    bool needsCompact() const
+    {
+        return (double)holeSlots > dynMaxWaste * (double)vals.size();
+    }
+
+    /**
+     * DynamicMat::findSlot - Position of a column within a row, or where it would go.
+     *
+     * @param  r      Row.
+     * @param  c      Column.
+     * @param  bFound Whether the row has an entry at c.
+     * @return        Slot of the entry, or of the first entry past c.
+     */
+
+    uint32_t findSlot(uint32_t r, uint32_t c, bool& bFound) const
+    {
+        const uint32_t* rowBegin    = colIdcs.data() + rowStarts[r];
+        const uint32_t* rowEnd      = rowBegin + rowLens[r];
+        const uint32_t* it          = lower_bound(rowBegin, rowEnd, c);
+
+        bFound = it != rowEnd && *it == c;
+        return (uint32_t)(it - colIdcs.data());
+    }
+
+    /**
+     * DynamicMat::relocateRow - Move a row to the end of the arrays with more capacity. Its
+     * old slots become a hole. Not safe to call from parallel row loops.
+     *
+     * @param r      Row to move.
+     * @param newCap Capacity of the moved row, at least its length.
+     */
+
+    void relocateRow(uint32_t r, uint32_t newCap)
+    {
+        size_t newStart = vals.size();
+        assert(newStart + newCap <= UINT32_MAX);
+
+        vals.resize(newStart + newCap, 0);
+        colIdcs.resize(newStart + newCap, 0);
+
+        copy_n(vals.data() + rowStarts[r], rowLens[r], vals.data() + newStart);
+        copy_n(colIdcs.data() + rowStarts[r], rowLens[r], colIdcs.data() + newStart);
+
+        holeSlots       += rowCaps[r];
+        rowStarts[r]    = (uint32_t)newStart;
+        rowCaps[r]      = newCap;
+    }
+
+    /**
+     * DynamicMat::insert - Add one entry, shifting the rest of its row up a slot.
+     *
+     * @param  r   Row.
+     * @param  c   Column.
+     * @param  val Value.
+     * @return     False if the entry already existed, its value is left alone.
+     */
+
+    bool insert(uint32_t r, uint32_t c, T val)
+    {
+        assert(r < n && c < m);
+
+        bool bFound;
+        uint32_t slot = findSlot(r, c, bFound);
+        if (bFound) return false;
+
+        if (rowLens[r] == rowCaps[r])
+        {
+            uint32_t offset = slot - rowStarts[r];
+            relocateRow(r, max(2 * rowCaps[r], RowCapacity(rowLens[r] + 1)));
+            slot = rowStarts[r] + offset;
+        }
+
+        uint32_t end = rowStarts[r] + rowLens[r];
+
+        copy_backward(vals.data() + slot, vals.data() + end, vals.data() + end + 1);
+        copy_backward(colIdcs.data() + slot, colIdcs.data() + end, colIdcs.data() + end + 1);
+
+        vals[slot]      = val;
+        colIdcs[slot]   = c;
+        rowLens[r]++;
+        numEntries++;
+
+        return true;
+    }
+
+    /**
+     * DynamicMat::erase - Remove one entry, shifting the rest of its row down a slot. The
+     * freed slot becomes slack of the row.
+     *
+     * @param  r Row.
+     * @param  c Column.
+     * @return   False if there was no such entry.
+     */
+
+    bool erase(uint32_t r, uint32_t c)
+    {
+        bool bFound;
+        uint32_t slot = findSlot(r, c, bFound);
+        if (!bFound) return false;
+
+        uint32_t end = rowStarts[r] + rowLens[r];
+
+        copy(vals.data() + slot + 1, vals.data() + end, vals.data() + slot);
+        copy(colIdcs.data() + slot + 1, colIdcs.data() + end, colIdcs.data() + slot);
+
+        vals[end - 1] = 0;
+        rowLens[r]--;
+        numEntries--;
+
+        return true;
+    }
+
+    /**
+     * DynamicMat::insertBatch - Add many entries at once. Edges are bucketed by row with a
+     * counting sort, then each row finds how many of its edges are new, rows without room
+     * are moved once with enough capacity for all of them, and every row merges its new
+     * edges in from the back in parallel. Costs O(edges + touched rows' lengths) instead of
+     * a full rebuild.
+     *
+     * @param  edges Entries to add, duplicates and existing entries are skipped.
+     * @return       Number of entries added.
+     */
+
+    size_t insertBatch(const vector<Triplet<T>>& edges)
+    {
+        PROFILE_ZONE_WORK("DynamicMat::insertBatch", edges.size(), "edge");
+
+        if (edges.empty()) return 0;
+
+        vector<uint32_t> bucketOffsets((size_t)n + 1, 0);
+        for (auto& edge : edges) bucketOffsets[edge.r]++;
+        ExclusiveScan(bucketOffsets.data(), (size_t)n + 1);
+
+        vector<pair<uint32_t, T>> buckets(edges.size());
+        vector<uint32_t> bucketFill(bucketOffsets.begin(), bucketOffsets.end() - 1);
+
+        for (auto& edge : edges)
+        {
+            assert(edge.r < n && edge.c < m);
+            buckets[bucketFill[edge.r]++] = { edge.c, edge.val };
+        }
+
+        // Sort and dedupe each row's new edges, then count the ones the row doesn't have.
+
+        vector<uint32_t> newCnts(n, 0);
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                auto first  = buckets.begin() + bucketOffsets[r];
+                auto last   = buckets.begin() + bucketOffsets[r + 1];
+
+                if (first == last) continue;
+
+                sort(first, last, [](const pair<uint32_t, T>& a, const pair<uint32_t, T>& b)
+                {
+                    return a.first < b.first;
+                });
+
+                const uint32_t* row = colIdcs.data() + rowStarts[r];
+                uint32_t len        = rowLens[r];
+                uint32_t i          = 0;
+                uint32_t cnt        = 0;
+
+                for (auto it = first; it != last; it++)
+                {
+                    if (it != first && it->first == (it - 1)->first) continue;
+                    while (i < len && row[i] < it->first) i++;
+                    if (i == len || row[i] != it->first) cnt++;
+                }
+
+                newCnts[r] = cnt;
+            }
+        });
+
+        // Rows that would overflow move once, serially, since moving appends to the arrays.
+
+        size_t numAdded = 0;
+
+        for (uint32_t r = 0; r < n; r++)
+        {
+            numAdded += newCnts[r];
+
+            if (rowLens[r] + newCnts[r] > rowCaps[r])
+            {
+                relocateRow(r, max(2 * rowCaps[r], RowCapacity(rowLens[r] + newCnts[r])));
+            }
+        }
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                if (newCnts[r] == 0) continue;
+
+                T* rowVals          = vals.data() + rowStarts[r];
+                uint32_t* rowCols   = colIdcs.data() + rowStarts[r];
+                int64_t i           = (int64_t)rowLens[r] - 1;
+                int64_t j           = (int64_t)bucketOffsets[r + 1] - 1;
+                int64_t jEnd        = (int64_t)bucketOffsets[r];
+                int64_t out         = (int64_t)rowLens[r] + newCnts[r] - 1;
+
+                // Merge from the back so existing entries move up at most once.
+
+                while (j >= jEnd)
+                {
+                    uint32_t c = buckets[j].first;
+
+                    if (j > jEnd && buckets[j - 1].first == c)
+                    {
+                        j--;
+                        continue;
+                    }
+
+                    while (i >= 0 && rowCols[i] > c)
+                    {
+                        rowVals[out]    = rowVals[i];
+                        rowCols[out]    = rowCols[i];
+                        out--;
+                        i--;
+                    }
+
+                    if (i < 0 || rowCols[i] != c)
+                    {
+                        rowVals[out]    = buckets[j].second;
+                        rowCols[out]    = c;
+                        out--;
+                    }
+
+                    j--;
+                }
+
+                rowLens[r] += newCnts[r];
+            }
+        });
+
+        numEntries += numAdded;
+        return numAdded;
+    }
+
+    /**
+     * DynamicMat::insertCoFiring - Structural plasticity, connect neurons that fire together.
+     * For each batch entry, every post neuron active above a threshold gets a synapse from
+     * every pre neuron active above it, if it doesn't have one yet. Edge count per batch entry
+     * is the product of the active counts, so thresholds should keep those small.
+     *
+     * @param  pre       Presynaptic activations per batch entry (m entries each).
+     * @param  post      Postsynaptic activations per batch entry (n entries each).
+     * @param  actThresh Activation a neuron must exceed to count as firing.
+     * @param  weight    Weight of new synapses.
+     * @return           Number of synapses added.
+     */
+
+    size_t insertCoFiring(const vector<vector<T>>& pre, const vector<vector<T>>& post, T actThresh, T weight)
+    {
+        PROFILE_ZONE("DynamicMat::insertCoFiring");
+
+        vector<Triplet<T>> edges;
+        vector<uint32_t> activePre;
+
+        for (uint32_t bat = 0; bat < (uint32_t)pre.size(); bat++)
+        {
+            activePre.clear();
+            for (uint32_t c = 0; c < m; c++) if (pre[bat][c] > actThresh) activePre.push_back(c);
+
+            if (activePre.empty()) continue;
+
+            for (uint32_t r = 0; r < n; r++)
+            {
+                if (!(post[bat][r] > actThresh)) continue;
+
+                for (auto c : activePre)
+                {
+                    if (c != r) edges.push_back({ r, c, weight });
+                }
+            }
+        }
+
+        return insertBatch(edges);
+    }
+
+    /**
+     * DynamicMat::multiply - Do matrix * vector multiply into a caller provided buffer, rows
+     * split across kernel threads.
+     *
+     * @param x Vector to multiply by this matrix (m entries).
+     * @param y Result vector (n entries), overwritten.
+     */
+
+    void multiply(const T* x, T* y) const
+    {
+        PROFILE_KERNEL("DynamicMat::multiply", 2 * numEntries,
+            numEntries * (sizeof(T) + sizeof(uint32_t)) + 2 * n * sizeof(uint32_t) + (n + m) * sizeof(T),
+            numEntries, "nnz");
+
+        uint32_t grain = numEntries < spmvParallelNnz ? max(n, 1u) : rowGrain;
+
+        ParallelFor(0, n, grain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            DynSpMVRows(vals.data(), colIdcs.data(), rowStarts.data(), rowLens.data(), x, y, rBegin, rEnd);
+        });
+    }
+
+    /**
+     * DynamicMat::multiplyBlock - Multiply a row-major block of k vectors, Y = A * X.
+     *
+     * @param x Input block (m x k, row-major).
+     * @param y Result block (n x k, row-major), overwritten.
+     * @param k Number of vectors in the block.
+     */
+
+    void multiplyBlock(const T* x, T* y, uint32_t k) const
+    {
+        PROFILE_KERNEL("DynamicMat::multiplyBlock", 2 * numEntries * k,
+            numEntries * (sizeof(T) + sizeof(uint32_t)) + (size_t)(n + m) * k * sizeof(T), numEntries * k, "nnz");
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                T* yRow = y + (size_t)r * k;
+                for (uint32_t j = 0; j < k; j++) yRow[j] = 0;
+
+                for (uint32_t i = rowStarts[r]; i < rowStarts[r] + rowLens[r]; i++)
+                {
+                    Axpy(vals[i], x + (size_t)colIdcs[i] * k, yRow, k);
+                }
+            }
+        });
+    }
+
+    /**
+     * DynamicMat::computePairings - Batch averaged pairings for every slot, rows in parallel.
+     * A row only gets work for batch entries where its post activation is nonzero.
+     *
+     * @param pre      Presynaptic activations per batch entry (m entries each).
+     * @param post     Postsynaptic activations per batch entry (n entries each).
+     * @param pairings Output pairings, resized to the slot count. Slack and holes are ignored.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const vector<vector<T>>& post, vector<T>& pairings) const
+    {
+        uint32_t batchSize = (uint32_t)pre.size();
+
+        PROFILE_KERNEL("DynamicMat::computePairings", (2 * batchSize + 1) * numEntries,
+            batchSize * (numEntries * (sizeof(uint32_t) + 2 * sizeof(T)) + (n + m) * sizeof(T)),
+            batchSize * numEntries, "nnz");
+
+        pairings.assign(vals.size(), 0);
+        T batchSizeInv = (T)1 / (T)batchSize;
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                uint32_t start  = rowStarts[r];
+                uint32_t end    = start + rowLens[r];
+                bool bAny       = false;
+
+                for (uint32_t bat = 0; bat < batchSize; bat++)
+                {
+                    T postAct = post[bat][r];
+                    if (postAct == 0) continue;
+
+                    const T* pPre = pre[bat].data();
+                    for (uint32_t i = start; i < end; i++) pairings[i] += postAct * pPre[colIdcs[i]];
+                    bAny = true;
+                }
+
+                if (!bAny) continue;
+                for (uint32_t i = start; i < end; i++) pairings[i] *= batchSizeInv;
+            }
+        });
+    }
+
+    /**
+     * DynamicMat::computePairings - Batch averaged pairings from sparse post activations,
+     * only rows with an active post neuron are walked.
+     *
+     * @param pre      Presynaptic activations per batch entry (m entries each).
+     * @param post     Active postsynaptic neurons of the batch.
+     * @param pairings Output pairings, resized to the slot count. Slack and holes are ignored.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const ActiveRows<T>& post, vector<T>& pairings) const
+    {
+        PROFILE_ZONE_WORK("DynamicMat::computePairings sparse", post.entries.size(), "entry");
+
+        pairings.assign(vals.size(), 0);
+        T batchSizeInv = (T)1 / (T)post.batchSize;
+
+        ParallelFor(0, post.size(), activeRowGrain, [&](uint32_t aBegin, uint32_t aEnd)
+        {
+            for (uint32_t a = aBegin; a < aEnd; a++)
+            {
+                uint32_t row    = post.rows[a];
+                uint32_t start  = rowStarts[row];
+                uint32_t end    = start + rowLens[row];
+
+                for (uint32_t e = post.offsets[a]; e < post.offsets[a + 1]; e++)
+                {
+                    const T* batPre = pre[post.entries[e].first].data();
+                    T postAct       = post.entries[e].second;
+
+                    for (uint32_t i = start; i < end; i++) pairings[i] += postAct * batPre[colIdcs[i]];
+                }
+
+                for (uint32_t i = start; i < end; i++) pairings[i] *= batchSizeInv;
+            }
+        });
+    }
+
+    /**
+     * DynamicMat::updateRows - Add scaled pairings to every entry, then normalize each row to
+     * unit L2 norm.
+     *
+     * @param pairings   Pairing per slot.
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     */
+
+    void updateRows(const vector<T>& pairings, T learnRate, bool bNormalize = true)
+    {
+        PROFILE_KERNEL("DynamicMat::updateRows", 5 * numEntries + n, 5 * numEntries * sizeof(T), numEntries, "nnz");
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                uint32_t start  = rowStarts[r];
+                uint32_t end    = start + rowLens[r];
+                T total         = 0;
+
+                for (uint32_t i = start; i < end; i++)
+                {
+                    T w     = vals[i] + learnRate * pairings[i];
+                    total   += w * w;
+                    vals[i] = w;
+                }
+
+                if (!bNormalize) continue;
+
+                total = total == 0 ? 1 : sqrt(total);
+                for (uint32_t i = start; i < end; i++) vals[i] /= total;
+            }
+        });
+    }
+
+    /**
+     * DynamicMat::cull - Remove entries with magnitude below a threshold. Each row compacts
+     * within its own slots, so rows are independent and freed slots become slack.
+     *
+     * @param  thresh Smallest magnitude kept.
+     * @return        Number of entries removed.
+     */
+
+    size_t cull(T thresh)
+    {
+        PROFILE_ZONE_WORK("DynamicMat::cull", numEntries, "nnz");
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                uint32_t start  = rowStarts[r];
+                uint32_t end    = start + rowLens[r];
+                uint32_t out    = start;
+
+                for (uint32_t i = start; i < end; i++)
+                {
+                    if (abs(vals[i]) < thresh) continue;
+
+                    vals[out]       = vals[i];
+                    colIdcs[out]    = colIdcs[i];
+                    out++;
+                }
+
+                for (uint32_t i = out; i < end; i++) vals[i] = 0;
+                rowLens[r] = out - start;
+            }
+        });
+
+        size_t oldEntries = numEntries;
+
+        numEntries = 0;
+        for (auto len : rowLens) numEntries += len;
+
+        return oldEntries - numEntries;
+    }
+};
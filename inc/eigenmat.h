@@ -0,0 +1,327 @@
+#pragma once
+
+#include "matrix.h"
+#include <Eigen/SparseCore>
+
+template<class T>
+struct EigenMat
+{
+    typedef Eigen::SparseMatrix<T, Eigen::RowMajor, int> SpMat;
+    typedef Eigen::Matrix<T, Eigen::Dynamic, 1> Vec;
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Block;
+
+    SpMat mat;
+
+    uint32_t n;
+    uint32_t m;
+    string name;
+
+    /**
+     * EigenMat::EigenMat - Synapse matrix kept in a compressed row-major Eigen::SparseMatrix,
+     * an interchangeable backend for comparing Eigen's sparse kernels against the hand rolled
+     * formats. SpMV, blocked SpMV, row norms and prune go through Eigen, split over row
+     * ranges with middleRows so every backend runs on the same kernel threads. Eigen has no
+     * sampled product, so pairing walks rows with InnerIterator. Storage indices are int,
+     * so nnz must stay below 2^31.
+     */
+
+    EigenMat() : n(0), m(0), name("") {}
+
+    /**
+     * EigenMat::EigenMat - Build an Eigen matrix from a CSC matrix.
+     *
+     * @param csc Matrix to convert.
+     */
+
+    EigenMat(const CSCMat<T>& csc) { fromCSC(csc); }
+
+    /**
+     * EigenMat::nnz - Number of nonzeros.
+     *
+     * @return Nonzero count.
+     */
+
+    size_t nnz() const { return (size_t)mat.nonZeros(); }
+
+    /**
+     * EigenMat::fromTriplets - Build from a triplet matrix with Eigen's setFromTriplets
+     * (duplicates are summed), the Eigen counterpart of TripletMat::toCSC.
+     *
+     * @param trip Matrix to convert.
+     */
+
+    void fromTriplets(const TripletMat<T>& trip)
+    {
+        PROFILE_ZONE_WORK("EigenMat::fromTriplets", trip.entries.size(), "entry");
+        assert(trip.entries.size() <= (size_t)numeric_limits<int>::max());
+
+        vector<Eigen::Triplet<T, int>> entries;
+        entries.reserve(trip.entries.size());
+
+        for (auto& e : trip.entries) entries.emplace_back((int)e.r, (int)e.c, e.val);
+
+        n       = trip.n;
+        m       = trip.m;
+        name    = trip.name;
+
+        mat.resize(n, m);
+        mat.setFromTriplets(entries.begin(), entries.end());
+        mat.makeCompressed();
+    }
+
+    /**
+     * EigenMat::fromCSC - Copy a CSC matrix into Eigen's compressed storage. Both are row
+     * sorted CSR, so the arrays are copied directly.
+     *
+     * @param csc Matrix to convert.
+     */
+
+    void fromCSC(const CSCMat<T>& csc)
+    {
+        PROFILE_ZONE_WORK("EigenMat::fromCSC", csc.vals.size(), "nnz");
+        assert(csc.vals.size() <= (size_t)numeric_limits<int>::max());
+
+        n       = csc.n;
+        m       = csc.m;
+        name    = csc.name;
+
+        mat.resize(n, m);
+        mat.resizeNonZeros((Eigen::Index)csc.vals.size());
+
+        int* outer = mat.outerIndexPtr();
+        for (uint32_t r = 0; r <= n; r++) outer[r] = (int)csc.offsets[r];
+
+        if (csc.vals.empty()) return;
+
+        ParallelCopy(csc.vals.data(), csc.vals.size(), mat.valuePtr());
+
+        int* inner = mat.innerIndexPtr();
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (size_t i = csc.offsets[rBegin]; i < csc.offsets[rEnd]; i++) inner[i] = (int)csc.colIdcs[i];
+        });
+    }
+
+    /**
+     * EigenMat::toCSC - Convert back to CSC form.
+     *
+     * @return Compressed sparse representation of this matrix.
+     */
+
+    CSCMat<T> toCSC() const
+    {
+        PROFILE_ZONE_WORK("EigenMat::toCSC", nnz(), "nnz");
+        CSCMat<T> csc(n, m, name);
+
+        const int* outer = mat.outerIndexPtr();
+        const int* inner = mat.innerIndexPtr();
+
+        csc.offsets.assign(outer, outer + (size_t)n + 1);
+        csc.colIdcs.assign(inner, inner + nnz());
+        csc.vals.assign(mat.valuePtr(), mat.valuePtr() + nnz());
+
+        return csc;
+    }
+
+    /**
+     * EigenMat::multiply - y = A * x with Eigen's sparse * dense product, rows split across
+     * kernel threads by nnz. Small matrices run on the calling thread.
+     *
+     * @param x Vector to multiply by this matrix (m entries).
+     * @param y Result vector (n entries), overwritten.
+     */
+
+    void multiply(const T* x, T* y) const
+    {
+        PROFILE_KERNEL("EigenMat::multiply", 2 * nnz(), nnz() * (sizeof(T) + sizeof(int)) + (n + m) * sizeof(T),
+            nnz(), "nnz");
+
+        Eigen::Map<const Vec> xVec(x, m);
+        Eigen::Map<Vec> yVec(y, n);
+
+        forEachRowRange([&](uint32_t rBegin, uint32_t rEnd)
+        {
+            yVec.segment(rBegin, rEnd - rBegin).noalias() = mat.middleRows(rBegin, rEnd - rBegin) * xVec;
+        });
+    }
+
+    /**
+     * EigenMat::multiplyBlock - Multiply a row-major block of k vectors, Y = A * X.
+     *
+     * @param x Input block (m x k, row-major).
+     * @param y Result block (n x k, row-major), overwritten.
+     * @param k Number of vectors in the block.
+     */
+
+    void multiplyBlock(const T* x, T* y, uint32_t k) const
+    {
+        PROFILE_KERNEL("EigenMat::multiplyBlock", 2 * nnz() * k,
+            nnz() * (sizeof(T) + sizeof(int)) + (size_t)(n + m) * k * sizeof(T), nnz() * k, "nnz");
+
+        Eigen::Map<const Block> xBlock(x, m, k);
+        Eigen::Map<Block> yBlock(y, n, k);
+
+        forEachRowRange([&](uint32_t rBegin, uint32_t rEnd)
+        {
+            yBlock.middleRows(rBegin, rEnd - rBegin).noalias() = mat.middleRows(rBegin, rEnd - rBegin) * xBlock;
+        });
+    }
+
+    /**
+     * EigenMat::computePairings - Batch averaged pre/post activation products for every
+     * nonzero, in Eigen's value order. A row only gets work for batch entries where its post
+     * activation is nonzero.
+     *
+     * @param pre      Presynaptic activations per batch entry (m entries each).
+     * @param post     Postsynaptic activations per batch entry (n entries each).
+     * @param pairings Output pairings, resized to nnz.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const vector<vector<T>>& post, vector<T>& pairings) const
+    {
+        uint32_t batchSize = (uint32_t)pre.size();
+
+        PROFILE_KERNEL("EigenMat::computePairings", (2 * batchSize + 1) * nnz(),
+            nnz() * (sizeof(T) + sizeof(int)) + batchSize * (n + m) * sizeof(T), batchSize * nnz(), "nnz");
+
+        pairings.assign(nnz(), 0);
+        T batchSizeInv = (T)1 / (T)batchSize;
+
+        forEachRowRange([&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                T* pairRow = pairings.data() + mat.outerIndexPtr()[r];
+
+                for (uint32_t bat = 0; bat < batchSize; bat++)
+                {
+                    T postAct = post[bat][r];
+                    if (postAct == 0) continue;
+
+                    const T* pPre   = pre[bat].data();
+                    size_t i        = 0;
+
+                    for (typename SpMat::InnerIterator it(mat, r); it; ++it, i++) pairRow[i] += postAct * pPre[it.col()];
+                }
+
+                size_t rowNnz = (size_t)(mat.outerIndexPtr()[r + 1] - mat.outerIndexPtr()[r]);
+                for (size_t i = 0; i < rowNnz; i++) pairRow[i] *= batchSizeInv;
+            }
+        });
+    }
+
+    /**
+     * EigenMat::computePairings - Batch averaged pairings from sparse post activations,
+     * only rows with an active post neuron are walked.
+     *
+     * @param pre      Presynaptic activations per batch entry (m entries each).
+     * @param post     Active postsynaptic neurons of the batch.
+     * @param pairings Output pairings, resized to nnz.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const ActiveRows<T>& post, vector<T>& pairings) const
+    {
+        PROFILE_ZONE_WORK("EigenMat::computePairings sparse", post.entries.size(), "entry");
+
+        pairings.assign(nnz(), 0);
+        T batchSizeInv = (T)1 / (T)post.batchSize;
+
+        ParallelFor(0, post.size(), activeRowGrain, [&](uint32_t aBegin, uint32_t aEnd)
+        {
+            for (uint32_t a = aBegin; a < aEnd; a++)
+            {
+                uint32_t row    = post.rows[a];
+                T* pairRow      = pairings.data() + mat.outerIndexPtr()[row];
+                size_t rowNnz   = (size_t)(mat.outerIndexPtr()[row + 1] - mat.outerIndexPtr()[row]);
+
+                for (uint32_t e = post.offsets[a]; e < post.offsets[a + 1]; e++)
+                {
+                    const T* pPre   = pre[post.entries[e].first].data();
+                    T postAct       = post.entries[e].second;
+                    size_t i        = 0;
+
+                    for (typename SpMat::InnerIterator it(mat, row); it; ++it, i++) pairRow[i] += postAct * pPre[it.col()];
+                }
+
+                for (size_t i = 0; i < rowNnz; i++) pairRow[i] *= batchSizeInv;
+            }
+        });
+    }
+
+    /**
+     * EigenMat::updateRows - Add scaled pairings to every nonzero, then normalize each row
+     * to unit L2 norm with Eigen's vector norm over the row's values.
+     *
+     * @param pairings   Pairing per nonzero.
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     */
+
+    void updateRows(const vector<T>& pairings, T learnRate, bool bNormalize = true)
+    {
+        PROFILE_KERNEL("EigenMat::updateRows", 5 * nnz() + n, 5 * nnz() * sizeof(T) + 2 * (n + 1) * sizeof(int),
+            nnz(), "nnz");
+
+        T* vals             = mat.valuePtr();
+        const int* outer    = mat.outerIndexPtr();
+
+        forEachRowRange([&](uint32_t rBegin, uint32_t rEnd)
+        {
+            Eigen::Index rowsBegin  = outer[rBegin];
+            Eigen::Index rowsNnz    = outer[rEnd] - rowsBegin;
+
+            Eigen::Map<Vec> rowsVals(vals + rowsBegin, rowsNnz);
+            rowsVals += learnRate * Eigen::Map<const Vec>(pairings.data() + rowsBegin, rowsNnz);
+
+            if (!bNormalize) return;
+
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                Eigen::Map<Vec> row(vals + outer[r], outer[r + 1] - outer[r]);
+                row /= row.norm();
+            }
+        });
+    }
+
+    /**
+     * EigenMat::cull - Remove nonzeros with magnitude below a threshold with Eigen's prune,
+     * which compacts the compressed storage in place.
+     *
+     * @param  thresh Smallest magnitude kept.
+     * @return        Number of nonzeros removed.
+     */
+
+    size_t cull(T thresh)
+    {
+        PROFILE_ZONE_WORK("EigenMat::cull", nnz(), "nnz");
+
+        size_t oldNnz = nnz();
+        mat.prune([&](Eigen::Index, Eigen::Index, const T& val) { return !(abs(val) < thresh); });
+
+        return oldNnz - nnz();
+    }
+
+private:
+
+    /**
+     * EigenMat::forEachRowRange - Split rows into one range per kernel thread with roughly
+     * equal nnz and run fn on each, small matrices run on the calling thread.
+     *
+     * @param fn Range function, called as fn(rBegin, rEnd).
+     */
+
+    template<class Fn>
+    void forEachRowRange(Fn fn) const
+    {
+        uint32_t numParts = nnz() < spmvParallelNnz ? 1 : GetNumThreads();
+        vector<uint32_t> bounds(numParts + 1);
+
+        PartitionRowsByNnz(mat.outerIndexPtr(), n, numParts, bounds.data());
+
+        ParallelRun(numParts, [&](uint32_t part)
+        {
+            if (bounds[part] < bounds[part + 1]) fn(bounds[part], bounds[part + 1]);
+        });
+    }
+};
@@ -0,0 +1,542 @@
+#pragma once
+
+#include "matrix.h"
+
+static const uint32_t fixedFracBits     = 14;
+static const double fixedOne            = (double)(1 << fixedFracBits);
+static const int32_t fixedActMax        = 127;
+
+#ifdef FTWT_HAS_AVX2_PATH
+void Fixed16SpMVRowsAVX2(const int16_t* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const float* x, float* y, uint32_t rBegin, uint32_t rEnd);
+void Fixed16SpMVRowsInt32AVX2(const int16_t* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const int32_t* xq, float scale, float* y, uint32_t rBegin, uint32_t rEnd);
+void Fixed16SpMMRowsInt32AVX2(const int16_t* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const int32_t* xq, float scale, float* y, uint32_t k, uint32_t rBegin, uint32_t rEnd);
+#endif
+
+/**
+ * QuantizeFixed16 - Round a weight to Q1.14 (half away from zero), saturating at the ends
+ * of the int16 range. Rounds with a truncating convert instead of floor, which keeps update
+ * loops vectorizable on baseline x86-64.
+ *
+ * @param  w Weight.
+ * @return   Fixed point weight.
+ */
+
+template<class T>
+inline int16_t QuantizeFixed16(T w)
+{
+    T q = w * (T)fixedOne;
+    q   = q < (T)-32768 ? (T)-32768 : (q > (T)32767 ? (T)32767 : q);
+    return (int16_t)(int32_t)(q + (q < 0 ? (T)-0.5 : (T)0.5));
+}
+
+/**
+ * DequantizeFixed16 - Fixed point weight back to a real value.
+ *
+ * @param  q Fixed point weight.
+ * @return   Weight.
+ */
+
+inline double DequantizeFixed16(int16_t q)
+{
+    return (double)q / fixedOne;
+}
+
+/**
+ * QuantizeActivations - Scale activations to [-127, 127] integers for int32 accumulation.
+ * One scale covers the whole vector (or block), so values that are already 8-bit (MNIST
+ * pixels) round trip exactly.
+ *
+ * @param  x   Activations.
+ * @param  cnt Number of activations.
+ * @param  xq  Output integers, cnt entries.
+ * @return     Scale taking an integer back to an activation, 0 for an all zero input.
+ */
+
+template<class T>
+inline T QuantizeActivations(const T* x, size_t cnt, int32_t* xq)
+{
+    T maxAbs = 0;
+    for (size_t i = 0; i < cnt; i++) maxAbs = max(maxAbs, (T)abs(x[i]));
+
+    if (maxAbs == 0)
+    {
+        for (size_t i = 0; i < cnt; i++) xq[i] = 0;
+        return 0;
+    }
+
+    T inv = (T)fixedActMax / maxAbs;
+
+    for (size_t i = 0; i < cnt; i++)
+    {
+        T q     = x[i] * inv;
+        xq[i]   = (int32_t)(q + (q < 0 ? (T)-0.5 : (T)0.5));
+    }
+
+    return maxAbs / (T)fixedActMax;
+}
+
+/**
+ * Fixed16SpMVRows - y = A * x for a range of rows with Q1.14 weights, dequantized and
+ * accumulated in T.
+ *
+ * @param vals    Fixed point values.
+ * @param colIdcs Column index of each nonzero.
+ * @param offsets Row offsets into vals/colIdcs.
+ * @param x       Input vector.
+ * @param y       Output vector, rows [rBegin, rEnd) are overwritten.
+ * @param rBegin  First row.
+ * @param rEnd    One past last row.
+ */
+
+template<class T>
+inline void Fixed16SpMVRows(const int16_t* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const T* x, T* y, uint32_t rBegin, uint32_t rEnd)
+{
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        T acc = 0;
+        for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++) acc += (T)vals[i] * x[colIdcs[i]];
+        y[r] = acc * (T)(1.0 / fixedOne);
+    }
+}
+
+/**
+ * Fixed16SpMVRows - Single precision rows, uses the AVX2 kernel when the CPU has it.
+ */
+
+inline void Fixed16SpMVRows(const int16_t* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const float* x, float* y, uint32_t rBegin, uint32_t rEnd)
+{
+#ifdef FTWT_HAS_AVX2_PATH
+    if (CpuHasAVX2())
+    {
+        Fixed16SpMVRowsAVX2(vals, colIdcs, offsets, x, y, rBegin, rEnd);
+        return;
+    }
+#endif
+
+    Fixed16SpMVRows<float>(vals, colIdcs, offsets, x, y, rBegin, rEnd);
+}
+
+/**
+ * Fixed16SpMVRowsInt32 - y = A * x for a range of rows with Q1.14 weights and integer
+ * activations, accumulated in int32. Rows are unit L2 norm, so by Cauchy-Schwarz a row
+ * sum is at most 2^14 * 127 * sqrt(row length), which stays in range for rows shorter than
+ * 2^20 entries.
+ *
+ * @param vals    Fixed point values.
+ * @param colIdcs Column index of each nonzero.
+ * @param offsets Row offsets into vals/colIdcs.
+ * @param xq      Quantized input vector.
+ * @param scale   Scale taking an accumulated sum back to a response.
+ * @param y       Output vector, rows [rBegin, rEnd) are overwritten.
+ * @param rBegin  First row.
+ * @param rEnd    One past last row.
+ */
+
+template<class T>
+inline void Fixed16SpMVRowsInt32(const int16_t* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const int32_t* xq, T scale, T* y, uint32_t rBegin, uint32_t rEnd)
+{
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        int32_t acc = 0;
+        for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++) acc += (int32_t)vals[i] * xq[colIdcs[i]];
+        y[r] = (T)acc * scale;
+    }
+}
+
+/**
+ * Fixed16SpMVRowsInt32 - Single precision responses, uses the AVX2 kernel when the CPU
+ * has it.
+ */
+
+inline void Fixed16SpMVRowsInt32(const int16_t* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const int32_t* xq, float scale, float* y, uint32_t rBegin, uint32_t rEnd)
+{
+#ifdef FTWT_HAS_AVX2_PATH
+    if (CpuHasAVX2())
+    {
+        Fixed16SpMVRowsInt32AVX2(vals, colIdcs, offsets, xq, scale, y, rBegin, rEnd);
+        return;
+    }
+#endif
+
+    Fixed16SpMVRowsInt32<float>(vals, colIdcs, offsets, xq, scale, y, rBegin, rEnd);
+}
+
+/**
+ * Fixed16SpMMRowsInt32 - Y = A * X for a range of rows with Q1.14 weights and a row-major
+ * block of integer activations, accumulated in int32.
+ *
+ * @param vals    Fixed point values.
+ * @param colIdcs Column index of each nonzero.
+ * @param offsets Row offsets into vals/colIdcs.
+ * @param xq      Quantized input block (m x k, row-major).
+ * @param scale   Scale taking an accumulated sum back to a response.
+ * @param y       Output block (n x k, row-major), rows [rBegin, rEnd) are overwritten.
+ * @param k       Number of vectors in the block.
+ * @param rBegin  First row.
+ * @param rEnd    One past last row.
+ */
+
+template<class T>
+inline void Fixed16SpMMRowsInt32(const int16_t* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const int32_t* xq, T scale, T* y, uint32_t k, uint32_t rBegin, uint32_t rEnd)
+{
+    vector<int32_t> acc(k);
+
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        for (uint32_t j = 0; j < k; j++) acc[j] = 0;
+
+        for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++)
+        {
+            int32_t w           = vals[i];
+            const int32_t* xRow = xq + (size_t)colIdcs[i] * k;
+
+            for (uint32_t j = 0; j < k; j++) acc[j] += w * xRow[j];
+        }
+
+        T* yRow = y + (size_t)r * k;
+        for (uint32_t j = 0; j < k; j++) yRow[j] = (T)acc[j] * scale;
+    }
+}
+
+/**
+ * Fixed16SpMMRowsInt32 - Single precision responses, uses the AVX2 kernel when the CPU
+ * has it.
+ */
+
+inline void Fixed16SpMMRowsInt32(const int16_t* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const int32_t* xq, float scale, float* y, uint32_t k, uint32_t rBegin, uint32_t rEnd)
+{
+#ifdef FTWT_HAS_AVX2_PATH
+    if (CpuHasAVX2())
+    {
+        Fixed16SpMMRowsInt32AVX2(vals, colIdcs, offsets, xq, scale, y, k, rBegin, rEnd);
+        return;
+    }
+#endif
+
+    Fixed16SpMMRowsInt32<float>(vals, colIdcs, offsets, xq, scale, y, k, rBegin, rEnd);
+}
+
+template<class T>
+struct Fixed16Mat
+{
+    vector<int16_t> vals;
+    vector<uint32_t> colIdcs;
+    vector<uint32_t> offsets;
+
+    uint32_t n;
+    uint32_t m;
+    bool bInt32Accum;
+    string name;
+
+    /**
+     * Fixed16Mat::Fixed16Mat - CSR matrix with Q1.14 fixed point weights, a quarter of
+     * the value traffic of double storage. Activations, responses and pairings stay in T.
+     * Kernels either dequantize each weight and accumulate in T, or quantize activations to
+     * 8-bit integers and accumulate in int32.
+     */
+
+    Fixed16Mat() : n(0), m(0), bInt32Accum(false), name("") {}
+
+    /**
+     * Fixed16Mat::Fixed16Mat - Quantize a CSC matrix.
+     *
+     * @param csc         Matrix to convert.
+     * @param bInt32Accum Whether kernels accumulate in int32.
+     */
+
+    Fixed16Mat(const CSCMat<T>& csc, bool bInt32Accum = false) { fromCSC(csc, bInt32Accum); }
+
+    /**
+     * Fixed16Mat::nnz - Number of entries.
+     *
+     * @return Nonzero count.
+     */
+
+    size_t nnz() const { return vals.size(); }
+
+    /**
+     * Fixed16Mat::fromCSC - Quantize a CSC matrix's values, sharing its row layout. Values
+     * outside [-2, 2) saturate, which is harmless for normalized rows but clips raw initial
+     * weights until the first renormalization.
+     *
+     * @param csc        Matrix to convert.
+     * @param bInt32     Whether kernels accumulate in int32.
+     */
+
+    void fromCSC(const CSCMat<T>& csc, bool bInt32 = false)
+    {
+        PROFILE_ZONE_WORK("Fixed16Mat::fromCSC", csc.vals.size(), "nnz");
+
+        n           = csc.n;
+        m           = csc.m;
+        name        = csc.name;
+        bInt32Accum = bInt32;
+        offsets     = csc.offsets;
+        colIdcs     = csc.colIdcs;
+
+        vals.resize(csc.vals.size());
+        for (size_t i = 0; i < vals.size(); i++) vals[i] = QuantizeFixed16(csc.vals[i]);
+    }
+
+    /**
+     * Fixed16Mat::toCSC - Dequantize back to a CSC matrix.
+     *
+     * @return Compressed sparse copy of this matrix.
+     */
+
+    CSCMat<T> toCSC() const
+    {
+        CSCMat<T> csc(n, m, name);
+        csc.offsets = offsets;
+        csc.colIdcs = colIdcs;
+
+        csc.vals.resize(vals.size());
+        for (size_t i = 0; i < vals.size(); i++) csc.vals[i] = (T)DequantizeFixed16(vals[i]);
+
+        return csc;
+    }
+
+    /**
+     * Fixed16Mat::multiply - y = A * x, rows split across kernel threads by nnz.
+     *
+     * @param x Vector to multiply by this matrix (m entries).
+     * @param y Result vector (n entries), overwritten.
+     */
+
+    void multiply(const T* x, T* y) const
+    {
+        PROFILE_KERNEL("Fixed16Mat::multiply", 2 * vals.size(),
+            vals.size() * (sizeof(int16_t) + sizeof(uint32_t)) + (n + 1) * sizeof(uint32_t) + (n + m) * sizeof(T),
+            vals.size(), "nnz");
+
+        if (n == 0) return;
+
+        uint32_t numParts = vals.size() < spmvParallelNnz ? 1 : GetNumThreads();
+        vector<uint32_t> bounds(numParts + 1);
+        PartitionRowsByNnz(offsets.data(), n, numParts, bounds.data());
+
+        if (!bInt32Accum)
+        {
+            ParallelRun(numParts, [&](uint32_t part)
+            {
+                Fixed16SpMVRows(vals.data(), colIdcs.data(), offsets.data(), x, y, bounds[part], bounds[part + 1]);
+            });
+
+            return;
+        }
+
+        vector<int32_t> xq(m);
+        T scale = QuantizeActivations(x, m, xq.data()) * (T)(1.0 / fixedOne);
+
+        ParallelRun(numParts, [&](uint32_t part)
+        {
+            Fixed16SpMVRowsInt32(vals.data(), colIdcs.data(), offsets.data(), xq.data(), scale, y,
+                bounds[part], bounds[part + 1]);
+        });
+    }
+
+    /**
+     * Fixed16Mat::multiplyBlock - Y = A * X for a row-major block of k vectors. With int32
+     * accumulation the whole block shares one activation scale.
+     *
+     * @param x Input block (m x k, row-major).
+     * @param y Result block (n x k, row-major), overwritten.
+     * @param k Number of vectors in the block.
+     */
+
+    void multiplyBlock(const T* x, T* y, uint32_t k) const
+    {
+        PROFILE_KERNEL("Fixed16Mat::multiplyBlock", 2 * vals.size() * k,
+            vals.size() * (sizeof(int16_t) + sizeof(uint32_t)) + (n + 1) * sizeof(uint32_t) +
+            (size_t)(n + m) * k * sizeof(T), vals.size() * k, "nnz");
+
+        if (n == 0) return;
+
+        uint32_t numParts = vals.size() * k < spmvParallelNnz ? 1 : GetNumThreads();
+        vector<uint32_t> bounds(numParts + 1);
+        PartitionRowsByNnz(offsets.data(), n, numParts, bounds.data());
+
+        if (!bInt32Accum)
+        {
+            ParallelRun(numParts, [&](uint32_t part)
+            {
+                for (uint32_t r = bounds[part]; r < bounds[part + 1]; r++)
+                {
+                    T* yRow = y + (size_t)r * k;
+                    for (uint32_t j = 0; j < k; j++) yRow[j] = 0;
+
+                    for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++)
+                    {
+                        Axpy((T)DequantizeFixed16(vals[i]), x + (size_t)colIdcs[i] * k, yRow, k);
+                    }
+                }
+            });
+
+            return;
+        }
+
+        vector<int32_t> xq((size_t)m * k);
+        T scale = QuantizeActivations(x, (size_t)m * k, xq.data()) * (T)(1.0 / fixedOne);
+
+        ParallelRun(numParts, [&](uint32_t part)
+        {
+            Fixed16SpMMRowsInt32(vals.data(), colIdcs.data(), offsets.data(), xq.data(), scale, y, k,
+                bounds[part], bounds[part + 1]);
+        });
+    }
+
+    /**
+     * Fixed16Mat::computePairings - Batch averaged pairings, one per entry. Only the row
+     * layout is read, so this matches CSR exactly.
+     *
+     * @param pre      Presynaptic activations per batch entry.
+     * @param post     Postsynaptic activations per batch entry.
+     * @param pairings Output pairings, resized to nnz.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const vector<vector<T>>& post, vector<T>& pairings) const
+    {
+        uint32_t batchSize  = (uint32_t)pre.size();
+        size_t nnz          = vals.size();
+
+        PROFILE_KERNEL("Fixed16Mat::computePairings", (2 * batchSize + 1) * nnz,
+            batchSize * (nnz * (sizeof(uint32_t) + 2 * sizeof(T)) + (n + m) * sizeof(T)), batchSize * nnz, "nnz");
+
+        pairings.assign(nnz, 0);
+        T batchSizeInv = (T)1 / (T)batchSize;
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t bat = 0; bat < batchSize; bat++)
+            {
+                const T* batPre     = pre[bat].data();
+                const T* batPost    = post[bat].data();
+
+                for (uint32_t r = rBegin; r < rEnd; r++)
+                {
+                    T postAct = batPost[r];
+                    if (postAct == 0) continue;
+
+                    for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++) pairings[i] += postAct * batPre[colIdcs[i]];
+                }
+            }
+
+            for (size_t i = offsets[rBegin]; i < offsets[rEnd]; i++) pairings[i] *= batchSizeInv;
+        });
+    }
+
+    /**
+     * Fixed16Mat::computePairings - Batch averaged pairings from sparse post activations,
+     * only rows with an active post neuron are walked. See CSCMat::computePairings.
+     *
+     * @param pre      Presynaptic activations per batch entry.
+     * @param post     Active postsynaptic neurons of the batch.
+     * @param pairings Output pairings, resized to nnz.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const ActiveRows<T>& post, vector<T>& pairings) const
+    {
+        PROFILE_ZONE_WORK("Fixed16Mat::computePairings sparse", post.entries.size(), "entry");
+
+        pairings.assign(vals.size(), 0);
+        T batchSizeInv = (T)1 / (T)post.batchSize;
+
+        ParallelFor(0, post.size(), activeRowGrain, [&](uint32_t aBegin, uint32_t aEnd)
+        {
+            for (uint32_t a = aBegin; a < aEnd; a++)
+            {
+                uint32_t row = post.rows[a];
+
+                for (uint32_t e = post.offsets[a]; e < post.offsets[a + 1]; e++)
+                {
+                    const T* batPre = pre[post.entries[e].first].data();
+                    T postAct       = post.entries[e].second;
+
+                    for (uint32_t i = offsets[row]; i < offsets[row + 1]; i++) pairings[i] += postAct * batPre[colIdcs[i]];
+                }
+
+                for (uint32_t i = offsets[row]; i < offsets[row + 1]; i++) pairings[i] *= batchSizeInv;
+            }
+        });
+    }
+
+    /**
+     * Fixed16Mat::updateRows - Add scaled pairings to every entry in T, optionally normalize
+     * each row to unit L2 norm, then round back to Q1.14. Steps below 2^-15 round away, so
+     * learnRate * pairing has to clear that to move a weight. Rows left unnormalized
+     * saturate at +-2.
+     *
+     * @param pairings   Pairing per entry.
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     */
+
+    void updateRows(const vector<T>& pairings, T learnRate, bool bNormalize = true)
+    {
+        PROFILE_KERNEL("Fixed16Mat::updateRows", 6 * vals.size() + n,
+            vals.size() * (2 * sizeof(int16_t) + sizeof(T)), vals.size(), "nnz");
+
+        T invOne = (T)(1.0 / fixedOne);
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                T total = 0;
+
+                for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++)
+                {
+                    T w     = (T)vals[i] * invOne + learnRate * pairings[i];
+                    total   += w * w;
+                }
+
+                // Rows with no entries, or all entries rounded to zero, are left alone.
+
+                T scale = bNormalize && total != 0 ? (T)1 / sqrt(total) : (T)1;
+
+                for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++)
+                {
+                    T w     = (T)vals[i] * invOne + learnRate * pairings[i];
+                    vals[i] = QuantizeFixed16(w * scale);
+                }
+            }
+        });
+    }
+
+    /**
+     * Fixed16Mat::cull - Remove entries below a threshold, compacted in place. Weights that
+     * rounded to zero are always removed.
+     *
+     * @param  thresh Smallest magnitude kept.
+     * @return        Number of entries removed.
+     */
+
+    size_t cull(T thresh)
+    {
+        PROFILE_ZONE_WORK("Fixed16Mat::cull", vals.size(), "nnz");
+
+        T invOne        = (T)1 / (T)fixedOne;
+        size_t oldNnz   = vals.size();
+        size_t nnz      = CompactRows(offsets, n,
+            [&](size_t i) { return vals[i] != 0 && !(abs((T)vals[i] * invOne) < thresh); },
+            [&](size_t dst, size_t src)
+            {
+                vals[dst]       = vals[src];
+                colIdcs[dst]    = colIdcs[src];
+            });
+
+        vals.resize(nnz);
+        colIdcs.resize(nnz);
+
+        return oldNnz - nnz;
+    }
+};
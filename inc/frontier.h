@@ -0,0 +1,190 @@
+#pragma once
+
+#include "matrix.h"
+
+enum PulseActivation
+{
+    PULSE_LINEAR,
+    PULSE_CLAMP,
+    PULSE_SIGMOID,
+    PULSE_TANH
+};
+
+/**
+ * PulseActivate - Nonlinearity applied to a neuron's summed input during pulse propagation.
+ * Linear passes the sum through, clamp limits it to [0, 1].
+ *
+ * @param  act Nonlinearity.
+ * @param  x   Summed input.
+ * @return     Neuron activation.
+ */
+
+template<class T>
+inline T PulseActivate(PulseActivation act, T x)
+{
+    switch (act)
+    {
+    case PULSE_CLAMP:   return min(max(x, (T)0), (T)1);
+    case PULSE_SIGMOID: return (T)1 / ((T)1 + exp(-x));
+    case PULSE_TANH:    return tanh(x);
+    default:            return x;
+    }
+}
+
+/**
+ * PulseActivationName - Printable name of a pulse nonlinearity.
+ *
+ * @param  act Nonlinearity.
+ * @return     Nonlinearity name.
+ */
+
+inline const char* PulseActivationName(PulseActivation act)
+{
+    switch (act)
+    {
+    case PULSE_CLAMP:   return "clamp";
+    case PULSE_SIGMOID: return "sigmoid";
+    case PULSE_TANH:    return "tanh";
+    default:            return "linear";
+    }
+}
+
+template<class OffT = uint32_t>
+struct ColumnIndex
+{
+    vector<OffT> offsets;
+    vector<uint32_t> rows;
+    vector<OffT> valIdcs;
+    uint32_t m;
+
+    /**
+     * ColumnIndex::ColumnIndex - Column-major companion of a CSR synapse matrix for pushing
+     * activity forward. Column c's entries are at [offsets[c], offsets[c + 1]), each with
+     * its row (postsynaptic neuron) and the position of its value in the CSR vals. Only the
+     * pattern is stored, so weight updates don't invalidate it, structural changes do.
+     */
+
+    ColumnIndex() : m(0) {}
+
+    /**
+     * ColumnIndex::empty - Whether the index has been built.
+     *
+     * @return True if not built.
+     */
+
+    bool empty() const { return offsets.empty(); }
+
+    /**
+     * ColumnIndex::clear - Drop the index, the matrix pattern changed.
+     */
+
+    void clear()
+    {
+        offsets.clear();
+        rows.clear();
+        valIdcs.clear();
+        m = 0;
+    }
+
+    /**
+     * ColumnIndex::build - Counting sort of a CSR matrix's entries by column. Rows are
+     * visited in order, so every column's rows come out ascending.
+     *
+     * @param csr Matrix to index.
+     */
+
+    template<class T, class IdxT>
+    void build(const CSCMat<T, IdxT, OffT>& csr)
+    {
+        PROFILE_ZONE_WORK("ColumnIndex::build", csr.vals.size(), "nnz");
+
+        size_t nnz = csr.vals.size();
+
+        m = csr.m;
+        offsets.assign((size_t)m + 1, 0);
+        rows.resize(nnz);
+        valIdcs.resize(nnz);
+
+        for (size_t i = 0; i < nnz; i++) offsets[csr.colIdcs[i]]++;
+        ExclusiveScan(offsets.data(), (size_t)m + 1);
+
+        vector<OffT> pos(offsets.begin(), offsets.end() - 1);
+
+        for (uint32_t r = 0; r < csr.n; r++)
+        {
+            for (OffT i = csr.offsets[r]; i < csr.offsets[r + 1]; i++)
+            {
+                OffT dst        = pos[csr.colIdcs[i]]++;
+                rows[dst]       = r;
+                valIdcs[dst]    = i;
+            }
+        }
+    }
+};
+
+template<class T>
+struct FrontierScratch
+{
+    vector<T> sums;
+    vector<uint32_t> marker;
+    vector<uint32_t> touched;
+    uint32_t stamp;
+
+    /**
+     * FrontierScratch::FrontierScratch - Per thread accumulator for PushFrontier: a dense
+     * sum per neuron, a stamp per neuron marking the ones touched by the current push and
+     * the list of touched neurons. Only touched entries are read or reset, so a push costs
+     * the out-edges of its frontier and nothing per neuron.
+     *
+     * @param n Number of neurons.
+     */
+
+    FrontierScratch(uint32_t n) : sums(n, 0), marker(n, UINT32_MAX), stamp(0) {}
+};
+
+/**
+ * PushFrontier - Sparse matrix * sparse vector product in the push direction. Every active
+ * neuron of the frontier adds its activation times the weight of each of its out-edges to
+ * the target's sum. Weights are read from the CSR values through the column index and
+ * scaled by the optional per row scales of lazily normalized synapses. Touched neurons are
+ * listed in scratch.touched, their sums in scratch.sums.
+ *
+ * @param colIndex     Column index of the synapses.
+ * @param vals         CSR synapse values.
+ * @param rowScales    Optional per row weight scale.
+ * @param frontier     Active neurons to push from.
+ * @param frontierSize Number of frontier neurons.
+ * @param acts         Activations, indexed by neuron.
+ * @param scratch      Accumulator, touched list overwritten.
+ */
+
+template<class T, class OffT>
+inline void PushFrontier(const ColumnIndex<OffT>& colIndex, const T* vals, const T* rowScales,
+    const uint32_t* frontier, size_t frontierSize, const T* acts, FrontierScratch<T>& scratch)
+{
+    uint32_t stamp = ++scratch.stamp;
+    scratch.touched.clear();
+
+    for (size_t f = 0; f < frontierSize; f++)
+    {
+        uint32_t c  = frontier[f];
+        T a         = acts[c];
+
+        for (OffT k = colIndex.offsets[c]; k < colIndex.offsets[c + 1]; k++)
+        {
+            uint32_t r  = colIndex.rows[k];
+            T w         = vals[colIndex.valIdcs[k]];
+
+            if (rowScales) w *= rowScales[r];
+
+            if (scratch.marker[r] != stamp)
+            {
+                scratch.marker[r]   = stamp;
+                scratch.sums[r]     = 0;
+                scratch.touched.push_back(r);
+            }
+
+            scratch.sums[r] += w * a;
+        }
+    }
+}
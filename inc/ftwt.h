@@ -4,13 +4,16 @@
 #include <vector>
 #include <algorithm>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 #include <math.h>
 #include <string>
 #include <map>
+#include <limits>
 #include <time.h>
-#include <Windows.h>
 #include <thread>
 #include <mutex>
+#include "platform.h"
+#include "profiler.h"
 
 using namespace std;
\ No newline at end of file
@@ -0,0 +1,545 @@
+#pragma once
+
+#include "matrix.h"
+
+static const char edgeListMagic[8]      = { 'F', 'T', 'W', 'T', 'E', 'D', 'G', 'E' };
+static const uint32_t edgeListVersion   = 1;
+static const size_t textChunkBytes      = 1 << 20;
+static const size_t graphChunkEdges     = 1 << 16;
+
+struct MatrixMarketHeader
+{
+    uint32_t n;
+    uint32_t m;
+    uint64_t nnz;
+    bool bPattern;
+    bool bSymmetric;
+    bool bSkew;
+    size_t bodyOffset;
+};
+
+/**
+ * EdgeListHeader - Start of a binary edge list. Edges follow directly as (row, column,
+ * value) records laid out like Triplet<T>, with valBytes picking float or double values.
+ * Fields are native endian.
+ */
+
+struct EdgeListHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t valBytes;
+    uint32_t n;
+    uint32_t m;
+    uint64_t count;
+};
+
+bool ParseMatrixMarketHeader(const char* data, size_t size, MatrixMarketHeader& header, string& err);
+void SplitTextChunks(const char* data, size_t begin, size_t end, uint32_t numChunks, vector<size_t>& bounds);
+size_t CountDataLines(const char* data, size_t begin, size_t end);
+bool ParseEdgeLine(const char* line, const char* lineEnd, bool bPattern, uint32_t& r, uint32_t& c, double& val);
+bool WriteTextChunks(FILE* f, size_t count, const function<void(size_t begin, size_t end, string& out)>& format);
+size_t FormatEdgeLine(char* buf, uint32_t r, uint32_t c, double val);
+size_t FormatEdgeLine(char* buf, uint32_t r, uint32_t c, float val);
+
+/**
+ * NextLine - Find the end of a text line.
+ *
+ * @param  p   Line start.
+ * @param  end End of text.
+ * @return     Position of the line's '\n', or end.
+ */
+
+inline const char* NextLine(const char* p, const char* end)
+{
+    const char* nl = (const char*)memchr(p, '\n', (size_t)(end - p));
+    return nl ? nl : end;
+}
+
+/**
+ * ParseMatrixMarketBody - Parse the entries of a coordinate Matrix Market file. The body is
+ * split into chunks at line starts. A first parallel pass counts entries per chunk, a scan
+ * turns the counts into write positions, and a second parallel pass parses every chunk
+ * straight into its slice of the output. Symmetric files get their mirrored entries
+ * appended the same way.
+ *
+ * @param  data   File text.
+ * @param  size   Text size.
+ * @param  header Parsed header.
+ * @param  trip   Output matrix, entries in file order.
+ * @param  err    Error message on failure.
+ * @return        True on success.
+ */
+
+template<class T>
+bool ParseMatrixMarketBody(const char* data, size_t size, const MatrixMarketHeader& header, TripletMat<T>& trip, string& err)
+{
+    PROFILE_ZONE_WORK("ParseMatrixMarketBody", size - header.bodyOffset, "byte");
+
+    size_t bodySize     = size - header.bodyOffset;
+    uint32_t numChunks  = (uint32_t)max((size_t)1, min((size_t)GetNumThreads() * 8, bodySize / textChunkBytes));
+
+    vector<size_t> bounds;
+    SplitTextChunks(data, header.bodyOffset, size, numChunks, bounds);
+
+    vector<size_t> chunkStart(numChunks + 1, 0);
+
+    ParallelRun(numChunks, [&](uint32_t chunk)
+    {
+        chunkStart[chunk] = CountDataLines(data, bounds[chunk], bounds[chunk + 1]);
+    });
+
+    size_t numEntries = ExclusiveScan(chunkStart.data(), numChunks + 1);
+
+    if (numEntries != header.nnz)
+    {
+        err = "header declares " + to_string(header.nnz) + " entries, found " + to_string(numEntries);
+        return false;
+    }
+
+    trip.n      = header.n;
+    trip.m      = header.m;
+    trip.entries.resize(numEntries);
+
+    vector<size_t> badEntry(numChunks, SIZE_MAX);
+
+    ParallelRun(numChunks, [&](uint32_t chunk)
+    {
+        const char* p   = data + bounds[chunk];
+        const char* end = data + bounds[chunk + 1];
+        size_t pos      = chunkStart[chunk];
+
+        while (p < end)
+        {
+            const char* lineEnd = NextLine(p, end);
+            const char* first   = p;
+
+            while (first < lineEnd && (*first == ' ' || *first == '\t' || *first == '\r')) first++;
+
+            if (first < lineEnd && *first != '%')
+            {
+                uint32_t r;
+                uint32_t c;
+                double val;
+
+                if (!ParseEdgeLine(first, lineEnd, header.bPattern, r, c, val) || r == 0 || r > header.n ||
+                    c == 0 || c > header.m)
+                {
+                    badEntry[chunk] = pos;
+                    return;
+                }
+
+                trip.entries[pos++] = { r - 1, c - 1, (T)val };
+            }
+
+            p = lineEnd + 1;
+        }
+    });
+
+    size_t firstBad = *min_element(badEntry.begin(), badEntry.end());
+
+    if (firstBad != SIZE_MAX)
+    {
+        err = "bad or out of range entry " + to_string(firstBad + 1);
+        return false;
+    }
+
+    if (!header.bSymmetric && !header.bSkew) return true;
+
+    // Only the lower triangle is stored, mirror every off-diagonal entry.
+
+    vector<size_t> mirrorStart(numChunks + 1, 0);
+    size_t chunkSize = (numEntries + numChunks - 1) / numChunks;
+
+    ParallelRun(numChunks, [&](uint32_t chunk)
+    {
+        size_t end = min(numEntries, (chunk + 1) * chunkSize);
+        for (size_t i = chunk * chunkSize; i < end; i++) mirrorStart[chunk] += trip.entries[i].r != trip.entries[i].c;
+    });
+
+    size_t numMirrored = ExclusiveScan(mirrorStart.data(), numChunks + 1);
+    trip.entries.resize(numEntries + numMirrored);
+
+    ParallelRun(numChunks, [&](uint32_t chunk)
+    {
+        size_t end = min(numEntries, (chunk + 1) * chunkSize);
+        size_t dst = numEntries + mirrorStart[chunk];
+
+        for (size_t i = chunk * chunkSize; i < end; i++)
+        {
+            const Triplet<T>& e = trip.entries[i];
+            if (e.r != e.c) trip.entries[dst++] = { e.c, e.r, header.bSkew ? -e.val : e.val };
+        }
+    });
+
+    return true;
+}
+
+/**
+ * ConvertEdges - Copy edge records, converting their values, in parallel chunks.
+ *
+ * @param src   Source edges.
+ * @param count Number of edges.
+ * @param dst   Destination edges.
+ */
+
+template<class S, class T>
+inline void ConvertEdges(const Triplet<S>* src, size_t count, Triplet<T>* dst)
+{
+    ParallelFor(0, (uint32_t)((count + graphChunkEdges - 1) / graphChunkEdges), 1, [&](uint32_t chBegin, uint32_t chEnd)
+    {
+        size_t end = min(count, (size_t)chEnd * graphChunkEdges);
+        for (size_t i = (size_t)chBegin * graphChunkEdges; i < end; i++) dst[i] = { src[i].r, src[i].c, (T)src[i].val };
+    });
+}
+
+/**
+ * ConvertEdges - Same precision, a plain parallel copy.
+ *
+ * @param src   Source edges.
+ * @param count Number of edges.
+ * @param dst   Destination edges.
+ */
+
+template<class T>
+inline void ConvertEdges(const Triplet<T>* src, size_t count, Triplet<T>* dst)
+{
+    ParallelCopy(src, count, dst);
+}
+
+/**
+ * ParseEdgeList - Read the edges of a binary edge list. Records are copied out in parallel,
+ * converting values if the file was written with the other precision, then range checked.
+ *
+ * @param  data File bytes.
+ * @param  size File size.
+ * @param  trip Output matrix, entries in file order.
+ * @param  err  Error message on failure.
+ * @return      True on success.
+ */
+
+template<class T>
+bool ParseEdgeList(const uint8_t* data, size_t size, TripletMat<T>& trip, string& err)
+{
+    EdgeListHeader header;
+
+    if (size < sizeof(header))
+    {
+        err = "file too small for header";
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, edgeListMagic, sizeof(header.magic)) != 0 || header.version != edgeListVersion ||
+        (header.valBytes != sizeof(float) && header.valBytes != sizeof(double)))
+    {
+        err = "not an FTWT edge list or unsupported version";
+        return false;
+    }
+
+    size_t recordBytes = 2 * sizeof(uint32_t) + header.valBytes;
+
+    if (header.count > (size - sizeof(header)) / recordBytes)
+    {
+        err = "truncated edge list";
+        return false;
+    }
+
+    PROFILE_ZONE_WORK("ParseEdgeList", header.count, "edge");
+
+    size_t count            = (size_t)header.count;
+    const uint8_t* records  = data + sizeof(header);
+
+    trip.n = header.n;
+    trip.m = header.m;
+    trip.entries.resize(count);
+
+    if (header.valBytes == sizeof(float)) ConvertEdges((const Triplet<float>*)records, count, trip.entries.data());
+    else ConvertEdges((const Triplet<double>*)records, count, trip.entries.data());
+
+    uint32_t numChunks = (uint32_t)((count + graphChunkEdges - 1) / graphChunkEdges);
+    vector<uint8_t> chunkOk(numChunks, 1);
+
+    ParallelFor(0, numChunks, 1, [&](uint32_t chBegin, uint32_t chEnd)
+    {
+        for (uint32_t chunk = chBegin; chunk < chEnd; chunk++)
+        {
+            size_t end = min(count, (size_t)(chunk + 1) * graphChunkEdges);
+
+            for (size_t i = (size_t)chunk * graphChunkEdges; i < end; i++)
+            {
+                if (trip.entries[i].r >= trip.n || trip.entries[i].c >= trip.m) chunkOk[chunk] = 0;
+            }
+        }
+    });
+
+    if (!all_of(chunkOk.begin(), chunkOk.end(), [](uint8_t ok) { return ok != 0; }))
+    {
+        err = "edge out of range";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * ReadSynapseGraph - Read a synapse matrix from a Matrix Market coordinate file or a binary
+ * edge list, told apart by the edge list's magic. The file is mapped read-only and parsed
+ * in parallel. Duplicate entries are kept, TripletMat::toCSC sums them.
+ *
+ * @param  path Input file path.
+ * @param  trip Output matrix.
+ * @param  err  Error message on failure.
+ * @return      True on success.
+ */
+
+template<class T>
+bool ReadSynapseGraph(const string& path, TripletMat<T>& trip, string& err)
+{
+    size_t size         = 0;
+    const uint8_t* data = MapFileReadOnly(path, size);
+
+    if (data == NULL)
+    {
+        err = "Couldn't map " + path;
+        return false;
+    }
+
+    bool bOk = false;
+
+    if (size >= sizeof(edgeListMagic) && memcmp(data, edgeListMagic, sizeof(edgeListMagic)) == 0)
+    {
+        bOk = ParseEdgeList(data, size, trip, err);
+    }
+    else
+    {
+        MatrixMarketHeader header;
+        bOk = ParseMatrixMarketHeader((const char*)data, size, header, err) &&
+            ParseMatrixMarketBody((const char*)data, size, header, trip, err);
+    }
+
+    UnmapFile(data, size);
+
+    if (!bOk) err = path + ": " + err;
+    trip.name = path;
+
+    return bOk;
+}
+
+/**
+ * ReadSynapseGraph - Read a synapse matrix straight into compressed sparse form through the
+ * parallel TripletMat::toCSC.
+ *
+ * @param  path Input file path.
+ * @param  csc  Output matrix.
+ * @param  err  Error message on failure.
+ * @return      True on success.
+ */
+
+template<class T>
+bool ReadSynapseGraph(const string& path, CSCMat<T>& csc, string& err)
+{
+    TripletMat<T> trip;
+    if (!ReadSynapseGraph(path, trip, err)) return false;
+
+    csc = trip.toCSC();
+    return true;
+}
+
+/**
+ * OpenGraphFile - Open an output file for the graph writers.
+ *
+ * @param  path Output file path.
+ * @param  err  Error message on failure.
+ * @return      Open file, NULL on failure.
+ */
+
+inline FILE* OpenGraphFile(const string& path, string& err)
+{
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == NULL) err = "Couldn't open " + path + " for writing";
+    return f;
+}
+
+/**
+ * CloseGraphFile - Close an output file, folding in close errors.
+ *
+ * @param  f    File to close.
+ * @param  bOk  Whether writing succeeded so far.
+ * @param  path Output file path.
+ * @param  err  Error message on failure.
+ * @return      True if writing and closing succeeded.
+ */
+
+inline bool CloseGraphFile(FILE* f, bool bOk, const string& path, string& err)
+{
+    if (fclose(f) != 0) bOk = false;
+    if (!bOk) err = "Couldn't write " + path;
+    return bOk;
+}
+
+/**
+ * WriteMatrixMarket - Write a triplet matrix as a general real coordinate Matrix Market file,
+ * entries in their current order. Lines are formatted in parallel chunks.
+ *
+ * @param  path Output file path.
+ * @param  trip Matrix to write.
+ * @param  err  Error message on failure.
+ * @return      True on success.
+ */
+
+template<class T>
+bool WriteMatrixMarket(const string& path, const TripletMat<T>& trip, string& err)
+{
+    PROFILE_ZONE_WORK("WriteMatrixMarket", trip.entries.size(), "nnz");
+
+    FILE* f = OpenGraphFile(path, err);
+    if (f == NULL) return false;
+
+    bool bOk = fprintf(f, "%%%%MatrixMarket matrix coordinate real general\n%u %u %zu\n", trip.n, trip.m,
+        trip.entries.size()) > 0;
+
+    bOk = bOk && WriteTextChunks(f, trip.entries.size(), [&](size_t begin, size_t end, string& out)
+    {
+        char line[96];
+
+        for (size_t i = begin; i < end; i++)
+        {
+            const Triplet<T>& e = trip.entries[i];
+            out.append(line, FormatEdgeLine(line, e.r + 1, e.c + 1, e.val));
+        }
+    });
+
+    return CloseGraphFile(f, bOk, path, err);
+}
+
+/**
+ * WriteMatrixMarket - Write a compressed sparse matrix as a general real coordinate Matrix
+ * Market file in row-major order. Each parallel chunk is a range of entries, it finds its
+ * starting row with a binary search on the row offsets.
+ *
+ * @param  path Output file path.
+ * @param  csc  Matrix to write.
+ * @param  err  Error message on failure.
+ * @return      True on success.
+ */
+
+template<class T>
+bool WriteMatrixMarket(const string& path, const CSCMat<T>& csc, string& err)
+{
+    PROFILE_ZONE_WORK("WriteMatrixMarket", csc.vals.size(), "nnz");
+
+    FILE* f = OpenGraphFile(path, err);
+    if (f == NULL) return false;
+
+    bool bOk = fprintf(f, "%%%%MatrixMarket matrix coordinate real general\n%u %u %zu\n", csc.n, csc.m,
+        csc.vals.size()) > 0;
+
+    bOk = bOk && WriteTextChunks(f, csc.vals.size(), [&](size_t begin, size_t end, string& out)
+    {
+        char line[96];
+        uint32_t r = (uint32_t)(upper_bound(csc.offsets.begin(), csc.offsets.end(), (uint32_t)begin) - csc.offsets.begin()) - 1;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            while (csc.offsets[r + 1] <= i) r++;
+            out.append(line, FormatEdgeLine(line, r + 1, csc.colIdcs[i] + 1, csc.vals[i]));
+        }
+    });
+
+    return CloseGraphFile(f, bOk, path, err);
+}
+
+/**
+ * WriteEdgeList - Write a triplet matrix as a binary edge list.
+ *
+ * @param  path Output file path.
+ * @param  trip Matrix to write.
+ * @param  err  Error message on failure.
+ * @return      True on success.
+ */
+
+template<class T>
+bool WriteEdgeList(const string& path, const TripletMat<T>& trip, string& err)
+{
+    PROFILE_ZONE_WORK("WriteEdgeList", trip.entries.size(), "edge");
+
+    static_assert(sizeof(Triplet<T>) == 2 * sizeof(uint32_t) + sizeof(T), "Edge records must be packed");
+
+    FILE* f = OpenGraphFile(path, err);
+    if (f == NULL) return false;
+
+    EdgeListHeader header   = {};
+    memcpy(header.magic, edgeListMagic, sizeof(header.magic));
+
+    header.version          = edgeListVersion;
+    header.valBytes         = sizeof(T);
+    header.n                = trip.n;
+    header.m                = trip.m;
+    header.count            = trip.entries.size();
+
+    bool bOk = fwrite(&header, sizeof(header), 1, f) == 1;
+    bOk = bOk && fwrite(trip.entries.data(), sizeof(Triplet<T>), trip.entries.size(), f) == trip.entries.size();
+
+    return CloseGraphFile(f, bOk, path, err);
+}
+
+/**
+ * WriteEdgeList - Write a compressed sparse matrix as a binary edge list in row-major order.
+ * Records are expanded from the CSR arrays in parallel, a block at a time.
+ *
+ * @param  path Output file path.
+ * @param  csc  Matrix to write.
+ * @param  err  Error message on failure.
+ * @return      True on success.
+ */
+
+template<class T>
+bool WriteEdgeList(const string& path, const CSCMat<T>& csc, string& err)
+{
+    PROFILE_ZONE_WORK("WriteEdgeList", csc.vals.size(), "edge");
+
+    FILE* f = OpenGraphFile(path, err);
+    if (f == NULL) return false;
+
+    EdgeListHeader header   = {};
+    memcpy(header.magic, edgeListMagic, sizeof(header.magic));
+
+    header.version          = edgeListVersion;
+    header.valBytes         = sizeof(T);
+    header.n                = csc.n;
+    header.m                = csc.m;
+    header.count            = csc.vals.size();
+
+    bool bOk = fwrite(&header, sizeof(header), 1, f) == 1;
+
+    size_t nnz          = csc.vals.size();
+    size_t blockSize    = (size_t)GetNumThreads() * graphChunkEdges;
+    vector<Triplet<T>> block;
+
+    for (size_t blockBegin = 0; blockBegin < nnz && bOk; blockBegin += blockSize)
+    {
+        size_t blockEnd     = min(nnz, blockBegin + blockSize);
+        uint32_t numChunks  = (uint32_t)((blockEnd - blockBegin + graphChunkEdges - 1) / graphChunkEdges);
+
+        block.resize(blockEnd - blockBegin);
+
+        ParallelFor(0, numChunks, 1, [&](uint32_t chBegin, uint32_t chEnd)
+        {
+            size_t begin    = blockBegin + (size_t)chBegin * graphChunkEdges;
+            size_t end      = min(blockEnd, blockBegin + (size_t)chEnd * graphChunkEdges);
+            uint32_t r      = (uint32_t)(upper_bound(csc.offsets.begin(), csc.offsets.end(), (uint32_t)begin) - csc.offsets.begin()) - 1;
+
+            for (size_t i = begin; i < end; i++)
+            {
+                while (csc.offsets[r + 1] <= i) r++;
+                block[i - blockBegin] = { r, csc.colIdcs[i], csc.vals[i] };
+            }
+        });
+
+        bOk = fwrite(block.data(), sizeof(Triplet<T>), block.size(), f) == block.size();
+    }
+
+    return CloseGraphFile(f, bOk, path, err);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+enum JsonType
+{
+    JSON_NULL,
+    JSON_BOOL,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+};
+
+struct JsonValue
+{
+    JsonType type;
+    bool boolean;
+    double number;
+    string str;
+    vector<JsonValue> array;
+    vector<pair<string, JsonValue>> object;
+
+    JsonValue() : type(JSON_NULL), boolean(false), number(0.0) {}
+    JsonValue(bool b) : type(JSON_BOOL), boolean(b), number(0.0) {}
+    JsonValue(double d) : type(JSON_NUMBER), boolean(false), number(d) {}
+    JsonValue(const string& s) : type(JSON_STRING), boolean(false), number(0.0), str(s) {}
+    JsonValue(const char* s) : type(JSON_STRING), boolean(false), number(0.0), str(s) {}
+
+    static JsonValue Array() { JsonValue v; v.type = JSON_ARRAY; return v; }
+    static JsonValue Object() { JsonValue v; v.type = JSON_OBJECT; return v; }
+
+    const JsonValue* Find(const string& key) const;
+    JsonValue& operator[](const string& key);
+};
+
+bool ParseJson(const string& text, JsonValue& value, string& err);
+bool ReadJsonFile(const string& path, JsonValue& value, string& err);
+void WriteJson(FILE* f, const JsonValue& value, uint32_t indent = 0);
+bool WriteJsonFile(const string& path, const JsonValue& value);
@@ -1,26 +1,222 @@
 #pragma once
 
 #include "ftwt.h"
+#include "parallel.h"
+#include "spmv.h"
 
 static const uint32_t maxPrint = 10;
+static const uint32_t rowGrain = 256;
+static const size_t spmvParallelNnz = 1 << 16;
+template<class T> struct Triplet;
 template<class T> struct TripletMat;
 
+enum SparseFormat
+{
+    SPARSE_AUTO,
+    SPARSE_CSR,
+    SPARSE_SELL,
+    SPARSE_BSR,
+    SPARSE_DENSE,
+    SPARSE_FIXED16,
+    SPARSE_FIXED16_I32,
+    SPARSE_DYNAMIC,
+    SPARSE_EIGEN
+};
+
+/**
+ * CompactRows - Stream compaction of CSR entries in place. Each thread filters its own
+ * rows down to the front of its range and counts survivors per row, the compacted ranges
+ * are then shifted down in order and the counts prefix summed into new offsets. Survivors
+ * keep their order, so rows stay sorted and nothing is re-sorted.
+ *
+ * @param  offsets   Row offsets (n + 1 entries), replaced by the compacted offsets.
+ * @param  n         Number of rows.
+ * @param  keep      keep(i), whether entry i survives.
+ * @param  moveEntry moveEntry(dst, src), copy entry src to slot dst (dst <= src).
+ * @return           Number of surviving entries, the caller shrinks its arrays to this.
+ */
+
+template<class OffT, class KeepFn, class MoveFn>
+inline size_t CompactRows(vector<OffT>& offsets, uint32_t n, const KeepFn& keep, const MoveFn& moveEntry)
+{
+    uint32_t numParts = offsets[n] < spmvParallelNnz ? 1 : GetNumThreads();
+    vector<uint32_t> bounds(numParts + 1);
+    vector<size_t> partKept(numParts);
+    vector<OffT> newOffsets((size_t)n + 1);
+
+    PartitionRowsByNnz(offsets.data(), n, numParts, bounds.data());
+
+    ParallelRun(numParts, [&](uint32_t part)
+    {
+        size_t dst = offsets[bounds[part]];
+
+        for (uint32_t r = bounds[part]; r < bounds[part + 1]; r++)
+        {
+            size_t rowBegin = dst;
+
+            for (size_t i = offsets[r]; i < offsets[r + 1]; i++)
+            {
+                if (!keep(i)) continue;
+                if (dst != i) moveEntry(dst, i);
+                dst++;
+            }
+
+            newOffsets[r] = (OffT)(dst - rowBegin);
+        }
+
+        partKept[part] = dst - offsets[bounds[part]];
+    });
+
+    // Ranges only ever move down and are shifted in order, so no range is overwritten
+    // before it has been moved. Only survivors are touched.
+
+    size_t dst = partKept[0];
+
+    for (uint32_t part = 1; part < numParts; part++)
+    {
+        size_t src = offsets[bounds[part]];
+        if (dst != src) for (size_t i = 0; i < partKept[part]; i++) moveEntry(dst + i, src + i);
+        dst += partKept[part];
+    }
+
+    newOffsets[n]   = 0;
+    size_t nnz      = ExclusiveScan(newOffsets.data(), (size_t)n + 1);
+    offsets         = move(newOffsets);
+
+    return nnz;
+}
+
+static const uint32_t activeRowGrain = 4;
+static const size_t pairFusedBytes  = 1 << 23;
+
+template<class T>
+struct ActiveRows
+{
+    vector<uint32_t> rows;
+    vector<uint32_t> offsets;
+    vector<pair<uint32_t, T>> entries;
+    uint32_t batchSize;
+
+    /**
+     * ActiveRows::ActiveRows - Sparse postsynaptic activations of a batch grouped by neuron.
+     * rows lists every neuron active in some batch entry in ascending order, and neuron
+     * rows[i] has its (batch entry, activation) pairs at entries[offsets[i], offsets[i + 1]).
+     * Pairing kernels walk these rows only, instead of checking every row of every batch
+     * entry.
+     */
+
+    ActiveRows() : batchSize(0) {}
+
+    /**
+     * ActiveRows::build - Group per batch entry activation lists by neuron. Zero activations
+     * are dropped. Lists are one-hot in training, so a sort of the flattened entries is
+     * cheap next to any kernel that uses them.
+     *
+     * @param acts Nonzero (neuron, activation) pairs per batch entry.
+     */
+
+    void build(const vector<vector<pair<uint32_t, T>>>& acts)
+    {
+        batchSize = (uint32_t)acts.size();
+
+        vector<Triplet<T>> flat;
+
+        for (uint32_t bat = 0; bat < batchSize; bat++)
+        {
+            for (auto& act : acts[bat])
+            {
+                if (act.second != 0) flat.push_back({ act.first, bat, act.second });
+            }
+        }
+
+        sort(flat.begin(), flat.end(), [](const Triplet<T>& a, const Triplet<T>& b)
+        {
+            return a.r < b.r || (a.r == b.r && a.c < b.c);
+        });
+
+        rows.clear();
+        offsets.clear();
+        entries.resize(flat.size());
+
+        for (size_t i = 0; i < flat.size(); i++)
+        {
+            if (i == 0 || flat[i].r != flat[i - 1].r)
+            {
+                rows.push_back(flat[i].r);
+                offsets.push_back((uint32_t)i);
+            }
+
+            entries[i] = { flat[i].c, flat[i].val };
+        }
+
+        offsets.push_back((uint32_t)flat.size());
+    }
+
+    /**
+     * ActiveRows::size - Number of active neurons.
+     *
+     * @return Active neuron count.
+     */
+
+    uint32_t size() const { return (uint32_t)rows.size(); }
+};
+
+/**
+ * TransposeBatchTiles - Copy numTiles tiles of pairBatchTile batch entries of activations
+ * into neuron-major order, neuron i's activations for the tiles at
+ * tiles[i * numTiles * pairBatchTile]. Entries past the end of the batch are zero.
+ *
+ * @param acts       Activations per batch entry.
+ * @param b0         First batch entry of the first tile.
+ * @param numTiles   Number of tiles.
+ * @param numNeurons Neurons per batch entry.
+ * @param scale      Scale applied to every activation.
+ * @param tiles      Output tiles, resized to numNeurons * numTiles * pairBatchTile.
+ */
+
 template<class T>
+inline void TransposeBatchTiles(const vector<vector<T>>& acts, uint32_t b0, uint32_t numTiles, uint32_t numNeurons,
+    T scale, vector<T>& tiles)
+{
+    uint32_t stride = numTiles * pairBatchTile;
+    uint32_t cnt    = min(stride, (uint32_t)acts.size() - b0);
+
+    tiles.resize((size_t)numNeurons * stride);
+
+    ParallelFor(0, numNeurons, max(rowGrain * 16 / numTiles, 1u), [&](uint32_t iBegin, uint32_t iEnd)
+    {
+        for (uint32_t i = iBegin; i < iEnd; i++)
+        {
+            T* out = &tiles[(size_t)i * stride];
+            for (uint32_t j = 0; j < cnt; j++) out[j] = scale * acts[b0 + j][i];
+            for (uint32_t j = cnt; j < stride; j++) out[j] = 0;
+        }
+    });
+}
+
+template<class T, class IdxT = uint32_t, class OffT = uint32_t>
 struct CSCMat
 {
     vector<T> vals;
-    vector<uint32_t> colIdcs;
-    vector<uint32_t> offsets;
+    vector<IdxT> colIdcs;
+    vector<OffT> offsets;
+    vector<uint8_t> colDeltas;
+    vector<OffT> deltaOffsets;
+    vector<uint8_t> deltaWidths;
+    vector<IdxT> deltaBases;
 
     uint32_t n;
     uint32_t m;
+    bool bDeltaIdcs;
     string name;
 
     /**
-     * CSCMat::CSCMat - Compressed sparse matrix default contructor.
+     * CSCMat::CSCMat - Compressed sparse matrix default contructor. IdxT is the column
+     * index type (uint16_t halves index traffic for nets under 64K neurons), OffT the row
+     * offset type (uint64_t for more than 4B synapses).
      */
     
-    CSCMat() : n(0), m(0), name("") {}
+    CSCMat() : n(0), m(0), bDeltaIdcs(false), name("") {}
     
     /**
      * CSCMat::CSCMat - Compressed sparse matrix constructor.
@@ -30,7 +226,10 @@ struct CSCMat
      * @param name Name of matrix, used when printing.
      */
     
-    CSCMat(uint32_t rows, uint32_t cols, string name) : n(rows), m(cols), name(name) {}
+    CSCMat(uint32_t rows, uint32_t cols, string name) : n(rows), m(cols), bDeltaIdcs(false), name(name)
+    {
+        assert(cols == 0 || (uint64_t)(cols - 1) <= (uint64_t)numeric_limits<IdxT>::max());
+    }
 
     /**
      * CSCMat::print Print CSC matrix's entries.
@@ -44,43 +243,545 @@ struct CSCMat
 
         printf("CSC Matrix - %s:\n", name.c_str());
 
-        for (uint32_t i = 0; i < vals.size(); i++)
+        for (size_t i = 0; i < vals.size(); i++)
         {
             if (i >= maxPrint && bAll == false) break;       
             while (i == offsets[r + 1]) r++;
-            printf("(%d, %d): %g\n", r, colIdcs[i], vals[i]);
+            printf("(%d, %d): %g\n", r, (uint32_t)colIdcs[i], vals[i]);
         }
 
         printf("\n");
     }
 
     /**
-     * CSCMat::operator+= - Add two CSC matrices together. Add both matrices' entries to
-     * a triplet matrix. Sort and merge the triplet matrix, then convert back to
-     * CSC matrix.
+     * CSCMat::convertIndices - Copy this matrix with different index and offset types.
+     *
+     * @return Matrix with the same entries, IdxT2 column indices and OffT2 offsets.
+     */
+
+    template<class IdxT2, class OffT2>
+    CSCMat<T, IdxT2, OffT2> convertIndices() const
+    {
+        CSCMat<T, IdxT2, OffT2> res(n, m, name);
+        assert((uint64_t)vals.size() <= (uint64_t)numeric_limits<OffT2>::max());
+
+        res.vals = vals;
+        res.colIdcs.assign(colIdcs.begin(), colIdcs.end());
+        res.offsets.assign(offsets.begin(), offsets.end());
+
+        if (bDeltaIdcs) res.encodeColDeltas();
+        return res;
+    }
+
+    /**
+     * CSCMat::encodeColDeltas - Build the delta encoded column index stream. Each row keeps
+     * its first column as a base and stores one gap per entry (0 for the first) in 1, 2 or
+     * 4 bytes, whichever fits its largest gap. Once built, multiply and computePairings read
+     * the stream instead of colIdcs, and structural changes (+=, cull) rebuild it. colIdcs
+     * is kept for everything else.
+     */
+
+    void encodeColDeltas()
+    {
+        PROFILE_ZONE_WORK("CSCMat::encodeColDeltas", vals.size(), "nnz");
+
+        bDeltaIdcs = true;
+        deltaOffsets.assign((size_t)n + 1, 0);
+        deltaWidths.resize(n);
+        deltaBases.resize(n);
+
+        // Gap width per row, then bytes per row padded so every row starts aligned to its
+        // width (rows are laid out in order, widths are at most 4).
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                uint64_t maxGap = 0;
+
+                for (OffT i = offsets[r] + 1; i < offsets[r + 1]; i++)
+                {
+                    maxGap = max(maxGap, (uint64_t)(colIdcs[i] - colIdcs[i - 1]));
+                }
+
+                deltaWidths[r]  = maxGap <= 0xff ? 1 : maxGap <= 0xffff ? 2 : 4;
+                deltaBases[r]   = offsets[r + 1] > offsets[r] ? colIdcs[offsets[r]] : 0;
+                deltaOffsets[r] = (OffT)(offsets[r + 1] - offsets[r]) * deltaWidths[r];
+            }
+        });
+
+        OffT totalBytes = 0;
+
+        for (uint32_t r = 0; r < n; r++)
+        {
+            OffT width      = deltaWidths[r];
+            OffT bytes      = deltaOffsets[r];
+            totalBytes      = (totalBytes + width - 1) / width * width;
+            deltaOffsets[r] = totalBytes;
+            totalBytes      += bytes;
+        }
+
+        deltaOffsets[n] = totalBytes;
+        colDeltas.assign(totalBytes, 0);
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                uint8_t* gaps = colDeltas.data() + deltaOffsets[r];
+
+                for (OffT i = offsets[r] + 1, j = 1; i < offsets[r + 1]; i++, j++)
+                {
+                    uint32_t gap = (uint32_t)(colIdcs[i] - colIdcs[i - 1]);
+
+                    switch (deltaWidths[r])
+                    {
+                    case 1:     gaps[j] = (uint8_t)gap; break;
+                    case 2:     ((uint16_t*)gaps)[j] = (uint16_t)gap; break;
+                    default:    ((uint32_t*)gaps)[j] = gap; break;
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * CSCMat::clearColDeltas - Drop the delta encoded column index stream, kernels go back
+     * to reading colIdcs.
+     */
+
+    void clearColDeltas()
+    {
+        bDeltaIdcs = false;
+        colDeltas.clear();
+        deltaOffsets.clear();
+        deltaWidths.clear();
+        deltaBases.clear();
+    }
+
+    /**
+     * CSCMat::indexBytes - Column index bytes the SpMV and pairing kernels stream per pass.
+     *
+     * @return Delta stream size plus per row widths and bases if built, otherwise colIdcs
+     *         size.
+     */
+
+    size_t indexBytes() const
+    {
+        return bDeltaIdcs ? colDeltas.size() + (size_t)n * (1 + sizeof(IdxT)) : colIdcs.size() * sizeof(IdxT);
+    }
+
+    /**
+     * CSCMat::operator+= - Add two CSC matrices together. Both matrices keep columns sorted
+     * within each row, so each output row is a two-pointer merge of the input rows. A first
+     * pass counts merged row lengths in parallel. If they add up to this matrix's nnz, rhs's
+     * pattern is a subset of ours and its values are added in place. Otherwise a prefix sum
+     * of the counts gives the output offsets and rows are merged in parallel into
+     * preallocated arrays.
      *
      * @param rhs CSC matrix to add to this one. 
      */
     
-    void operator+=(const CSCMat<T>& rhs)
+    void operator+=(const CSCMat& rhs)
     {
+        PROFILE_ZONE_WORK("CSCMat::operator+=", vals.size() + rhs.vals.size(), "nnz");
         assert(rhs.n == n && rhs.m == m);
 
-        TripletMat<T> tmat = toTriplet();
+        vector<OffT> mergedOffsets(n + 1, 0);
 
-        for (uint32_t r = 0; r < rhs.n; r++)
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
         {
-            for (uint32_t i = rhs.offsets[r]; i < rhs.offsets[r + 1]; i++)
+            for (uint32_t r = rBegin; r < rEnd; r++)
             {
-                tmat.insert({ r, rhs.colIdcs[i], rhs.vals[i] });
+                OffT i      = offsets[r];
+                OffT j      = rhs.offsets[r];
+                OffT cnt    = 0;
+
+                while (i < offsets[r + 1] && j < rhs.offsets[r + 1])
+                {
+                    IdxT ci = colIdcs[i];
+                    IdxT cj = rhs.colIdcs[j];
+
+                    i += ci <= cj;
+                    j += cj <= ci;
+                    cnt++;
+                }
+
+                mergedOffsets[r] = cnt + (offsets[r + 1] - i) + (rhs.offsets[r + 1] - j);
+            }
+        });
+
+        OffT mergedNnz = ExclusiveScan(&mergedOffsets[0], n + 1);
+
+        // Subset pattern, every rhs entry lands on one of ours.
+
+        if (mergedNnz == vals.size())
+        {
+            ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+            {
+                for (uint32_t r = rBegin; r < rEnd; r++)
+                {
+                    OffT i = offsets[r];
+
+                    for (OffT j = rhs.offsets[r]; j < rhs.offsets[r + 1]; j++)
+                    {
+                        while (colIdcs[i] != rhs.colIdcs[j]) i++;
+                        vals[i] += rhs.vals[j];
+                    }
+                }
+            });
+
+            return;
+        }
+
+        vector<T> mergedVals(mergedNnz);
+        vector<IdxT> mergedColIdcs(mergedNnz);
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                OffT i      = offsets[r];
+                OffT j      = rhs.offsets[r];
+                OffT iEnd   = offsets[r + 1];
+                OffT jEnd   = rhs.offsets[r + 1];
+                OffT out    = mergedOffsets[r];
+
+                while (i < iEnd && j < jEnd)
+                {
+                    IdxT ci = colIdcs[i];
+                    IdxT cj = rhs.colIdcs[j];
+
+                    if (ci < cj)
+                    {
+                        mergedColIdcs[out]  = ci;
+                        mergedVals[out]     = vals[i++];
+                    }
+                    else if (cj < ci)
+                    {
+                        mergedColIdcs[out]  = cj;
+                        mergedVals[out]     = rhs.vals[j++];
+                    }
+                    else
+                    {
+                        mergedColIdcs[out]  = ci;
+                        mergedVals[out]     = vals[i++] + rhs.vals[j++];
+                    }
+
+                    out++;
+                }
+
+                for (; i < iEnd; i++, out++)
+                {
+                    mergedColIdcs[out]  = colIdcs[i];
+                    mergedVals[out]     = vals[i];
+                }
+
+                for (; j < jEnd; j++, out++)
+                {
+                    mergedColIdcs[out]  = rhs.colIdcs[j];
+                    mergedVals[out]     = rhs.vals[j];
+                }
+            }
+        });
+
+        vals.swap(mergedVals);
+        colIdcs.swap(mergedColIdcs);
+        offsets.swap(mergedOffsets);
+
+        if (bDeltaIdcs) encodeColDeltas();
+    }
+
+    /**
+     * CSCMat::multiplyMat - Sparse matrix * sparse matrix with Gustavson's row-wise method,
+     * output row r is the sum of rhs's rows scaled by the entries of our row r. Rows are
+     * split into ranges of equal multiply-add count. A symbolic pass counts each output
+     * row's distinct columns with a per-range marker array, a prefix sum sizes the output,
+     * then a numeric pass accumulates each row in a dense per-range accumulator and writes
+     * it column-sorted straight into place. With a prune threshold, weak entries are dropped
+     * as each row is written out and the output is sized from the kept counts, which keeps
+     * fill-in bounded when chaining products without allocating it first.
+     *
+     * @param  rhs         Right hand matrix (m rows).
+     * @param  pruneThresh Smallest output magnitude kept, 0 keeps every structural entry.
+     * @return             Product, n x rhs.m, plain column indices.
+     */
+
+    CSCMat multiplyMat(const CSCMat& rhs, T pruneThresh = 0) const
+    {
+        PROFILE_ZONE_WORK("CSCMat::multiplyMat", vals.size() + rhs.vals.size(), "nnz");
+        assert(rhs.n == m);
+
+        CSCMat res(n, rhs.m, name + " * " + rhs.name);
+
+        // Multiply-adds per row, scanned into running totals to partition rows by.
+
+        vector<uint64_t> rowFlops((size_t)n + 1, 0);
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                for (OffT i = offsets[r]; i < offsets[r + 1]; i++)
+                {
+                    rowFlops[r] += rhs.offsets[colIdcs[i] + 1] - rhs.offsets[colIdcs[i]];
+                }
+            }
+        });
+
+        uint64_t totalFlops = ExclusiveScan(rowFlops.data(), (size_t)n + 1);
+        uint32_t numParts   = totalFlops < spmvParallelNnz ? 1 : GetNumThreads();
+        vector<uint32_t> bounds(numParts + 1);
+
+        PartitionRowsByNnz(rowFlops.data(), n, numParts, bounds.data());
+
+        // Accumulates output row r into acc, leaving its distinct columns sorted in rowCols.
+
+        auto accumulateRow = [&](uint32_t r, vector<T>& acc, vector<uint32_t>& marker, vector<IdxT>& rowCols)
+        {
+            rowCols.clear();
+
+            for (OffT i = offsets[r]; i < offsets[r + 1]; i++)
+            {
+                IdxT k  = colIdcs[i];
+                T a     = vals[i];
+
+                for (OffT j = rhs.offsets[k]; j < rhs.offsets[k + 1]; j++)
+                {
+                    IdxT c = rhs.colIdcs[j];
+
+                    if (marker[c] == r)
+                    {
+                        acc[c] += a * rhs.vals[j];
+                        continue;
+                    }
+
+                    marker[c]   = r;
+                    acc[c]      = a * rhs.vals[j];
+                    rowCols.push_back(c);
+                }
+            }
+
+            sort(rowCols.begin(), rowCols.end());
+        };
+
+        vector<uint64_t> rowNnz((size_t)n + 1, 0);
+
+        if (pruneThresh > 0)
+        {
+            // Kept entries are only known after accumulating, so each range buffers its
+            // surviving entries and the output is sized from the kept counts.
+
+            vector<vector<IdxT>> partCols(numParts);
+            vector<vector<T>> partVals(numParts);
+
+            ParallelRun(numParts, [&](uint32_t part)
+            {
+                vector<T> acc(rhs.m);
+                vector<uint32_t> marker(rhs.m, UINT32_MAX);
+                vector<IdxT> rowCols;
+
+                for (uint32_t r = bounds[part]; r < bounds[part + 1]; r++)
+                {
+                    accumulateRow(r, acc, marker, rowCols);
+
+                    for (IdxT c : rowCols)
+                    {
+                        if (abs(acc[c]) < pruneThresh) continue;
+
+                        partCols[part].push_back(c);
+                        partVals[part].push_back(acc[c]);
+                        rowNnz[r]++;
+                    }
+                }
+            });
+
+            uint64_t resNnz = ExclusiveScan(rowNnz.data(), (size_t)n + 1);
+            assert(resNnz <= (uint64_t)numeric_limits<OffT>::max());
+
+            res.offsets.assign(rowNnz.begin(), rowNnz.end());
+            res.colIdcs.resize((size_t)resNnz);
+            res.vals.resize((size_t)resNnz);
+
+            ParallelRun(numParts, [&](uint32_t part)
+            {
+                OffT out = res.offsets[bounds[part]];
+
+                copy(partCols[part].begin(), partCols[part].end(), res.colIdcs.begin() + out);
+                copy(partVals[part].begin(), partVals[part].end(), res.vals.begin() + out);
+            });
+
+            return res;
+        }
+
+        ParallelRun(numParts, [&](uint32_t part)
+        {
+            vector<uint32_t> marker(rhs.m, UINT32_MAX);
+
+            for (uint32_t r = bounds[part]; r < bounds[part + 1]; r++)
+            {
+                for (OffT i = offsets[r]; i < offsets[r + 1]; i++)
+                {
+                    IdxT k = colIdcs[i];
+
+                    for (OffT j = rhs.offsets[k]; j < rhs.offsets[k + 1]; j++)
+                    {
+                        IdxT c = rhs.colIdcs[j];
+                        if (marker[c] == r) continue;
+
+                        marker[c] = r;
+                        rowNnz[r]++;
+                    }
+                }
+            }
+        });
+
+        uint64_t resNnz = ExclusiveScan(rowNnz.data(), (size_t)n + 1);
+        assert(resNnz <= (uint64_t)numeric_limits<OffT>::max());
+
+        res.offsets.assign(rowNnz.begin(), rowNnz.end());
+        res.colIdcs.resize((size_t)resNnz);
+        res.vals.resize((size_t)resNnz);
+
+        ParallelRun(numParts, [&](uint32_t part)
+        {
+            vector<T> acc(rhs.m);
+            vector<uint32_t> marker(rhs.m, UINT32_MAX);
+            vector<IdxT> rowCols;
+
+            for (uint32_t r = bounds[part]; r < bounds[part + 1]; r++)
+            {
+                accumulateRow(r, acc, marker, rowCols);
+
+                OffT out = res.offsets[r];
+
+                for (IdxT c : rowCols)
+                {
+                    res.colIdcs[out]    = c;
+                    res.vals[out++]     = acc[c];
+                }
+            }
+        });
+
+        return res;
+    }
+
+    /**
+     * CSCMat::power - Raise a square matrix to a power with multiplyMat, by repeated
+     * squaring. Entry (r, c) of W^k sums the weights of all k-synapse paths from c to r.
+     *
+     * @param  k           Power, 0 gives the identity.
+     * @param  pruneThresh Prune threshold passed to every product.
+     * @return             This matrix to the kth power.
+     */
+
+    CSCMat power(uint32_t k, T pruneThresh = 0) const
+    {
+        assert(n == m);
+
+        string resName = name + "^" + to_string(k);
+        CSCMat res(n, n, resName);
+
+        res.offsets.resize((size_t)n + 1);
+        res.colIdcs.resize(n);
+        res.vals.assign(n, (T)1);
+
+        for (uint32_t r = 0; r <= n; r++) res.offsets[r] = (OffT)r;
+        for (uint32_t r = 0; r < n; r++) res.colIdcs[r] = (IdxT)r;
+
+        CSCMat base = *this;
+        bool bFirst = true;
+
+        base.clearColDeltas();
+
+        for (; k > 0; k >>= 1)
+        {
+            if (k & 1)
+            {
+                res     = bFirst ? base : res.multiplyMat(base, pruneThresh);
+                bFirst  = false;
             }
+
+            if (k > 1) base = base.multiplyMat(base, pruneThresh);
         }
 
-        CSCMat csc  = tmat.toCSC();
+        res.name = resName;
+        return res;
+    }
+
+    /**
+     * CSCMat::multiply - Do CSC matrix * vector multiply into a caller provided buffer. Rows
+     * are split into one range per kernel thread with roughly equal nnz, small matrices
+     * run on the calling thread.
+     *
+     * @param x         Vector to multiply by this matrix (m entries).
+     * @param y         Result vector (n entries), overwritten.
+     * @param rowScales Optional per row scale applied to each result, see
+     *                  hebbianUpdateScaled.
+     */
+    
+    void multiply(const T* x, T* y, const T* rowScales = nullptr) const
+    {
+        PROFILE_KERNEL("CSCMat::multiply", 2 * vals.size(),
+            vals.size() * sizeof(T) + indexBytes() + (n + 1) * sizeof(OffT) + (n + m) * sizeof(T), vals.size(), "nnz");
+
+        if (n == 0) return;
+
+        uint32_t numParts = vals.size() < spmvParallelNnz ? 1 : GetNumThreads();
+        vector<uint32_t> bounds(numParts + 1);
+        PartitionRowsByNnz(offsets.data(), n, numParts, bounds.data());
+
+        ParallelRun(numParts, [&](uint32_t part)
+        {
+            if (bDeltaIdcs)
+            {
+                DeltaSpMVRows(vals.data(), colDeltas.data(), deltaOffsets.data(), deltaWidths.data(),
+                    deltaBases.data(), offsets.data(), x, y, bounds[part], bounds[part + 1]);
+            }
+            else
+            {
+                SpMVRows(vals.data(), colIdcs.data(), offsets.data(), x, y, bounds[part], bounds[part + 1]);
+            }
+
+            if (!rowScales) return;
+            for (uint32_t r = bounds[part]; r < bounds[part + 1]; r++) y[r] *= rowScales[r];
+        });
+    }
+
+    /**
+     * CSCMat::multiplyBlock - Multiply a block of k vectors at once, Y = A * X. X and Y are
+     * row-major so the matrix is streamed from memory once per block instead of once per
+     * vector. Rows are split across kernel threads by nnz like multiply.
+     *
+     * @param x         Input block (m x k, row-major).
+     * @param y         Result block (n x k, row-major), overwritten.
+     * @param k         Number of vectors in the block.
+     * @param rowScales Optional per row scale applied to each result row.
+     */
+    
+    void multiplyBlock(const T* x, T* y, uint32_t k, const T* rowScales = nullptr) const
+    {
+        PROFILE_KERNEL("CSCMat::multiplyBlock", 2 * vals.size() * k,
+            vals.size() * (sizeof(T) + sizeof(IdxT)) + (n + 1) * sizeof(OffT) + (size_t)(n + m) * k * sizeof(T),
+            vals.size() * k, "nnz");
+
+        if (n == 0) return;
+
+        uint32_t numParts = vals.size() * k < spmvParallelNnz ? 1 : GetNumThreads();
+        vector<uint32_t> bounds(numParts + 1);
+        PartitionRowsByNnz(offsets.data(), n, numParts, bounds.data());
+
+        ParallelRun(numParts, [&](uint32_t part)
+        {
+            SpMMRows(vals.data(), colIdcs.data(), offsets.data(), x, y, k, bounds[part], bounds[part + 1]);
+
+            if (!rowScales) return;
 
-        vals        = csc.vals;
-        colIdcs     = csc.colIdcs;
-        offsets     = csc.offsets;
+            for (uint32_t r = bounds[part]; r < bounds[part + 1]; r++)
+            {
+                for (uint32_t j = 0; j < k; j++) y[(size_t)r * k + j] *= rowScales[r];
+            }
+        });
     }
 
     /**
@@ -91,20 +792,463 @@ struct CSCMat
      * @return Result of matrix vector multiply.
      */
     
-    vector<T> operator*(const vector<T>& rhs)
+    vector<T> operator*(const vector<T>& rhs) const
     {
         assert(rhs.size() == m);
         vector<T> res(n, 0);
+        multiply(rhs.data(), res.data());
+        return res;
+    }
 
-        for (uint32_t r = 0; r < n; r++)
+    /**
+     * CSCMat::computePairings - Batch averaged pairing of the neurons each entry connects,
+     * pairing = post activation of the entry's row * pre activation of its column. The batch
+     * is walked in tiles of pairBatchTile entries transposed to neuron-major, so every entry
+     * is visited once per tile rather than once per batch entry and its batch sum is a SIMD
+     * dot product. Rows are split across kernel threads by nnz, and rows whose post
+     * activations are zero across a tile are skipped.
+     *
+     * @param pre      Presynaptic activations per batch entry (m entries each).
+     * @param post     Postsynaptic activations per batch entry (n entries each).
+     * @param pairings Output pairings, resized to nnz.
+     */
+    
+    void computePairings(const vector<vector<T>>& pre, const vector<vector<T>>& post, vector<T>& pairings) const
+    {
+        uint32_t batchSize  = (uint32_t)pre.size();
+        size_t nnz          = vals.size();
+        size_t numTiles     = (batchSize + pairBatchTile - 1) / pairBatchTile;
+
+        PROFILE_KERNEL("CSCMat::computePairings", (2 * batchSize + 1) * nnz,
+            numTiles * (indexBytes() + 2 * nnz * sizeof(T) + (n + 1) * sizeof(OffT) +
+            (n + m) * pairBatchTile * sizeof(T)) + batchSize * (n + m) * sizeof(T), batchSize * nnz, "nnz");
+
+        pairings.assign(nnz, 0);
+        if (n == 0 || batchSize == 0) return;
+
+        uint32_t numParts = nnz * batchSize < spmvParallelNnz ? 1 : GetNumThreads();
+        vector<uint32_t> bounds(numParts + 1);
+        PartitionRowsByNnz(offsets.data(), n, numParts, bounds.data());
+
+        vector<T> preTile;
+        vector<T> postTile;
+
+        for (uint32_t b0 = 0; b0 < batchSize; b0 += pairBatchTile)
+        {
+            // The batch average is folded into the post activations.
+
+            TransposeBatchTiles(pre, b0, 1, m, (T)1, preTile);
+            TransposeBatchTiles(post, b0, 1, n, (T)1 / (T)batchSize, postTile);
+
+            ParallelRun(numParts, [&](uint32_t part)
+            {
+                vector<uint32_t> cols;
+
+                for (uint32_t row = bounds[part]; row < bounds[part + 1]; row++)
+                {
+                    const T* postRow    = &postTile[(size_t)row * pairBatchTile];
+                    bool bActive        = false;
+
+                    for (uint32_t j = 0; j < pairBatchTile; j++) bActive |= postRow[j] != 0;
+                    if (!bActive) continue;
+
+                    T* rowPairings  = pairings.data() + offsets[row];
+                    size_t len      = offsets[row + 1] - offsets[row];
+
+                    if (!bDeltaIdcs)
+                    {
+                        TileRowPairings(rowPairings, colIdcs.data() + offsets[row], len, postRow, preTile.data(), 1);
+                        continue;
+                    }
+
+                    decodeRow(row, cols);
+                    TileRowPairings(rowPairings, cols.data(), len, postRow, preTile.data(), 1);
+                }
+            });
+        }
+    }
+
+    /**
+     * CSCMat::computePairings - Batch averaged pairings from sparse post activations. Only
+     * rows with an active post neuron are walked, each once for all of its batch entries,
+     * split across kernel threads. Pairings of other rows are zero. So few rows are read
+     * that colIdcs is used even when the delta stream is built.
+     *
+     * @param pre      Presynaptic activations per batch entry (m entries each).
+     * @param post     Active postsynaptic neurons of the batch.
+     * @param pairings Output pairings, resized to nnz.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const ActiveRows<T>& post, vector<T>& pairings) const
+    {
+        PROFILE_ZONE_WORK("CSCMat::computePairings sparse", post.entries.size(), "entry");
+
+        pairings.assign(vals.size(), 0);
+        T batchSizeInv = (T)1 / (T)post.batchSize;
+
+        ParallelFor(0, post.size(), activeRowGrain, [&](uint32_t aBegin, uint32_t aEnd)
+        {
+            for (uint32_t a = aBegin; a < aEnd; a++)
+            {
+                uint32_t row        = post.rows[a];
+                T* rowPairings      = pairings.data() + offsets[row];
+                size_t len          = offsets[row + 1] - offsets[row];
+                const IdxT* cols    = colIdcs.data() + offsets[row];
+
+                for (uint32_t e = post.offsets[a]; e < post.offsets[a + 1]; e++)
+                {
+                    const T* batPre = pre[post.entries[e].first].data();
+                    T postAct       = post.entries[e].second;
+
+                    for (size_t i = 0; i < len; i++) rowPairings[i] += postAct * batPre[cols[i]];
+                }
+
+                for (size_t i = 0; i < len; i++) rowPairings[i] *= batchSizeInv;
+            }
+        });
+    }
+
+    /**
+     * CSCMat::updateRows - Add scaled pairings to every entry, then normalize each row to
+     * unit L2 norm. Rows are split across kernel threads by nnz.
+     *
+     * @param pairings   Pairing per entry.
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     */
+    
+    void updateRows(const vector<T>& pairings, T learnRate, bool bNormalize = true)
+    {
+        size_t nnz = vals.size();
+
+        PROFILE_KERNEL("CSCMat::updateRows", 5 * nnz + n,
+            5 * nnz * sizeof(T) + 2 * (n + 1) * sizeof(OffT), nnz, "nnz");
+
+        forEachRowRange([&](uint32_t rBegin, uint32_t rEnd)
         {
-            for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++)
+            for (uint32_t row = rBegin; row < rEnd; row++)
             {
-                res[r] += vals[i] * rhs[colIdcs[i]];
+                UpdateRow(vals.data() + offsets[row], pairings.data() + offsets[row],
+                    offsets[row + 1] - offsets[row], learnRate, bNormalize);
             }
+        });
+    }
+
+    /**
+     * CSCMat::hebbianUpdate - One fused Hebbian step, the same result as computePairings
+     * followed by updateRows without a pairings buffer. Each row's pairings are summed over
+     * every batch tile into a row sized scratch buffer, then added to the row's weights and
+     * the row renormalized while it's still in cache. The whole batch is transposed up
+     * front with every tile of a neuron contiguous. Once the transposed pre activations
+     * outgrow pairFusedBytes their random column reads miss cache, so large batches fall
+     * back to computePairings and updateRows.
+     *
+     * @param pre        Presynaptic activations per batch entry (m entries each).
+     * @param post       Postsynaptic activations per batch entry (n entries each).
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     */
+
+    void hebbianUpdate(const vector<vector<T>>& pre, const vector<vector<T>>& post, T learnRate,
+        bool bNormalize = true)
+    {
+        uint32_t batchSize  = (uint32_t)pre.size();
+        size_t nnz          = vals.size();
+        uint32_t numTiles   = (batchSize + pairBatchTile - 1) / pairBatchTile;
+        size_t stride       = (size_t)numTiles * pairBatchTile;
+
+        // Past the budget the transposed batch no longer stays cached alongside the
+        // synapses, and a pass per tile over a separate pairings buffer is faster.
+
+        if ((size_t)m * stride * sizeof(T) > pairFusedBytes)
+        {
+            vector<T> pairings;
+            computePairings(pre, post, pairings);
+            updateRows(pairings, learnRate, bNormalize);
+            return;
         }
 
-        return res;
+        PROFILE_KERNEL("CSCMat::hebbianUpdate", (2 * batchSize + 6) * nnz + n,
+            indexBytes() + 2 * nnz * sizeof(T) + (n + 1) * sizeof(OffT) +
+            2 * (size_t)batchSize * (n + m) * sizeof(T), batchSize * nnz, "nnz");
+
+        if (n == 0 || batchSize == 0) return;
+
+        // The batch average is folded into the post activations.
+
+        vector<T> preTiles;
+        vector<T> postTiles;
+
+        TransposeBatchTiles(pre, 0, numTiles, m, (T)1, preTiles);
+        TransposeBatchTiles(post, 0, numTiles, n, (T)1 / (T)batchSize, postTiles);
+
+        forEachRowRange([&](uint32_t rBegin, uint32_t rEnd)
+        {
+            vector<T> rowPairings;
+            vector<uint32_t> cols;
+
+            for (uint32_t row = rBegin; row < rEnd; row++)
+            {
+                T* rowVals          = vals.data() + offsets[row];
+                size_t len          = offsets[row + 1] - offsets[row];
+                const T* postRow    = &postTiles[row * stride];
+                bool bActive        = false;
+
+                for (size_t j = 0; j < stride; j++) bActive |= postRow[j] != 0;
+
+                if (!bActive)
+                {
+                    if (bNormalize) NormalizeRow(rowVals, len);
+                    continue;
+                }
+
+                rowPairings.assign(len, 0);
+
+                if (bDeltaIdcs)
+                {
+                    decodeRow(row, cols);
+                    TileRowPairings(rowPairings.data(), cols.data(), len, postRow, preTiles.data(), numTiles);
+                }
+                else
+                {
+                    TileRowPairings(rowPairings.data(), colIdcs.data() + offsets[row], len, postRow, preTiles.data(),
+                        numTiles);
+                }
+
+                UpdateRow(rowVals, rowPairings.data(), len, learnRate, bNormalize);
+            }
+        });
+    }
+
+    /**
+     * CSCMat::hebbianUpdate - Fused Hebbian step from sparse post activations. Rows with an
+     * active post neuron sum their pairings into a row sized scratch buffer and are updated
+     * and renormalized in the same visit. Other rows have zero pairings, they're only
+     * renormalized, and left alone when bNormalize is false.
+     *
+     * @param pre        Presynaptic activations per batch entry (m entries each).
+     * @param post       Active postsynaptic neurons of the batch.
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     */
+
+    void hebbianUpdate(const vector<vector<T>>& pre, const ActiveRows<T>& post, T learnRate,
+        bool bNormalize = true)
+    {
+        PROFILE_ZONE_WORK("CSCMat::hebbianUpdate sparse", post.entries.size(), "entry");
+
+        auto updateActiveRow = [&](uint32_t a, vector<T>& rowPairings)
+        {
+            uint32_t row = post.rows[a];
+
+            activeRowPairings(pre, post, a, rowPairings);
+            UpdateRow(vals.data() + offsets[row], rowPairings.data(), rowPairings.size(), learnRate, bNormalize);
+        };
+
+        if (!bNormalize)
+        {
+            ParallelFor(0, post.size(), activeRowGrain, [&](uint32_t aBegin, uint32_t aEnd)
+            {
+                vector<T> rowPairings;
+                for (uint32_t a = aBegin; a < aEnd; a++) updateActiveRow(a, rowPairings);
+            });
+
+            return;
+        }
+
+        forEachRowRange([&](uint32_t rBegin, uint32_t rEnd)
+        {
+            vector<T> rowPairings;
+            uint32_t a = (uint32_t)(lower_bound(post.rows.begin(), post.rows.end(), rBegin) - post.rows.begin());
+
+            for (uint32_t row = rBegin; row < rEnd; row++)
+            {
+                if (a < post.size() && post.rows[a] == row)
+                {
+                    updateActiveRow(a++, rowPairings);
+                    continue;
+                }
+
+                NormalizeRow(vals.data() + offsets[row], offsets[row + 1] - offsets[row]);
+            }
+        });
+    }
+
+    /**
+     * CSCMat::hebbianUpdateScaled - Fused Hebbian step from sparse post activations with
+     * lazy row normalization. Row r's weights are rowScales[r] * vals, and rowSumSq[r] holds
+     * the sum of squares of its stored vals. Active rows fold their scale into the values as
+     * they're updated, so only the active rows' entries are touched. Renormalization sets
+     * every row's scale from its sum of squares, O(rows) instead of O(nnz). Rows with a zero
+     * sum of squares, empty rows included, have no norm and keep unit scale.
+     *
+     * @param pre        Presynaptic activations per batch entry (m entries each).
+     * @param post       Active postsynaptic neurons of the batch.
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     * @param rowScales  Per row weight scale (n entries), updated.
+     * @param rowSumSq   Per row sum of squared stored values (n entries), updated.
+     */
+
+    void hebbianUpdateScaled(const vector<vector<T>>& pre, const ActiveRows<T>& post, T learnRate,
+        bool bNormalize, vector<T>& rowScales, vector<T>& rowSumSq)
+    {
+        PROFILE_ZONE_WORK("CSCMat::hebbianUpdateScaled", post.entries.size(), "entry");
+
+        ParallelFor(0, post.size(), activeRowGrain, [&](uint32_t aBegin, uint32_t aEnd)
+        {
+            vector<T> rowPairings;
+
+            for (uint32_t a = aBegin; a < aEnd; a++)
+            {
+                uint32_t row = post.rows[a];
+
+                activeRowPairings(pre, post, a, rowPairings);
+
+                rowSumSq[row]   = ScaleUpdateRow(vals.data() + offsets[row], rowPairings.data(), rowPairings.size(),
+                    rowScales[row], learnRate);
+                rowScales[row]  = 1;
+            }
+        });
+
+        if (!bNormalize) return;
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                rowScales[r] = rowSumSq[r] == 0 ? (T)1 : (T)1 / sqrt(rowSumSq[r]);
+            }
+        });
+    }
+
+    /**
+     * CSCMat::foldRowScales - Multiply every row's values by its scale, the stored form of
+     * lazily normalized weights.
+     *
+     * @param rowScales Per row scale (n entries).
+     */
+
+    void foldRowScales(const vector<T>& rowScales)
+    {
+        PROFILE_ZONE_WORK("CSCMat::foldRowScales", vals.size(), "nnz");
+
+        forEachRowRange([&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                for (OffT i = offsets[r]; i < offsets[r + 1]; i++) vals[i] *= rowScales[r];
+            }
+        });
+    }
+
+    /**
+     * CSCMat::rowSumSquares - Sum of squared values of every row.
+     *
+     * @param sumSq Output sums, resized to n.
+     */
+
+    void rowSumSquares(vector<T>& sumSq) const
+    {
+        sumSq.assign(n, 0);
+
+        forEachRowRange([&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                for (OffT i = offsets[r]; i < offsets[r + 1]; i++) sumSq[r] += vals[i] * vals[i];
+            }
+        });
+    }
+
+    /**
+     * CSCMat::cull - Remove entries with magnitude below a threshold. Entries are compacted
+     * in place, rows are already sorted so nothing is rebuilt but the offsets and, if in
+     * use, the delta stream.
+     *
+     * @param  thresh Smallest magnitude kept.
+     * @return        Number of entries removed.
+     */
+    
+    size_t cull(T thresh)
+    {
+        PROFILE_ZONE_WORK("CSCMat::cull", vals.size(), "nnz");
+
+        size_t oldNnz   = vals.size();
+        size_t nnz      = CompactRows(offsets, n,
+            [&](size_t i) { return !(abs(vals[i]) < thresh); },
+            [&](size_t dst, size_t src)
+            {
+                vals[dst]       = vals[src];
+                colIdcs[dst]    = colIdcs[src];
+            });
+
+        vals.resize(nnz);
+        colIdcs.resize(nnz);
+        if (bDeltaIdcs) encodeColDeltas();
+
+        return oldNnz - nnz;
+    }
+
+    /**
+     * CSCMat::permute - Renumber rows and columns of a square matrix together, entry (r, c)
+     * moves to (perm[r], perm[c]). Rows are kept sorted by column and the delta stream is
+     * rebuilt if it was in use.
+     *
+     * @param perm New index of each row/column, perm[old] = new.
+     */
+
+    void permute(const vector<uint32_t>& perm)
+    {
+        PROFILE_ZONE_WORK("CSCMat::permute", vals.size(), "nnz");
+        assert(n == m && perm.size() == n);
+
+        vector<uint32_t> oldRows(n);
+        for (uint32_t r = 0; r < n; r++) oldRows[perm[r]] = r;
+
+        vector<OffT> newOffsets(n + 1);
+        newOffsets[0] = 0;
+
+        for (uint32_t r = 0; r < n; r++)
+        {
+            newOffsets[r + 1] = newOffsets[r] + (offsets[oldRows[r] + 1] - offsets[oldRows[r]]);
+        }
+
+        vector<T> newVals(vals.size());
+        vector<IdxT> newIdcs(vals.size());
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            vector<pair<IdxT, T>> row;
+
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                uint32_t oldRow = oldRows[r];
+                row.clear();
+
+                for (OffT i = offsets[oldRow]; i < offsets[oldRow + 1]; i++)
+                {
+                    row.push_back({ (IdxT)perm[colIdcs[i]], vals[i] });
+                }
+
+                sort(row.begin(), row.end(), [](const pair<IdxT, T>& a, const pair<IdxT, T>& b)
+                {
+                    return a.first < b.first;
+                });
+
+                for (size_t j = 0; j < row.size(); j++)
+                {
+                    newIdcs[newOffsets[r] + j]  = row[j].first;
+                    newVals[newOffsets[r] + j]  = row[j].second;
+                }
+            }
+        });
+
+        offsets.swap(newOffsets);
+        colIdcs.swap(newIdcs);
+        vals.swap(newVals);
+
+        if (bDeltaIdcs) encodeColDeltas();
     }
 
     /**
@@ -119,14 +1263,91 @@ struct CSCMat
 
         for (uint32_t r = 0; r < n; r++)
         {
-            for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++)
+            for (OffT i = offsets[r]; i < offsets[r + 1]; i++)
             {
-                tripletMat.insert({ r, colIdcs[i], vals[i] });
+                tripletMat.insert({ r, (uint32_t)colIdcs[i], vals[i] });
             }
         }
 
         return tripletMat;
     }
+
+private:
+
+    /**
+     * CSCMat::forEachRowRange - Split rows into one range per kernel thread with roughly
+     * equal nnz and run fn on each, small matrices run on the calling thread.
+     *
+     * @param fn Range function, called as fn(rBegin, rEnd).
+     */
+
+    template<class Fn>
+    void forEachRowRange(Fn fn) const
+    {
+        if (n == 0) return;
+
+        uint32_t numParts = vals.size() < spmvParallelNnz ? 1 : GetNumThreads();
+        vector<uint32_t> bounds(numParts + 1);
+
+        PartitionRowsByNnz(offsets.data(), n, numParts, bounds.data());
+
+        ParallelRun(numParts, [&](uint32_t part)
+        {
+            if (bounds[part] < bounds[part + 1]) fn(bounds[part], bounds[part + 1]);
+        });
+    }
+
+    /**
+     * CSCMat::activeRowPairings - Batch averaged pairings of one active post neuron's row.
+     *
+     * @param pre         Presynaptic activations per batch entry.
+     * @param post        Active postsynaptic neurons of the batch.
+     * @param a           Index of the neuron in post.
+     * @param rowPairings Output pairings, resized to the row length.
+     */
+
+    void activeRowPairings(const vector<vector<T>>& pre, const ActiveRows<T>& post, uint32_t a,
+        vector<T>& rowPairings) const
+    {
+        uint32_t row        = post.rows[a];
+        size_t len          = offsets[row + 1] - offsets[row];
+        const IdxT* cols    = colIdcs.data() + offsets[row];
+        T batchSizeInv      = (T)1 / (T)post.batchSize;
+
+        rowPairings.assign(len, 0);
+
+        for (uint32_t e = post.offsets[a]; e < post.offsets[a + 1]; e++)
+        {
+            const T* batPre = pre[post.entries[e].first].data();
+            T postAct       = post.entries[e].second;
+
+            for (size_t i = 0; i < len; i++) rowPairings[i] += postAct * batPre[cols[i]];
+        }
+
+        for (size_t i = 0; i < len; i++) rowPairings[i] *= batchSizeInv;
+    }
+
+    /**
+     * CSCMat::decodeRow - Decode one row's column indices from the delta stream.
+     *
+     * @param row  Row to decode.
+     * @param cols Output column indices, resized to the row length.
+     */
+
+    void decodeRow(uint32_t row, vector<uint32_t>& cols) const
+    {
+        const uint8_t* gaps = colDeltas.data() + deltaOffsets[row];
+        size_t len          = offsets[row + 1] - offsets[row];
+
+        cols.resize(len);
+
+        switch (deltaWidths[row])
+        {
+        case 1:     DeltaDecodeRow(gaps, deltaBases[row], len, cols.data()); break;
+        case 2:     DeltaDecodeRow((const uint16_t*)gaps, deltaBases[row], len, cols.data()); break;
+        default:    DeltaDecodeRow((const uint32_t*)gaps, deltaBases[row], len, cols.data()); break;
+        }
+    }
 };
 
 template<class T>
@@ -140,6 +1361,12 @@ struct Triplet
 template<class T>
 struct TripletMat
 {
+    struct ColVal
+    {
+        uint32_t c;
+        T val;
+    };
+
     vector<Triplet<T>> entries;
     uint32_t n;
     uint32_t m;
@@ -221,13 +1448,126 @@ struct TripletMat
     }
 
     /**
-     * TripletMat::toCSC - Convert triplet matrix to compressed sparse form.
+     * TripletMat::toCSC - Convert triplet matrix to compressed sparse form with a counting
+     * sort keyed on row. Entries are split into chunks, and each chunk builds a row
+     * histogram. A prefix sum over (row, chunk) gives every chunk its own write cursor into
+     * each row, so the scatter runs in parallel and stays stable. Rows are then sorted by
+     * column and duplicates combined (values summed) in parallel, and a second prefix sum
+     * over the combined row lengths gives exact output sizes.
+     *
+     * @return - Compressed sparse representation of this matrix, with IdxT column indices
+     *           and OffT row offsets.
+     */
+    
+    template<class IdxT = uint32_t, class OffT = uint32_t>
+    CSCMat<T, IdxT, OffT> toCSC()
+    {
+        PROFILE_ZONE_WORK("TripletMat::toCSC", entries.size(), "nnz");
+        CSCMat<T, IdxT, OffT> csc(n, m, name);
+
+        size_t nnz          = entries.size();
+        uint32_t numChunks  = (uint32_t)min((size_t)GetNumThreads(), max((size_t)1, nnz / max(n, 1u)));
+
+        assert((uint64_t)nnz <= (uint64_t)numeric_limits<OffT>::max());
+        size_t chunkSize    = (nnz + numChunks - 1) / max(numChunks, 1u);
+
+        // Per chunk row histograms, laid out row-major so the scan walks (row, chunk).
+
+        vector<size_t> cursors((size_t)n * numChunks + 1, 0);
+
+        ParallelRun(numChunks, [&](uint32_t chunk)
+        {
+            size_t begin = chunk * chunkSize;
+            size_t end   = min(nnz, begin + chunkSize);
+
+            for (size_t i = begin; i < end; i++)
+            {
+                assert(entries[i].r < n);
+                cursors[(size_t)entries[i].r * numChunks + chunk]++;
+            }
+        });
+
+        ExclusiveScan(&cursors[0], cursors.size());
+
+        vector<ColVal> scattered(nnz);
+
+        ParallelRun(numChunks, [&](uint32_t chunk)
+        {
+            size_t begin = chunk * chunkSize;
+            size_t end   = min(nnz, begin + chunkSize);
+
+            for (size_t i = begin; i < end; i++)
+            {
+                size_t& cursor      = cursors[(size_t)entries[i].r * numChunks + chunk];
+                scattered[cursor++] = { entries[i].c, entries[i].val };
+            }
+        });
+
+        // After the scatter, each row's first chunk cursor sits at the start of the next
+        // row, so row r spans [rowEnd(r - 1), rowEnd(r)).
+
+        auto rowBegin   = [&](uint32_t r) { return r == 0 ? (size_t)0 : cursors[(size_t)r * numChunks - 1]; };
+        auto rowEnd     = [&](uint32_t r) { return cursors[(size_t)(r + 1) * numChunks - 1]; };
+
+        csc.offsets.resize((size_t)n + 1, 0);
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                size_t begin    = rowBegin(r);
+                size_t end      = rowEnd(r);
+
+                if (end - begin > 1)
+                {
+                    sort(scattered.begin() + begin, scattered.begin() + end,
+                        [](const ColVal& a, const ColVal& b) { return a.c < b.c; });
+                }
+
+                size_t cur = begin;
+
+                for (size_t i = begin + 1; i < end; i++)
+                {
+                    if (scattered[i].c == scattered[cur].c) scattered[cur].val += scattered[i].val;
+                    else scattered[++cur] = scattered[i];
+                }
+
+                csc.offsets[r] = (OffT)(end > begin ? cur + 1 - begin : 0);
+            }
+        });
+
+        OffT cscNnz = ExclusiveScan(&csc.offsets[0], (size_t)n + 1);
+
+        csc.vals.resize(cscNnz);
+        csc.colIdcs.resize(cscNnz);
+
+        ParallelFor(0, n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+        {
+            for (uint32_t r = rBegin; r < rEnd; r++)
+            {
+                size_t src = rowBegin(r);
+
+                for (OffT i = csc.offsets[r]; i < csc.offsets[r + 1]; i++, src++)
+                {
+                    csc.colIdcs[i]  = (IdxT)scattered[src].c;
+                    csc.vals[i]     = scattered[src].val;
+                }
+            }
+        });
+
+        return csc;
+    }
+
+    /**
+     * TripletMat::toCSCSorted - Convert triplet matrix to compressed sparse form by sorting
+     * all entries with a comparison sort. Reference path kept for benchmarks against toCSC.
      *
      * @return - Compressed sparse representation of this matrix.
      */
     
-    CSCMat<T> toCSC()
+    CSCMat<T> toCSCSorted()
     {
+        PROFILE_ZONE_WORK("TripletMat::toCSCSorted", entries.size(), "nnz");
         CSCMat<T> csc(n, m, name);
 
         sortAndCombine();
@@ -250,7 +1590,7 @@ struct TripletMat
             cnt++;
         }
 
-        csc.offsets.push_back((uint32_t)entries.size());
+        while (csc.offsets.size() < (size_t)n + 1) csc.offsets.push_back(cnt);
 
         return csc;
     }
@@ -264,6 +1604,8 @@ private:
     
     void combineDuplicates()
     {
+        if (entries.empty()) return;
+
         uint32_t cur = 0;
 
         for (uint32_t i = 1; i < entries.size(); i++)
@@ -11,6 +11,7 @@
 
 #include "dataset.h"
 #include "settings.h"
+#include "profiler.h"
 #include "Eigen/Dense"
 
 using Eigen::MatrixXd;
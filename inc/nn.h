@@ -1,6 +1,8 @@
 #pragma once
 
-#include "matrix.h"
+#include "synapsestore.h"
+#include "reorder.h"
+#include "nnfile.h"
 
 template<class T>
 struct NNCreateParams
@@ -10,7 +12,22 @@ struct NNCreateParams
     uint32_t batchSize;
     double learnRate;
     double cullThresh;
+    SparseFormat format;
+    bool bDeltaIdcs;
+    uint32_t renormInterval;
+    NeuronOrder order;
+    PulseActivation pulseActivation;
+    double pulseThresh;
     vector<Triplet<T>> synapsesIn;
+
+    /**
+     * NNCreateParams::NNCreateParams - Defaults, synapse storage format picked automatically,
+     * plain column indices, rows renormalized after every update, neurons kept in the
+     * caller's numbering and pulses propagating any positive activation unchanged.
+     */
+
+    NNCreateParams() : numNeurons(0), batchSize(1), learnRate(1.0), cullThresh(0.0), format(SPARSE_AUTO),
+        bDeltaIdcs(false), renormInterval(1), order(ORDER_NONE), pulseActivation(PULSE_LINEAR), pulseThresh(0.0) {}
 };
 
 template<class T>
@@ -18,18 +35,31 @@ struct NN
 {
     uint32_t numNeurons;
     uint32_t batchSize;
-    CSCMat<T> synapses;
+    SynapseStore<T> synapses;
     vector<vector<T>> activationsPre;
     vector<vector<T>> activationsPost;
-    CSCMat<T> pairings;
+    vector<vector<uint32_t>> activePre;
+    vector<vector<pair<uint32_t, T>>> activePost;
+    ActiveRows<T> activeRowsPost;
+    bool bSparseActs;
     double learnRate;
     double cullThresh;
+    uint32_t renormInterval;
+    uint32_t numUpdates;
+    PulseActivation pulseActivation;
+    double pulseThresh;
+    vector<uint32_t> neuronPerm;
+    vector<uint32_t> inputNeurons;
+    vector<uint32_t> outputNeurons;
+    vector<T> permInputs;
+    vector<T> permRes;
 
     /**
      * NN::NN - FTWT NN default constructor.
      */
 
-    NN() : numNeurons(0), batchSize(1), learnRate(1.0), cullThresh(0.0) {}
+    NN() : numNeurons(0), batchSize(1), bSparseActs(false), learnRate(1.0), cullThresh(0.0), renormInterval(1),
+        numUpdates(0), pulseActivation(PULSE_LINEAR), pulseThresh(0.0) {}
 
     /**
      * NN::NN - FTWT NN constructor.
@@ -39,11 +69,18 @@ struct NN
 
     NN(NNCreateParams<T> &params) : numNeurons(params.numNeurons),
         batchSize(params.batchSize),
+        bSparseActs(false),
         learnRate(params.learnRate),
-        cullThresh(params.cullThresh)
+        cullThresh(params.cullThresh),
+        renormInterval(max(params.renormInterval, 1u)),
+        numUpdates(0),
+        pulseActivation(params.pulseActivation),
+        pulseThresh(params.pulseThresh)
     {
         activationsPre.resize(batchSize);
         activationsPost.resize(batchSize);
+        activePre.resize(batchSize);
+        activePost.resize(batchSize);
 
         for (uint32_t i = 0; i < batchSize; i++)
         {
@@ -53,19 +90,44 @@ struct NN
 
         TripletMat<T> synapsesTrip(numNeurons, numNeurons, params.name);
         for (auto& synapse : params.synapsesIn) synapsesTrip.insert(synapse);
-        synapses = synapsesTrip.toCSC();
-        pairings = synapses;
+
+        CSCMat<T> csc = synapsesTrip.toCSC();
+        neuronPerm    = ComputeNeuronOrder(csc, params.order);
+        if (!neuronPerm.empty()) csc.permute(neuronPerm);
+
+        synapses.build(move(csc), params.format, params.bDeltaIdcs);
+    }
+
+    /**
+     * NN::neuronIndex - Internal index of a neuron. With a neuron ordering the synapses and
+     * activations are stored renumbered, the NN's methods take and return neurons in the
+     * caller's numbering and map them through here.
+     *
+     * @param  neuron Neuron in the caller's numbering.
+     * @return        Storage index of the neuron.
+     */
+
+    uint32_t neuronIndex(uint32_t neuron) const
+    {
+        return neuronPerm.empty() ? neuron : neuronPerm[neuron];
     }
 
     /**
      * NN::applyAssocs - Apply desired learning associations and record
      * neuron activations. These activations are used to compute neuron pairings
      * and strengthen/weaken appropriate synapse connections. Neurons pair if a
-     * postsynaptic activation follows a presynaptic activation.
+     * postsynaptic activation follows a presynaptic activation. Besides the dense
+     * activation vectors, the nonzeros are kept as per batch entry lists (neurons only for
+     * pre, neuron and activation for post), so the previous batch is cleared in O(active)
+     * instead of refilling numNeurons entries per sample, and updateSynapses only pairs
+     * rows with an active post neuron. Callers that write activationsPre/activationsPost
+     * directly clear bSparseActs to get the dense paths. With more than one pulse the
+     * presynaptic activity is then pushed through the synapses, see propagatePulses.
      *
      * @param assocPre  Presynaptic neuron activations.
      * @param assocPost Postsynaptic neuron activations.
-     * @param numPulses Number of iterations to propagate presynaptic activations through network.
+     * @param numPulses Number of pulses, the first applies assocPre and each further one
+     *                  propagates activations one synapse further through the network.
      */
     
     void applyAssocs(
@@ -73,13 +135,176 @@ struct NN
         vector<vector<pair<uint32_t, T>>>& assocPost,
         uint32_t numPulses)
     {
+        PROFILE_ZONE("NN::applyAssocs");
+
+        for (uint32_t i = 0; i < batchSize; i++)
+        {
+            if (bSparseActs)
+            {
+                for (auto neuron : activePre[i]) activationsPre[i][neuron] = 0;
+                for (auto& act : activePost[i]) activationsPost[i][act.first] = 0;
+            }
+            else
+            {
+                fill(activationsPre[i].begin(), activationsPre[i].end(), 0.0);
+                fill(activationsPost[i].begin(), activationsPost[i].end(), 0.0);
+            }
+
+            // Zero activations stay out of the list, without a branch since MNIST pixels
+            // are zero or not at random.
+
+            size_t numActive = 0;
+            activePre[i].resize(assocPre[i].size());
+            activePost[i].clear();
+
+            for (auto& assoc : assocPre[i])
+            {
+                uint32_t neuron             = neuronIndex(assoc.first);
+                activationsPre[i][neuron]   = assoc.second;
+                activePre[i][numActive]     = neuron;
+                numActive                   += assoc.second != 0;
+            }
+
+            activePre[i].resize(numActive);
+
+            uint32_t neuron             = neuronIndex(assocPost[i][0].first);
+            activationsPost[i][neuron]  = assocPost[i][0].second;
+            activePost[i].push_back({ neuron, assocPost[i][0].second });
+        }
+
+        if (numPulses > 1) propagatePulses(numPulses - 1);
+
+        activeRowsPost.build(activePost);
+        bSparseActs = true;
+    }
+
+    /**
+     * NN::propagatePulses - Push presynaptic activity through the synapses. Each pulse sums
+     * the weighted activations of the frontier, the neurons that became active in the last
+     * pulse (the applied inputs for the first), into their postsynaptic neurons. Neurons that
+     * weren't active yet and whose activation (pulseActivation of the sum) passes
+     * pulseThresh become active and form the next frontier. CSR synapses push through their
+     * column index, a sparse matrix * sparse vector product that only touches the frontier's
+     * out-edges, batch entries in parallel. Other formats run a full SpMV per pulse.
+     *
+     * @param numSteps Number of pulses after the inputs.
+     */
+
+    void propagatePulses(uint32_t numSteps)
+    {
+        PROFILE_ZONE("NN::propagatePulses");
+
+        if (synapses.format != SPARSE_CSR)
+        {
+            propagatePulsesSpMV(numSteps);
+            return;
+        }
+
+        const ColumnIndex<>& colIndex   = synapses.columnIndex();
+        const T* rowScales              = synapses.rowScales.empty() ? nullptr : synapses.rowScales.data();
+
+        ParallelFor(0, batchSize, 1, [&](uint32_t bBegin, uint32_t bEnd)
+        {
+            FrontierScratch<T> scratch(numNeurons);
+            vector<uint32_t> frontier;
+
+            for (uint32_t i = bBegin; i < bEnd; i++)
+            {
+                initialFrontier(i, frontier);
+
+                for (uint32_t step = 0; step < numSteps && !frontier.empty(); step++)
+                {
+                    PushFrontier(colIndex, synapses.csr.vals.data(), rowScales, frontier.data(), frontier.size(),
+                        activationsPre[i].data(), scratch);
+
+                    frontier.clear();
+                    activateNeurons(i, scratch.touched.data(), scratch.touched.size(), scratch.sums.data(), frontier);
+                }
+            }
+        });
+    }
+
+    /**
+     * NN::propagatePulsesSpMV - Pulse propagation for storage formats without a column
+     * index. The frontier is scattered into a dense vector and multiplied by the synapses,
+     * one batch entry at a time since the SpMV is parallel itself.
+     *
+     * @param numSteps Number of pulses after the inputs.
+     */
+
+    void propagatePulsesSpMV(uint32_t numSteps)
+    {
+        vector<T> x(numNeurons, 0);
+        vector<T> y(numNeurons);
+        vector<uint32_t> frontier;
+        vector<uint32_t> touched;
+
         for (uint32_t i = 0; i < batchSize; i++)
         {
-            fill(activationsPre[i].begin(), activationsPre[i].end(), 0.0);
-            fill(activationsPost[i].begin(), activationsPost[i].end(), 0.0);
-            
-            for (auto& assoc : assocPre[i]) activationsPre[i][assoc.first] = assoc.second;
-            activationsPost[i][assocPost[i][0].first] = assocPost[i][0].second;
+            initialFrontier(i, frontier);
+
+            for (uint32_t step = 0; step < numSteps && !frontier.empty(); step++)
+            {
+                for (auto neuron : frontier) x[neuron] = activationsPre[i][neuron];
+                synapses.multiply(x.data(), y.data());
+                for (auto neuron : frontier) x[neuron] = 0;
+
+                touched.clear();
+
+                for (uint32_t neuron = 0; neuron < numNeurons; neuron++)
+                {
+                    if (y[neuron] != 0) touched.push_back(neuron);
+                }
+
+                frontier.clear();
+                activateNeurons(i, touched.data(), touched.size(), y.data(), frontier);
+            }
+        }
+    }
+
+    /**
+     * NN::initialFrontier - Active inputs of a batch entry, each neuron once. Inputs may
+     * repeat a neuron, and a repeated frontier neuron would push its activation twice.
+     *
+     * @param bat      Batch entry.
+     * @param frontier Output frontier.
+     */
+
+    void initialFrontier(uint32_t bat, vector<uint32_t>& frontier) const
+    {
+        frontier = activePre[bat];
+        sort(frontier.begin(), frontier.end());
+        frontier.erase(unique(frontier.begin(), frontier.end()), frontier.end());
+    }
+
+    /**
+     * NN::activateNeurons - Second half of a pulse. Every candidate neuron with a nonzero
+     * summed input that isn't active yet is activated if pulseActivation of its sum passes
+     * pulseThresh, recorded in the batch entry's active list and added to the next frontier.
+     *
+     * @param bat        Batch entry.
+     * @param candidates Neurons that received input this pulse.
+     * @param numCands   Number of candidates.
+     * @param sums       Summed input, indexed by neuron.
+     * @param frontier   Next frontier, newly active neurons appended.
+     */
+
+    void activateNeurons(uint32_t bat, const uint32_t* candidates, size_t numCands, const T* sums,
+        vector<uint32_t>& frontier)
+    {
+        T* acts = activationsPre[bat].data();
+
+        for (size_t k = 0; k < numCands; k++)
+        {
+            uint32_t neuron = candidates[k];
+            if (acts[neuron] != 0 || sums[neuron] == 0) continue;
+
+            T act = PulseActivate(pulseActivation, sums[neuron]);
+            if (!(act > (T)pulseThresh) || act == 0) continue;
+
+            acts[neuron] = act;
+            activePre[bat].push_back(neuron);
+            frontier.push_back(neuron);
         }
     }
 
@@ -93,109 +318,402 @@ struct NN
     
     vector<T> applyInput(vector<T>& input)
     {
-        vector<T> res = synapses * input;
+        vector<T> res;
+        applyInput(input, res);
         return res;
     }
 
     /**
-     * NN::computePairings - After applying batch of associations and recording activations, 
-     * record average pairing of neurons connected by synapses. Pairing = 
-     * preSynapseNeuronActiviation * postSynapseNeuronActiviation. 
+     * NN::applyInput - Compute response of NN to a given input into a caller owned buffer,
+     * so test loops don't allocate per image.
+     *
+     * @param input Input activations to compute response for.
+     * @param res   Response of NN to input, resized to numNeurons.
      */
-    
-    void computePairings()
+
+    void applyInput(const vector<T>& input, vector<T>& res)
     {
-        double* pPairings = &pairings.vals[0];
-        memset(pPairings, 0, pairings.vals.size() * sizeof(double));
+        PROFILE_ZONE("NN::applyInput");
+        assert(input.size() == numNeurons);
+        res.resize(numNeurons);
 
-        for (uint32_t bat = 0; bat < batchSize; bat++)
+        if (neuronPerm.empty())
         {
-            double* pBatActivationsPre  = &activationsPre[bat][0];
-            double* pBatActivationsPost = &activationsPost[bat][0];
-            uint32_t *pOffsets          = &synapses.offsets[0];
-            uint32_t *pIdcs             = &synapses.colIdcs[0];
+            synapses.multiply(input.data(), res.data());
+            return;
+        }
 
-            for (uint32_t row = 0; row < synapses.n; row++)
-            {
-                for (uint32_t syn = pOffsets[row]; syn < pOffsets[row + 1]; syn++)
-                {
-                    pPairings[syn] += pBatActivationsPost[row] * pBatActivationsPre[pIdcs[syn]];
-                }
-            }
+        permInputs.resize(numNeurons);
+        permRes.resize(numNeurons);
+
+        for (uint32_t i = 0; i < numNeurons; i++) permInputs[neuronPerm[i]] = input[i];
+        synapses.multiply(permInputs.data(), permRes.data());
+        for (uint32_t i = 0; i < numNeurons; i++) res[i] = permRes[neuronPerm[i]];
+    }
+
+    /**
+     * NN::applyInputBlock - Compute responses of NN to a block of inputs at once. Inputs
+     * and responses are row-major (neuron i's activation for input j at i * blockSize + j),
+     * so synapses are read once per block. Used to evaluate test sets.
+     *
+     * @param inputs    Input activations, numNeurons x blockSize.
+     * @param res       Responses, resized to numNeurons x blockSize.
+     * @param blockSize Number of inputs in the block.
+     */
+
+    void applyInputBlock(const vector<T>& inputs, vector<T>& res, uint32_t blockSize)
+    {
+        PROFILE_ZONE_WORK("NN::applyInputBlock", blockSize, "sample");
+        assert(inputs.size() == (size_t)numNeurons * blockSize);
+        res.resize((size_t)numNeurons * blockSize);
+
+        if (neuronPerm.empty())
+        {
+            synapses.multiplyBlock(inputs.data(), res.data(), blockSize);
+            return;
+        }
+
+        // Neuron rows move as a whole, so a block is permuted with one row copy per neuron.
+
+        permInputs.resize((size_t)numNeurons * blockSize);
+        permRes.resize((size_t)numNeurons * blockSize);
+
+        for (uint32_t i = 0; i < numNeurons; i++)
+        {
+            copy_n(&inputs[(size_t)i * blockSize], blockSize, &permInputs[(size_t)neuronPerm[i] * blockSize]);
         }
 
-        double batchSizeInv = 1.0 / (double)batchSize;
+        synapses.multiplyBlock(permInputs.data(), permRes.data(), blockSize);
 
-        for (uint32_t i = 0; i < pairings.vals.size(); i++)
+        for (uint32_t i = 0; i < numNeurons; i++)
         {
-            pPairings[i] *= batchSizeInv;
+            copy_n(&permRes[(size_t)neuronPerm[i] * blockSize], blockSize, &res[(size_t)i * blockSize]);
         }
     }
 
     /**
-     * NN::cull - Between synapse updates, remove any weak synapses.
+     * NN::cull - Between synapse updates, remove any weak synapses. The synapse storage
+     * format is re-picked afterwards when it was chosen automatically.
+     *
+     * @return Number of synapses removed.
      */
     
-    void cull()
+    size_t cull()
     {
-        TripletMat<T> triplet;
-        triplet.m = synapses.m;
-        triplet.n = synapses.n;
+        PROFILE_ZONE_WORK("NN::cull", synapses.nnz(), "nnz");
+        return synapses.cull((T)cullThresh);
+    }
+
+    /**
+     * NN::growSynapses - Structural plasticity. After associations are applied, add a synapse
+     * between every pair of neurons that fired together and aren't connected yet. Synapses
+     * switch to dynamic storage on the first call so growth doesn't rebuild the matrix, rows
+     * are compacted once moved rows waste too many slots.
+     *
+     * @param  actThresh Activation a neuron must exceed to count as firing.
+     * @param  weight    Weight of new synapses.
+     * @return           Number of synapses added.
+     */
 
-        uint32_t r = 0;
+    size_t growSynapses(T actThresh, T weight)
+    {
+        PROFILE_ZONE("NN::growSynapses");
 
-        for (uint32_t i = 0; i < synapses.vals.size(); i++)
-        {
-            while (i == synapses.offsets[r + 1]) r++;
-            if (abs(synapses.vals[i]) < cullThresh) continue;
-            else
-            {
-                triplet.insert({ r, synapses.colIdcs[i], synapses.vals[i] });
-            }
-        }
+        synapses.makeDynamic();
 
-        synapses = triplet.toCSC();
-        pairings = synapses;
+        size_t numGrown = synapses.dyn.insertCoFiring(activationsPre, activationsPost, actThresh, weight);
+        if (synapses.dyn.needsCompact()) synapses.dyn.compact();
+
+        return numGrown;
+    }
+
+    /**
+     * NN::packSynapses - Done growing for now, repack dynamic synapses into their static
+     * format for faster kernels. Growing again switches back.
+     */
+
+    void packSynapses()
+    {
+        PROFILE_ZONE("NN::packSynapses");
+        synapses.pack();
     }
 
     /**
-     * NN::updateSynapses - After associations have been applied and average neuron pairings
-     * computed, adjust sypanse strength in proportion to product of pre/post synapse activation
-     * strength. All synapse weights feeding into a given neuron are normalized to 1 to avoid
-     * runaway sypanse weights.
+     * NN::updateSynapses - After associations have been applied, pair the neurons each
+     * synapse connects (pairing = batch averaged preSynapseNeuronActiviation *
+     * postSynapseNeuronActiviation) and adjust sypanse strength in proportion. All synapse
+     * weights feeding into a given neuron are normalized to 1 to avoid runaway sypanse
+     * weights. Normalization runs every renormInterval updates, in between updates only add
+     * pairings. Pairing, update and normalization run as one pass over the synapses. After
+     * applyAssocs only the rows of active post neurons are paired, otherwise every row of
+     * every batch entry.
      */
     
     void updateSynapses()
     {
-        vector<T> synapseTotal(synapses.n, 0);
-        uint32_t r = 0;
+        PROFILE_ZONE("NN::updateSynapses");
+        numUpdates++;
+
+        bool bNormalize = numUpdates % renormInterval == 0;
+
+        if (bSparseActs)
+        {
+            synapses.hebbianUpdate(activationsPre, activeRowsPost, (T)learnRate, bNormalize);
+            return;
+        }
+
+        synapses.hebbianUpdate(activationsPre, activationsPost, (T)learnRate, bNormalize);
+    }
+
+    /**
+     * NN::save - Write the NN to a binary file: hyperparameters, the synapses as CSR in
+     * storage order, the neuron ordering and the input/output neuron maps. Synapses in
+     * other formats, or CSR with unfolded row scales, are converted to CSR for the file and
+     * rebuilt in the same format by load. Activations aren't saved, they're per batch.
+     *
+     * @param  path Output file path.
+     * @param  err  Error message on failure.
+     * @return      True on success.
+     */
+
+    bool save(const string& path, string& err) const
+    {
+        PROFILE_ZONE_WORK("NN::save", synapses.nnz(), "nnz");
+
+        CSCMat<T> converted;
+        const CSCMat<T>* csc = &synapses.csr;
+
+        if (synapses.format != SPARSE_CSR || !synapses.rowScales.empty())
+        {
+            converted   = synapses.toCSC();
+            csc         = &converted;
+        }
+
+        SparseFormat format = synapses.bAutoFormat ? SPARSE_AUTO : synapses.format;
+        if (synapses.format == SPARSE_DYNAMIC) format = synapses.packedFormat;
+
+        NNFileHeader header = {};
+        memcpy(header.magic, nnFileMagic, sizeof(header.magic));
+
+        header.version          = nnFileVersion;
+        header.valBytes         = sizeof(T);
+        header.numNeurons       = numNeurons;
+        header.batchSize        = batchSize;
+        header.learnRate        = learnRate;
+        header.cullThresh       = cullThresh;
+        header.renormInterval   = renormInterval;
+        header.numUpdates       = numUpdates;
+        header.format           = (uint32_t)format;
+        header.bDeltaIdcs       = synapses.bDeltaIdcs ? 1 : 0;
+        header.pulseThresh      = pulseThresh;
+        header.pulseActivation  = (uint32_t)pulseActivation;
+
+        const void* data[NN_SECTION_COUNT] =
+        {
+            csc->offsets.data(), csc->colIdcs.data(), csc->vals.data(), neuronPerm.data(),
+            inputNeurons.data(), outputNeurons.data(), csc->name.data()
+        };
+
+        size_t counts[NN_SECTION_COUNT] =
+        {
+            csc->offsets.size(), csc->colIdcs.size(), csc->vals.size(), neuronPerm.size(),
+            inputNeurons.size(), outputNeurons.size(), csc->name.size()
+        };
+
+        size_t elemBytes[NN_SECTION_COUNT] =
+        {
+            sizeof(uint32_t), sizeof(uint32_t), sizeof(T), sizeof(uint32_t), sizeof(uint32_t),
+            sizeof(uint32_t), sizeof(char)
+        };
+
+        uint64_t offset = NNFileAlignUp(sizeof(header));
+
+        for (uint32_t s = 0; s < NN_SECTION_COUNT; s++)
+        {
+            header.sections[s].offset   = offset;
+            header.sections[s].count    = counts[s];
+            offset                      = NNFileAlignUp(offset + counts[s] * elemBytes[s]);
+        }
+
+        FILE* f = fopen(path.c_str(), "wb");
+
+        if (f == NULL)
+        {
+            err = "Couldn't open " + path + " for writing";
+            return false;
+        }
+
+        uint64_t pos    = 0;
+        bool bOk        = fwrite(&header, sizeof(header), 1, f) == 1;
+        pos             += sizeof(header);
+
+        for (uint32_t s = 0; s < NN_SECTION_COUNT && bOk; s++)
+        {
+            bOk = NNFileWriteSection(f, pos, header.sections[s], data[s], counts[s] * elemBytes[s]);
+        }
+
+        if (fclose(f) != 0) bOk = false;
+        if (!bOk) err = "Couldn't write " + path;
+
+        return bOk;
+    }
+
+    /**
+     * NN::load - Replace this NN with one written by save. The file is mapped read-only,
+     * validated, and its arrays copied out in parallel, so loading costs a memory copy
+     * instead of a triplet sort, and processes loading the same file share its pages in
+     * the page cache. The NN is left untouched if the file is rejected.
+     *
+     * @param  path Input file path.
+     * @param  err  Error message on failure.
+     * @return      True on success.
+     */
+
+    bool load(const string& path, string& err)
+    {
+        PROFILE_ZONE("NN::load");
+
+        size_t fileSize     = 0;
+        const uint8_t* file = MapFileReadOnly(path, fileSize);
+
+        if (file == NULL)
+        {
+            err = "Couldn't map " + path;
+            return false;
+        }
+
+        bool bOk = loadMapped(file, fileSize, err);
+        UnmapFile(file, fileSize);
+
+        if (!bOk) err = path + ": " + err;
+        return bOk;
+    }
+
+    /**
+     * NN::loadMapped - Body of load, reading from a mapped file.
+     *
+     * @param  file     Start of the mapping.
+     * @param  fileSize Mapping size.
+     * @param  err      Error message on failure.
+     * @return          True on success.
+     */
+
+    bool loadMapped(const uint8_t* file, size_t fileSize, string& err)
+    {
+        NNFileHeader header;
+
+        if (fileSize < sizeof(header))
+        {
+            err = "file too small for header";
+            return false;
+        }
+
+        memcpy(&header, file, sizeof(header));
+
+        if (memcmp(header.magic, nnFileMagic, sizeof(header.magic)) != 0 || header.version != nnFileVersion)
+        {
+            err = "not an FTWT NN file or unsupported version";
+            return false;
+        }
+
+        if (header.valBytes != sizeof(T))
+        {
+            err = "saved with " + to_string(header.valBytes) + " byte weights, loading as " +
+                to_string(sizeof(T));
+            return false;
+        }
+
+        const NNFileSection* sections = header.sections;
+        uint32_t numNeuronsIn         = header.numNeurons;
+
+        const uint32_t* offsetsIn   = NNFileSectionData<uint32_t>(file, fileSize, sections[NN_SECTION_OFFSETS]);
+        const uint32_t* colIdcsIn   = NNFileSectionData<uint32_t>(file, fileSize, sections[NN_SECTION_COL_IDCS]);
+        const T* valsIn             = NNFileSectionData<T>(file, fileSize, sections[NN_SECTION_VALS]);
+        const uint32_t* permIn      = NNFileSectionData<uint32_t>(file, fileSize, sections[NN_SECTION_NEURON_PERM]);
+        const uint32_t* inputsIn    = NNFileSectionData<uint32_t>(file, fileSize, sections[NN_SECTION_INPUTS]);
+        const uint32_t* outputsIn   = NNFileSectionData<uint32_t>(file, fileSize, sections[NN_SECTION_OUTPUTS]);
+        const char* nameIn          = NNFileSectionData<char>(file, fileSize, sections[NN_SECTION_NAME]);
 
-        for (uint32_t i = 0; i < pairings.vals.size(); i++)
+        if (!offsetsIn || !colIdcsIn || !valsIn || !permIn || !inputsIn || !outputsIn || !nameIn)
         {
-            while (i == synapses.offsets[r + 1]) r++;
-            
-            T w = synapses.vals[i] + learnRate * pairings.vals[i];
-            
-            synapseTotal[r] += w * w;
-            synapses.vals[i] = w;
+            err = "section out of bounds or misaligned";
+            return false;
         }
 
-        for (uint32_t i = 0; i < synapseTotal.size(); i++)
+        uint64_t nnzIn      = sections[NN_SECTION_VALS].count;
+        uint64_t permCnt    = sections[NN_SECTION_NEURON_PERM].count;
+
+        if (sections[NN_SECTION_OFFSETS].count != (uint64_t)numNeuronsIn + 1 ||
+            sections[NN_SECTION_COL_IDCS].count != nnzIn || nnzIn > UINT32_MAX ||
+            (permCnt != 0 && permCnt != numNeuronsIn) || header.batchSize == 0 ||
+            header.format > SPARSE_EIGEN || header.pulseActivation > PULSE_TANH)
         {
-            synapseTotal[i] = sqrt(synapseTotal[i]);
+            err = "inconsistent header";
+            return false;
         }
 
-        r = 0;
+        CSCMat<T> csc(numNeuronsIn, numNeuronsIn, string(nameIn, (size_t)sections[NN_SECTION_NAME].count));
+        NNFileCopySection(offsetsIn, (size_t)numNeuronsIn + 1, csc.offsets);
+        NNFileCopySection(colIdcsIn, (size_t)nnzIn, csc.colIdcs);
+        NNFileCopySection(valsIn, (size_t)nnzIn, csc.vals);
 
-        for (uint32_t i = 0; i < pairings.vals.size(); i++)
+        if (!NNFileCheckRows(csc))
         {
-            while (i == synapses.offsets[r + 1]) r++;
-            synapses.vals[i] /= synapseTotal[r];
+            err = "corrupt synapse rows";
+            return false;
         }
+
+        vector<uint32_t> permLoaded(permIn, permIn + permCnt);
+        vector<uint8_t> seen(permCnt, 0);
+
+        for (uint32_t idx : permLoaded)
+        {
+            if (idx >= permCnt || seen[idx])
+            {
+                err = "neuron ordering isn't a permutation";
+                return false;
+            }
+
+            seen[idx] = 1;
+        }
+
+        vector<uint32_t> inputsLoaded(inputsIn, inputsIn + sections[NN_SECTION_INPUTS].count);
+        vector<uint32_t> outputsLoaded(outputsIn, outputsIn + sections[NN_SECTION_OUTPUTS].count);
+
+        auto inRange = [&](uint32_t neuron) { return neuron < numNeuronsIn; };
+
+        if (!all_of(inputsLoaded.begin(), inputsLoaded.end(), inRange) ||
+            !all_of(outputsLoaded.begin(), outputsLoaded.end(), inRange))
+        {
+            err = "input/output neuron out of range";
+            return false;
+        }
+
+        numNeurons      = numNeuronsIn;
+        batchSize       = header.batchSize;
+        learnRate       = header.learnRate;
+        cullThresh      = header.cullThresh;
+        renormInterval  = max(header.renormInterval, 1u);
+        numUpdates      = header.numUpdates;
+        pulseActivation = (PulseActivation)header.pulseActivation;
+        pulseThresh     = header.pulseThresh;
+        neuronPerm      = move(permLoaded);
+        inputNeurons    = move(inputsLoaded);
+        outputNeurons   = move(outputsLoaded);
+
+        activationsPre.assign(batchSize, vector<T>(numNeurons));
+        activationsPost.assign(batchSize, vector<T>(numNeurons));
+        activePre.assign(batchSize, {});
+        activePost.assign(batchSize, {});
+        bSparseActs = false;
+
+        synapses.build(move(csc), (SparseFormat)header.format, header.bDeltaIdcs != 0);
+        return true;
     }
 
     /**
-     * NN::print - Print synapse weights for this NN.
+     * NN::print - Print synapse weights for this NN, in storage order when neurons have
+     * been renumbered.
      *
      * @param bAll Whether to print full synapse matrix.
      */
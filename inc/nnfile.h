@@ -0,0 +1,161 @@
+#pragma once
+
+#include "matrix.h"
+
+static const char nnFileMagic[8]        = { 'F', 'T', 'W', 'T', 'N', 'N', '\0', '\0' };
+static const uint32_t nnFileVersion     = 2;
+static const uint64_t nnFileAlign       = 64;
+
+enum NNFileSectionId
+{
+    NN_SECTION_OFFSETS,
+    NN_SECTION_COL_IDCS,
+    NN_SECTION_VALS,
+    NN_SECTION_NEURON_PERM,
+    NN_SECTION_INPUTS,
+    NN_SECTION_OUTPUTS,
+    NN_SECTION_NAME,
+    NN_SECTION_COUNT
+};
+
+struct NNFileSection
+{
+    uint64_t offset;
+    uint64_t count;
+};
+
+/**
+ * NNFileHeader - Start of a saved network. Every array follows in its own section, each
+ * aligned to nnFileAlign bytes from the start of the file so a mapped file can be read in
+ * place with aligned loads. Fields are native endian.
+ */
+
+struct NNFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t valBytes;
+    uint32_t numNeurons;
+    uint32_t batchSize;
+    double learnRate;
+    double cullThresh;
+    uint32_t renormInterval;
+    uint32_t numUpdates;
+    uint32_t format;
+    uint32_t bDeltaIdcs;
+    double pulseThresh;
+    uint32_t pulseActivation;
+    NNFileSection sections[NN_SECTION_COUNT];
+};
+
+/**
+ * NNFileAlignUp - Round a file offset up to the section alignment.
+ */
+
+inline uint64_t NNFileAlignUp(uint64_t offset)
+{
+    return (offset + nnFileAlign - 1) / nnFileAlign * nnFileAlign;
+}
+
+/**
+ * NNFileWriteSection - Write one section's data at its offset, zero padding from the
+ * current file position.
+ *
+ * @param  f       Output file, positioned at or before the section offset.
+ * @param  pos     Current file position, advanced past the section.
+ * @param  section Section to write.
+ * @param  data    Section data.
+ * @param  bytes   Section size in bytes.
+ * @return         True on success.
+ */
+
+inline bool NNFileWriteSection(FILE* f, uint64_t& pos, const NNFileSection& section, const void* data, size_t bytes)
+{
+    static const uint8_t zeros[nnFileAlign] = {};
+
+    while (pos < section.offset)
+    {
+        size_t pad = (size_t)min<uint64_t>(section.offset - pos, nnFileAlign);
+        if (fwrite(zeros, 1, pad, f) != pad) return false;
+        pos += pad;
+    }
+
+    if (bytes > 0 && fwrite(data, 1, bytes, f) != bytes) return false;
+
+    pos += bytes;
+    return true;
+}
+
+/**
+ * NNFileSectionData - Locate a section in a mapped file.
+ *
+ * @param  file     Start of the mapping.
+ * @param  fileSize Mapping size.
+ * @param  section  Section to locate.
+ * @return          Section data, NULL if it runs past the end of the file or is
+ *                  misaligned for E.
+ */
+
+template<class E>
+inline const E* NNFileSectionData(const uint8_t* file, size_t fileSize, const NNFileSection& section)
+{
+    if (section.offset % alignof(E) != 0 || section.offset > fileSize) return NULL;
+    if (section.count > (fileSize - section.offset) / sizeof(E)) return NULL;
+
+    return (const E*)(file + section.offset);
+}
+
+/**
+ * NNFileCopySection - Copy a mapped section into an array, see ParallelCopy.
+ *
+ * @param src   Mapped section data.
+ * @param count Number of elements.
+ * @param dst   Destination, resized to count.
+ */
+
+template<class E>
+inline void NNFileCopySection(const E* src, size_t count, vector<E>& dst)
+{
+    dst.resize(count);
+    ParallelCopy(src, count, dst.data());
+}
+
+/**
+ * NNFileCheckRows - Check a loaded CSR layout before kernels index with it: offsets start
+ * at 0, don't decrease and end at nnz, and every row's columns are in range and strictly
+ * increasing.
+ *
+ * @param  csc Loaded matrix.
+ * @return     True if the layout is valid.
+ */
+
+template<class T>
+inline bool NNFileCheckRows(const CSCMat<T>& csc)
+{
+    if (csc.offsets.size() != (size_t)csc.n + 1) return false;
+    if (csc.offsets[0] != 0 || csc.offsets[csc.n] != csc.vals.size()) return false;
+
+    vector<uint8_t> rowOk(csc.n, 1);
+
+    ParallelFor(0, csc.n, rowGrain, [&](uint32_t rBegin, uint32_t rEnd)
+    {
+        for (uint32_t r = rBegin; r < rEnd; r++)
+        {
+            uint32_t begin  = csc.offsets[r];
+            uint32_t end    = csc.offsets[r + 1];
+
+            if (end < begin || end > csc.vals.size())
+            {
+                rowOk[r] = 0;
+                continue;
+            }
+
+            for (uint32_t i = begin; i < end; i++)
+            {
+                if (csc.colIdcs[i] >= csc.m || (i > begin && csc.colIdcs[i] <= csc.colIdcs[i - 1])) rowOk[r] = 0;
+            }
+        }
+    });
+
+    return all_of(rowOk.begin(), rowOk.end(), [](uint8_t ok) { return ok != 0; });
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+void SetNumThreads(uint32_t numThreads);
+uint32_t GetNumThreads();
+void ParallelRun(uint32_t numTasks, const function<void(uint32_t task)>& fn);
+void ParallelFor(uint32_t begin, uint32_t end, uint32_t grain, const function<void(uint32_t begin, uint32_t end)>& fn);
+
+/**
+ * ExclusiveScan - In-place exclusive prefix sum, data[i] becomes the sum of data[0..i).
+ * Used to turn per-row output counts into offsets. It's a single streaming pass over row
+ * counts, cheap next to the per-nnz passes it feeds, so it stays serial.
+ *
+ * @param  data Values to scan.
+ * @param  cnt  Number of values.
+ * @return      Sum of all values.
+ */
+
+template<class T>
+inline T ExclusiveScan(T* data, size_t cnt)
+{
+    T sum = 0;
+
+    for (size_t i = 0; i < cnt; i++)
+    {
+        T val   = data[i];
+        data[i] = sum;
+        sum     += val;
+    }
+
+    return sum;
+}
+
+/**
+ * ParallelCopy - Copy an array in fixed size chunks spread over threads. Used to copy out of
+ * file mappings, where the copy is bound by page faults on a cold mapping and threads let
+ * them overlap.
+ *
+ * @param src   Source elements.
+ * @param count Number of elements.
+ * @param dst   Destination, count elements.
+ */
+
+template<class E>
+inline void ParallelCopy(const E* src, size_t count, E* dst)
+{
+    const size_t chunkSize = ((size_t)1 << 20) / sizeof(E) + 1;
+
+    if (count == 0) return;
+
+    uint32_t numChunks = (uint32_t)((count + chunkSize - 1) / chunkSize);
+
+    ParallelFor(0, numChunks, 1, [&](uint32_t chBegin, uint32_t chEnd)
+    {
+        size_t begin    = (size_t)chBegin * chunkSize;
+        size_t end      = min(count, (size_t)chEnd * chunkSize);
+
+        memcpy(dst + begin, src + begin, (end - begin) * sizeof(E));
+    });
+}
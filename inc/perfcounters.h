@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+enum PerfCounterId
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    NUM_PERF_COUNTERS
+};
+
+struct PerfCounterValues
+{
+    uint64_t counts[NUM_PERF_COUNTERS];
+};
+
+extern bool bPerfCountersEnabled;
+
+bool EnablePerfCounters(bool bEnable);
+bool IsPerfCounterValid(PerfCounterId id);
+bool ReadPerfCounters(PerfCounterValues& values);
+void AddWorkerPerfCounters(const PerfCounterValues& start, const PerfCounterValues& end);
+bool ReadZonePerfCounters(PerfCounterValues& values);
+void PrintPerfCounterReport();
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <intrin.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <signal.h>
+#include <limits.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+#endif
+
+using namespace std;
+
+/**
+ * GetNanoseconds - Get a monotonic timestamp in nanoseconds. Backed by the platform's
+ * steady clock, so it is safe to difference across threads and never goes backwards.
+ *
+ * @return Timestamp in nanoseconds since an arbitrary epoch.
+ */
+
+inline uint64_t GetNanoseconds()
+{
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * ReadCycleCounter - Read the CPU timestamp counter. Cheaper and finer grained than
+ * GetNanoseconds, but only meaningful as a difference taken on the same core. Falls
+ * back to the steady clock on non-x86 targets.
+ *
+ * @return Current cycle count.
+ */
+
+inline uint64_t ReadCycleCounter()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return GetNanoseconds();
+#endif
+}
+
+/**
+ * GetCycleCounterFrequency - Estimate cycle counter ticks per second. Calibrated once
+ * against the steady clock on first call.
+ *
+ * @return Cycle counter frequency in Hz.
+ */
+
+inline double GetCycleCounterFrequency()
+{
+    static double frequency = []()
+    {
+        uint64_t t0 = GetNanoseconds();
+        uint64_t c0 = ReadCycleCounter();
+
+        while (GetNanoseconds() - t0 < 20000000ULL) {}
+
+        uint64_t t1 = GetNanoseconds();
+        uint64_t c1 = ReadCycleCounter();
+
+        return 1e9 * (double)(c1 - c0) / (double)(t1 - t0);
+    }();
+
+    return frequency;
+}
+
+/**
+ * GetCPUBrandString - Get the CPU model name reported by cpuid.
+ *
+ * @return CPU brand string, "unknown" on non-x86 targets.
+ */
+
+inline string GetCPUBrandString()
+{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    uint32_t regs[12] = {};
+
+    for (uint32_t i = 0; i < 3; i++)
+    {
+#ifdef _WIN32
+        __cpuid((int*)&regs[4 * i], 0x80000002 + i);
+#else
+        __get_cpuid(0x80000002 + i, &regs[4 * i], &regs[4 * i + 1], &regs[4 * i + 2], &regs[4 * i + 3]);
+#endif
+    }
+
+    string brand((const char*)regs, sizeof(regs));
+    brand = brand.substr(0, brand.find('\0'));
+
+    size_t first = brand.find_first_not_of(' ');
+    size_t last  = brand.find_last_not_of(' ');
+
+    return first == string::npos ? string("unknown") : brand.substr(first, last - first + 1);
+#else
+    return string("unknown");
+#endif
+}
+
+/**
+ * GetOSName - Get the name of the OS this binary was built for.
+ *
+ * @return OS name.
+ */
+
+inline string GetOSName()
+{
+#if defined(_WIN32)
+    return "windows";
+#elif defined(__APPLE__)
+    return "macos";
+#elif defined(__linux__)
+    return "linux";
+#else
+    return "unknown";
+#endif
+}
+
+/**
+ * GetWorkingDirectory - Get the process' current working directory.
+ *
+ * @return Current working directory, or an empty string on failure.
+ */
+
+inline string GetWorkingDirectory()
+{
+#ifdef _WIN32
+    char pwdBuffer[MAX_PATH];
+    if (GetCurrentDirectoryA(MAX_PATH, pwdBuffer) == 0) return string();
+#else
+    char pwdBuffer[PATH_MAX];
+    if (getcwd(pwdBuffer, PATH_MAX) == NULL) return string();
+#endif
+    return string(pwdBuffer);
+}
+
+/**
+ * SleepMilliseconds - Suspend the calling thread.
+ *
+ * @param ms Time to sleep in milliseconds.
+ */
+
+inline void SleepMilliseconds(uint32_t ms)
+{
+    this_thread::sleep_for(chrono::milliseconds(ms));
+}
+
+/**
+ * ResetPeakRSS - Reset the peak resident set size to the current one, so GetPeakRSSBytes
+ * measures the peak from here on. Only Linux supports this, through /proc/self/clear_refs.
+ *
+ * @return True if the peak was reset.
+ */
+
+inline bool ResetPeakRSS()
+{
+#ifdef __linux__
+    FILE *clearRefs = fopen("/proc/self/clear_refs", "w");
+    if (clearRefs == NULL) return false;
+
+    bool bReset = fputs("5", clearRefs) >= 0;
+    bReset      = fclose(clearRefs) == 0 && bReset;
+
+    return bReset;
+#else
+    return false;
+#endif
+}
+
+/**
+ * GetPeakRSSBytes - Get the peak resident set size of this process since it started or
+ * since the last ResetPeakRSS. Linux reads VmHWM, which the reset rewinds, rather than
+ * getrusage, which never goes back down.
+ *
+ * @return Peak RSS in bytes, zero if unavailable.
+ */
+
+inline uint64_t GetPeakRSSBytes()
+{
+#ifdef __linux__
+    FILE *status = fopen("/proc/self/status", "r");
+
+    if (status != NULL)
+    {
+        char line[256];
+        uint64_t peakKB = 0;
+
+        while (fgets(line, sizeof(line), status))
+        {
+            if (strncmp(line, "VmHWM:", 6) == 0)
+            {
+                peakKB = strtoull(line + 6, NULL, 10);
+                break;
+            }
+        }
+
+        fclose(status);
+        if (peakKB != 0) return 1024ULL * peakKB;
+    }
+#endif
+
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return (uint64_t)counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;
+#else
+    return 1024ULL * (uint64_t)usage.ru_maxrss;
+#endif
+#endif
+}
+
+/**
+ * MapFileReadOnly - Map a whole file into memory read-only. Pages are shared with the
+ * page cache, so other processes mapping the same file share them too, and are only read
+ * from disk when touched.
+ *
+ * @param  path File path.
+ * @param  size File size in bytes.
+ * @return      Start of the mapping, NULL if the file can't be opened, is empty or can't
+ *              be mapped.
+ */
+
+inline const uint8_t* MapFileReadOnly(const string& path, size_t& size)
+{
+    size = 0;
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER fileSize;
+
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL) return NULL;
+
+    // The view keeps the mapping alive after its handle is closed.
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == NULL) return NULL;
+
+    size = (size_t)fileSize.QuadPart;
+    return (const uint8_t*)data;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+
+#ifdef MADV_WILLNEED
+    madvise(data, (size_t)st.st_size, MADV_WILLNEED);
+#endif
+
+    size = (size_t)st.st_size;
+    return (const uint8_t*)data;
+#endif
+}
+
+/**
+ * UnmapFile - Release a mapping from MapFileReadOnly.
+ *
+ * @param data Start of the mapping.
+ * @param size Size of the mapping.
+ */
+
+inline void UnmapFile(const uint8_t* data, size_t size)
+{
+    if (data == NULL) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+#else
+    munmap((void*)data, size);
+#endif
+}
+
+/**
+ * DebugTrap - Break into an attached debugger. On POSIX the trap is only raised when a
+ * tracer is attached, so unattended runs don't die with SIGTRAP.
+ */
+
+inline void DebugTrap()
+{
+#ifdef _WIN32
+    __debugbreak();
+#else
+    FILE *status = fopen("/proc/self/status", "r");
+    if (status == NULL) return;
+
+    char line[256];
+    int tracerPid = 0;
+
+    while (fgets(line, sizeof(line), status))
+    {
+        if (strncmp(line, "TracerPid:", 10) == 0)
+        {
+            tracerPid = atoi(line + 10);
+            break;
+        }
+    }
+
+    fclose(status);
+    if (tracerPid != 0) raise(SIGTRAP);
+#endif
+}
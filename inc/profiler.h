@@ -0,0 +1,147 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include "timer.h"
+#include "perfcounters.h"
+
+using namespace std;
+
+#define FTWT_CONCAT_INNER(a, b) a##b
+#define FTWT_CONCAT(a, b) FTWT_CONCAT_INNER(a, b)
+
+struct ProfileZoneStats
+{
+    uint64_t calls;
+    uint64_t totalNs;
+    uint64_t maxNs;
+    uint64_t totalCycles;
+    uint64_t flops;
+    uint64_t bytes;
+    uint64_t units;
+    uint64_t perf[NUM_PERF_COUNTERS];
+};
+
+struct ProfileThreadData
+{
+    uint32_t threadIdx;
+    vector<ProfileZoneStats> zones;
+};
+
+struct ProfileZoneReport
+{
+    string name;
+    string unitName;
+    uint32_t threadIdx;
+    ProfileZoneStats stats;
+};
+
+uint32_t RegisterProfileSite(const char* name, const char* unitName);
+ProfileThreadData& GetProfileThreadData();
+vector<ProfileZoneReport> CollectProfileZones(bool perThread);
+void PrintProfileReport(bool perThread = false);
+void ResetProfiler();
+
+struct ProfileSite
+{
+    uint32_t id;
+    const char* name;
+
+    /**
+     * ProfileSite::ProfileSite - Register a named profiling site. Sites are created once per
+     * PROFILE_ZONE call site (function local static) and get a dense id used to index
+     * per-thread stats.
+     *
+     * @param name     Zone name shown in profile reports.
+     * @param unitName Unit of work the zone counts (e.g., "nnz"), used for per-unit stats.
+     */
+
+    ProfileSite(const char* name, const char* unitName = "") : id(RegisterProfileSite(name, unitName)), name(name) {}
+};
+
+struct ProfileZone
+{
+    const ProfileSite& site;
+    uint64_t startNs;
+    uint64_t startCycles;
+    uint64_t flops;
+    uint64_t bytes;
+    uint64_t units;
+    bool bPerf;
+    PerfCounterValues startPerf;
+
+    /**
+     * ProfileZone::ProfileZone - Open a scoped profiling zone. Time between construction
+     * and destruction is attributed to the zone's site on the calling thread. Hardware
+     * counters are read first on entry and last on exit so their syscalls stay out of
+     * the timed region, and include the kernel pool workers' share of parallel kernels.
+     *
+     * @param site  Site this zone accumulates into.
+     * @param flops Floating point operations done inside the zone (kernels only).
+     * @param bytes Bytes moved to/from memory inside the zone (kernels only).
+     * @param units Units of work done inside the zone, in the site's unit.
+     */
+
+    ProfileZone(const ProfileSite& site, uint64_t flops = 0, uint64_t bytes = 0, uint64_t units = 0) :
+        site(site), flops(flops), bytes(bytes), units(units)
+    {
+        bPerf       = bPerfCountersEnabled && ReadZonePerfCounters(startPerf);
+        startNs     = GetNanoseconds();
+        startCycles = ReadCycleCounter();
+    }
+
+    /**
+     * ProfileZone::~ProfileZone - Close the zone and fold its duration into the calling
+     * thread's stats. No locking, each thread only ever touches its own stats.
+     */
+
+    ~ProfileZone()
+    {
+        uint64_t cycles = ReadCycleCounter() - startCycles;
+        uint64_t ns     = GetNanoseconds() - startNs;
+
+        PerfCounterValues endPerf;
+        bool bPerfEnd = bPerf && ReadZonePerfCounters(endPerf);
+
+        ProfileThreadData& data = GetProfileThreadData();
+        if (data.zones.size() <= site.id) data.zones.resize(site.id + 1, ProfileZoneStats{});
+
+        ProfileZoneStats& stats = data.zones[site.id];
+        stats.calls++;
+        stats.totalNs       += ns;
+        stats.totalCycles   += cycles;
+        stats.maxNs         = max(stats.maxNs, ns);
+        stats.flops         += flops;
+        stats.bytes         += bytes;
+        stats.units         += units;
+
+        if (bPerfEnd)
+        {
+            for (uint32_t i = 0; i < NUM_PERF_COUNTERS; i++) stats.perf[i] += endPerf.counts[i] - startPerf.counts[i];
+        }
+    }
+};
+
+// PROFILE_ZONE_WORK records how many units of work (samples, nnz, ...) the zone did, for
+// per-unit hardware counter stats. PROFILE_KERNEL additionally records analytic FLOP and
+// byte counts, which the roofline report turns into achieved GFLOP/s and GB/s. Byte counts
+// follow a compulsory traffic model: every array the kernel streams is counted once per
+// pass, gathered vectors once in total.
+
+#ifdef FTWT_PROFILE
+#define PROFILE_ZONE(name) \
+    static ProfileSite FTWT_CONCAT(profileSite, __LINE__)(name); \
+    ProfileZone FTWT_CONCAT(profileZone, __LINE__)(FTWT_CONCAT(profileSite, __LINE__))
+#define PROFILE_ZONE_WORK(name, units, unitName) \
+    static ProfileSite FTWT_CONCAT(profileSite, __LINE__)(name, unitName); \
+    ProfileZone FTWT_CONCAT(profileZone, __LINE__)(FTWT_CONCAT(profileSite, __LINE__), 0, 0, (uint64_t)(units))
+#define PROFILE_KERNEL(name, flops, bytes, units, unitName) \
+    static ProfileSite FTWT_CONCAT(profileSite, __LINE__)(name, unitName); \
+    ProfileZone FTWT_CONCAT(profileZone, __LINE__)(FTWT_CONCAT(profileSite, __LINE__), \
+        (uint64_t)(flops), (uint64_t)(bytes), (uint64_t)(units))
+#else
+#define PROFILE_ZONE(name)
+#define PROFILE_ZONE_WORK(name, units, unitName)
+#define PROFILE_KERNEL(name, flops, bytes, units, unitName)
+#endif
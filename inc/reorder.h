@@ -0,0 +1,106 @@
+#pragma once
+
+#include "matrix.h"
+
+static const uint32_t reorderPartSize       = 4096;
+static const uint32_t reorderCoarsestVerts  = 32;
+static const uint32_t reorderRefinePasses   = 2;
+static const double reorderImbalance        = 1.05;
+
+enum NeuronOrder
+{
+    ORDER_NONE,
+    ORDER_RCM,
+    ORDER_PARTITION
+};
+
+struct NeuronGraph
+{
+    uint32_t n;
+    vector<uint32_t> offsets;
+    vector<uint32_t> adj;
+    vector<uint32_t> edgeWeights;
+    vector<uint32_t> vertWeights;
+};
+
+NeuronGraph BuildNeuronGraph(const uint32_t* offsets, const uint32_t* colIdcs, uint32_t n, uint32_t m);
+vector<uint32_t> ReverseCuthillMcKee(const NeuronGraph& graph);
+vector<uint32_t> MultilevelPartition(const NeuronGraph& graph, uint32_t numParts);
+vector<uint32_t> PartitionOrder(const NeuronGraph& graph, uint32_t partSize);
+vector<uint32_t> InvertPermutation(const vector<uint32_t>& perm);
+
+/**
+ * NeuronOrderName - Printable name of a neuron ordering.
+ *
+ * @param  order Neuron ordering.
+ * @return       Ordering name.
+ */
+
+inline const char* NeuronOrderName(NeuronOrder order)
+{
+    switch (order)
+    {
+    case ORDER_RCM:         return "rcm";
+    case ORDER_PARTITION:   return "partition";
+    default:                return "none";
+    }
+}
+
+/**
+ * ComputeNeuronOrder - Renumber a square synapse matrix's neurons so connected neurons get
+ * nearby indices, which keeps the activation gathers in SpMV and pairing kernels within a
+ * few cache lines of each other. Synapse direction is ignored.
+ *
+ * @param  csc   Synapse matrix, n x n.
+ * @param  order Ordering to compute.
+ * @return       Permutation, perm[old neuron] = new neuron. Empty for ORDER_NONE.
+ */
+
+template<class T>
+vector<uint32_t> ComputeNeuronOrder(const CSCMat<T>& csc, NeuronOrder order)
+{
+    PROFILE_ZONE_WORK("ComputeNeuronOrder", csc.vals.size(), "nnz");
+
+    if (order == ORDER_NONE || csc.n == 0) return vector<uint32_t>();
+    assert(csc.n == csc.m);
+
+    NeuronGraph graph   = BuildNeuronGraph(csc.offsets.data(), csc.colIdcs.data(), csc.n, csc.m);
+    vector<uint32_t> newToOld;
+
+    switch (order)
+    {
+    case ORDER_PARTITION:   newToOld = PartitionOrder(graph, reorderPartSize); break;
+    default:                newToOld = ReverseCuthillMcKee(graph); break;
+    }
+
+    return InvertPermutation(newToOld);
+}
+
+/**
+ * MatrixBandwidth - Mean and max distance of an entry's column from its row, a quick
+ * measure of how well an ordering clusters the gathers.
+ *
+ * @param csc     Matrix to measure.
+ * @param meanOut Mean |row - col| over entries.
+ * @param maxOut  Max |row - col| over entries.
+ */
+
+template<class T>
+void MatrixBandwidth(const CSCMat<T>& csc, double& meanOut, uint32_t& maxOut)
+{
+    double sum  = 0.0;
+    maxOut      = 0;
+
+    for (uint32_t r = 0; r < csc.n; r++)
+    {
+        for (uint32_t i = csc.offsets[r]; i < csc.offsets[r + 1]; i++)
+        {
+            uint32_t c      = csc.colIdcs[i];
+            uint32_t dist   = c > r ? c - r : r - c;
+            sum             += dist;
+            maxOut          = max(maxOut, dist);
+        }
+    }
+
+    meanOut = csc.vals.empty() ? 0.0 : sum / (double)csc.vals.size();
+}
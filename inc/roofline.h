@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "profiler.h"
+
+using namespace std;
+
+struct RooflineMachine
+{
+    uint32_t numThreads;
+    double peakGflops;
+    double bandwidthGBs;
+
+    /**
+     * RooflineMachine::RidgeIntensity - Arithmetic intensity where the memory roof meets the
+     * compute roof. Kernels below it are bandwidth bound.
+     *
+     * @return Ridge point in FLOP/byte.
+     */
+
+    double RidgeIntensity() const { return peakGflops / bandwidthGBs; }
+
+    /**
+     * RooflineMachine::Attainable - Best achievable GFLOP/s at a given arithmetic intensity.
+     *
+     * @param  intensity Arithmetic intensity in FLOP/byte.
+     * @return           Roofline bound in GFLOP/s.
+     */
+
+    double Attainable(double intensity) const { return min(peakGflops, intensity * bandwidthGBs); }
+};
+
+double MeasureStreamBandwidth(uint32_t numThreads);
+double MeasurePeakFlops(uint32_t numThreads);
+RooflineMachine MeasureRoofline(uint32_t numThreads = 0);
+void PrintRooflineReport(const RooflineMachine& machine);
@@ -0,0 +1,599 @@
+#pragma once
+
+#include "matrix.h"
+#include "simd.h"
+
+static const uint32_t sellChunkHeight   = 8;
+static const uint32_t sellSortWindow    = 256;
+static const uint32_t sellChunkGrain    = 64;
+static const uint32_t sellPadRow        = 0xffffffff;
+static const double sellMinRowCV        = 0.5;
+static const double sellMinFill         = 0.75;
+
+#ifdef FTWT_HAS_AVX2_PATH
+void SELLSpMVChunksAVX2(const double* vals, const uint32_t* colIdcs, const uint32_t* chunkOffsets,
+    const uint32_t* rowPerm, const double* x, double* y, uint32_t chBegin, uint32_t chEnd);
+void SELLPairChunksAVX2(const uint32_t* colIdcs, const uint32_t* chunkOffsets,
+    const uint32_t* rowPerm, const double* const* pre, const double* const* post, uint32_t batchSize,
+    double* pairings, uint32_t chBegin, uint32_t chEnd);
+#endif
+
+/**
+ * SELLSpMVChunks - y = A * x over a range of SELL chunks. Within a chunk, slot j of lane l
+ * sits at j * C + l, so the lane loop is unit stride over values and column indices.
+ *
+ * @param vals         Padded values.
+ * @param colIdcs      Padded column indices (padding points at column 0 with value 0).
+ * @param chunkOffsets Slot offset of each chunk.
+ * @param rowPerm      Original row of each sorted row, sellPadRow for padding rows.
+ * @param C            Chunk height.
+ * @param x            Input vector.
+ * @param y            Output vector, indexed by original row.
+ * @param chBegin      First chunk.
+ * @param chEnd        One past last chunk.
+ */
+
+template<class T>
+inline void SELLSpMVChunks(const T* vals, const uint32_t* colIdcs, const uint32_t* chunkOffsets,
+    const uint32_t* rowPerm, uint32_t C, const T* x, T* y, uint32_t chBegin, uint32_t chEnd)
+{
+    T acc[64];
+
+    for (uint32_t ch = chBegin; ch < chEnd; ch++)
+    {
+        for (uint32_t l = 0; l < C; l++) acc[l] = 0;
+
+        for (uint32_t s = chunkOffsets[ch]; s < chunkOffsets[ch + 1]; s += C)
+        {
+            for (uint32_t l = 0; l < C; l++) acc[l] += vals[s + l] * x[colIdcs[s + l]];
+        }
+
+        for (uint32_t l = 0; l < C; l++)
+        {
+            uint32_t row = rowPerm[ch * C + l];
+            if (row != sellPadRow) y[row] = acc[l];
+        }
+    }
+}
+
+/**
+ * SELLPairChunks - Batch averaged pairings over a range of SELL chunks, pairing = post
+ * activation of the synapse's row * pre activation of its column. The batch loop runs
+ * inside the chunk loop so a chunk's pairings stay in cache across the batch, and chunks
+ * whose rows are all inactive for a batch entry are skipped. Padding slots get pairings
+ * too, callers only read slots inside row lengths.
+ *
+ * @param colIdcs      Padded column indices.
+ * @param chunkOffsets Slot offset of each chunk.
+ * @param rowPerm      Original row of each sorted row, sellPadRow for padding rows.
+ * @param C            Chunk height.
+ * @param pre          Presynaptic activations per batch entry.
+ * @param post         Postsynaptic activations per batch entry.
+ * @param batchSize    Number of batch entries.
+ * @param pairings     Output pairings, same layout as the values.
+ * @param chBegin      First chunk.
+ * @param chEnd        One past last chunk.
+ */
+
+template<class T>
+inline void SELLPairChunks(const uint32_t* colIdcs, const uint32_t* chunkOffsets, const uint32_t* rowPerm,
+    uint32_t C, const T* const* pre, const T* const* post, uint32_t batchSize, T* pairings,
+    uint32_t chBegin, uint32_t chEnd)
+{
+    T postLane[64];
+    T batchSizeInv = (T)1 / (T)batchSize;
+
+    for (uint32_t ch = chBegin; ch < chEnd; ch++)
+    {
+        uint32_t begin  = chunkOffsets[ch];
+        uint32_t end    = chunkOffsets[ch + 1];
+
+        for (uint32_t s = begin; s < end; s++) pairings[s] = 0;
+
+        for (uint32_t b = 0; b < batchSize; b++)
+        {
+            bool bActive = false;
+
+            for (uint32_t l = 0; l < C; l++)
+            {
+                uint32_t row    = rowPerm[ch * C + l];
+                postLane[l]     = row == sellPadRow ? 0 : post[b][row];
+                bActive         |= postLane[l] != 0;
+            }
+
+            if (!bActive) continue;
+
+            for (uint32_t s = begin; s < end; s += C)
+            {
+                for (uint32_t l = 0; l < C; l++) pairings[s + l] += postLane[l] * pre[b][colIdcs[s + l]];
+            }
+        }
+
+        for (uint32_t s = begin; s < end; s++) pairings[s] *= batchSizeInv;
+    }
+}
+
+template<class T>
+struct SELLMat
+{
+    vector<T> vals;
+    vector<uint32_t> colIdcs;
+    vector<uint32_t> chunkOffsets;
+    vector<uint32_t> rowLens;
+    vector<uint32_t> rowPerm;
+    vector<uint32_t> rowPos;
+
+    uint32_t n;
+    uint32_t m;
+    uint32_t C;
+    uint32_t sigma;
+    uint32_t numChunks;
+    string name;
+
+    /**
+     * SELLMat::SELLMat - Sliced ELLPACK (SELL-C-sigma) matrix default constructor. Rows are
+     * sorted by length within windows of sigma rows, then packed into chunks of C rows
+     * padded to the chunk's longest row and stored column-major inside the chunk, so SIMD
+     * lanes walk C rows at once. rowPos maps each row back to its sorted position.
+     */
+
+    SELLMat() : n(0), m(0), C(sellChunkHeight), sigma(sellSortWindow), numChunks(0), name("") {}
+
+    /**
+     * SELLMat::SELLMat - Build a SELL-C-sigma matrix from a CSC matrix.
+     *
+     * @param csc      Matrix to convert.
+     * @param chunkH   Chunk height (rows per chunk, at most 64).
+     * @param sortRows Sorting window in rows, rounded up to a multiple of chunkH.
+     */
+
+    SELLMat(const CSCMat<T>& csc, uint32_t chunkH = sellChunkHeight, uint32_t sortRows = sellSortWindow)
+    {
+        fromCSC(csc, chunkH, sortRows);
+    }
+
+    /**
+     * SELLMat::nnz - Number of real (unpadded) entries.
+     *
+     * @return Nonzero count.
+     */
+
+    size_t nnz() const
+    {
+        size_t cnt = 0;
+        for (auto len : rowLens) cnt += len;
+        return cnt;
+    }
+
+    /**
+     * SELLMat::fromCSC - Convert a CSC matrix. Sort rows by descending length inside each
+     * sigma window, size chunks from their longest row, then fill chunks in parallel.
+     *
+     * @param csc      Matrix to convert.
+     * @param chunkH   Chunk height (rows per chunk, at most 64).
+     * @param sortRows Sorting window in rows, rounded up to a multiple of chunkH.
+     */
+
+    void fromCSC(const CSCMat<T>& csc, uint32_t chunkH = sellChunkHeight, uint32_t sortRows = sellSortWindow)
+    {
+        PROFILE_ZONE_WORK("SELLMat::fromCSC", csc.vals.size(), "nnz");
+        assert(chunkH > 0 && chunkH <= 64);
+
+        n           = csc.n;
+        m           = csc.m;
+        C           = chunkH;
+        sigma       = max(C, (sortRows + C - 1) / C * C);
+        numChunks   = (n + C - 1) / C;
+        name        = csc.name;
+
+        uint32_t paddedRows = numChunks * C;
+
+        rowPerm.resize(paddedRows);
+        rowLens.resize(paddedRows);
+
+        for (uint32_t r = 0; r < paddedRows; r++) rowPerm[r] = r < n ? r : sellPadRow;
+
+        auto rowLen = [&](uint32_t row) { return row == sellPadRow ? 0 : csc.offsets[row + 1] - csc.offsets[row]; };
+
+        for (uint32_t w = 0; w < paddedRows; w += sigma)
+        {
+            uint32_t wEnd = min(paddedRows, w + sigma);
+
+            stable_sort(rowPerm.begin() + w, rowPerm.begin() + wEnd,
+                [&](uint32_t a, uint32_t b) { return rowLen(a) > rowLen(b); });
+        }
+
+        chunkOffsets.assign(numChunks + 1, 0);
+
+        for (uint32_t r = 0; r < paddedRows; r++) rowLens[r] = rowLen(rowPerm[r]);
+
+        rowPos.resize(n);
+
+        for (uint32_t r = 0; r < paddedRows; r++)
+        {
+            if (rowPerm[r] != sellPadRow) rowPos[rowPerm[r]] = r;
+        }
+
+        for (uint32_t ch = 0; ch < numChunks; ch++)
+        {
+            uint32_t width = 0;
+            for (uint32_t l = 0; l < C; l++) width = max(width, rowLens[ch * C + l]);
+            chunkOffsets[ch] = width * C;
+        }
+
+        ExclusiveScan(&chunkOffsets[0], numChunks + 1);
+
+        vals.assign(chunkOffsets[numChunks], 0);
+        colIdcs.assign(chunkOffsets[numChunks], 0);
+
+        ParallelFor(0, numChunks, sellChunkGrain, [&](uint32_t chBegin, uint32_t chEnd)
+        {
+            for (uint32_t ch = chBegin; ch < chEnd; ch++)
+            {
+                for (uint32_t l = 0; l < C; l++)
+                {
+                    uint32_t row = rowPerm[ch * C + l];
+                    if (row == sellPadRow) continue;
+
+                    uint32_t slot = chunkOffsets[ch] + l;
+
+                    for (uint32_t i = csc.offsets[row]; i < csc.offsets[row + 1]; i++, slot += C)
+                    {
+                        vals[slot]      = csc.vals[i];
+                        colIdcs[slot]   = csc.colIdcs[i];
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * SELLMat::toCSC - Convert back to CSC form, dropping padding.
+     *
+     * @return Compressed sparse representation of this matrix.
+     */
+
+    CSCMat<T> toCSC() const
+    {
+        PROFILE_ZONE_WORK("SELLMat::toCSC", vals.size(), "nnz");
+        CSCMat<T> csc(n, m, name);
+
+        csc.offsets.assign((size_t)n + 1, 0);
+
+        for (uint32_t r = 0; r < numChunks * C; r++)
+        {
+            if (rowPerm[r] != sellPadRow) csc.offsets[rowPerm[r]] = rowLens[r];
+        }
+
+        uint32_t nnz = ExclusiveScan(&csc.offsets[0], (size_t)n + 1);
+
+        csc.vals.resize(nnz);
+        csc.colIdcs.resize(nnz);
+
+        ParallelFor(0, numChunks, sellChunkGrain, [&](uint32_t chBegin, uint32_t chEnd)
+        {
+            for (uint32_t ch = chBegin; ch < chEnd; ch++)
+            {
+                for (uint32_t l = 0; l < C; l++)
+                {
+                    uint32_t row = rowPerm[ch * C + l];
+                    if (row == sellPadRow) continue;
+
+                    uint32_t slot = chunkOffsets[ch] + l;
+
+                    for (uint32_t i = csc.offsets[row]; i < csc.offsets[row + 1]; i++, slot += C)
+                    {
+                        csc.vals[i]     = vals[slot];
+                        csc.colIdcs[i]  = colIdcs[slot];
+                    }
+                }
+            }
+        });
+
+        return csc;
+    }
+
+    /**
+     * SELLMat::multiply - Do SELL matrix * vector multiply into a caller provided buffer.
+     * Chunks are split across kernel threads, doubles with C = 8 use the AVX2 gather
+     * kernel.
+     *
+     * @param x Vector to multiply by this matrix (m entries).
+     * @param y Result vector (n entries), overwritten.
+     */
+
+    void multiply(const T* x, T* y) const
+    {
+        PROFILE_KERNEL("SELLMat::multiply", 2 * vals.size(),
+            vals.size() * (sizeof(T) + sizeof(uint32_t)) + (numChunks + 1 + numChunks * C) * sizeof(uint32_t) +
+            (n + m) * sizeof(T), vals.size(), "slot");
+
+        uint32_t grain = vals.size() < spmvParallelNnz ? numChunks : sellChunkGrain;
+
+        ParallelFor(0, numChunks, grain, [&](uint32_t chBegin, uint32_t chEnd)
+        {
+            multiplyChunks(x, y, chBegin, chEnd);
+        });
+    }
+
+    /**
+     * SELLMat::multiplyBlock - Multiply a row-major block of k vectors, Y = A * X. Each
+     * slot's value is applied to the k-wide row of X, padding slots are skipped.
+     *
+     * @param x Input block (m x k, row-major).
+     * @param y Result block (n x k, row-major), overwritten.
+     * @param k Number of vectors in the block.
+     */
+
+    void multiplyBlock(const T* x, T* y, uint32_t k) const
+    {
+        PROFILE_KERNEL("SELLMat::multiplyBlock", 2 * vals.size() * k,
+            vals.size() * (sizeof(T) + sizeof(uint32_t)) + (size_t)(n + m) * k * sizeof(T),
+            vals.size() * k, "slot");
+
+        ParallelFor(0, numChunks, sellChunkGrain, [&](uint32_t chBegin, uint32_t chEnd)
+        {
+            for (uint32_t ch = chBegin; ch < chEnd; ch++)
+            {
+                for (uint32_t l = 0; l < C; l++)
+                {
+                    uint32_t row = rowPerm[ch * C + l];
+                    if (row == sellPadRow) continue;
+
+                    T* yRow = y + (size_t)row * k;
+                    for (uint32_t j = 0; j < k; j++) yRow[j] = 0;
+
+                    for (uint32_t s = chunkOffsets[ch] + l, i = 0; i < rowLens[ch * C + l]; s += C, i++)
+                    {
+                        Axpy(vals[s], x + (size_t)colIdcs[s] * k, yRow, k);
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * SELLMat::computePairings - Batch averaged pairings for every slot, see SELLPairChunks.
+     *
+     * @param pre      Presynaptic activations per batch entry (m entries each).
+     * @param post     Postsynaptic activations per batch entry (n entries each).
+     * @param pairings Output pairings, resized to the padded slot count.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const vector<vector<T>>& post, vector<T>& pairings) const
+    {
+        uint32_t batchSize = (uint32_t)pre.size();
+
+        PROFILE_KERNEL("SELLMat::computePairings", (2 * batchSize + 1) * vals.size(),
+            vals.size() * (sizeof(uint32_t) + 2 * sizeof(T)) + batchSize * (n + m) * sizeof(T),
+            batchSize * vals.size(), "slot");
+
+        assert(batchSize > 0 && post.size() == batchSize);
+
+        pairings.resize(vals.size());
+
+        vector<const T*> pPre(batchSize);
+        vector<const T*> pPost(batchSize);
+
+        for (uint32_t b = 0; b < batchSize; b++)
+        {
+            pPre[b]     = pre[b].data();
+            pPost[b]    = post[b].data();
+        }
+
+        ParallelFor(0, numChunks, sellChunkGrain, [&](uint32_t chBegin, uint32_t chEnd)
+        {
+            pairChunks(pPre.data(), pPost.data(), batchSize, pairings.data(), chBegin, chEnd);
+        });
+    }
+
+    /**
+     * SELLMat::computePairings - Batch averaged pairings from sparse post activations. Only
+     * the slots of rows with an active post neuron are walked, found through rowPos.
+     *
+     * @param pre      Presynaptic activations per batch entry (m entries each).
+     * @param post     Active postsynaptic neurons of the batch.
+     * @param pairings Output pairings, resized to the padded slot count.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const ActiveRows<T>& post, vector<T>& pairings) const
+    {
+        PROFILE_ZONE_WORK("SELLMat::computePairings sparse", post.entries.size(), "entry");
+
+        pairings.assign(vals.size(), 0);
+        T batchSizeInv = (T)1 / (T)post.batchSize;
+
+        ParallelFor(0, post.size(), activeRowGrain, [&](uint32_t aBegin, uint32_t aEnd)
+        {
+            for (uint32_t a = aBegin; a < aEnd; a++)
+            {
+                uint32_t pos    = rowPos[post.rows[a]];
+                uint32_t first  = chunkOffsets[pos / C] + pos % C;
+                uint32_t end    = first + rowLens[pos] * C;
+
+                for (uint32_t e = post.offsets[a]; e < post.offsets[a + 1]; e++)
+                {
+                    const T* pPre   = pre[post.entries[e].first].data();
+                    T postAct       = post.entries[e].second;
+
+                    for (uint32_t s = first; s < end; s += C) pairings[s] += postAct * pPre[colIdcs[s]];
+                }
+
+                for (uint32_t s = first; s < end; s += C) pairings[s] *= batchSizeInv;
+            }
+        });
+    }
+
+    /**
+     * SELLMat::updateRows - Add scaled pairings to every real slot, then normalize each row
+     * to unit L2 norm. Padding slots are left at zero.
+     *
+     * @param pairings   Pairing per slot.
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     */
+
+    void updateRows(const vector<T>& pairings, T learnRate, bool bNormalize = true)
+    {
+        PROFILE_KERNEL("SELLMat::updateRows", 5 * vals.size() + n,
+            5 * vals.size() * sizeof(T) + 2 * numChunks * C * sizeof(uint32_t), vals.size(), "slot");
+
+        ParallelFor(0, numChunks, sellChunkGrain, [&](uint32_t chBegin, uint32_t chEnd)
+        {
+            T totals[64];
+
+            for (uint32_t ch = chBegin; ch < chEnd; ch++)
+            {
+                const uint32_t* lens = &rowLens[ch * C];
+
+                for (uint32_t l = 0; l < C; l++) totals[l] = 0;
+
+                for (uint32_t s = chunkOffsets[ch], j = 0; s < chunkOffsets[ch + 1]; s += C, j++)
+                {
+                    for (uint32_t l = 0; l < C; l++)
+                    {
+                        if (j >= lens[l]) continue;
+
+                        T w         = vals[s + l] + learnRate * pairings[s + l];
+                        totals[l]   += w * w;
+                        vals[s + l] = w;
+                    }
+                }
+
+                if (!bNormalize) continue;
+
+                for (uint32_t l = 0; l < C; l++) totals[l] = sqrt(totals[l]);
+
+                for (uint32_t s = chunkOffsets[ch], j = 0; s < chunkOffsets[ch + 1]; s += C, j++)
+                {
+                    for (uint32_t l = 0; l < C; l++)
+                    {
+                        if (j < lens[l]) vals[s + l] /= totals[l];
+                    }
+                }
+            }
+        });
+    }
+
+private:
+
+    /**
+     * SELLMat::multiplyChunks - Pick the SpMV chunk kernel.
+     */
+
+    void multiplyChunks(const T* x, T* y, uint32_t chBegin, uint32_t chEnd) const
+    {
+        SELLSpMVChunks(vals.data(), colIdcs.data(), chunkOffsets.data(), rowPerm.data(), C, x, y, chBegin, chEnd);
+    }
+
+    /**
+     * SELLMat::pairChunks - Pick the pairing chunk kernel.
+     */
+
+    void pairChunks(const T* const* pre, const T* const* post, uint32_t batchSize, T* pairings,
+        uint32_t chBegin, uint32_t chEnd) const
+    {
+        SELLPairChunks(colIdcs.data(), chunkOffsets.data(), rowPerm.data(), C, pre, post, batchSize, pairings,
+            chBegin, chEnd);
+    }
+};
+
+#ifdef FTWT_HAS_AVX2_PATH
+
+/**
+ * SELLMat<double>::multiplyChunks - Double precision, AVX2 when C = 8.
+ */
+
+template<>
+inline void SELLMat<double>::multiplyChunks(const double* x, double* y, uint32_t chBegin, uint32_t chEnd) const
+{
+    if (C == 8 && CpuHasAVX2())
+    {
+        SELLSpMVChunksAVX2(vals.data(), colIdcs.data(), chunkOffsets.data(), rowPerm.data(), x, y, chBegin, chEnd);
+        return;
+    }
+
+    SELLSpMVChunks(vals.data(), colIdcs.data(), chunkOffsets.data(), rowPerm.data(), C, x, y, chBegin, chEnd);
+}
+
+/**
+ * SELLMat<double>::pairChunks - Double precision, AVX2 when C = 8.
+ */
+
+template<>
+inline void SELLMat<double>::pairChunks(const double* const* pre, const double* const* post, uint32_t batchSize,
+    double* pairings, uint32_t chBegin, uint32_t chEnd) const
+{
+    if (C == 8 && CpuHasAVX2())
+    {
+        SELLPairChunksAVX2(colIdcs.data(), chunkOffsets.data(), rowPerm.data(), pre, post, batchSize,
+            pairings, chBegin, chEnd);
+        return;
+    }
+
+    SELLPairChunks(colIdcs.data(), chunkOffsets.data(), rowPerm.data(), C, pre, post, batchSize, pairings,
+        chBegin, chEnd);
+}
+
+#endif
+
+/**
+ * SELLFillRatio - Fraction of SELL-C-sigma slots that would hold real entries, without
+ * building the matrix.
+ *
+ * @param  csc   Matrix to check.
+ * @param  C     Chunk height.
+ * @param  sigma Sorting window in rows.
+ * @return       Nonzeros / padded slots, 1 for an empty matrix.
+ */
+
+template<class T>
+inline double SELLFillRatio(const CSCMat<T>& csc, uint32_t C = sellChunkHeight, uint32_t sigma = sellSortWindow)
+{
+    sigma = max(C, (sigma + C - 1) / C * C);
+
+    vector<uint32_t> lens(csc.n);
+    for (uint32_t r = 0; r < csc.n; r++) lens[r] = csc.offsets[r + 1] - csc.offsets[r];
+
+    uint64_t slots = 0;
+
+    for (uint32_t w = 0; w < csc.n; w += sigma)
+    {
+        uint32_t wEnd = min(csc.n, w + sigma);
+        sort(lens.begin() + w, lens.begin() + wEnd, greater<uint32_t>());
+
+        for (uint32_t r = w; r < wEnd; r += C) slots += (uint64_t)lens[r] * C;
+    }
+
+    return slots ? (double)csc.vals.size() / (double)slots : 1.0;
+}
+
+/**
+ * ChooseSparseFormat - Pick CSR or SELL storage for a matrix from its row-length spread.
+ * Uniform rows already vectorize fine as CSR. When the coefficient of variation of row
+ * lengths is high, CSR's per-row remainder loops dominate and SELL wins, as long as
+ * sorting keeps its padding low.
+ *
+ * @param  csc Matrix to check.
+ * @return     Preferred storage format.
+ */
+
+template<class T>
+inline SparseFormat ChooseSparseFormat(const CSCMat<T>& csc)
+{
+    if (csc.n == 0 || csc.vals.empty()) return SPARSE_CSR;
+
+    double mean = (double)csc.vals.size() / (double)csc.n;
+    double var  = 0.0;
+
+    for (uint32_t r = 0; r < csc.n; r++)
+    {
+        double d = (double)(csc.offsets[r + 1] - csc.offsets[r]) - mean;
+        var += d * d;
+    }
+
+    double cv = sqrt(var / (double)csc.n) / mean;
+
+    if (cv < sellMinRowCV) return SPARSE_CSR;
+    return SELLFillRatio(csc) >= sellMinFill ? SPARSE_SELL : SPARSE_CSR;
+}
@@ -4,7 +4,7 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include <Windows.h>
+#include "platform.h"
 
 using namespace std;
 
@@ -0,0 +1,38 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FTWT_X86 1
+#include <immintrin.h>
+#endif
+
+// Kernels with AVX2 code paths are compiled per function with FTWT_TARGET_AVX2 so the
+// rest of the build stays baseline x86-64, then picked at runtime with CpuHasAVX2().
+// MSVC can't retarget single functions, there the AVX2 paths need /arch:AVX2.
+
+#if defined(FTWT_X86) && (defined(__GNUC__) || defined(__clang__))
+#define FTWT_HAS_AVX2_PATH 1
+#define FTWT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#elif defined(FTWT_X86) && defined(_MSC_VER) && defined(__AVX2__)
+#define FTWT_HAS_AVX2_PATH 1
+#define FTWT_TARGET_AVX2
+#else
+#define FTWT_TARGET_AVX2
+#endif
+
+/**
+ * CpuHasAVX2 - Check whether the CPU supports AVX2 and FMA.
+ *
+ * @return True if AVX2 code paths can be used.
+ */
+
+inline bool CpuHasAVX2()
+{
+#if defined(FTWT_HAS_AVX2_PATH) && (defined(__GNUC__) || defined(__clang__))
+    static bool bHasAVX2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return bHasAVX2;
+#elif defined(FTWT_HAS_AVX2_PATH)
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,464 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include "simd.h"
+
+#ifdef FTWT_HAS_AVX2_PATH
+void SpMVRowsAVX2(const double* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const double* x, double* y, uint32_t rBegin, uint32_t rEnd);
+void SpMVRowsAVX2(const double* vals, const uint16_t* colIdcs, const uint32_t* offsets,
+    const double* x, double* y, uint32_t rBegin, uint32_t rEnd);
+void SpMMRowsAVX2(const double* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const double* x, double* y, uint32_t k, uint32_t rBegin, uint32_t rEnd);
+void AxpyAVX2(double a, const double* x, double* y, uint32_t k);
+void TileRowPairingsAVX2(double* pairings, const uint32_t* cols, size_t len, const double* postRow,
+    const double* preTiles, uint32_t numTiles);
+#endif
+
+static const uint32_t pairBatchTile = 16;
+
+/**
+ * PartitionRowsByNnz - Split CSR rows into contiguous ranges of roughly equal work. Work
+ * for a row is its nonzero count plus one, so long rows don't all land on one thread in
+ * skewed graphs and runs of empty rows still get spread out.
+ *
+ * @param offsets  Row offsets (n + 1 entries).
+ * @param n        Number of rows.
+ * @param numParts Number of ranges.
+ * @param bounds   Output range boundaries (numParts + 1 entries), part p is rows
+ *                 [bounds[p], bounds[p + 1]).
+ */
+
+template<class OffT>
+inline void PartitionRowsByNnz(const OffT* offsets, uint32_t n, uint32_t numParts, uint32_t* bounds)
+{
+    uint64_t totalWork = (uint64_t)offsets[n] + n;
+
+    bounds[0]           = 0;
+    bounds[numParts]    = n;
+
+    for (uint32_t p = 1; p < numParts; p++)
+    {
+        uint64_t target = totalWork * p / numParts;
+        uint32_t lo     = bounds[p - 1];
+        uint32_t hi     = n;
+
+        // First row whose starting work offset reaches the target.
+
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+
+            if ((uint64_t)offsets[mid] + mid < target) lo = mid + 1;
+            else hi = mid;
+        }
+
+        bounds[p] = lo;
+    }
+}
+
+/**
+ * SpMVRows - Compute y = A * x for a range of CSR rows. Four independent accumulators per
+ * row hide the FMA latency and let the gathers from x overlap.
+ *
+ * @param vals    Nonzero values.
+ * @param colIdcs Column index of each nonzero.
+ * @param offsets Row offsets into vals/colIdcs.
+ * @param x       Input vector.
+ * @param y       Output vector, rows [rBegin, rEnd) are overwritten.
+ * @param rBegin  First row.
+ * @param rEnd    One past last row.
+ */
+
+template<class T, class IdxT, class OffT>
+inline void SpMVRows(const T* vals, const IdxT* colIdcs, const OffT* offsets,
+    const T* x, T* y, uint32_t rBegin, uint32_t rEnd)
+{
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        OffT i          = offsets[r];
+        OffT end        = offsets[r + 1];
+        T acc0          = 0;
+        T acc1          = 0;
+        T acc2          = 0;
+        T acc3          = 0;
+
+        for (; i + 4 <= end; i += 4)
+        {
+            acc0 += vals[i + 0] * x[colIdcs[i + 0]];
+            acc1 += vals[i + 1] * x[colIdcs[i + 1]];
+            acc2 += vals[i + 2] * x[colIdcs[i + 2]];
+            acc3 += vals[i + 3] * x[colIdcs[i + 3]];
+        }
+
+        for (; i < end; i++) acc0 += vals[i] * x[colIdcs[i]];
+
+        y[r] = (acc0 + acc1) + (acc2 + acc3);
+    }
+}
+
+/**
+ * SpMVRows - Double precision rows with 32-bit indices, uses the AVX2 gather kernel when
+ * the CPU has it.
+ */
+
+inline void SpMVRows(const double* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const double* x, double* y, uint32_t rBegin, uint32_t rEnd)
+{
+#ifdef FTWT_HAS_AVX2_PATH
+    if (CpuHasAVX2())
+    {
+        SpMVRowsAVX2(vals, colIdcs, offsets, x, y, rBegin, rEnd);
+        return;
+    }
+#endif
+
+    SpMVRows<double, uint32_t, uint32_t>(vals, colIdcs, offsets, x, y, rBegin, rEnd);
+}
+
+/**
+ * SpMVRows - Double precision rows with 16-bit indices, AVX2 widens them for the gather.
+ */
+
+inline void SpMVRows(const double* vals, const uint16_t* colIdcs, const uint32_t* offsets,
+    const double* x, double* y, uint32_t rBegin, uint32_t rEnd)
+{
+#ifdef FTWT_HAS_AVX2_PATH
+    if (CpuHasAVX2())
+    {
+        SpMVRowsAVX2(vals, colIdcs, offsets, x, y, rBegin, rEnd);
+        return;
+    }
+#endif
+
+    SpMVRows<double, uint16_t, uint32_t>(vals, colIdcs, offsets, x, y, rBegin, rEnd);
+}
+
+/**
+ * DeltaRowDot - Dot product of one row whose column indices are a running sum of fixed
+ * width gaps from a base column.
+ *
+ * @param  vals   Row values.
+ * @param  gaps   Row gaps, the first one is 0.
+ * @param  base   First column of the row.
+ * @param  len    Row length.
+ * @param  x      Input vector.
+ * @return        Row dot product.
+ */
+
+template<class T, class GapT>
+inline T DeltaRowDot(const T* vals, const GapT* gaps, size_t base, size_t len, const T* x)
+{
+    size_t c    = base;
+    size_t i    = 0;
+    T acc0      = 0;
+    T acc1      = 0;
+    T acc2      = 0;
+    T acc3      = 0;
+
+    for (; i + 4 <= len; i += 4)
+    {
+        size_t c0   = c + gaps[i + 0];
+        size_t c1   = c0 + gaps[i + 1];
+        size_t c2   = c1 + gaps[i + 2];
+        c           = c2 + gaps[i + 3];
+
+        acc0 += vals[i + 0] * x[c0];
+        acc1 += vals[i + 1] * x[c1];
+        acc2 += vals[i + 2] * x[c2];
+        acc3 += vals[i + 3] * x[c];
+    }
+
+    for (; i < len; i++)
+    {
+        c       += gaps[i];
+        acc0    += vals[i] * x[c];
+    }
+
+    return (acc0 + acc1) + (acc2 + acc3);
+}
+
+/**
+ * DeltaSpMVRows - Compute y = A * x for a range of CSR rows whose column indices are stored
+ * as gaps. Each row keeps its first column as a base plus one gap per entry, in the
+ * narrowest of 1, 2 or 4 bytes that fits the row's largest gap, so clustered rows cost a
+ * byte of index traffic per nonzero and decoding is a branch free running sum.
+ *
+ * @param vals         Nonzero values.
+ * @param colDeltas    Gap stream, each row aligned to its gap width.
+ * @param deltaOffsets Byte offset of each row in colDeltas.
+ * @param deltaWidths  Gap width of each row in bytes.
+ * @param deltaBases   First column of each row.
+ * @param offsets      Row offsets into vals.
+ * @param x            Input vector.
+ * @param y            Output vector, rows [rBegin, rEnd) are overwritten.
+ * @param rBegin       First row.
+ * @param rEnd         One past last row.
+ */
+
+template<class T, class IdxT, class OffT>
+inline void DeltaSpMVRows(const T* vals, const uint8_t* colDeltas, const OffT* deltaOffsets,
+    const uint8_t* deltaWidths, const IdxT* deltaBases, const OffT* offsets, const T* x, T* y,
+    uint32_t rBegin, uint32_t rEnd)
+{
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        const uint8_t* gaps = colDeltas + deltaOffsets[r];
+        const T* rowVals    = vals + offsets[r];
+        size_t len          = offsets[r + 1] - offsets[r];
+        size_t base         = deltaBases[r];
+
+        switch (deltaWidths[r])
+        {
+        case 1:     y[r] = DeltaRowDot(rowVals, gaps, base, len, x); break;
+        case 2:     y[r] = DeltaRowDot(rowVals, (const uint16_t*)gaps, base, len, x); break;
+        default:    y[r] = DeltaRowDot(rowVals, (const uint32_t*)gaps, base, len, x); break;
+        }
+    }
+}
+
+/**
+ * DeltaDecodeRow - Expand one row's gaps back into column indices.
+ *
+ * @param gaps Row gaps, the first one is 0.
+ * @param base First column of the row.
+ * @param len  Row length.
+ * @param cols Output column indices (len entries).
+ */
+
+template<class GapT>
+inline void DeltaDecodeRow(const GapT* gaps, size_t base, size_t len, uint32_t* cols)
+{
+    uint32_t c = (uint32_t)base;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        c       += gaps[i];
+        cols[i] = c;
+    }
+}
+
+/**
+ * TileRowPairings - Accumulate one row's pairings over numTiles tiles of pairBatchTile batch
+ * entries, one sweep of the row per tile. Activations are neuron-major, so the row's post
+ * activations and each column's pre activations are contiguous and each tile's batch sum
+ * is a short dot product with four accumulators.
+ *
+ * @param pairings Row pairings, accumulated into.
+ * @param cols     Column index of each entry.
+ * @param len      Row length.
+ * @param postRow  Post activations of the row, numTiles * pairBatchTile entries.
+ * @param preTiles Pre activations, numTiles * pairBatchTile per column.
+ * @param numTiles Number of batch tiles.
+ */
+
+template<class T, class IdxT>
+inline void TileRowPairings(T* pairings, const IdxT* cols, size_t len, const T* postRow, const T* preTiles,
+    uint32_t numTiles)
+{
+    size_t stride = (size_t)numTiles * pairBatchTile;
+
+    for (size_t j0 = 0; j0 < stride; j0 += pairBatchTile)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            const T* preCol = preTiles + (size_t)cols[i] * stride;
+            T acc0          = 0;
+            T acc1          = 0;
+            T acc2          = 0;
+            T acc3          = 0;
+
+            for (size_t j = j0; j < j0 + pairBatchTile; j += 4)
+            {
+                acc0 += postRow[j + 0] * preCol[j + 0];
+                acc1 += postRow[j + 1] * preCol[j + 1];
+                acc2 += postRow[j + 2] * preCol[j + 2];
+                acc3 += postRow[j + 3] * preCol[j + 3];
+            }
+
+            pairings[i] += (acc0 + acc1) + (acc2 + acc3);
+        }
+    }
+}
+
+/**
+ * TileRowPairings - Double precision with 32-bit indices, the batch dot products run in
+ * AVX2 registers when the CPU has it.
+ */
+
+inline void TileRowPairings(double* pairings, const uint32_t* cols, size_t len, const double* postRow,
+    const double* preTiles, uint32_t numTiles)
+{
+#ifdef FTWT_HAS_AVX2_PATH
+    if (CpuHasAVX2())
+    {
+        TileRowPairingsAVX2(pairings, cols, len, postRow, preTiles, numTiles);
+        return;
+    }
+#endif
+
+    TileRowPairings<double, uint32_t>(pairings, cols, len, postRow, preTiles, numTiles);
+}
+
+/**
+ * UpdateRow - Add scaled pairings to one row's weights, then optionally normalize the row to
+ * unit L2 norm. The squared norm is summed as the weights are written, so a row is read
+ * twice at most and both times while it's still in cache.
+ *
+ * @param vals       Row weights, updated in place.
+ * @param pairings   Row pairings.
+ * @param len        Row length.
+ * @param learnRate  Pairing scale.
+ * @param bNormalize Whether to renormalize the row.
+ */
+
+template<class T>
+inline void UpdateRow(T* vals, const T* pairings, size_t len, T learnRate, bool bNormalize)
+{
+    T sumSq = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        T w     = vals[i] + learnRate * pairings[i];
+        sumSq   += w * w;
+        vals[i] = w;
+    }
+
+    if (!bNormalize) return;
+
+    T norm = sqrt(sumSq);
+    for (size_t i = 0; i < len; i++) vals[i] /= norm;
+}
+
+/**
+ * ScaleUpdateRow - Fold a row's scale into its weights and add scaled pairings, the update
+ * of a lazily normalized row.
+ *
+ * @param  vals      Row weights, updated in place.
+ * @param  pairings  Row pairings.
+ * @param  len       Row length.
+ * @param  scale     Row scale folded into the weights.
+ * @param  learnRate Pairing scale.
+ * @return           Sum of squares of the updated weights.
+ */
+
+template<class T>
+inline T ScaleUpdateRow(T* vals, const T* pairings, size_t len, T scale, T learnRate)
+{
+    T sumSq = 0;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        T w     = scale * vals[i] + learnRate * pairings[i];
+        sumSq   += w * w;
+        vals[i] = w;
+    }
+
+    return sumSq;
+}
+
+/**
+ * NormalizeRow - Normalize one row's weights to unit L2 norm, the update of a row whose
+ * pairings are all zero.
+ *
+ * @param vals Row weights, updated in place.
+ * @param len  Row length.
+ */
+
+template<class T>
+inline void NormalizeRow(T* vals, size_t len)
+{
+    T sumSq = 0;
+    for (size_t i = 0; i < len; i++) sumSq += vals[i] * vals[i];
+
+    T norm = sqrt(sumSq);
+    for (size_t i = 0; i < len; i++) vals[i] /= norm;
+}
+
+/**
+ * SpMMRows - Compute Y = A * X for a range of CSR rows, where X and Y hold k vectors stored
+ * row-major (entry j of row c at c * k + j). Each nonzero's value and column index are
+ * loaded once and applied to all k vectors, with the k-wide row of X contiguous.
+ *
+ * @param vals    Nonzero values.
+ * @param colIdcs Column index of each nonzero.
+ * @param offsets Row offsets into vals/colIdcs.
+ * @param x       Input block (m x k, row-major).
+ * @param y       Output block (n x k, row-major), rows [rBegin, rEnd) are overwritten.
+ * @param k       Number of vectors in the block.
+ * @param rBegin  First row.
+ * @param rEnd    One past last row.
+ */
+
+template<class T, class IdxT, class OffT>
+inline void SpMMRows(const T* vals, const IdxT* colIdcs, const OffT* offsets,
+    const T* x, T* y, uint32_t k, uint32_t rBegin, uint32_t rEnd)
+{
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        T* yRow = y + (size_t)r * k;
+        for (uint32_t j = 0; j < k; j++) yRow[j] = 0;
+
+        for (OffT i = offsets[r]; i < offsets[r + 1]; i++)
+        {
+            T val           = vals[i];
+            const T* xRow   = x + (size_t)colIdcs[i] * k;
+
+            for (uint32_t j = 0; j < k; j++) yRow[j] += val * xRow[j];
+        }
+    }
+}
+
+/**
+ * SpMMRows - Double precision rows with 32-bit indices, uses the AVX2 kernel when the CPU
+ * has it.
+ */
+
+inline void SpMMRows(const double* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const double* x, double* y, uint32_t k, uint32_t rBegin, uint32_t rEnd)
+{
+#ifdef FTWT_HAS_AVX2_PATH
+    if (CpuHasAVX2())
+    {
+        SpMMRowsAVX2(vals, colIdcs, offsets, x, y, k, rBegin, rEnd);
+        return;
+    }
+#endif
+
+    SpMMRows<double, uint32_t, uint32_t>(vals, colIdcs, offsets, x, y, k, rBegin, rEnd);
+}
+
+/**
+ * Axpy - y += a * x over k entries. Block multiply kernels of the non-CSR formats apply
+ * each stored value to a k-wide row of the input block with it.
+ *
+ * @param a Scale.
+ * @param x Input row.
+ * @param y Output row, accumulated into.
+ * @param k Row length.
+ */
+
+template<class T>
+inline void Axpy(T a, const T* x, T* y, uint32_t k)
+{
+    for (uint32_t j = 0; j < k; j++) y[j] += a * x[j];
+}
+
+/**
+ * Axpy - Double precision, AVX2 when the CPU has it.
+ */
+
+inline void Axpy(double a, const double* x, double* y, uint32_t k)
+{
+#ifdef FTWT_HAS_AVX2_PATH
+    if (CpuHasAVX2())
+    {
+        AxpyAVX2(a, x, y, k);
+        return;
+    }
+#endif
+
+    Axpy<double>(a, x, y, k);
+}
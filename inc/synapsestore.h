@@ -0,0 +1,508 @@
+#pragma once
+
+#include "matrix.h"
+#include "sellmat.h"
+#include "bsrmat.h"
+#include "densemat.h"
+#include "fixedmat.h"
+#include "dynmat.h"
+#include "eigenmat.h"
+#include "frontier.h"
+
+/**
+ * ChooseSynapseFormat - Pick the storage format for a synapse matrix. Dense storage wins
+ * once half the entries are present, since it drops index loads entirely. Next, 4x8 blocks
+ * are used when the nonzeros cluster well enough to keep blocks mostly full, which lets
+ * SpMV read contiguous slices of x. Otherwise CSR or SELL is picked from the row-length
+ * spread, see ChooseSparseFormat.
+ *
+ * @param  csc Matrix to check.
+ * @return     Preferred storage format.
+ */
+
+template<class T>
+inline SparseFormat ChooseSynapseFormat(const CSCMat<T>& csc)
+{
+    if (csc.n == 0 || csc.vals.empty()) return SPARSE_CSR;
+
+    double density = (double)csc.vals.size() / ((double)csc.n * (double)csc.m);
+
+    if (density >= denseMinDensity) return SPARSE_DENSE;
+    if (BSRFillRatio(csc) >= bsrMinFill) return SPARSE_BSR;
+
+    return ChooseSparseFormat(csc);
+}
+
+/**
+ * SparseFormatName - Printable name of a storage format.
+ *
+ * @param  format Storage format.
+ * @return        Format name.
+ */
+
+inline const char* SparseFormatName(SparseFormat format)
+{
+    switch (format)
+    {
+    case SPARSE_CSR:    return "CSR";
+    case SPARSE_SELL:   return "SELL";
+    case SPARSE_BSR:    return "BSR";
+    case SPARSE_DENSE:  return "Dense";
+    case SPARSE_FIXED16:        return "Fixed16";
+    case SPARSE_FIXED16_I32:    return "Fixed16-I32";
+    case SPARSE_DYNAMIC:        return "Dynamic";
+    case SPARSE_EIGEN:          return "Eigen";
+    default:            return "Auto";
+    }
+}
+
+static const uint32_t rowScaleFoldInterval = 256;
+
+template<class T>
+struct SynapseStore
+{
+    SparseFormat format;
+    bool bAutoFormat;
+    bool bDeltaIdcs;
+
+    CSCMat<T> csr;
+    SELLMat<T> sell;
+    BSRMat<T> bsr;
+    DenseMat<T> dense;
+    Fixed16Mat<T> fixed;
+    DynamicMat<T> dyn;
+    EigenMat<T> eigen;
+    SparseFormat packedFormat;
+    vector<T> pairings;
+    vector<T> rowScales;
+    vector<T> rowSumSq;
+    uint32_t numScaledUpdates;
+    ColumnIndex<> colIndex;
+
+    /**
+     * SynapseStore::SynapseStore - Synapse matrix held in one of several storage formats.
+     * Only the active format's matrix is populated, the others stay empty. The fixed point
+     * formats are lossy, the dynamic format trades kernel speed for cheap inserts and the
+     * Eigen format is a comparison baseline, so automatic selection never picks them. CSR
+     * synapses updated from sparse post activations are normalized lazily: row r's weights
+     * are rowScales[r] * csr row r until the scales are folded back into the values, see
+     * foldRowScales. rowScales is empty when there's nothing to fold. CSR synapses also get
+     * a column index for pushing activity forward, built on first use and dropped when the
+     * pattern changes.
+     */
+
+    SynapseStore() : format(SPARSE_CSR), bAutoFormat(true), bDeltaIdcs(false), packedFormat(SPARSE_AUTO),
+        numScaledUpdates(0) {}
+
+    /**
+     * SynapseStore::build - Store a matrix in the given format.
+     *
+     * @param csc         Synapse matrix, taken by value so callers done with theirs can move
+     *                    it in and CSR storage keeps it without a copy.
+     * @param fmt         Storage format, SPARSE_AUTO picks one with ChooseSynapseFormat and
+     *                    keeps re-picking after culls.
+     * @param bDelta      Whether CSR storage uses the delta encoded column index stream.
+     */
+
+    void build(CSCMat<T> csc, SparseFormat fmt = SPARSE_AUTO, bool bDelta = false)
+    {
+        PROFILE_ZONE_WORK("SynapseStore::build", csc.vals.size(), "nnz");
+
+        bAutoFormat = fmt == SPARSE_AUTO;
+        bDeltaIdcs  = bDelta;
+        format      = bAutoFormat ? ChooseSynapseFormat(csc) : fmt;
+
+        rowScales.clear();
+        rowSumSq.clear();
+        numScaledUpdates = 0;
+        colIndex.clear();
+
+        csr     = CSCMat<T>();
+        sell    = SELLMat<T>();
+        bsr     = BSRMat<T>();
+        dense   = DenseMat<T>();
+        fixed   = Fixed16Mat<T>();
+        dyn     = DynamicMat<T>();
+        eigen   = EigenMat<T>();
+
+        switch (format)
+        {
+        case SPARSE_SELL:   sell.fromCSC(csc); break;
+        case SPARSE_BSR:    bsr.fromCSC(csc); break;
+        case SPARSE_DENSE:  dense.fromCSC(csc); break;
+        case SPARSE_FIXED16:
+        case SPARSE_FIXED16_I32:
+            fixed.fromCSC(csc, format == SPARSE_FIXED16_I32);
+            break;
+        case SPARSE_DYNAMIC:    dyn.fromCSC(csc); break;
+        case SPARSE_EIGEN:      eigen.fromCSC(csc); break;
+        default:            csr = move(csc); break;
+        }
+
+        if (format == SPARSE_CSR && bDeltaIdcs && !csr.bDeltaIdcs) csr.encodeColDeltas();
+        if (format == SPARSE_CSR && !bDeltaIdcs && csr.bDeltaIdcs) csr.clearColDeltas();
+    }
+
+    /**
+     * SynapseStore::toCSC - Synapse matrix in CSC form, whatever the storage format.
+     *
+     * @return Compressed sparse copy of the synapses.
+     */
+
+    CSCMat<T> toCSC() const
+    {
+        switch (format)
+        {
+        case SPARSE_SELL:   return sell.toCSC();
+        case SPARSE_BSR:    return bsr.toCSC();
+        case SPARSE_DENSE:  return dense.toCSC();
+        case SPARSE_FIXED16:
+        case SPARSE_FIXED16_I32:    return fixed.toCSC();
+        case SPARSE_DYNAMIC:    return dyn.toCSC();
+        case SPARSE_EIGEN:      return eigen.toCSC();
+        default:            break;
+        }
+
+        CSCMat<T> csc = csr;
+        if (!rowScales.empty()) csc.foldRowScales(rowScales);
+
+        return csc;
+    }
+
+    /**
+     * SynapseStore::foldRowScales - Fold lazy row normalization scales into the CSR values
+     * and drop them. Done every rowScaleFoldInterval lazy updates so stored values don't
+     * drift from the weights they represent, and before anything that reads CSR values
+     * directly.
+     */
+
+    void foldRowScales()
+    {
+        if (rowScales.empty()) return;
+
+        csr.foldRowScales(rowScales);
+
+        rowScales.clear();
+        rowSumSq.clear();
+        numScaledUpdates = 0;
+    }
+
+    /**
+     * SynapseStore::columnIndex - Column index of CSR synapses, built if the pattern changed
+     * since the last call. Only valid for CSR storage.
+     *
+     * @return Column index.
+     */
+
+    const ColumnIndex<>& columnIndex()
+    {
+        assert(format == SPARSE_CSR);
+        if (colIndex.empty()) colIndex.build(csr);
+
+        return colIndex;
+    }
+
+    /**
+     * SynapseStore::nnz - Number of synapses.
+     *
+     * @return Synapse count.
+     */
+
+    size_t nnz() const
+    {
+        switch (format)
+        {
+        case SPARSE_SELL:   return sell.nnz();
+        case SPARSE_BSR:    return bsr.nnz();
+        case SPARSE_DENSE:  return dense.nnz();
+        case SPARSE_FIXED16:
+        case SPARSE_FIXED16_I32:    return fixed.nnz();
+        case SPARSE_DYNAMIC:    return dyn.nnz();
+        case SPARSE_EIGEN:      return eigen.nnz();
+        default:            return csr.vals.size();
+        }
+    }
+
+    /**
+     * SynapseStore::multiply - y = synapses * x.
+     *
+     * @param x Presynaptic activations.
+     * @param y Postsynaptic responses, overwritten.
+     */
+
+    void multiply(const T* x, T* y) const
+    {
+        switch (format)
+        {
+        case SPARSE_SELL:   sell.multiply(x, y); break;
+        case SPARSE_BSR:    bsr.multiply(x, y); break;
+        case SPARSE_DENSE:  dense.multiply(x, y); break;
+        case SPARSE_FIXED16:
+        case SPARSE_FIXED16_I32:    fixed.multiply(x, y); break;
+        case SPARSE_DYNAMIC:    dyn.multiply(x, y); break;
+        case SPARSE_EIGEN:      eigen.multiply(x, y); break;
+        default:            csr.multiply(x, y, rowScales.empty() ? nullptr : rowScales.data()); break;
+        }
+    }
+
+    /**
+     * SynapseStore::multiplyBlock - Y = synapses * X for a row-major block of k vectors.
+     *
+     * @param x Input block (m x k, row-major).
+     * @param y Result block (n x k, row-major), overwritten.
+     * @param k Number of vectors in the block.
+     */
+
+    void multiplyBlock(const T* x, T* y, uint32_t k) const
+    {
+        switch (format)
+        {
+        case SPARSE_SELL:   sell.multiplyBlock(x, y, k); break;
+        case SPARSE_BSR:    bsr.multiplyBlock(x, y, k); break;
+        case SPARSE_DENSE:  dense.multiplyBlock(x, y, k); break;
+        case SPARSE_FIXED16:
+        case SPARSE_FIXED16_I32:    fixed.multiplyBlock(x, y, k); break;
+        case SPARSE_DYNAMIC:    dyn.multiplyBlock(x, y, k); break;
+        case SPARSE_EIGEN:      eigen.multiplyBlock(x, y, k); break;
+        default:            csr.multiplyBlock(x, y, k, rowScales.empty() ? nullptr : rowScales.data()); break;
+        }
+    }
+
+    /**
+     * SynapseStore::computePairings - Batch averaged pairings in the layout of the active
+     * format's values.
+     *
+     * @param pre      Presynaptic activations per batch entry.
+     * @param post     Postsynaptic activations per batch entry.
+     * @param pairings Output pairings.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const vector<vector<T>>& post, vector<T>& pairings) const
+    {
+        switch (format)
+        {
+        case SPARSE_SELL:   sell.computePairings(pre, post, pairings); break;
+        case SPARSE_BSR:    bsr.computePairings(pre, post, pairings); break;
+        case SPARSE_DENSE:  dense.computePairings(pre, post, pairings); break;
+        case SPARSE_FIXED16:
+        case SPARSE_FIXED16_I32:    fixed.computePairings(pre, post, pairings); break;
+        case SPARSE_DYNAMIC:    dyn.computePairings(pre, post, pairings); break;
+        case SPARSE_EIGEN:      eigen.computePairings(pre, post, pairings); break;
+        default:            csr.computePairings(pre, post, pairings); break;
+        }
+    }
+
+    /**
+     * SynapseStore::computePairings - Batch averaged pairings from sparse post activations,
+     * same layout and values as the dense overload but only active rows are walked.
+     *
+     * @param pre      Presynaptic activations per batch entry.
+     * @param post     Active postsynaptic neurons of the batch.
+     * @param pairings Output pairings.
+     */
+
+    void computePairings(const vector<vector<T>>& pre, const ActiveRows<T>& post, vector<T>& pairings) const
+    {
+        switch (format)
+        {
+        case SPARSE_SELL:   sell.computePairings(pre, post, pairings); break;
+        case SPARSE_BSR:    bsr.computePairings(pre, post, pairings); break;
+        case SPARSE_DENSE:  dense.computePairings(pre, post, pairings); break;
+        case SPARSE_FIXED16:
+        case SPARSE_FIXED16_I32:    fixed.computePairings(pre, post, pairings); break;
+        case SPARSE_DYNAMIC:    dyn.computePairings(pre, post, pairings); break;
+        case SPARSE_EIGEN:      eigen.computePairings(pre, post, pairings); break;
+        default:            csr.computePairings(pre, post, pairings); break;
+        }
+    }
+
+    /**
+     * SynapseStore::update - Add scaled pairings to synapses and normalize each neuron's
+     * incoming weights.
+     *
+     * @param pairings   Pairings from computePairings.
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     */
+
+    void update(const vector<T>& pairings, T learnRate, bool bNormalize = true)
+    {
+        foldRowScales();
+
+        switch (format)
+        {
+        case SPARSE_SELL:   sell.updateRows(pairings, learnRate, bNormalize); break;
+        case SPARSE_BSR:    bsr.updateRows(pairings, learnRate, bNormalize); break;
+        case SPARSE_DENSE:  dense.updateRows(pairings, learnRate, bNormalize); break;
+        case SPARSE_FIXED16:
+        case SPARSE_FIXED16_I32:    fixed.updateRows(pairings, learnRate, bNormalize); break;
+        case SPARSE_DYNAMIC:    dyn.updateRows(pairings, learnRate, bNormalize); break;
+        case SPARSE_EIGEN:      eigen.updateRows(pairings, learnRate, bNormalize); break;
+        default:            csr.updateRows(pairings, learnRate, bNormalize); break;
+        }
+    }
+
+    /**
+     * SynapseStore::hebbianUpdate - One Hebbian step, pairings then update and
+     * renormalization. CSR runs the fused kernel with no pairings buffer, other formats
+     * compute pairings into a buffer kept between steps and update from it. Every row is
+     * touched, so lazy row scales are folded first.
+     *
+     * @param pre        Presynaptic activations per batch entry.
+     * @param post       Postsynaptic activations per batch entry.
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     */
+
+    void hebbianUpdate(const vector<vector<T>>& pre, const vector<vector<T>>& post, T learnRate,
+        bool bNormalize = true)
+    {
+        foldRowScales();
+
+        if (format == SPARSE_CSR)
+        {
+            csr.hebbianUpdate(pre, post, learnRate, bNormalize);
+            return;
+        }
+
+        computePairings(pre, post, pairings);
+        update(pairings, learnRate, bNormalize);
+    }
+
+    /**
+     * SynapseStore::hebbianUpdate - One Hebbian step from sparse post activations. CSR
+     * normalizes lazily, so only the entries of active rows are touched.
+     *
+     * @param pre        Presynaptic activations per batch entry.
+     * @param post       Active postsynaptic neurons of the batch.
+     * @param learnRate  Pairing scale.
+     * @param bNormalize Whether to renormalize rows after the update.
+     */
+
+    void hebbianUpdate(const vector<vector<T>>& pre, const ActiveRows<T>& post, T learnRate,
+        bool bNormalize = true)
+    {
+        if (format == SPARSE_CSR)
+        {
+            if (rowScales.empty())
+            {
+                rowScales.assign(csr.n, 1);
+                csr.rowSumSquares(rowSumSq);
+            }
+
+            csr.hebbianUpdateScaled(pre, post, learnRate, bNormalize, rowScales, rowSumSq);
+            if (++numScaledUpdates == rowScaleFoldInterval) foldRowScales();
+
+            return;
+        }
+
+        computePairings(pre, post, pairings);
+        update(pairings, learnRate, bNormalize);
+    }
+
+    /**
+     * SynapseStore::cull - Remove synapses weaker than a threshold. CSR and fixed point
+     * storage compact in place, BSR and dense storage clear mask bits in place, dynamic
+     * storage compacts each row within its slots, Eigen storage uses Eigen's prune, SELL is
+     * culled through CSR, lazy row scales are folded first so the threshold applies to the
+     * weights. With automatic format selection the format is re-picked afterwards and the
+     * matrix rebuilt if it changed. Emptied BSR blocks are only dropped by a rebuild, so BSR
+     * is always rebuilt.
+     *
+     * @param  thresh Smallest magnitude kept.
+     * @return        Number of synapses removed.
+     */
+
+    size_t cull(T thresh)
+    {
+        foldRowScales();
+        colIndex.clear();
+
+        size_t numCulled = 0;
+
+        switch (format)
+        {
+        case SPARSE_SELL:
+        {
+            CSCMat<T> csc   = sell.toCSC();
+            numCulled       = csc.cull(thresh);
+            sell.fromCSC(csc);
+            break;
+        }
+        case SPARSE_BSR:
+        {
+            size_t oldNnz = bsr.nnz();
+            bsr.cull(thresh);
+            numCulled = oldNnz - bsr.nnz();
+            break;
+        }
+        case SPARSE_DENSE:
+        {
+            size_t oldNnz = dense.nnz();
+            dense.cull(thresh);
+            numCulled = oldNnz - dense.nnz();
+            break;
+        }
+        case SPARSE_FIXED16:
+        case SPARSE_FIXED16_I32:    numCulled = fixed.cull(thresh); break;
+        case SPARSE_DYNAMIC:    numCulled = dyn.cull(thresh); break;
+        case SPARSE_EIGEN:      numCulled = eigen.cull(thresh); break;
+        default:            numCulled = csr.cull(thresh); break;
+        }
+
+        if (!bAutoFormat) return numCulled;
+
+        if (format == SPARSE_CSR)
+        {
+            if (ChooseSynapseFormat(csr) == SPARSE_CSR) return numCulled;
+
+            build(move(csr), SPARSE_AUTO, bDeltaIdcs);
+            return numCulled;
+        }
+
+        CSCMat<T> csc = toCSC();
+        if (format == SPARSE_BSR || ChooseSynapseFormat(csc) != format) build(move(csc), SPARSE_AUTO, bDeltaIdcs);
+
+        return numCulled;
+    }
+
+    /**
+     * SynapseStore::makeDynamic - Switch to dynamic storage so synapses can be added without
+     * rebuilding, remembering the current format for pack. No-op if already dynamic.
+     */
+
+    void makeDynamic()
+    {
+        if (format == SPARSE_DYNAMIC) return;
+
+        SparseFormat fmt = bAutoFormat ? SPARSE_AUTO : format;
+        build(toCSC(), SPARSE_DYNAMIC, bDeltaIdcs);
+        packedFormat = fmt;
+    }
+
+    /**
+     * SynapseStore::pack - Leave dynamic storage, repacking the synapses into the format
+     * they were in before makeDynamic (or an automatically picked one) for the faster static
+     * kernels. No-op for other formats.
+     */
+
+    void pack()
+    {
+        if (format != SPARSE_DYNAMIC) return;
+
+        PROFILE_ZONE_WORK("SynapseStore::pack", dyn.nnz(), "nnz");
+        build(dyn.toCSC(), packedFormat, bDeltaIdcs);
+    }
+
+    /**
+     * SynapseStore::print - Print synapse weights.
+     *
+     * @param bAll Whether to print full synapse matrix.
+     */
+
+    void print(bool bAll = false) const
+    {
+        CSCMat<T> csc = toCSC();
+        csc.print(bAll);
+    }
+};
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "ftwt.h"
+#include "platform.h"
 
 /**
  * GetMilliseconds Get elapsed timestamp in milliseconds since beginning of clock epoch.
@@ -10,17 +10,51 @@
 
 inline long long GetMilliseconds()
 {
-    static LARGE_INTEGER frequency;
-    static BOOL useQpc = QueryPerformanceFrequency(&frequency);
+    return (long long)(GetNanoseconds() / 1000000ULL);
+}
 
-    if (useQpc)
-    {
-        LARGE_INTEGER now;
-        QueryPerformanceCounter(&now);
-        return (1000LL * now.QuadPart) / frequency.QuadPart;
-    }
-    else
+struct CycleTimer
+{
+    uint64_t startNs;
+    uint64_t startCycles;
+
+    /**
+     * CycleTimer::CycleTimer - Create a timer and start it.
+     */
+
+    CycleTimer() { Start(); }
+
+    /**
+     * CycleTimer::Start - Restart the timer.
+     */
+
+    void Start()
     {
-        return GetTickCount();
+        startNs     = GetNanoseconds();
+        startCycles = ReadCycleCounter();
     }
-}
\ No newline at end of file
+
+    /**
+     * CycleTimer::Nanoseconds - Wall time elapsed since the timer was started.
+     *
+     * @return Elapsed nanoseconds.
+     */
+
+    uint64_t Nanoseconds() const { return GetNanoseconds() - startNs; }
+
+    /**
+     * CycleTimer::Cycles - Cycle counter ticks elapsed since the timer was started.
+     *
+     * @return Elapsed cycles.
+     */
+
+    uint64_t Cycles() const { return ReadCycleCounter() - startCycles; }
+
+    /**
+     * CycleTimer::Seconds - Wall time elapsed since the timer was started.
+     *
+     * @return Elapsed seconds.
+     */
+
+    double Seconds() const { return 1e-9 * (double)Nanoseconds(); }
+};
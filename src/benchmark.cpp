@@ -0,0 +1,533 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <thread>
+#include "benchmark.h"
+#include "platform.h"
+
+/**
+ * BenchRecord::GetMetric - Find a metric by name, adding it if this is the first sample.
+ *
+ * @param  metricName      Metric name, e.g., "wall_time".
+ * @param  unit            Metric unit, e.g., "s".
+ * @param  bHigherIsBetter Whether larger values are an improvement (throughputs).
+ * @param  bGated          Whether baseline comparison can flag the metric, info-only
+ *                         metrics are reported but never regress.
+ * @return                 Metric to append samples to.
+ */
+
+BenchMetric& BenchRecord::GetMetric(const string& metricName, const string& unit, bool bHigherIsBetter, bool bGated)
+{
+    for (auto& metric : metrics)
+    {
+        if (metric.name == metricName) return metric;
+    }
+
+    metrics.push_back({ metricName, unit, bHigherIsBetter, bGated, {} });
+    return metrics.back();
+}
+
+/**
+ * ComputeSampleStats - Summarize a list of samples.
+ *
+ * @param  samples Samples to summarize.
+ * @return         Min, max, mean, median and sample standard deviation.
+ */
+
+SampleStats ComputeSampleStats(const vector<double>& samples)
+{
+    SampleStats stats = {};
+    if (samples.empty()) return stats;
+
+    vector<double> sorted = samples;
+    sort(sorted.begin(), sorted.end());
+
+    size_t n        = sorted.size();
+    stats.min       = sorted.front();
+    stats.max       = sorted.back();
+    stats.median    = (n % 2) ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+
+    for (double s : sorted) stats.mean += s;
+    stats.mean /= (double)n;
+
+    if (n > 1)
+    {
+        double var = 0.0;
+        for (double s : sorted) var += (s - stats.mean) * (s - stats.mean);
+        stats.stddev = sqrt(var / (double)(n - 1));
+    }
+
+    return stats;
+}
+
+/**
+ * MannWhitneyPValue - One-sided Mann-Whitney U test that current samples are worse than
+ * baseline samples. Rank based, so a single noisy outlier can't trigger (or hide) a
+ * regression the way a mean/t-test would. Uses the exact U distribution for small sample
+ * counts and the tie-corrected normal approximation otherwise.
+ *
+ * @param  baseline       Baseline samples.
+ * @param  current        Current samples.
+ * @param  bHigherIsWorse True if larger values are worse (times), false for throughputs.
+ * @return                p-value for H0: current is not worse than baseline.
+ */
+
+double MannWhitneyPValue(const vector<double>& baseline, const vector<double>& current, bool bHigherIsWorse)
+{
+    size_t n1 = current.size();
+    size_t n2 = baseline.size();
+    if (n1 == 0 || n2 == 0) return 1.0;
+
+    // U counts (current, baseline) pairs where current is worse, ties count half.
+
+    double u = 0.0;
+
+    for (double c : current)
+    {
+        for (double b : baseline)
+        {
+            if (c == b) u += 0.5;
+            else if ((c > b) == bHigherIsWorse) u += 1.0;
+        }
+    }
+
+    if (n1 * n2 <= 400)
+    {
+        // counts[i][j][k] = arrangements of i current and j baseline samples with U = k.
+        // Only a rolling 2D table over (j, k) is kept per i.
+
+        uint32_t maxU = (uint32_t)(n1 * n2);
+        vector<vector<double>> prev(n2 + 1, vector<double>(maxU + 1, 0.0));
+        vector<vector<double>> cur = prev;
+
+        for (size_t j = 0; j <= n2; j++) prev[j][0] = 1.0;
+
+        for (size_t i = 1; i <= n1; i++)
+        {
+            for (auto& row : cur) fill(row.begin(), row.end(), 0.0);
+            cur[0][0] = 1.0;
+
+            for (size_t j = 1; j <= n2; j++)
+            {
+                for (uint32_t k = 0; k <= maxU; k++)
+                {
+                    double c = cur[j - 1][k];
+                    if (k >= j) c += prev[j][k - j];
+                    cur[j][k] = c;
+                }
+            }
+
+            swap(prev, cur);
+        }
+
+        double total    = 0.0;
+        double tail     = 0.0;
+        uint32_t uObs   = (uint32_t)floor(u);
+
+        for (uint32_t k = 0; k <= maxU; k++)
+        {
+            total += prev[n2][k];
+            if (k >= uObs) tail += prev[n2][k];
+        }
+
+        return tail / total;
+    }
+
+    // Normal approximation with tie correction.
+
+    vector<double> all = current;
+    all.insert(all.end(), baseline.begin(), baseline.end());
+    sort(all.begin(), all.end());
+
+    double tieTerm = 0.0;
+
+    for (size_t i = 0; i < all.size();)
+    {
+        size_t j = i;
+        while (j < all.size() && all[j] == all[i]) j++;
+        double t = (double)(j - i);
+        tieTerm += t * t * t - t;
+        i = j;
+    }
+
+    double n       = (double)(n1 + n2);
+    double mean    = 0.5 * (double)(n1 * n2);
+    double var     = (double)(n1 * n2) / 12.0 * ((n + 1.0) - tieTerm / (n * (n - 1.0)));
+
+    if (var <= 0.0) return 1.0;
+
+    double z = (u - mean - 0.5) / sqrt(var);
+    return 0.5 * erfc(z / sqrt(2.0));
+}
+
+/**
+ * GetMachineFingerprint - Identify the machine results were measured on. Baselines are
+ * only comparable on the same CPU model, thread count and OS.
+ *
+ * @return Machine fingerprint string.
+ */
+
+string GetMachineFingerprint()
+{
+    return GetCPUBrandString() + " | " + to_string(thread::hardware_concurrency()) + " threads | " + GetOSName();
+}
+
+/**
+ * PrintBenchTable - Print a summary table with one row per benchmark metric.
+ *
+ * @param records Benchmark results to print.
+ */
+
+void PrintBenchTable(const vector<BenchRecord>& records)
+{
+    printf("\n%-28s %-30s %6s %14s %14s %14s %12s\n",
+        "benchmark", "metric", "runs", "median", "min", "max", "stddev %");
+
+    for (auto& record : records)
+    {
+        for (auto& metric : record.metrics)
+        {
+            SampleStats stats   = ComputeSampleStats(metric.samples);
+            double relStddev    = stats.mean != 0.0 ? 100.0 * stats.stddev / fabs(stats.mean) : 0.0;
+            string metricName   = metric.name + " (" + metric.unit + ")";
+
+            printf("%-28s %-30s %6zu %14.6g %14.6g %14.6g %12.2f\n",
+                record.name.c_str(),
+                metricName.c_str(),
+                metric.samples.size(),
+                stats.median,
+                stats.min,
+                stats.max,
+                relStddev);
+        }
+    }
+
+    printf("\n");
+}
+
+/**
+ * MetricToJson - Serialize a metric's samples and summary stats.
+ *
+ * @param  metric Metric to serialize.
+ * @return        JSON object.
+ */
+
+static JsonValue MetricToJson(const BenchMetric& metric)
+{
+    SampleStats stats   = ComputeSampleStats(metric.samples);
+    JsonValue value     = JsonValue::Object();
+    JsonValue samples   = JsonValue::Array();
+
+    for (double s : metric.samples) samples.array.push_back(JsonValue(s));
+
+    value["unit"]               = JsonValue(metric.unit);
+    value["higher_is_better"]   = JsonValue(metric.bHigherIsBetter);
+    value["gated"]              = JsonValue(metric.bGated);
+    value["median"]             = JsonValue(stats.median);
+    value["mean"]               = JsonValue(stats.mean);
+    value["stddev"]             = JsonValue(stats.stddev);
+    value["samples"]            = samples;
+
+    return value;
+}
+
+/**
+ * ConfigToJson - Serialize a run configuration.
+ *
+ * @param  config Key/value run configuration.
+ * @return        JSON object.
+ */
+
+static JsonValue ConfigToJson(const map<string, string>& config)
+{
+    JsonValue value = JsonValue::Object();
+    for (auto& entry : config) value[entry.first] = JsonValue(entry.second);
+    return value;
+}
+
+/**
+ * WriteBenchJson - Write benchmark results, including raw samples, as JSON.
+ *
+ * @param  path    Output file path.
+ * @param  records Benchmark results.
+ * @param  config  Run configuration (seed, threads, ...) recorded alongside results.
+ * @return         True on success.
+ */
+
+bool WriteBenchJson(const string& path, const vector<BenchRecord>& records, const map<string, string>& config)
+{
+    JsonValue root      = JsonValue::Object();
+    JsonValue benches   = JsonValue::Array();
+
+    for (auto& record : records)
+    {
+        JsonValue bench     = JsonValue::Object();
+        JsonValue metrics   = JsonValue::Object();
+
+        for (auto& metric : record.metrics) metrics[metric.name] = MetricToJson(metric);
+
+        bench["name"]       = JsonValue(record.name);
+        bench["metrics"]    = metrics;
+        benches.array.push_back(bench);
+    }
+
+    root["machine"]     = JsonValue(GetMachineFingerprint());
+    root["config"]      = ConfigToJson(config);
+    root["benchmarks"]  = benches;
+
+    return WriteJsonFile(path, root);
+}
+
+/**
+ * LoadBaselineFile - Load a baseline file and check its version.
+ *
+ * @param  path     Baseline file path.
+ * @param  baseline Parsed baseline.
+ * @param  err      Error message on failure.
+ * @return          True on success.
+ */
+
+static bool LoadBaselineFile(const string& path, JsonValue& baseline, string& err)
+{
+    if (!ReadJsonFile(path, baseline, err)) return false;
+
+    const JsonValue* version = baseline.Find("version");
+
+    if (version == NULL || version->type != JSON_NUMBER || (uint32_t)version->number != benchBaselineVersion)
+    {
+        err = path + " is not a version " + to_string(benchBaselineVersion) + " baseline file";
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * SaveBenchBaseline - Store results as the baseline for this machine. Other machines'
+ * baselines and benchmarks not in this run are kept, matching benchmarks are replaced.
+ *
+ * @param  path    Baseline file path, created if it doesn't exist.
+ * @param  records Benchmark results.
+ * @param  config  Run configuration.
+ * @return         True on success.
+ */
+
+bool SaveBenchBaseline(const string& path, const vector<BenchRecord>& records, const map<string, string>& config)
+{
+    JsonValue baseline;
+    string err;
+
+    FILE* f = fopen(path.c_str(), "r");
+
+    if (f != NULL)
+    {
+        fclose(f);
+
+        if (!LoadBaselineFile(path, baseline, err))
+        {
+            printf("Not overwriting baseline: %s\n", err.c_str());
+            return false;
+        }
+    }
+    else
+    {
+        baseline = JsonValue::Object();
+        baseline["version"] = JsonValue((double)benchBaselineVersion);
+    }
+
+    JsonValue& machine  = baseline["machines"][GetMachineFingerprint()];
+    JsonValue& benches  = machine["benchmarks"];
+
+    for (auto& record : records)
+    {
+        JsonValue metrics = JsonValue::Object();
+        for (auto& metric : record.metrics) metrics[metric.name] = MetricToJson(metric);
+
+        JsonValue& bench    = benches[record.name];
+        bench               = JsonValue::Object();
+        bench["config"]     = ConfigToJson(config);
+        bench["timestamp"]  = JsonValue((double)time(NULL));
+        bench["metrics"]    = metrics;
+    }
+
+    if (!WriteJsonFile(path, baseline)) return false;
+
+    printf("Saved baseline for %zu benchmarks to %s\n", records.size(), path.c_str());
+    return true;
+}
+
+/**
+ * CompareBenchBaseline - Compare results against this machine's baseline. A metric
+ * regresses when its median is worse than baseline by more than the noise threshold and
+ * a Mann-Whitney test says the shift is significant. Info-only metrics just show their
+ * change.
+ *
+ * @param  path      Baseline file path.
+ * @param  records   Benchmark results.
+ * @param  threshold Relative change of the median to tolerate (0.05 = 5%).
+ * @param  alpha     Significance level of the rank test.
+ * @return           0 if nothing regressed, 1 on regressions, 2 if no usable baseline.
+ */
+
+int CompareBenchBaseline(const string& path, const vector<BenchRecord>& records, double threshold, double alpha)
+{
+    JsonValue baseline;
+    string err;
+
+    if (!LoadBaselineFile(path, baseline, err))
+    {
+        printf("Baseline comparison failed: %s\n", err.c_str());
+        return 2;
+    }
+
+    string fingerprint          = GetMachineFingerprint();
+    const JsonValue* machines   = baseline.Find("machines");
+    const JsonValue* machine    = machines ? machines->Find(fingerprint) : NULL;
+    const JsonValue* benches    = machine ? machine->Find("benchmarks") : NULL;
+
+    if (benches == NULL)
+    {
+        printf("No baseline for machine \"%s\" in %s\n", fingerprint.c_str(), path.c_str());
+        return 2;
+    }
+
+    printf("\nComparing against baseline %s (threshold %.1f%%, alpha %g)\n", path.c_str(),
+        100.0 * threshold, alpha);
+    printf("%-28s %-22s %14s %14s %9s %9s  %s\n",
+        "benchmark", "metric", "baseline", "current", "change %", "p", "status");
+
+    uint32_t numRegressions = 0;
+
+    for (auto& record : records)
+    {
+        const JsonValue* bench      = benches->Find(record.name);
+        const JsonValue* metrics    = bench ? bench->Find("metrics") : NULL;
+
+        for (auto& metric : record.metrics)
+        {
+            const JsonValue* baseMetric     = metrics ? metrics->Find(metric.name) : NULL;
+            const JsonValue* baseSamples    = baseMetric ? baseMetric->Find("samples") : NULL;
+            SampleStats curStats            = ComputeSampleStats(metric.samples);
+
+            // Non-finite samples were stored as null and are left out.
+
+            vector<double> base;
+
+            if (baseSamples)
+            {
+                for (auto& s : baseSamples->array)
+                {
+                    if (s.type == JSON_NUMBER) base.push_back(s.number);
+                }
+            }
+
+            if (base.empty())
+            {
+                printf("%-28s %-22s %14s %14.6g %9s %9s  new\n", record.name.c_str(),
+                    metric.name.c_str(), "-", curStats.median, "-", "-");
+                continue;
+            }
+
+            // A zero baseline has no relative change, any move away from it counts as unbounded.
+
+            SampleStats baseStats   = ComputeSampleStats(base);
+            double diff             = curStats.median - baseStats.median;
+            double change           = baseStats.median != 0.0 ? diff / fabs(baseStats.median) :
+                (diff != 0.0 ? copysign(INFINITY, diff) : 0.0);
+
+            if (!metric.bGated)
+            {
+                printf("%-28s %-22s %14.6g %14.6g %9.2f %9s  info\n", record.name.c_str(), metric.name.c_str(),
+                    baseStats.median, curStats.median, 100.0 * change, "-");
+                continue;
+            }
+
+            double worseChange      = metric.bHigherIsBetter ? -change : change;
+            double p                = MannWhitneyPValue(base, metric.samples, !metric.bHigherIsBetter);
+
+            const char* status = "ok";
+
+            if (worseChange > threshold && p < alpha)
+            {
+                status = "REGRESSION";
+                numRegressions++;
+            }
+            else if (worseChange < -threshold && MannWhitneyPValue(metric.samples, base, !metric.bHigherIsBetter) < alpha)
+            {
+                status = "improved";
+            }
+
+            printf("%-28s %-22s %14.6g %14.6g %9.2f %9.4f  %s\n", record.name.c_str(), metric.name.c_str(),
+                baseStats.median, curStats.median, 100.0 * change, p, status);
+        }
+    }
+
+    printf("\n%u regression(s) found\n", numRegressions);
+    return numRegressions ? 1 : 0;
+}
+
+/**
+ * ParseBenchGateArg - Parse a result output / baseline gating command line option.
+ *
+ *   --json <file>           Write results to a JSON file.
+ *   --save-baseline <file>  Store results as this machine's baseline.
+ *   --compare <file>        Compare results against this machine's baseline.
+ *   --threshold <percent>   Noise threshold for the median change (default 5).
+ *   --alpha <p>             Significance level (default 0.05).
+ *
+ * @param  argc    Number of command line args.
+ * @param  argv    Command line args.
+ * @param  i       Index of current arg, advanced past any consumed value.
+ * @param  options Options to fill.
+ * @return         True if the arg was a gate option.
+ */
+
+bool ParseBenchGateArg(int argc, char** argv, int& i, BenchGateOptions& options)
+{
+    string arg = argv[i];
+    if (i + 1 >= argc) return false;
+
+    if (arg == "--json") options.jsonPath = argv[++i];
+    else if (arg == "--save-baseline") options.saveBaselinePath = argv[++i];
+    else if (arg == "--compare") options.comparePath = argv[++i];
+    else if (arg == "--threshold") options.threshold = 0.01 * atof(argv[++i]);
+    else if (arg == "--alpha") options.alpha = atof(argv[++i]);
+    else return false;
+
+    return true;
+}
+
+/**
+ * RunBenchGate - Write results, update the baseline and/or compare against it as
+ * requested on the command line.
+ *
+ * @param  records Benchmark results.
+ * @param  config  Run configuration.
+ * @param  options Output and gating options.
+ * @return         Process exit code, nonzero on regressions or errors.
+ */
+
+int RunBenchGate(const vector<BenchRecord>& records, const map<string, string>& config, const BenchGateOptions& options)
+{
+    int exitCode = 0;
+
+    if (!options.jsonPath.empty())
+    {
+        if (WriteBenchJson(options.jsonPath, records, config)) printf("Wrote benchmark results to %s\n", options.jsonPath.c_str());
+        else exitCode = 2;
+    }
+
+    if (!options.comparePath.empty())
+    {
+        exitCode = max(exitCode, CompareBenchBaseline(options.comparePath, records, options.threshold, options.alpha));
+    }
+
+    if (!options.saveBaselinePath.empty())
+    {
+        if (!SaveBenchBaseline(options.saveBaselinePath, records, config)) exitCode = max(exitCode, 2);
+    }
+
+    return exitCode;
+}
@@ -0,0 +1,67 @@
+#include "bsrmat.h"
+
+#ifdef FTWT_HAS_AVX2_PATH
+
+/**
+ * BSRSpMVBlockRowsAVX2 - AVX2 double precision 4x8 BSR SpMV. Each block loads its 8 x
+ * entries once as two contiguous vectors and reuses them for all four block rows, so no
+ * gathers are needed. Blocks crossing the last column fall back to scalar code.
+ *
+ * @param vals         Block values, bsrBlockSize per block.
+ * @param blockCols    Block column of each block.
+ * @param blockOffsets Block offsets of each block row.
+ * @param n            Rows in matrix.
+ * @param m            Columns in matrix.
+ * @param x            Input vector.
+ * @param y            Output vector, rows of the block row range are overwritten.
+ * @param brBegin      First block row.
+ * @param brEnd        One past last block row.
+ */
+
+FTWT_TARGET_AVX2 void BSRSpMVBlockRowsAVX2(const double* vals, const uint32_t* blockCols, const uint32_t* blockOffsets,
+    uint32_t n, uint32_t m, const double* x, double* y, uint32_t brBegin, uint32_t brEnd)
+{
+    for (uint32_t br = brBegin; br < brEnd; br++)
+    {
+        __m256d acc[bsrBlockRows];
+        double tail[bsrBlockRows] = {};
+
+        for (uint32_t i = 0; i < bsrBlockRows; i++) acc[i] = _mm256_setzero_pd();
+
+        for (uint32_t b = blockOffsets[br]; b < blockOffsets[br + 1]; b++)
+        {
+            const double* blk   = vals + (size_t)b * bsrBlockSize;
+            uint32_t c0         = blockCols[b] * bsrBlockCols;
+
+            if (c0 + bsrBlockCols <= m)
+            {
+                __m256d x0 = _mm256_loadu_pd(x + c0);
+                __m256d x1 = _mm256_loadu_pd(x + c0 + 4);
+
+                for (uint32_t i = 0; i < bsrBlockRows; i++)
+                {
+                    acc[i] = _mm256_fmadd_pd(_mm256_loadu_pd(blk + i * bsrBlockCols), x0, acc[i]);
+                    acc[i] = _mm256_fmadd_pd(_mm256_loadu_pd(blk + i * bsrBlockCols + 4), x1, acc[i]);
+                }
+            }
+            else
+            {
+                for (uint32_t i = 0; i < bsrBlockRows; i++)
+                {
+                    for (uint32_t j = 0; c0 + j < m; j++) tail[i] += blk[i * bsrBlockCols + j] * x[c0 + j];
+                }
+            }
+        }
+
+        uint32_t r0 = br * bsrBlockRows;
+
+        for (uint32_t i = 0; i < bsrBlockRows && r0 + i < n; i++)
+        {
+            __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(acc[i]), _mm256_extractf128_pd(acc[i], 1));
+            sum         = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+            y[r0 + i]   = _mm_cvtsd_f64(sum) + tail[i];
+        }
+    }
+}
+
+#endif
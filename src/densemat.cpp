@@ -0,0 +1,62 @@
+#include "densemat.h"
+
+#ifdef FTWT_HAS_AVX2_PATH
+
+/**
+ * DenseMVRowsAVX2 - AVX2 double precision dense rows. Two rows share each load of x and
+ * each row keeps two 4-wide accumulators.
+ *
+ * @param vals   Row-major values, m per row.
+ * @param m      Columns in matrix.
+ * @param x      Input vector.
+ * @param y      Output vector, rows [rBegin, rEnd) are overwritten.
+ * @param rBegin First row.
+ * @param rEnd   One past last row.
+ */
+
+FTWT_TARGET_AVX2 void DenseMVRowsAVX2(const double* vals, uint32_t m, const double* x, double* y,
+    uint32_t rBegin, uint32_t rEnd)
+{
+    uint32_t r = rBegin;
+
+    for (; r + 2 <= rEnd; r += 2)
+    {
+        const double* row0  = vals + (size_t)r * m;
+        const double* row1  = row0 + m;
+        __m256d acc00       = _mm256_setzero_pd();
+        __m256d acc01       = _mm256_setzero_pd();
+        __m256d acc10       = _mm256_setzero_pd();
+        __m256d acc11       = _mm256_setzero_pd();
+        uint32_t c          = 0;
+
+        for (; c + 8 <= m; c += 8)
+        {
+            __m256d x0  = _mm256_loadu_pd(x + c);
+            __m256d x1  = _mm256_loadu_pd(x + c + 4);
+            acc00       = _mm256_fmadd_pd(_mm256_loadu_pd(row0 + c), x0, acc00);
+            acc01       = _mm256_fmadd_pd(_mm256_loadu_pd(row0 + c + 4), x1, acc01);
+            acc10       = _mm256_fmadd_pd(_mm256_loadu_pd(row1 + c), x0, acc10);
+            acc11       = _mm256_fmadd_pd(_mm256_loadu_pd(row1 + c + 4), x1, acc11);
+        }
+
+        acc00           = _mm256_add_pd(acc00, acc01);
+        acc10           = _mm256_add_pd(acc10, acc11);
+        __m256d sum     = _mm256_hadd_pd(acc00, acc10);
+        __m128d sum2    = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+        double res0     = _mm_cvtsd_f64(sum2);
+        double res1     = _mm_cvtsd_f64(_mm_unpackhi_pd(sum2, sum2));
+
+        for (; c < m; c++)
+        {
+            res0 += row0[c] * x[c];
+            res1 += row1[c] * x[c];
+        }
+
+        y[r]        = res0;
+        y[r + 1]    = res1;
+    }
+
+    if (r < rEnd) DenseMVRows<double>(vals, m, x, y, r, rEnd);
+}
+
+#endif
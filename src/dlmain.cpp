@@ -1,6 +1,5 @@
 #include <string>
 #include <stdio.h>
-#include <Windows.h>
 #include "dataset.h"
 #include "neuralnetworkcpu.h"
 #include "neuralnetworkgpu.h"
@@ -25,9 +24,7 @@ void GetDataFilePaths(
     string &testLblPath
 )
 {
-    char pwdBuffer[256];
-    GetCurrentDirectory(256, pwdBuffer);
-    string pwd(pwdBuffer);
+    string pwd = GetWorkingDirectory();
 
     trainingImgPath = pwd + "/data/mnist/trainimages.txt";
     trainingLblPath = pwd + "/data/mnist/trainlabels.txt";
@@ -71,7 +68,8 @@ void InitData(
 
 /**
  * main - Run a NN model on MNIST digit image data. Load settings
- * and data from file. Execute on CPU/GPU depending on settings file.
+ * and data from file. Execute on CPU/GPU depending on settings file. Set FTWT_PERF in the
+ * environment to collect hardware counters for the CPU profiling zones.
  *
  * @param  argc Command line argument count.
  * @param  argv List of command line strings.
@@ -83,6 +81,8 @@ int main(int argc, char** argv)
     NNSettings settings;
     settings.Load();
 
+    if (getenv("FTWT_PERF")) EnablePerfCounters(true);
+
     MNISTDataSet trainingSet;
     MNISTDataSet testSet;
     InitData(trainingSet, testSet);
@@ -0,0 +1,158 @@
+#include "fixedmat.h"
+
+#ifdef FTWT_HAS_AVX2_PATH
+
+/**
+ * HorizontalSum - Sum of the eight lanes of a single precision register.
+ */
+
+FTWT_TARGET_AVX2 static inline float HorizontalSum(__m256 v)
+{
+    __m128 sum  = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum         = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum         = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+/**
+ * HorizontalSum - Sum of the eight lanes of an int32 register.
+ */
+
+FTWT_TARGET_AVX2 static inline int32_t HorizontalSum(__m256i v)
+{
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum         = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum         = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+/**
+ * Fixed16SpMVRowsAVX2 - AVX2 Q1.14 rows with single precision accumulation. Eight weights
+ * are sign extended and converted per step, x is gathered with the matching indices.
+ *
+ * @param vals    Fixed point values.
+ * @param colIdcs Column index of each nonzero.
+ * @param offsets Row offsets into vals/colIdcs.
+ * @param x       Input vector.
+ * @param y       Output vector, rows [rBegin, rEnd) are overwritten.
+ * @param rBegin  First row.
+ * @param rEnd    One past last row.
+ */
+
+FTWT_TARGET_AVX2 void Fixed16SpMVRowsAVX2(const int16_t* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const float* x, float* y, uint32_t rBegin, uint32_t rEnd)
+{
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        uint32_t i      = offsets[r];
+        uint32_t end    = offsets[r + 1];
+        __m256 acc      = _mm256_setzero_ps();
+
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256i idx = _mm256_loadu_si256((const __m256i*)(colIdcs + i));
+            __m256 w    = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(vals + i))));
+            acc         = _mm256_fmadd_ps(w, _mm256_i32gather_ps(x, idx, 4), acc);
+        }
+
+        float res = HorizontalSum(acc);
+        for (; i < end; i++) res += (float)vals[i] * x[colIdcs[i]];
+
+        y[r] = res * (float)(1.0 / fixedOne);
+    }
+}
+
+/**
+ * Fixed16SpMVRowsInt32AVX2 - AVX2 Q1.14 rows with integer activations and int32
+ * accumulation.
+ *
+ * @param vals    Fixed point values.
+ * @param colIdcs Column index of each nonzero.
+ * @param offsets Row offsets into vals/colIdcs.
+ * @param xq      Quantized input vector.
+ * @param scale   Scale taking an accumulated sum back to a response.
+ * @param y       Output vector, rows [rBegin, rEnd) are overwritten.
+ * @param rBegin  First row.
+ * @param rEnd    One past last row.
+ */
+
+FTWT_TARGET_AVX2 void Fixed16SpMVRowsInt32AVX2(const int16_t* vals, const uint32_t* colIdcs,
+    const uint32_t* offsets, const int32_t* xq, float scale, float* y, uint32_t rBegin, uint32_t rEnd)
+{
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        uint32_t i      = offsets[r];
+        uint32_t end    = offsets[r + 1];
+        __m256i acc     = _mm256_setzero_si256();
+
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256i idx = _mm256_loadu_si256((const __m256i*)(colIdcs + i));
+            __m256i w   = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)(vals + i)));
+            acc         = _mm256_add_epi32(acc, _mm256_mullo_epi32(w, _mm256_i32gather_epi32((const int*)xq, idx, 4)));
+        }
+
+        int32_t res = HorizontalSum(acc);
+        for (; i < end; i++) res += (int32_t)vals[i] * xq[colIdcs[i]];
+
+        y[r] = (float)res * scale;
+    }
+}
+
+/**
+ * Fixed16SpMMRowsInt32AVX2 - AVX2 Q1.14 rows times a row-major block of integer
+ * activations. Each weight is broadcast against eight block entries at a time into an
+ * int32 row accumulator, which is scaled to responses once the row is done.
+ *
+ * @param vals    Fixed point values.
+ * @param colIdcs Column index of each nonzero.
+ * @param offsets Row offsets into vals/colIdcs.
+ * @param xq      Quantized input block (m x k, row-major).
+ * @param scale   Scale taking an accumulated sum back to a response.
+ * @param y       Output block (n x k, row-major), rows [rBegin, rEnd) are overwritten.
+ * @param k       Number of vectors in the block.
+ * @param rBegin  First row.
+ * @param rEnd    One past last row.
+ */
+
+FTWT_TARGET_AVX2 void Fixed16SpMMRowsInt32AVX2(const int16_t* vals, const uint32_t* colIdcs,
+    const uint32_t* offsets, const int32_t* xq, float scale, float* y, uint32_t k, uint32_t rBegin, uint32_t rEnd)
+{
+    __m256 vScale = _mm256_set1_ps(scale);
+    vector<int32_t> accBuf(k);
+    int32_t* acc = accBuf.data();
+
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        for (uint32_t j = 0; j < k; j++) acc[j] = 0;
+
+        for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++)
+        {
+            const int32_t* xRow = xq + (size_t)colIdcs[i] * k;
+            __m256i w           = _mm256_set1_epi32(vals[i]);
+            uint32_t j          = 0;
+
+            for (; j + 8 <= k; j += 8)
+            {
+                __m256i a = _mm256_loadu_si256((const __m256i*)(acc + j));
+                __m256i p = _mm256_mullo_epi32(w, _mm256_loadu_si256((const __m256i*)(xRow + j)));
+                _mm256_storeu_si256((__m256i*)(acc + j), _mm256_add_epi32(a, p));
+            }
+
+            for (; j < k; j++) acc[j] += (int32_t)vals[i] * xRow[j];
+        }
+
+        float* yRow = y + (size_t)r * k;
+        uint32_t j  = 0;
+
+        for (; j + 8 <= k; j += 8)
+        {
+            __m256 v = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(acc + j)));
+            _mm256_storeu_ps(yRow + j, _mm256_mul_ps(v, vScale));
+        }
+
+        for (; j < k; j++) yRow[j] = (float)acc[j] * scale;
+    }
+}
+
+#endif
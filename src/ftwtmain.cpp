@@ -1,13 +1,26 @@
 #include "tests.h"
+#include "benchmark.h"
+#include "roofline.h"
+#include "perfcounters.h"
+#include "parallel.h"
 
-typedef void(*pfnTest)(void);
+typedef void(*PfnTest)(TestParams&, TestResults&);
 
 struct TestCase
 {
-    pfnTest pfnTest;
+    PfnTest pfnTest;
     string desc;
 };
 
+struct BenchOptions
+{
+    uint32_t runs;
+    uint32_t warmupRuns;
+    bool bRoofline;
+    vector<Precision> precisions;
+    BenchGateOptions gate;
+};
+
 map<string, TestCase> problems =
 {
     { "SimpleCross", { SimpleCrossTest, "SimpleCrossTest - Train a network to cross two inputs to two outputs {0, 1} -> {1, 0}." } },
@@ -29,16 +42,197 @@ void DisplayTests()
         printf("%s: %s\n", problem.first.c_str(), problem.second.desc.c_str());
     }
 
+    printf("\nUsage: FTWT <test> [--bench] [--runs N] [--warmup N] [--seed N] [--threads N (sweeps only)]\n");
+    printf("                   [--kernel-threads N] [--roofline] [--perf] [--json file] [--save-baseline file]\n");
+    printf("                   [--compare file] [--threshold pct] [--alpha p]\n");
+    printf("                   [--precision double|float|fixed16|fixed16-i32|all]\n");
+    printf("                   [--renorm N] [--order none|rcm|partition] [--grow weight] [--save-net file]\n");
+    printf("                   [--load-net file] [--synapses file.mtx|file.edges] [--pulses N]\n");
+    printf("                   [--pulse-act linear|clamp|sigmoid|tanh] [--pulse-thresh x]\n");
     printf("\nPress any key to continue ...\n");
     getchar();
 }
 
+/**
+ * ParsePrecisions - Parse a --precision argument, "all" expands to every precision.
+ *
+ * @param  arg        Argument value.
+ * @param  precisions Parsed precisions, appended to.
+ * @return            False if the value is not a known precision.
+ */
+
+bool ParsePrecisions(const string& arg, vector<Precision>& precisions)
+{
+    const Precision all[] = { PRECISION_DOUBLE, PRECISION_FLOAT, PRECISION_FIXED16, PRECISION_FIXED16_I32 };
+
+    for (auto precision : all)
+    {
+        if (arg == "all" || arg == PrecisionName(precision)) precisions.push_back(precision);
+    }
+
+    return precisions.size() > 0;
+}
+
+/**
+ * ParseNeuronOrder - Parse an --order argument.
+ *
+ * @param  arg   Argument value.
+ * @param  order Parsed ordering.
+ * @return       False if the value is not a known ordering.
+ */
+
+bool ParseNeuronOrder(const string& arg, NeuronOrder& order)
+{
+    const NeuronOrder all[] = { ORDER_NONE, ORDER_RCM, ORDER_PARTITION };
+
+    for (auto candidate : all)
+    {
+        if (arg != NeuronOrderName(candidate)) continue;
+
+        order = candidate;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * ParsePulseActivation - Parse a --pulse-act argument.
+ *
+ * @param  arg Argument value.
+ * @param  act Parsed nonlinearity.
+ * @return     False if the value is not a known nonlinearity.
+ */
+
+bool ParsePulseActivation(const string& arg, PulseActivation& act)
+{
+    const PulseActivation all[] = { PULSE_LINEAR, PULSE_CLAMP, PULSE_SIGMOID, PULSE_TANH };
+
+    for (auto candidate : all)
+    {
+        if (arg != PulseActivationName(candidate)) continue;
+
+        act = candidate;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * RunBench - Benchmark a test case end to end. Run warmup passes, then time a number of
+ * runs with the same seed and collect wall time, training throughput, peak RSS and
+ * accuracy for each. Peak RSS is per run where the platform can reset it, otherwise the
+ * process peak is recorded as an info-only metric. With several precisions each gets its own record, so the table shows
+ * the accuracy/throughput trade-off side by side. Print a summary table, then write JSON,
+ * save a baseline or compare against one as requested.
+ *
+ * @param  testStr Name of test case to benchmark.
+ * @param  params  Test parameters shared by every run.
+ * @param  options Run counts, output and baseline options.
+ * @return         Zero on success, nonzero on regressions or errors.
+ */
+
+int RunBench(const string& testStr, TestParams& params, BenchOptions& options)
+{
+    TestCase& problem = problems[testStr];
+    vector<BenchRecord> records;
+    vector<Precision> precisions = options.precisions;
+    string precisionNames;
+
+    if (precisions.empty()) precisions.push_back(params.precision);
+
+    for (auto precision : precisions)
+    {
+        BenchRecord record;
+        record.name = testStr;
+
+        // Double runs keep the plain test name so existing baselines still match.
+
+        if (precision != PRECISION_DOUBLE) record.name += string(" ") + PrecisionName(precision);
+
+        params.precision = precision;
+        precisionNames += (precisionNames.empty() ? "" : ",") + string(PrecisionName(precision));
+
+        for (uint32_t run = 0; run < options.warmupRuns + options.runs; run++)
+        {
+            bool bWarmup = run < options.warmupRuns;
+            if (run == options.warmupRuns && records.empty()) ResetProfiler();
+
+            printf("\n=== %s %s run %u ===\n", record.name.c_str(), bWarmup ? "warmup" : "timed",
+                bWarmup ? run : run - options.warmupRuns);
+
+            TestResults results = {};
+            bool bRunPeakRSS    = ResetPeakRSS();
+            CycleTimer timer;
+
+            problem.pfnTest(params, results);
+
+            double wallTime = timer.Seconds();
+            if (bWarmup) continue;
+
+            record.GetMetric("wall_time", "s", false).samples.push_back(wallTime);
+            record.GetMetric("train_time", "s", false).samples.push_back(results.trainTime);
+            record.GetMetric("test_time", "s", false).samples.push_back(results.testTime);
+            record.GetMetric("train_images_per_sec", "img/s", true).samples.push_back(
+                results.trainTime > 0.0 ? (double)results.trainImages / results.trainTime : 0.0);
+
+            // Without a per-run reset the peak covers every earlier run too, so it is only
+            // reported, under its own name, and not gated.
+
+            double peakRSS = (double)GetPeakRSSBytes() / (1024.0 * 1024.0);
+
+            if (bRunPeakRSS) record.GetMetric("peak_rss", "MiB", false).samples.push_back(peakRSS);
+            else record.GetMetric("process_peak_rss", "MiB", false, false).samples.push_back(peakRSS);
+
+            record.GetMetric("accuracy", "%", true).samples.push_back(results.accuracy);
+
+            // Plasticity counts describe the run rather than its cost, so they are never gated.
+
+            record.GetMetric("synapses_culled", "synapses", false, false).samples.push_back(
+                (double)results.synapsesCulled);
+            record.GetMetric("synapses_grown", "synapses", false, false).samples.push_back(
+                (double)results.synapsesGrown);
+        }
+
+        records.push_back(record);
+    }
+
+    printf("\nBenchmark %s: %u runs, %u warmup, seed %u, kernel threads %u\n", testStr.c_str(),
+        options.runs, options.warmupRuns, params.seed, GetNumThreads());
+
+    PrintBenchTable(records);
+    PrintProfileReport();
+    PrintPerfCounterReport();
+    if (options.bRoofline) PrintRooflineReport(MeasureRoofline(GetNumThreads()));
+
+    map<string, string> config =
+    {
+        { "problem", testStr },
+        { "runs", to_string(options.runs) },
+        { "warmup_runs", to_string(options.warmupRuns) },
+        { "seed", to_string(params.seed) },
+        { "kernel_threads", to_string(GetNumThreads()) },
+        { "precision", precisionNames },
+        { "renorm_interval", to_string(params.renormInterval) },
+        { "order", NeuronOrderName(params.order) },
+        { "grow_weight", to_string(params.growWeight) },
+        { "pulses", to_string(params.numPulses) },
+        { "pulse_act", PulseActivationName(params.pulseActivation) },
+        { "pulse_thresh", to_string(params.pulseThresh) },
+        { "load_net", params.loadNetPath },
+        { "synapses", params.synapsesPath }
+    };
+
+    return RunBenchGate(records, config, options.gate);
+}
+
 /**
  * main - Parse command line arguments and kickoff test case specified on command line.
  *
  * @param  argc Number of command line args.
  * @param  argv Array of command args.
- * @return      Program success code (not used).
+ * @return      Program success code.
  */
 
 int main(int argc, char** argv)
@@ -59,5 +253,72 @@ int main(int argc, char** argv)
         exit(0);
     }
 
-    problems[testStr].pfnTest();
-}
\ No newline at end of file
+    TestParams params       = {};
+    params.seed             = (uint32_t)time(NULL);
+    params.precision        = PRECISION_DOUBLE;
+    params.renormInterval   = 1;
+    params.order            = ORDER_NONE;
+    params.growWeight       = 0.0;
+    params.numPulses        = 1;
+    params.pulseActivation  = PULSE_LINEAR;
+    params.pulseThresh      = 0.0;
+
+    BenchOptions options    = {};
+    options.runs            = 5;
+    options.warmupRuns      = 1;
+
+    bool bSeedSet = false;
+
+    for (int i = 2; i < argc; i++)
+    {
+        string arg = argv[i];
+
+        if (arg == "--bench") params.bBench = true;
+        else if (arg == "--runs" && i + 1 < argc) options.runs = (uint32_t)atoi(argv[++i]);
+        else if (arg == "--warmup" && i + 1 < argc) options.warmupRuns = (uint32_t)atoi(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc) { params.seed = (uint32_t)atoi(argv[++i]); bSeedSet = true; }
+        else if (arg == "--threads" && i + 1 < argc) params.numThreads = (uint32_t)atoi(argv[++i]);
+        else if (arg == "--kernel-threads" && i + 1 < argc) SetNumThreads((uint32_t)atoi(argv[++i]));
+        else if (arg == "--roofline") options.bRoofline = true;
+        else if (arg == "--perf") EnablePerfCounters(true);
+        else if (arg == "--precision" && i + 1 < argc && ParsePrecisions(argv[i + 1], options.precisions)) i++;
+        else if (arg == "--renorm" && i + 1 < argc) params.renormInterval = (uint32_t)atoi(argv[++i]);
+        else if (arg == "--order" && i + 1 < argc && ParseNeuronOrder(argv[i + 1], params.order)) i++;
+        else if (arg == "--grow" && i + 1 < argc) params.growWeight = atof(argv[++i]);
+        else if (arg == "--save-net" && i + 1 < argc) params.saveNetPath = argv[++i];
+        else if (arg == "--load-net" && i + 1 < argc) params.loadNetPath = argv[++i];
+        else if (arg == "--synapses" && i + 1 < argc) params.synapsesPath = argv[++i];
+        else if (arg == "--pulses" && i + 1 < argc) params.numPulses = (uint32_t)atoi(argv[++i]);
+        else if (arg == "--pulse-act" && i + 1 < argc && ParsePulseActivation(argv[i + 1], params.pulseActivation)) i++;
+        else if (arg == "--pulse-thresh" && i + 1 < argc) params.pulseThresh = atof(argv[++i]);
+        else if (ParseBenchGateArg(argc, argv, i, options.gate)) continue;
+        else
+        {
+            printf("Unknown argument: %s\n\n", arg.c_str());
+            DisplayTests();
+            exit(1);
+        }
+    }
+
+    if (params.numPulses == 0) params.numPulses = 1;
+
+    if (params.bBench)
+    {
+        if (!bSeedSet) params.seed = 1234;
+        if (options.runs == 0) options.runs = 1;
+        return RunBench(testStr, params, options);
+    }
+
+    if (options.precisions.empty()) options.precisions.push_back(params.precision);
+
+    for (auto precision : options.precisions)
+    {
+        TestResults results = {};
+        params.precision    = precision;
+        problems[testStr].pfnTest(params, results);
+    }
+
+    PrintPerfCounterReport();
+
+    return 0;
+}
@@ -0,0 +1,405 @@
+#include <ctype.h>
+#include "graphio.h"
+
+/**
+ * NextToken - Split the next whitespace separated token off a line.
+ *
+ * @param  p       Current position, advanced past the token.
+ * @param  lineEnd End of the line.
+ * @return         Token, empty at the end of the line.
+ */
+
+static string NextToken(const char*& p, const char* lineEnd)
+{
+    while (p < lineEnd && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+
+    const char* begin = p;
+    while (p < lineEnd && *p != ' ' && *p != '\t' && *p != '\r') p++;
+
+    string token(begin, p);
+    for (auto& ch : token) ch = (char)tolower((unsigned char)ch);
+
+    return token;
+}
+
+/**
+ * ParseUInt - Parse an unsigned decimal number.
+ *
+ * @param  p       Current position, advanced past the number.
+ * @param  lineEnd End of the line.
+ * @param  val     Parsed number.
+ * @return         False if there are no digits or the number overflows 64 bits.
+ */
+
+static bool ParseUInt(const char*& p, const char* lineEnd, uint64_t& val)
+{
+    while (p < lineEnd && (*p == ' ' || *p == '\t')) p++;
+
+    const char* begin = p;
+    val = 0;
+
+    for (; p < lineEnd && *p >= '0' && *p <= '9'; p++)
+    {
+        if (val > (UINT64_MAX - 9) / 10) return false;
+        val = 10 * val + (uint64_t)(*p - '0');
+    }
+
+    return p > begin;
+}
+
+/**
+ * ParseMatrixMarketHeader - Parse the banner and size line of a Matrix Market file. Only
+ * the coordinate format is supported, with real, integer or pattern values and general,
+ * symmetric or skew-symmetric structure.
+ *
+ * @param  data   File text.
+ * @param  size   Text size.
+ * @param  header Parsed header, bodyOffset is the first byte after the size line.
+ * @param  err    Error message on failure.
+ * @return        True on success.
+ */
+
+bool ParseMatrixMarketHeader(const char* data, size_t size, MatrixMarketHeader& header, string& err)
+{
+    const char* end     = data + size;
+    const char* lineEnd = NextLine(data, end);
+    const char* p       = data;
+
+    if (NextToken(p, lineEnd) != "%%matrixmarket" || NextToken(p, lineEnd) != "matrix")
+    {
+        err = "missing %%MatrixMarket matrix banner";
+        return false;
+    }
+
+    string format   = NextToken(p, lineEnd);
+    string field    = NextToken(p, lineEnd);
+    string symmetry = NextToken(p, lineEnd);
+
+    if (format != "coordinate" || (field != "real" && field != "double" && field != "integer" && field != "pattern") ||
+        (symmetry != "general" && symmetry != "symmetric" && symmetry != "skew-symmetric"))
+    {
+        err = "unsupported Matrix Market type " + format + " " + field + " " + symmetry;
+        return false;
+    }
+
+    header.bPattern     = field == "pattern";
+    header.bSymmetric   = symmetry == "symmetric";
+    header.bSkew        = symmetry == "skew-symmetric";
+
+    // Comments and blank lines until the size line.
+
+    for (p = lineEnd + 1; p < end; p = lineEnd + 1)
+    {
+        lineEnd = NextLine(p, end);
+
+        const char* first = p;
+        while (first < lineEnd && (*first == ' ' || *first == '\t' || *first == '\r')) first++;
+
+        if (first < lineEnd && *first != '%') break;
+    }
+
+    uint64_t n;
+    uint64_t m;
+    uint64_t nnz;
+
+    if (p >= end || !ParseUInt(p, lineEnd, n) || !ParseUInt(p, lineEnd, m) || !ParseUInt(p, lineEnd, nnz) ||
+        n > UINT32_MAX || m > UINT32_MAX)
+    {
+        err = "bad size line";
+        return false;
+    }
+
+    header.n            = (uint32_t)n;
+    header.m            = (uint32_t)m;
+    header.nnz          = nnz;
+    header.bodyOffset   = min(size, (size_t)(lineEnd - data) + 1);
+
+    return true;
+}
+
+/**
+ * SplitTextChunks - Split a range of text into chunks of about equal size that start at
+ * line starts.
+ *
+ * @param data      Text.
+ * @param begin     Start of the range.
+ * @param end       End of the range.
+ * @param numChunks Number of chunks.
+ * @param bounds    Chunk boundaries, numChunks + 1 entries. Chunks may be empty.
+ */
+
+void SplitTextChunks(const char* data, size_t begin, size_t end, uint32_t numChunks, vector<size_t>& bounds)
+{
+    bounds.assign((size_t)numChunks + 1, end);
+    bounds[0] = begin;
+
+    for (uint32_t chunk = 1; chunk < numChunks; chunk++)
+    {
+        size_t target   = max(bounds[chunk - 1], begin + (end - begin) / numChunks * chunk);
+        const char* nl  = NextLine(data + target, data + end);
+
+        bounds[chunk]   = min(end, (size_t)(nl - data) + 1);
+    }
+}
+
+/**
+ * CountDataLines - Count the entry lines in a chunk of a Matrix Market body, skipping
+ * comments and blank lines.
+ *
+ * @param  data  Text.
+ * @param  begin Chunk start, at a line start.
+ * @param  end   Chunk end.
+ * @return       Number of entry lines.
+ */
+
+size_t CountDataLines(const char* data, size_t begin, size_t end)
+{
+    const char* p       = data + begin;
+    const char* last    = data + end;
+    size_t count        = 0;
+
+    while (p < last)
+    {
+        const char* lineEnd = NextLine(p, last);
+
+        while (p < lineEnd && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        if (p < lineEnd && *p != '%') count++;
+
+        p = lineEnd + 1;
+    }
+
+    return count;
+}
+
+/**
+ * ParseDecimalFast - Parse a decimal value without strtod when that's exact: up to 19
+ * significant digits forming an integer below 2^53, scaled by a power of ten up to 22. Both
+ * are exact doubles, so one multiply or divide rounds correctly. Most hand written and
+ * exported weights fit.
+ *
+ * @param  p   Token start.
+ * @param  end Token end.
+ * @param  val Parsed value.
+ * @return     False if the token doesn't fit the fast path, the caller falls back to strtod.
+ */
+
+static bool ParseDecimalFast(const char* p, const char* end, double& val)
+{
+    static const double pow10[] =
+    {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16,
+        1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    bool bNeg = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) p++;
+
+    uint64_t mantissa  = 0;
+    int32_t exponent   = 0;
+    uint32_t numDigits = 0;
+
+    for (; p < end && *p >= '0' && *p <= '9'; p++, numDigits++) mantissa = 10 * mantissa + (uint64_t)(*p - '0');
+
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, numDigits++, exponent--)
+        {
+            mantissa = 10 * mantissa + (uint64_t)(*p - '0');
+        }
+    }
+
+    if (numDigits == 0 || numDigits > 19) return false;
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+        bool bNegExp = p < end && *p == '-';
+        if (p < end && (*p == '-' || *p == '+')) p++;
+
+        int32_t expVal = 0;
+        const char* expBegin = p;
+
+        for (; p < end && *p >= '0' && *p <= '9' && expVal < 1000; p++) expVal = 10 * expVal + (*p - '0');
+        if (p == expBegin) return false;
+
+        exponent += bNegExp ? -expVal : expVal;
+    }
+
+    if (p != end || mantissa > (1ULL << 53) || exponent < -22 || exponent > 22) return false;
+
+    val = (double)mantissa;
+    val = exponent < 0 ? val / pow10[-exponent] : val * pow10[exponent];
+    if (bNeg) val = -val;
+
+    return true;
+}
+
+/**
+ * ParseEdgeLine - Parse one Matrix Market entry line, "row col [value]". Values off the
+ * fast path are copied to a terminated buffer for strtod, since a mapped file isn't
+ * terminated.
+ *
+ * @param  line     First non-blank character of the line.
+ * @param  lineEnd  End of the line.
+ * @param  bPattern Whether entries have no value, they get 1.
+ * @param  r        One based row.
+ * @param  c        One based column.
+ * @param  val      Entry value.
+ * @return          False on a malformed line.
+ */
+
+bool ParseEdgeLine(const char* line, const char* lineEnd, bool bPattern, uint32_t& r, uint32_t& c, double& val)
+{
+    const char* p = line;
+    uint64_t row;
+    uint64_t col;
+
+    if (!ParseUInt(p, lineEnd, row) || !ParseUInt(p, lineEnd, col) || row > UINT32_MAX || col > UINT32_MAX) return false;
+
+    r = (uint32_t)row;
+    c = (uint32_t)col;
+
+    if (bPattern)
+    {
+        val = 1.0;
+        return true;
+    }
+
+    while (p < lineEnd && (*p == ' ' || *p == '\t')) p++;
+
+    const char* tokenBegin = p;
+    while (p < lineEnd && *p != ' ' && *p != '\t' && *p != '\r') p++;
+
+    if (ParseDecimalFast(tokenBegin, p, val)) return true;
+
+    char token[64];
+    size_t len = (size_t)(p - tokenBegin);
+
+    if (len == 0 || len >= sizeof(token)) return false;
+
+    memcpy(token, tokenBegin, len);
+    token[len] = '\0';
+
+    char* tokenEnd;
+    val = strtod(token, &tokenEnd);
+
+    return tokenEnd == token + len;
+}
+
+/**
+ * WriteTextChunks - Write text formatted in parallel. Items are split into chunks of
+ * graphChunkEdges, a block of chunks is formatted at a time, one string per chunk, then the
+ * block is written in order. Memory stays bounded by the block size.
+ *
+ * @param  f      Output file.
+ * @param  count  Number of items.
+ * @param  format Appends the text of items [begin, end) to out.
+ * @return        True on success.
+ */
+
+bool WriteTextChunks(FILE* f, size_t count, const function<void(size_t begin, size_t end, string& out)>& format)
+{
+    uint32_t chunksPerBlock = GetNumThreads() * 4;
+    size_t numChunks        = (count + graphChunkEdges - 1) / graphChunkEdges;
+
+    vector<string> texts(chunksPerBlock);
+
+    for (size_t blockChunk = 0; blockChunk < numChunks; blockChunk += chunksPerBlock)
+    {
+        uint32_t blockSize = (uint32_t)min((size_t)chunksPerBlock, numChunks - blockChunk);
+
+        ParallelRun(blockSize, [&](uint32_t chunk)
+        {
+            size_t begin = (blockChunk + chunk) * graphChunkEdges;
+
+            texts[chunk].clear();
+            format(begin, min(count, begin + graphChunkEdges), texts[chunk]);
+        });
+
+        for (uint32_t chunk = 0; chunk < blockSize; chunk++)
+        {
+            if (fwrite(texts[chunk].data(), 1, texts[chunk].size(), f) != texts[chunk].size()) return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * FormatUInt - Format an unsigned number in decimal.
+ *
+ * @param  buf Output buffer, at least 11 characters.
+ * @param  val Number to format.
+ * @return     Number of characters written.
+ */
+
+static size_t FormatUInt(char* buf, uint32_t val)
+{
+    char digits[10];
+    size_t len = 0;
+
+    do
+    {
+        digits[len++] = (char)('0' + val % 10);
+        val /= 10;
+    } while (val != 0);
+
+    for (size_t i = 0; i < len; i++) buf[i] = digits[len - 1 - i];
+
+    return len;
+}
+
+/**
+ * FormatEdgeLine - Format a Matrix Market entry line. Values get 15 significant digits when
+ * that reads back exactly, which keeps typical weights short and on the reader's fast path,
+ * and 17 otherwise.
+ *
+ * @param  buf Output buffer, at least 96 characters.
+ * @param  r   One based row.
+ * @param  c   One based column.
+ * @param  val Entry value.
+ * @return     Number of characters written.
+ */
+
+size_t FormatEdgeLine(char* buf, uint32_t r, uint32_t c, double val)
+{
+    size_t len  = FormatUInt(buf, r);
+    buf[len++]  = ' ';
+    len         += FormatUInt(buf + len, c);
+    buf[len++]  = ' ';
+
+    int valLen = snprintf(buf + len, 96 - len, "%.15g", val);
+    if (strtod(buf + len, NULL) != val) valLen = snprintf(buf + len, 96 - len, "%.17g", val);
+
+    len         += valLen;
+    buf[len++]  = '\n';
+
+    return len;
+}
+
+/**
+ * FormatEdgeLine - Format a Matrix Market entry line with a float value, 6 or 9 significant
+ * digits.
+ *
+ * @param  buf Output buffer, at least 96 characters.
+ * @param  r   One based row.
+ * @param  c   One based column.
+ * @param  val Entry value.
+ * @return     Number of characters written.
+ */
+
+size_t FormatEdgeLine(char* buf, uint32_t r, uint32_t c, float val)
+{
+    size_t len  = FormatUInt(buf, r);
+    buf[len++]  = ' ';
+    len         += FormatUInt(buf + len, c);
+    buf[len++]  = ' ';
+
+    int valLen = snprintf(buf + len, 96 - len, "%.6g", (double)val);
+    if ((float)strtod(buf + len, NULL) != val) valLen = snprintf(buf + len, 96 - len, "%.9g", (double)val);
+
+    len         += valLen;
+    buf[len++]  = '\n';
+
+    return len;
+}
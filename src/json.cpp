@@ -0,0 +1,382 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "json.h"
+
+/**
+ * JsonValue::Find - Look up an object member.
+ *
+ * @param  key Member name.
+ * @return     Member value, or NULL if this isn't an object or has no such member.
+ */
+
+const JsonValue* JsonValue::Find(const string& key) const
+{
+    if (type != JSON_OBJECT) return NULL;
+
+    for (auto& member : object)
+    {
+        if (member.first == key) return &member.second;
+    }
+
+    return NULL;
+}
+
+/**
+ * JsonValue::operator[] - Get an object member, adding a null member if it doesn't exist.
+ * Converts a null value into an empty object first.
+ *
+ * @param  key Member name.
+ * @return     Member value.
+ */
+
+JsonValue& JsonValue::operator[](const string& key)
+{
+    if (type == JSON_NULL) type = JSON_OBJECT;
+
+    for (auto& member : object)
+    {
+        if (member.first == key) return member.second;
+    }
+
+    object.push_back({ key, JsonValue() });
+    return object.back().second;
+}
+
+struct JsonParser
+{
+    const string& text;
+    size_t pos;
+    string err;
+
+    JsonParser(const string& text) : text(text), pos(0) {}
+
+    void SkipWhitespace()
+    {
+        while (pos < text.size() &&
+            (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\r' || text[pos] == '\n')) pos++;
+    }
+
+    bool Fail(const char* msg)
+    {
+        err = string(msg) + " at offset " + to_string(pos);
+        return false;
+    }
+
+    bool Match(const char* literal)
+    {
+        size_t len = strlen(literal);
+        if (text.compare(pos, len, literal) != 0) return false;
+        pos += len;
+        return true;
+    }
+
+    bool ParseString(string& out)
+    {
+        if (text[pos] != '"') return Fail("Expected string");
+        pos++;
+
+        while (pos < text.size() && text[pos] != '"')
+        {
+            char c = text[pos++];
+
+            if (c != '\\')
+            {
+                out.push_back(c);
+                continue;
+            }
+
+            if (pos >= text.size()) return Fail("Unterminated escape");
+            char e = text[pos++];
+
+            switch (e)
+            {
+            case 'n': out.push_back('\n'); break;
+            case 't': out.push_back('\t'); break;
+            case 'r': out.push_back('\r'); break;
+            case 'b': out.push_back('\b'); break;
+            case 'f': out.push_back('\f'); break;
+            case 'u':
+            {
+                if (pos + 4 > text.size()) return Fail("Bad unicode escape");
+                uint32_t code = (uint32_t)strtoul(text.substr(pos, 4).c_str(), NULL, 16);
+                pos += 4;
+
+                // Benchmark files only ever escape control characters, no need for
+                // surrogate pairs.
+
+                if (code < 0x80) out.push_back((char)code);
+                else if (code < 0x800)
+                {
+                    out.push_back((char)(0xc0 | (code >> 6)));
+                    out.push_back((char)(0x80 | (code & 0x3f)));
+                }
+                else
+                {
+                    out.push_back((char)(0xe0 | (code >> 12)));
+                    out.push_back((char)(0x80 | ((code >> 6) & 0x3f)));
+                    out.push_back((char)(0x80 | (code & 0x3f)));
+                }
+                break;
+            }
+            default: out.push_back(e); break;
+            }
+        }
+
+        if (pos >= text.size()) return Fail("Unterminated string");
+        pos++;
+        return true;
+    }
+
+    bool ParseValue(JsonValue& value)
+    {
+        SkipWhitespace();
+        if (pos >= text.size()) return Fail("Unexpected end of input");
+
+        char c = text[pos];
+
+        if (c == '{')
+        {
+            value = JsonValue::Object();
+            pos++;
+            SkipWhitespace();
+
+            if (pos < text.size() && text[pos] == '}')
+            {
+                pos++;
+                return true;
+            }
+
+            while (true)
+            {
+                SkipWhitespace();
+                string key;
+                if (!ParseString(key)) return false;
+
+                SkipWhitespace();
+                if (pos >= text.size() || text[pos] != ':') return Fail("Expected ':'");
+                pos++;
+
+                value.object.push_back({ key, JsonValue() });
+                if (!ParseValue(value.object.back().second)) return false;
+
+                SkipWhitespace();
+                if (pos < text.size() && text[pos] == ',') { pos++; continue; }
+                if (pos < text.size() && text[pos] == '}') { pos++; return true; }
+                return Fail("Expected ',' or '}'");
+            }
+        }
+
+        if (c == '[')
+        {
+            value = JsonValue::Array();
+            pos++;
+            SkipWhitespace();
+
+            if (pos < text.size() && text[pos] == ']')
+            {
+                pos++;
+                return true;
+            }
+
+            while (true)
+            {
+                value.array.push_back(JsonValue());
+                if (!ParseValue(value.array.back())) return false;
+
+                SkipWhitespace();
+                if (pos < text.size() && text[pos] == ',') { pos++; continue; }
+                if (pos < text.size() && text[pos] == ']') { pos++; return true; }
+                return Fail("Expected ',' or ']'");
+            }
+        }
+
+        if (c == '"')
+        {
+            value = JsonValue("");
+            return ParseString(value.str);
+        }
+
+        if (Match("true")) { value = JsonValue(true); return true; }
+        if (Match("false")) { value = JsonValue(false); return true; }
+        if (Match("null")) { value = JsonValue(); return true; }
+
+        const char* start = text.c_str() + pos;
+        char* end = NULL;
+        double d = strtod(start, &end);
+
+        if (end == start) return Fail("Unexpected character");
+
+        pos += end - start;
+        value = JsonValue(d);
+        return true;
+    }
+};
+
+/**
+ * ParseJson - Parse a JSON document.
+ *
+ * @param  text  Document text.
+ * @param  value Parsed value.
+ * @param  err   Error message on failure.
+ * @return       True on success.
+ */
+
+bool ParseJson(const string& text, JsonValue& value, string& err)
+{
+    JsonParser parser(text);
+
+    if (!parser.ParseValue(value))
+    {
+        err = parser.err;
+        return false;
+    }
+
+    parser.SkipWhitespace();
+
+    if (parser.pos != text.size())
+    {
+        parser.Fail("Trailing characters");
+        err = parser.err;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * ReadJsonFile - Load and parse a JSON file.
+ *
+ * @param  path  File path.
+ * @param  value Parsed value.
+ * @param  err   Error message on failure.
+ * @return       True on success.
+ */
+
+bool ReadJsonFile(const string& path, JsonValue& value, string& err)
+{
+    FILE* f = fopen(path.c_str(), "rb");
+
+    if (f == NULL)
+    {
+        err = "Failed to open " + path;
+        return false;
+    }
+
+    string text;
+    char buffer[4096];
+    size_t bytes;
+
+    while ((bytes = fread(buffer, 1, sizeof(buffer), f)) > 0) text.append(buffer, bytes);
+    fclose(f);
+
+    return ParseJson(text, value, err);
+}
+
+/**
+ * WriteJsonString - Write a JSON string literal, escaping quotes, backslashes and
+ * control characters.
+ *
+ * @param f   Output file.
+ * @param str String to write.
+ */
+
+static void WriteJsonString(FILE* f, const string& str)
+{
+    fputc('"', f);
+
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if ((unsigned char)c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+
+    fputc('"', f);
+}
+
+/**
+ * WriteJson - Pretty print a JSON value. Arrays of scalars are kept on one line so
+ * sample lists stay readable. NaN and infinity have no JSON form and are written as null.
+ *
+ * @param f      Output file.
+ * @param value  Value to write.
+ * @param indent Current indentation level.
+ */
+
+void WriteJson(FILE* f, const JsonValue& value, uint32_t indent)
+{
+    string pad(2 * (indent + 1), ' ');
+    string padEnd(2 * indent, ' ');
+
+    switch (value.type)
+    {
+    case JSON_NULL: fprintf(f, "null"); break;
+    case JSON_BOOL: fprintf(f, value.boolean ? "true" : "false"); break;
+    case JSON_NUMBER:
+        if (!isfinite(value.number)) fprintf(f, "null");
+        else if (value.number == floor(value.number) && fabs(value.number) < 1e15) fprintf(f, "%.0f", value.number);
+        else fprintf(f, "%.9g", value.number);
+        break;
+    case JSON_STRING: WriteJsonString(f, value.str); break;
+    case JSON_ARRAY:
+    {
+        bool bScalars = true;
+        for (auto& v : value.array) bScalars &= (v.type != JSON_ARRAY && v.type != JSON_OBJECT);
+
+        fputc('[', f);
+
+        for (size_t i = 0; i < value.array.size(); i++)
+        {
+            if (bScalars) fprintf(f, "%s", i ? ", " : "");
+            else fprintf(f, "%s\n%s", i ? "," : "", pad.c_str());
+            WriteJson(f, value.array[i], indent + 1);
+        }
+
+        if (!bScalars && !value.array.empty()) fprintf(f, "\n%s", padEnd.c_str());
+        fputc(']', f);
+        break;
+    }
+    case JSON_OBJECT:
+    {
+        fputc('{', f);
+
+        for (size_t i = 0; i < value.object.size(); i++)
+        {
+            fprintf(f, "%s\n%s", i ? "," : "", pad.c_str());
+            WriteJsonString(f, value.object[i].first);
+            fprintf(f, ": ");
+            WriteJson(f, value.object[i].second, indent + 1);
+        }
+
+        if (!value.object.empty()) fprintf(f, "\n%s", padEnd.c_str());
+        fputc('}', f);
+        break;
+    }
+    }
+}
+
+/**
+ * WriteJsonFile - Write a JSON value to file.
+ *
+ * @param  path  Output file path.
+ * @param  value Value to write.
+ * @return       True on success.
+ */
+
+bool WriteJsonFile(const string& path, const JsonValue& value)
+{
+    FILE* f = fopen(path.c_str(), "w");
+
+    if (f == NULL)
+    {
+        printf("Failed to open %s for writing\n", path.c_str());
+        return false;
+    }
+
+    WriteJson(f, value);
+    fprintf(f, "\n");
+    fclose(f);
+
+    return true;
+}
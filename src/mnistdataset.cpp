@@ -15,6 +15,13 @@ void MNISTDataSet::Init(const char* dataFile, const char* labelFile)
     printf("Label File: %s\n\n", labelFile);
 
     FILE *df = fopen(dataFile, "r");
+
+    if (df == NULL)
+    {
+        printf("Failed to open MNIST data file %s\n", dataFile);
+        exit(1);
+    }
+
     char lineBuffer[128];
     fgets(lineBuffer, 128, df);
 
@@ -79,6 +86,13 @@ void MNISTDataSet::Init(const char* dataFile, const char* labelFile)
     // Load labels.
 
     df = fopen(labelFile, "r");
+
+    if (df == NULL)
+    {
+        printf("Failed to open MNIST label file %s\n", labelFile);
+        exit(1);
+    }
+
     fgets(lineBuffer, 128, df);
     uint32_t curLabel = 0;
 
@@ -12,14 +12,17 @@ static MNISTDataSet testData;
 static const uint32_t inputSize     = 784;
 static const uint32_t outputSize    = 10;
 
-static const bool bDoSweep          = true;
-static const uint32_t numThreads    = 8;
+static const uint32_t defaultNumThreads = 8;
+static const uint32_t testBlockSize = 64;
+static const double growActThresh = 0.5;
 
 struct TrainParams
 {
     uint32_t numIterations;
     uint32_t batchSize;
     uint32_t pulseLength;
+    PulseActivation pulseActivation;
+    double pulseThresh;
     double learnRate;
     double cullThresh;
     uint32_t minVerts;
@@ -27,12 +30,23 @@ struct TrainParams
     double minEdge;
     double maxEdge;
     double edgeProb;
+    Precision precision;
+    uint32_t renormInterval;
+    NeuronOrder order;
+    double growWeight;
+    string saveNetPath;
+    string loadNetPath;
+    string synapsesPath;
 };
 
 struct TrainResults
 {
     double trainTime;
+    double testTime;
     double accuracy;
+    uint64_t trainImages;
+    uint64_t synapsesCulled;
+    uint64_t synapsesGrown;
 };
 
 static vector<TrainParams> ParamQueue;
@@ -83,14 +97,15 @@ void PickRandomInputsAndOutputs(
  * @param assocPost List of postsynaptic activations to populate.
  */
 
+template<class T>
 void getAssocBatch(
     MNISTDataSet &data,
     uint32_t start,
     uint32_t batchSize,
     vector<uint32_t> &inputs,
     vector<uint32_t> &outputs,
-    vector<vector<pair<uint32_t, double>>> &assocPre,
-    vector<vector<pair<uint32_t, double>>> &assocPost)
+    vector<vector<pair<uint32_t, T>>> &assocPre,
+    vector<vector<pair<uint32_t, T>>> &assocPost)
 {
     for (uint32_t i = 0; i < batchSize; i++)
     {
@@ -99,7 +114,7 @@ void getAssocBatch(
         for (uint32_t j = 0; j < inputSize; j++)
         {
             assocPre[i][j].first    = inputs[j];
-            assocPre[i][j].second   = data.data[start + i][j];
+            assocPre[i][j].second   = (T)data.data[start + i][j];
         }
 
         assocPost[i][0].first   = outputs[data.labels[start + i]];
@@ -113,9 +128,22 @@ void getAssocBatch(
  * of iterations of trianing data. Etc. Worker threads will then pull parameters sets
  * from this queue, train a neural net, and report training time and test set
  * accuaracy.
+ *
+ * @param precision      Precision every job trains in.
+ * @param renormInterval Updates between synapse renormalizations.
+ * @param order          Neuron ordering of every job's net.
+ * @param growWeight     Weight of synapses grown between co-firing neurons, 0 disables growth.
+ * @param numPulses      Pulses per training batch.
+ * @param pulseAct       Pulse nonlinearity.
+ * @param pulseThresh    Activation a neuron's pulse input must pass.
+ * @param saveNetPath    If set, every job saves its trained net to this path with the job's
+ *                       queue index appended.
+ * @param synapsesPath   If set, every job trains the graph in this file instead of a random one.
  */
 
-void InitParamSweepQueue()
+void InitParamSweepQueue(Precision precision, uint32_t renormInterval, NeuronOrder order, double growWeight,
+    uint32_t numPulses, PulseActivation pulseAct, double pulseThresh, const string& saveNetPath,
+    const string& synapsesPath)
 {
     assert(ParamQueue.size() == 0);
 
@@ -136,7 +164,9 @@ void InitParamSweepQueue()
 
                     params.numIterations    = n;
                     params.batchSize        = b;
-                    params.pulseLength      = 1;
+                    params.pulseLength      = numPulses;
+                    params.pulseActivation  = pulseAct;
+                    params.pulseThresh      = pulseThresh;
                     params.learnRate        = lr;
                     params.cullThresh       = 1e-8;
                     params.minVerts         = inputSize + outputSize;
@@ -144,6 +174,13 @@ void InitParamSweepQueue()
                     params.minEdge          = 1e-6;
                     params.maxEdge          = 100.0;
                     params.edgeProb         = e;
+                    params.precision        = precision;
+                    params.renormInterval   = renormInterval;
+                    params.order            = order;
+                    params.growWeight       = growWeight;
+                    params.synapsesPath     = synapsesPath;
+
+                    if (!saveNetPath.empty()) params.saveNetPath = saveNetPath + "." + to_string(ParamQueue.size());
 
                     ParamQueue.push_back(params);
                 }
@@ -153,27 +190,64 @@ void InitParamSweepQueue()
 }
 
 /**
- * MNISTRandThreadFunc - Thread routine for MNISTRand training. Grab a set of training parameters
- * from the parameter sweep queue. Train a neural net with these parameters and report training time
- * and test set accuracy. Keep grabbing parameter sets until queue is emtpy.
+ * MNISTRandTrainAndTest - Build a random graph, or read one from a Matrix Market or edge
+ * list file, train it on MNIST with activations in T and measure test set accuracy. A net
+ * loaded from a file keeps the input/output neurons it was trained with and skips training.
+ *
+ * @param  params Training parameters.
+ * @return        Training/test time, accuracy and training image count.
  */
 
-void MNISTRandThreadFunc()
+template<class T>
+TrainResults MNISTRandTrainAndTest(TrainParams &params)
 {
-    while (1)
-    {
-        paramQueueMtx.lock();
+    NN<T> nn;
+    vector<uint32_t> inputs;
+    vector<uint32_t> outputs;
+    string err;
 
-        if (ParamQueue.size() > 0)
+    if (!params.loadNetPath.empty())
+    {
+        if (!nn.load(params.loadNetPath, err) || nn.inputNeurons.size() != inputSize ||
+            nn.outputNeurons.size() != outputSize)
         {
-            TrainParams params = ParamQueue.back();
-            ParamQueue.pop_back();
+            printf("Failed to load net: %s\n", err.empty() ? "not an MNIST net" : err.c_str());
+            return {};
+        }
 
-            printf("Thread %zd training new net. Remaining jobs = %zd\n", this_thread::get_id(),
-                ParamQueue.size());
+        inputs                  = nn.inputNeurons;
+        outputs                 = nn.outputNeurons;
+        params.numIterations    = 0;
+    }
+    else
+    {
+        NNCreateParams<T> nnParams;
+        nnParams.batchSize = params.batchSize;
+        nnParams.name = "MNIST Digit Net Random";
+        nnParams.learnRate = params.learnRate;
+        nnParams.cullThresh = params.cullThresh;
+        nnParams.format = PrecisionFormat(params.precision);
+        nnParams.renormInterval = params.renormInterval;
+        nnParams.order = params.order;
+        nnParams.pulseActivation = params.pulseActivation;
+        nnParams.pulseThresh = params.pulseThresh;
+
+        if (!params.synapsesPath.empty())
+        {
+            TripletMat<T> trip;
 
-            paramQueueMtx.unlock();
+            if (!ReadSynapseGraph(params.synapsesPath, trip, err) || trip.n != trip.m || trip.n < inputSize + outputSize)
+            {
+                printf("Failed to read synapses: %s\n", err.empty() ? "graph must be square with enough neurons" :
+                    err.c_str());
+                return {};
+            }
 
+            nnParams.numNeurons = trip.n;
+            nnParams.synapsesIn = move(trip.entries);
+        }
+        else
+        {
             RandomGraph graph(
                 params.minVerts,
                 params.maxVerts,
@@ -184,97 +258,139 @@ void MNISTRandThreadFunc()
 
             vector<Triplet<double>> synapses = graph.GetEdgeTriplets();
 
-            NNCreateParams<double> nnParams;
-            nnParams.batchSize = params.batchSize;
-            nnParams.name = "MNIST Digit Net Random";
             nnParams.numNeurons = graph.numVerts;
-            nnParams.synapsesIn = synapses;
-            nnParams.learnRate = params.learnRate;
-            nnParams.cullThresh = params.cullThresh;
+            nnParams.synapsesIn.reserve(synapses.size());
+            for (auto& synapse : synapses) nnParams.synapsesIn.push_back({ synapse.r, synapse.c, (T)synapse.val });
+        }
 
-            NN<double> nn(nnParams);
+        nn = NN<T>(nnParams);
 
-            vector<uint32_t> inputs;
-            vector<uint32_t> outputs;
+        PickRandomInputsAndOutputs(nnParams.numNeurons, inputs, outputs);
 
-            PickRandomInputsAndOutputs(graph.numVerts, inputs, outputs);
+        nn.inputNeurons     = inputs;
+        nn.outputNeurons    = outputs;
+    }
 
-            vector<vector<pair<uint32_t, double>>> assocPre(params.batchSize);
-            vector<vector<pair<uint32_t, double>>> assocPost(params.batchSize);
+    vector<vector<pair<uint32_t, T>>> assocPre(params.batchSize);
+    vector<vector<pair<uint32_t, T>>> assocPost(params.batchSize);
 
-            for (uint32_t i = 0; i < params.batchSize; i++)
+    for (uint32_t i = 0; i < params.batchSize; i++)
+    {
+        assocPre[i].resize(inputSize);
+        assocPost[i].resize(1);
+    }
+
+    // 2. Train
+
+    uint32_t totalImagePasses = params.numIterations * trainData.numImgs;
+    uint32_t batchProgress = 0;
+    uint64_t synapsesCulled = 0;
+    uint64_t synapsesGrown = 0;
+
+    long long t1 = GetMilliseconds();
+
+    for (uint32_t i = 0; i < params.numIterations; i++)
+    {
+        for (uint32_t j = 0; j < trainData.numImgs; j += params.batchSize, batchProgress += params.batchSize)
+        {
+            if (j % 10000 == 0)
             {
-                assocPre[i].resize(inputSize);
-                assocPost[i].resize(1);
+                double progress = (double)batchProgress / (double)totalImagePasses;
+                jobProgress[this_thread::get_id()] = progress;
             }
 
-            // 2. Train
+            PROFILE_ZONE_WORK("MNISTRandTest::trainBatch", params.batchSize, "sample");
+            getAssocBatch(trainData, j, params.batchSize, inputs, outputs, assocPre, assocPost);
+            nn.applyAssocs(assocPre, assocPost, params.pulseLength);
+            if (params.growWeight > 0.0) synapsesGrown += nn.growSynapses((T)growActThresh, (T)params.growWeight);
+            nn.updateSynapses();
+        }
 
-            uint32_t totalImagePasses = params.numIterations * trainData.numImgs;
-            uint32_t batchProgress = 0;
+        synapsesCulled += nn.cull();
+        nn.packSynapses();
+    }
 
-            long long t1 = GetMilliseconds();
+    long long t2 = GetMilliseconds();
 
-            for (uint32_t i = 0; i < params.numIterations; i++)
-            {
-                for (uint32_t j = 0; j < trainData.numImgs; j += params.batchSize, batchProgress += params.batchSize)
-                {
-                    if (j % 10000 == 0)
-                    {
-                        double progress = (double)batchProgress / (double)totalImagePasses;
-                        jobProgress[this_thread::get_id()] = progress;
-                    }
-
-                    getAssocBatch(trainData, j, params.batchSize, inputs, outputs, assocPre, assocPost);
-                    nn.applyAssocs(assocPre, assocPost, params.pulseLength);
-                    nn.computePairings();
-                    nn.updateSynapses();
-                }
+    if (!params.saveNetPath.empty() && !nn.save(params.saveNetPath, err)) printf("Failed to save net: %s\n", err.c_str());
 
-                nn.cull();
-            }
+    // 3. Test
 
-            long long t2 = GetMilliseconds();
+    double trainingTime = ((double)(t2 - t1)) / 1000.0;
+    vector<T> testBlock;
+    vector<T> res;
 
-            // 3. Test
+    uint32_t correctCnt = 0;
 
-            double trainingTime = ((double)(t2 - t1)) / 1000.0;
-            vector<double> testVec(nn.numNeurons);
+    // Evaluate test images in blocks, neuron-major so the net is streamed once per block.
 
-            uint32_t correctCnt = 0;
+    for (uint32_t i = 0; i < testData.numImgs; i += testBlockSize)
+    {
+        uint32_t blockSize = min(testBlockSize, testData.numImgs - i);
+        PROFILE_ZONE_WORK("MNISTRandTest::testBlock", blockSize, "sample");
+        testBlock.assign((size_t)nn.numNeurons * blockSize, 0.0);
 
-            for (uint32_t i = 0; i < testData.numImgs; i++)
-            {
-                memset(&testVec[0], 0, nn.numNeurons * sizeof(double));
+        for (uint32_t j = 0; j < inputSize; j++)
+        {
+            for (uint32_t k = 0; k < blockSize; k++) testBlock[inputs[j] * blockSize + k] = (T)testData.data[i + k][j];
+        }
+
+        nn.applyInputBlock(testBlock, res, blockSize);
+
+        for (uint32_t k = 0; k < blockSize; k++)
+        {
+            T max = -50.0;
+            uint32_t outIdx = outputSize;
 
-                for (uint32_t j = 0; j < inputSize; j++)
+            for (uint32_t o = 0; o < outputSize; o++)
+            {
+                if (res[outputs[o] * blockSize + k] > max)
                 {
-                    testVec[inputs[j]] = testData.data[i][j];
+                    max = res[outputs[o] * blockSize + k];
+                    outIdx = o;
                 }
+            }
 
-                vector<double> res = nn.applyInput(testVec);
+            uint32_t label = testData.labels[i + k];
 
-                double max = -50.0;
-                uint32_t outIdx = outputSize;
+            if (label == outIdx) correctCnt++;
+        }
+    }
 
-                for (uint32_t i = 0; i < outputSize; i++)
-                {
-                    if (res[outputs[i]] > max)
-                    {
-                        max = res[outputs[i]];
-                        outIdx = i;
-                    }
-                }
+    double accuracy = 100.0 * (double)correctCnt / (double)testData.numImgs;
 
-                uint32_t label = testData.labels[i];
+    double testingTime = ((double)(GetMilliseconds() - t2)) / 1000.0;
 
-                if (label == outIdx) correctCnt++;
-            }
+    return { trainingTime, testingTime, accuracy, totalImagePasses, synapsesCulled, synapsesGrown };
+}
+
+/**
+ * MNISTRandThreadFunc - Thread routine for MNISTRand training. Grab a set of training parameters
+ * from the parameter sweep queue. Train a neural net with these parameters and report training time
+ * and test set accuracy. Keep grabbing parameter sets until queue is emtpy.
+ */
+
+void MNISTRandThreadFunc()
+{
+    while (1)
+    {
+        paramQueueMtx.lock();
 
-            double accuracy = 100.0 * (double)correctCnt / (double)testData.numImgs;
+        if (ParamQueue.size() > 0)
+        {
+            TrainParams params = ParamQueue.back();
+            ParamQueue.pop_back();
+
+            printf("Thread %zu training new net. Remaining jobs = %zu\n",
+                hash<thread::id>()(this_thread::get_id()), ParamQueue.size());
+
+            paramQueueMtx.unlock();
+
+            TrainResults trainResults = params.precision == PRECISION_DOUBLE ?
+                MNISTRandTrainAndTest<double>(params) : MNISTRandTrainAndTest<float>(params);
 
             resultMtx.lock();
-            results.push_back({ params, {trainingTime, accuracy} });
+            results.push_back({ params, trainResults });
             resultMtx.unlock();
         }
         else
@@ -293,13 +409,13 @@ void PollFunc()
 {
     while (!pollLock.try_lock())
     {
-        Sleep(10000);
+        SleepMilliseconds(10000);
 
         printf("\nCurrent job progress:\n");
 
         for (auto& tProgress : jobProgress)
         {
-            printf("Thread %zd = %3.2g%%\n", tProgress.first, 100.0 * tProgress.second);
+            printf("Thread %zu = %3.2g%%\n", hash<thread::id>()(tProgress.first), 100.0 * tProgress.second);
         }
     }
 }
@@ -307,24 +423,43 @@ void PollFunc()
 /**
  * MNISTRandTest - Train a random graph to learn MNIST hand digits using
  * Hebbian learning. Loop over batches, report training time and NN
- * accuracy.
+ * accuracy. Normal runs sweep training parameters across worker threads,
+ * benchmark runs train a single fixed configuration so results are reproducible.
+ *
+ * @param params      Test run parameters (seed, sweep thread count, precision, neuron order,
+ *                    synapse growth weight, pulses, net save/load paths, synapse graph file).
+ *                    The sweep thread count doesn't apply to benchmark runs, which train
+ *                    one net on the calling thread.
+ * @param testResults Total training time and images, mean test accuracy.
  */
 
-void MNISTRandTest()
+void MNISTRandTest(TestParams &params, TestResults &testResults)
 {
-    trainData.Init(trainImageFile.c_str(), trainLabelFile.data());
-    testData.Init(testImageFile.c_str(), testLabelFile.data());
+    if (trainData.numImgs == 0)
+    {
+        trainData.Init(trainImageFile.c_str(), trainLabelFile.data());
+        testData.Init(testImageFile.c_str(), testLabelFile.data());
+    }
+
+    srand(params.seed);
 
-    srand((uint32_t)time(NULL));
+    results.clear();
+    jobProgress.clear();
+
+    bool bDoSweep       = !params.bBench;
+    uint32_t numThreads = params.numThreads ? params.numThreads : defaultNumThreads;
 
     if (bDoSweep)
     {
-        InitParamSweepQueue();
+        if (!params.loadNetPath.empty()) printf("--load-net only applies to benchmark runs, ignored\n");
+
+        InitParamSweepQueue(params.precision, params.renormInterval, params.order, params.growWeight,
+            params.numPulses, params.pulseActivation, params.pulseThresh, params.saveNetPath, params.synapsesPath);
         pollLock.lock();
 
-        printf("Beginning parameter sweep. Number of jobs = %zd\n\n", ParamQueue.size());
+        printf("Beginning parameter sweep. Number of jobs = %zu\n\n", ParamQueue.size());
 
-        thread threads[numThreads];
+        vector<thread> threads(numThreads);
 
         for (uint32_t i = 0; i < numThreads; i++)
         {
@@ -343,28 +478,53 @@ void MNISTRandTest()
     }
     else
     {
-        TrainParams params = {};
-
-        params.numIterations    = 5;
-        params.batchSize        = 100;
-        params.pulseLength      = 1;
-        params.learnRate        = 0.01;
-        params.cullThresh       = 1e-8;
-        params.minVerts         = inputSize + outputSize;
-        params.maxVerts         = inputSize + outputSize + 500;
-        params.minEdge          = 1e-6;
-        params.maxEdge          = 100.0;
-        params.edgeProb         = 0.7;
-
-        ParamQueue.push_back(params);
+        if (params.numThreads) printf("--threads only applies to parameter sweeps, ignored\n");
+
+        TrainParams trainParams = {};
+
+        trainParams.numIterations   = 5;
+        trainParams.batchSize       = 100;
+        trainParams.pulseLength     = params.numPulses;
+        trainParams.pulseActivation = params.pulseActivation;
+        trainParams.pulseThresh     = params.pulseThresh;
+        trainParams.learnRate       = 0.01;
+        trainParams.cullThresh      = 1e-8;
+        trainParams.minVerts        = inputSize + outputSize;
+        trainParams.maxVerts        = inputSize + outputSize + 500;
+        trainParams.minEdge         = 1e-6;
+        trainParams.maxEdge         = 100.0;
+        trainParams.edgeProb        = 0.7;
+        trainParams.precision       = params.precision;
+        trainParams.renormInterval  = params.renormInterval;
+        trainParams.order           = params.order;
+        trainParams.growWeight      = params.growWeight;
+        trainParams.saveNetPath     = params.saveNetPath;
+        trainParams.loadNetPath     = params.loadNetPath;
+        trainParams.synapsesPath    = params.synapsesPath;
+
+        ParamQueue.push_back(trainParams);
         MNISTRandThreadFunc();
     }
 
+    testResults = {};
+
+    for (auto& result : results)
+    {
+        testResults.trainTime   += result.second.trainTime;
+        testResults.testTime    += result.second.testTime;
+        testResults.trainImages += result.second.trainImages;
+        testResults.synapsesCulled += result.second.synapsesCulled;
+        testResults.synapsesGrown += result.second.synapsesGrown;
+        testResults.accuracy    += result.second.accuracy / (double)results.size();
+    }
+
     for (auto& result : results)
     {
         printf("numIterations = %d\n", result.first.numIterations);
         printf("batchSize     = %d\n", result.first.batchSize);
         printf("pulseLength   = %d\n", result.first.pulseLength);
+        printf("pulseAct      = %s\n", PulseActivationName(result.first.pulseActivation));
+        printf("pulseThresh   = %g\n", result.first.pulseThresh);
         printf("learnRate     = %g\n", result.first.learnRate);
         printf("cullThresh    = %g\n", result.first.cullThresh);
         printf("minVerts      = %d\n", result.first.minVerts);
@@ -372,7 +532,12 @@ void MNISTRandTest()
         printf("minEdge       = %g\n", result.first.minEdge);
         printf("maxEdge       = %g\n", result.first.maxEdge);
         printf("edgeProb      = %g\n", result.first.edgeProb);
+        printf("precision     = %s\n", PrecisionName(result.first.precision));
         printf("train time    = %g\n", result.second.trainTime);
+        printf("culled        = %llu\n", (unsigned long long)result.second.synapsesCulled);
+        printf("grown         = %llu\n", (unsigned long long)result.second.synapsesGrown);
         printf("accuarcy      = %g\n\n", result.second.accuracy);
     }
+
+    if (!params.bBench) PrintProfileReport(true);
 }
\ No newline at end of file
@@ -58,6 +58,10 @@ void NNLayerCPU::Init(uint32_t inSize, uint32_t outSize, NNLayerType type)
 
 void NNLayerCPU::EvaluateFull(VectorXd &in, VectorXd &out, VectorXd &aOut, VectorXd &spOut)
 {
+    PROFILE_KERNEL("NNLayerCPU::EvaluateFull", 2 * outputSize * inputSize + 8 * outputSize,
+        sizeof(double) * (outputSize * inputSize + inputSize + 4 * outputSize),
+        outputSize * inputSize, "weight");
+
     VectorXd ones;
     ones.resize(outputSize);
     ones.setOnes();
@@ -79,6 +83,10 @@ void NNLayerCPU::EvaluateFull(VectorXd &in, VectorXd &out, VectorXd &aOut, Vecto
 
 void NNLayerCPU::Evaluate(VectorXd &in, VectorXd &out)
 {
+    PROFILE_KERNEL("NNLayerCPU::Evaluate", 2 * outputSize * inputSize + 5 * outputSize,
+        sizeof(double) * (outputSize * inputSize + inputSize + 2 * outputSize),
+        outputSize * inputSize, "weight");
+
     VectorXd ones;
     ones.resize(outputSize);
     ones.setOnes();
@@ -126,6 +134,8 @@ void NNFullCPU::main(
     NN.Train(trainingSet, settings);
 
     NN.Test(testSet);
+    PrintProfileReport();
+    PrintPerfCounterReport();
     return;
 }
 
@@ -236,6 +246,8 @@ void NNFullCPU::Evaluate(VectorXd &in, VectorXd &out)
 
 void NNFullCPU::BackProp(VectorXd &in, VectorXd &actual)
 {
+    PROFILE_ZONE_WORK("NNFullCPU::BackProp", 1, "sample");
+
     // Feedforward pass. Set input activations to input data, then
     // evaluate remaining layers.
 
@@ -256,26 +268,58 @@ void NNFullCPU::BackProp(VectorXd &in, VectorXd &actual)
     scratch.deltas[numLayers - 1] = scratch.activations[numLayers - 1] - actual;
     scratch.deltas[numLayers - 1].cwiseProduct(scratch.sps[numLayers - 1]);
 
+    // Analytic work for the backward pass. Error propagation copies each transposed weight
+    // matrix then does a GEMV with it, gradient accumulation is a rank-1 update per layer.
+
+    uint64_t deltaFlops = 0;
+    uint64_t deltaBytes = 0;
+    uint64_t gradFlops  = 0;
+    uint64_t gradBytes  = 0;
+    uint64_t weightCnt  = 0;
+
+    for (uint32_t l = 1; l < numLayers; l++)
+    {
+        uint64_t layerWeights = (uint64_t)layers[l].outputSize * layers[l].inputSize;
+        weightCnt += layerWeights;
+
+        if (l > 1)
+        {
+            deltaFlops += 2 * layerWeights + layers[l].inputSize;
+            deltaBytes += sizeof(double) * (3 * layerWeights + layers[l].outputSize + 3 * layers[l].inputSize);
+        }
+
+        gradFlops += 2 * layerWeights + layers[l].outputSize;
+        gradBytes += sizeof(double) * (2 * layerWeights + 3 * layers[l].outputSize + layers[l].inputSize);
+    }
+
     // Backpropagate output error.
 
-    for (uint32_t l = numLayers - 1; l-- > 1;)
     {
-        // Compute current layer's error: 
-        // delta^L = (W^(L+1))^t * delta^(L+1) * sig'(z^L).
+        PROFILE_KERNEL("NNFullCPU::BackProp::deltas", deltaFlops, deltaBytes, weightCnt, "weight");
+
+        for (uint32_t l = numLayers - 1; l-- > 1;)
+        {
+            // Compute current layer's error: 
+            // delta^L = (W^(L+1))^t * delta^(L+1) * sig'(z^L).
 
-        MatrixXd weightsT = layers[l + 1].weights.transpose();
-        scratch.deltas[l].setZero();
-        scratch.deltas[l] = weightsT * scratch.deltas[l + 1];
-        scratch.deltas[l].cwiseProduct(scratch.sps[l]);
+            MatrixXd weightsT = layers[l + 1].weights.transpose();
+            scratch.deltas[l].setZero();
+            scratch.deltas[l] = weightsT * scratch.deltas[l + 1];
+            scratch.deltas[l].cwiseProduct(scratch.sps[l]);
+        }
     }
 
     // Add each layer's weights and bias gradients for current sample to
     // the minibatch gradient estimate.
 
-    for (uint32_t l = numLayers; l-- > 1;)
     {
-        scratch.nablaBs[l] += scratch.deltas[l];
-        scratch.nablaWs[l] += scratch.deltas[l] * scratch.activations[l - 1].transpose();
+        PROFILE_KERNEL("NNFullCPU::BackProp::gradients", gradFlops, gradBytes, weightCnt, "weight");
+
+        for (uint32_t l = numLayers; l-- > 1;)
+        {
+            scratch.nablaBs[l] += scratch.deltas[l];
+            scratch.nablaWs[l] += scratch.deltas[l] * scratch.activations[l - 1].transpose();
+        }
     }
 
     return;
@@ -297,6 +341,8 @@ void NNFullCPU::SGDStepMiniBatch(
     uint32_t miniBatchSize,
     double learningRate)
 {
+    PROFILE_ZONE("NNFullCPU::SGDStepMiniBatch");
+
     VectorXd actual(outputSize);
     double stepSize = learningRate / ((double)miniBatchSize);
 
@@ -0,0 +1,216 @@
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+#include "parallel.h"
+#include "perfcounters.h"
+
+struct ThreadPool
+{
+    vector<thread> workers;
+    mutex mtx;
+    condition_variable startCv;
+    condition_variable doneCv;
+    const function<void(uint32_t)>* pTask;
+    atomic<uint32_t> nextTask;
+    uint32_t numTasks;
+    uint32_t numBusy;
+    uint64_t generation;
+    bool bExit;
+
+    ThreadPool() : pTask(nullptr), nextTask(0), numTasks(0), numBusy(0), generation(0), bExit(false) {}
+    ~ThreadPool() { Stop(); }
+
+    /**
+     * ThreadPool::Start - Spin up worker threads. The calling thread takes part in every
+     * dispatch, so a pool for N threads has N - 1 workers.
+     *
+     * @param numThreads Total threads working on each dispatch.
+     */
+
+    void Start(uint32_t numThreads)
+    {
+        for (uint32_t i = 1; i < numThreads; i++) workers.push_back(thread(&ThreadPool::WorkerFunc, this, generation));
+    }
+
+    /**
+     * ThreadPool::Stop - Wake and join all workers.
+     */
+
+    void Stop()
+    {
+        {
+            lock_guard<mutex> lock(mtx);
+            bExit = true;
+        }
+
+        startCv.notify_all();
+        for (auto& worker : workers) worker.join();
+
+        workers.clear();
+        bExit = false;
+    }
+
+    /**
+     * ThreadPool::RunTasks - Pull task indices until none are left.
+     */
+
+    void RunTasks()
+    {
+        for (uint32_t task = nextTask++; task < numTasks; task = nextTask++) (*pTask)(task);
+    }
+
+    /**
+     * ThreadPool::WorkerFunc - Worker loop. Sleep until a new dispatch, help drain its
+     * tasks, add its hardware counts to the worker totals if counters are on, then report
+     * back.
+     *
+     * @param seen Dispatch generation current when the worker was started.
+     */
+
+    void WorkerFunc(uint64_t seen)
+    {
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(mtx);
+                startCv.wait(lock, [&]() { return bExit || generation != seen; });
+                if (bExit) return;
+                seen = generation;
+            }
+
+            PerfCounterValues startPerf;
+            bool bPerf = bPerfCountersEnabled && ReadPerfCounters(startPerf);
+
+            RunTasks();
+
+            // Counted before reporting back, so the dispatching zone sees them on return.
+
+            PerfCounterValues endPerf;
+            if (bPerf && ReadPerfCounters(endPerf)) AddWorkerPerfCounters(startPerf, endPerf);
+
+            {
+                lock_guard<mutex> lock(mtx);
+                if (--numBusy == 0) doneCv.notify_one();
+            }
+        }
+    }
+
+    /**
+     * ThreadPool::Dispatch - Run tasks on the workers and the calling thread, return when
+     * all of them are done.
+     *
+     * @param cnt Number of tasks.
+     * @param fn  Task function.
+     */
+
+    void Dispatch(uint32_t cnt, const function<void(uint32_t)>& fn)
+    {
+        {
+            lock_guard<mutex> lock(mtx);
+            pTask       = &fn;
+            numTasks    = cnt;
+            nextTask    = 0;
+            numBusy     = (uint32_t)workers.size();
+            generation++;
+        }
+
+        startCv.notify_all();
+        RunTasks();
+
+        unique_lock<mutex> lock(mtx);
+        doneCv.wait(lock, [&]() { return numBusy == 0; });
+    }
+};
+
+static ThreadPool pool;
+static mutex dispatchMtx;
+static atomic<uint32_t> poolThreads(0);
+
+/**
+ * SetNumThreads - Set how many threads parallel kernels use. Zero picks the hardware
+ * thread count. Must not be called while a parallel kernel is running.
+ *
+ * @param numThreads Number of kernel threads.
+ */
+
+void SetNumThreads(uint32_t numThreads)
+{
+    if (numThreads == 0) numThreads = max(1u, thread::hardware_concurrency());
+
+    lock_guard<mutex> lock(dispatchMtx);
+    if (numThreads == poolThreads) return;
+
+    pool.Stop();
+    pool.Start(numThreads);
+    poolThreads = numThreads;
+}
+
+/**
+ * GetNumThreads - Get the number of threads parallel kernels use.
+ *
+ * @return Number of kernel threads.
+ */
+
+uint32_t GetNumThreads()
+{
+    if (poolThreads == 0) SetNumThreads(0);
+    return poolThreads;
+}
+
+/**
+ * ParallelRun - Run a set of tasks on the kernel thread pool, tasks are handed out
+ * dynamically. If the pool is already busy (a nested call, or another test thread is in
+ * a kernel) tasks run serially on the calling thread instead of oversubscribing.
+ *
+ * @param numTasks Number of tasks.
+ * @param fn       Function taking a task index.
+ */
+
+void ParallelRun(uint32_t numTasks, const function<void(uint32_t task)>& fn)
+{
+    if (numTasks == 0) return;
+
+    if (numTasks > 1 && GetNumThreads() > 1)
+    {
+        unique_lock<mutex> lock(dispatchMtx, try_to_lock);
+
+        if (lock.owns_lock())
+        {
+            pool.Dispatch(numTasks, fn);
+            return;
+        }
+    }
+
+    for (uint32_t task = 0; task < numTasks; task++) fn(task);
+}
+
+/**
+ * ParallelFor - Split an index range into chunks and run them on the kernel thread pool.
+ * Chunks are at least grain indices and there are a few per thread so skewed rows even
+ * out.
+ *
+ * @param begin First index.
+ * @param end   One past last index.
+ * @param grain Minimum indices per chunk.
+ * @param fn    Function taking a [begin, end) chunk.
+ */
+
+void ParallelFor(uint32_t begin, uint32_t end, uint32_t grain, const function<void(uint32_t begin, uint32_t end)>& fn)
+{
+    if (end <= begin) return;
+
+    uint32_t cnt        = end - begin;
+    uint32_t maxChunks  = 4 * GetNumThreads();
+    uint32_t numChunks  = min(maxChunks, max(1u, cnt / max(1u, grain)));
+    uint32_t chunkSize  = (cnt + numChunks - 1) / numChunks;
+    numChunks           = (cnt + chunkSize - 1) / chunkSize;
+
+    ParallelRun(numChunks, [&](uint32_t chunk)
+    {
+        uint32_t chunkBegin = begin + chunk * chunkSize;
+        fn(chunkBegin, min(end, chunkBegin + chunkSize));
+    });
+}
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <atomic>
+#include "perfcounters.h"
+#include "profiler.h"
+#include "parallel.h"
+
+#if defined(__linux__) && defined(FTWT_PERF_EVENTS)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define FTWT_HAS_PERF_EVENTS 1
+#endif
+
+using namespace std;
+
+bool bPerfCountersEnabled = false;
+static bool bCounterValid[NUM_PERF_COUNTERS];
+static atomic<uint64_t> workerCounts[NUM_PERF_COUNTERS];
+
+static const char* counterNames[NUM_PERF_COUNTERS] =
+{
+    "cycles",
+    "instructions",
+    "LLC misses",
+    "branch misses"
+};
+
+#ifdef FTWT_HAS_PERF_EVENTS
+
+static const uint64_t counterConfigs[NUM_PERF_COUNTERS] =
+{
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+struct PerfThreadGroup
+{
+    bool bOpened;
+    int leaderFd;
+    int fds[NUM_PERF_COUNTERS];
+    int groupSlot[NUM_PERF_COUNTERS];
+    uint32_t numOpen;
+
+    PerfThreadGroup() : bOpened(false), leaderFd(-1), numOpen(0)
+    {
+        for (uint32_t i = 0; i < NUM_PERF_COUNTERS; i++)
+        {
+            fds[i]          = -1;
+            groupSlot[i]    = -1;
+        }
+    }
+
+    ~PerfThreadGroup()
+    {
+        for (uint32_t i = 0; i < NUM_PERF_COUNTERS; i++)
+        {
+            if (fds[i] >= 0) close(fds[i]);
+        }
+    }
+
+    /**
+     * PerfThreadGroup::Open - Open this thread's counter group. Counters only count the
+     * calling thread in user space. Counters the PMU doesn't support are skipped, the
+     * group is read with one read() call.
+     */
+
+    void Open()
+    {
+        bOpened = true;
+
+        for (uint32_t i = 0; i < NUM_PERF_COUNTERS; i++)
+        {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+
+            attr.size           = sizeof(attr);
+            attr.type           = PERF_TYPE_HARDWARE;
+            attr.config         = counterConfigs[i];
+            attr.disabled       = leaderFd < 0 ? 1 : 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv     = 1;
+            attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+            int fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, leaderFd, 0);
+            if (fd < 0) continue;
+
+            if (leaderFd < 0) leaderFd = fd;
+
+            fds[i]          = fd;
+            groupSlot[i]    = (int)numOpen++;
+        }
+
+        if (leaderFd >= 0)
+        {
+            ioctl(leaderFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leaderFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    /**
+     * PerfThreadGroup::Read - Read all counters in the group, scaled up if the kernel had
+     * to multiplex them.
+     *
+     * @param  values Counter values.
+     * @return        True on success.
+     */
+
+    bool Read(PerfCounterValues& values)
+    {
+        if (!bOpened) Open();
+        if (leaderFd < 0) return false;
+
+        uint64_t buffer[3 + NUM_PERF_COUNTERS];
+        if (read(leaderFd, buffer, sizeof(buffer)) < (ssize_t)(3 + numOpen) * 8) return false;
+
+        uint64_t enabled    = buffer[1];
+        uint64_t running    = buffer[2];
+        double scale        = running > 0 ? (double)enabled / (double)running : 0.0;
+
+        for (uint32_t i = 0; i < NUM_PERF_COUNTERS; i++)
+        {
+            values.counts[i] = groupSlot[i] < 0 ? 0 : (uint64_t)((double)buffer[3 + groupSlot[i]] * scale);
+        }
+
+        return true;
+    }
+};
+
+/**
+ * GetPerfThreadGroup - Get the calling thread's counter group.
+ *
+ * @return Counter group, opened on first read.
+ */
+
+static PerfThreadGroup& GetPerfThreadGroup()
+{
+    thread_local PerfThreadGroup group;
+    return group;
+}
+
+#endif
+
+/**
+ * EnablePerfCounters - Turn hardware counter collection in profiling zones on or off.
+ * Probes the calling thread's counters first, so a kernel that forbids perf events
+ * (perf_event_paranoid, containers, VMs without a virtual PMU) just leaves them off.
+ *
+ * @param  bEnable Whether to collect counters.
+ * @return         True if counters are now being collected.
+ */
+
+bool EnablePerfCounters(bool bEnable)
+{
+    bPerfCountersEnabled = false;
+    if (!bEnable) return false;
+
+#ifdef FTWT_HAS_PERF_EVENTS
+    PerfCounterValues values;
+
+    if (!ReadPerfCounters(values))
+    {
+        printf("perf_event_open unavailable (check /proc/sys/kernel/perf_event_paranoid), "
+            "hardware counters disabled\n");
+        return false;
+    }
+
+    PerfThreadGroup& group = GetPerfThreadGroup();
+    for (uint32_t i = 0; i < NUM_PERF_COUNTERS; i++) bCounterValid[i] = group.fds[i] >= 0;
+
+    bPerfCountersEnabled = true;
+    return true;
+#else
+    printf("Built without FTWT_PERF_EVENTS, hardware counters disabled\n");
+    return false;
+#endif
+}
+
+/**
+ * IsPerfCounterValid - Check whether a counter could be opened on this machine.
+ *
+ * @param  id Counter.
+ * @return    True if the counter is being collected.
+ */
+
+bool IsPerfCounterValid(PerfCounterId id)
+{
+    return bCounterValid[id];
+}
+
+/**
+ * ReadPerfCounters - Read the calling thread's hardware counters, opening them on first
+ * use.
+ *
+ * @param  values Counter values.
+ * @return        True on success.
+ */
+
+bool ReadPerfCounters(PerfCounterValues& values)
+{
+#ifdef FTWT_HAS_PERF_EVENTS
+    return GetPerfThreadGroup().Read(values);
+#else
+    (void)values;
+    return false;
+#endif
+}
+
+/**
+ * AddWorkerPerfCounters - Add the counts a kernel pool worker accumulated over one
+ * dispatch to the running worker totals. Workers open no profiling zones of their own, so
+ * this is how their share of a parallel kernel reaches the zone that dispatched it.
+ *
+ * @param start Worker's counters before the dispatch.
+ * @param end   Worker's counters after the dispatch.
+ */
+
+void AddWorkerPerfCounters(const PerfCounterValues& start, const PerfCounterValues& end)
+{
+    for (uint32_t i = 0; i < NUM_PERF_COUNTERS; i++) workerCounts[i] += end.counts[i] - start.counts[i];
+}
+
+/**
+ * ReadZonePerfCounters - Read the calling thread's hardware counters plus the running
+ * totals of the kernel pool workers. The difference over a zone covers every thread of the
+ * parallel kernels dispatched inside it. Dispatches from other threads that overlap the
+ * zone, as in the multithreaded parameter sweep, are counted too.
+ *
+ * @param  values Counter values.
+ * @return        True on success.
+ */
+
+bool ReadZonePerfCounters(PerfCounterValues& values)
+{
+    if (!ReadPerfCounters(values)) return false;
+
+    for (uint32_t i = 0; i < NUM_PERF_COUNTERS; i++) values.counts[i] += workerCounts[i];
+    return true;
+}
+
+/**
+ * PrintPerfCounterReport - Print hardware counters for every profiling zone: IPC, plus LLC
+ * and branch misses per unit of work (nnz, sample, weight...) for zones that record it.
+ * Counts are summed over the calling thread and the kernel pool workers.
+ */
+
+void PrintPerfCounterReport()
+{
+    if (!bPerfCountersEnabled) return;
+
+    vector<ProfileZoneReport> zones = CollectProfileZones(false);
+
+    printf("\nHardware Counters (summed over %u kernel threads):\n", GetNumThreads());
+    printf("%-32s %14s %14s %6s %12s %12s %14s %14s\n", "zone", counterNames[PERF_CYCLES],
+        counterNames[PERF_INSTRUCTIONS], "IPC", counterNames[PERF_LLC_MISSES], counterNames[PERF_BRANCH_MISSES],
+        "LLC miss/unit", "br miss/unit");
+
+    for (auto& zone : zones)
+    {
+        const ProfileZoneStats& s   = zone.stats;
+        double cycles               = (double)s.perf[PERF_CYCLES];
+        double ipc                  = cycles > 0.0 ? (double)s.perf[PERF_INSTRUCTIONS] / cycles : 0.0;
+
+        printf("%-32s %14llu %14llu %6.2f %12llu %12llu", zone.name.c_str(),
+            (unsigned long long)s.perf[PERF_CYCLES], (unsigned long long)s.perf[PERF_INSTRUCTIONS], ipc,
+            (unsigned long long)s.perf[PERF_LLC_MISSES], (unsigned long long)s.perf[PERF_BRANCH_MISSES]);
+
+        if (s.units > 0)
+        {
+            char llc[64];
+            char br[64];
+
+            snprintf(llc, sizeof(llc), "%.3g/%s", (double)s.perf[PERF_LLC_MISSES] / (double)s.units, zone.unitName.c_str());
+            snprintf(br, sizeof(br), "%.3g/%s", (double)s.perf[PERF_BRANCH_MISSES] / (double)s.units, zone.unitName.c_str());
+            printf(" %14s %14s", llc, br);
+        }
+
+        printf("\n");
+    }
+
+    for (uint32_t i = 0; i < NUM_PERF_COUNTERS; i++)
+    {
+        if (!bCounterValid[i]) printf("(%s not supported by this PMU)\n", counterNames[i]);
+    }
+
+    printf("\n");
+}
@@ -0,0 +1,147 @@
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include "profiler.h"
+
+static mutex profilerMtx;
+static vector<string> siteNames;
+static vector<string> siteUnits;
+static vector<unique_ptr<ProfileThreadData>> threadData;
+
+/**
+ * RegisterProfileSite - Assign a dense id to a new profiling site.
+ *
+ * @param  name     Zone name.
+ * @param  unitName Unit of work counted by the zone.
+ * @return          Site id.
+ */
+
+uint32_t RegisterProfileSite(const char* name, const char* unitName)
+{
+    lock_guard<mutex> lock(profilerMtx);
+    siteNames.push_back(name);
+    siteUnits.push_back(unitName);
+    return (uint32_t)siteNames.size() - 1;
+}
+
+/**
+ * GetProfileThreadData - Get the calling thread's zone stats, registering them on first
+ * use. Stats are owned by the profiler, so they outlive the thread and still show up in
+ * reports after worker threads are joined.
+ *
+ * @return Calling thread's profile data.
+ */
+
+ProfileThreadData& GetProfileThreadData()
+{
+    thread_local ProfileThreadData* pData = nullptr;
+
+    if (pData == nullptr)
+    {
+        lock_guard<mutex> lock(profilerMtx);
+        threadData.push_back(make_unique<ProfileThreadData>());
+        pData = threadData.back().get();
+        pData->threadIdx = (uint32_t)threadData.size() - 1;
+    }
+
+    return *pData;
+}
+
+/**
+ * CollectProfileZones - Gather zone stats from all threads. Zones with the same name
+ * (e.g., one per template instantiation) are merged. Must not race with threads that are
+ * still inside profiling zones, call it once workers are joined.
+ *
+ * @param  perThread Report each thread separately rather than merging across threads.
+ * @return           List of zone stats sorted by total time, largest first.
+ */
+
+vector<ProfileZoneReport> CollectProfileZones(bool perThread)
+{
+    lock_guard<mutex> lock(profilerMtx);
+    vector<ProfileZoneReport> reports;
+
+    for (auto& pData : threadData)
+    {
+        for (uint32_t site = 0; site < pData->zones.size(); site++)
+        {
+            const ProfileZoneStats& stats = pData->zones[site];
+            if (stats.calls == 0) continue;
+
+            uint32_t threadIdx = perThread ? pData->threadIdx : 0;
+            auto it = find_if(reports.begin(), reports.end(), [&](const ProfileZoneReport& r)
+            {
+                return r.name == siteNames[site] && r.threadIdx == threadIdx;
+            });
+
+            if (it == reports.end())
+            {
+                reports.push_back({ siteNames[site], siteUnits[site], threadIdx, stats });
+                continue;
+            }
+
+            it->stats.calls         += stats.calls;
+            it->stats.totalNs       += stats.totalNs;
+            it->stats.totalCycles   += stats.totalCycles;
+            it->stats.maxNs         = max(it->stats.maxNs, stats.maxNs);
+            it->stats.flops         += stats.flops;
+            it->stats.bytes         += stats.bytes;
+            it->stats.units         += stats.units;
+
+            for (uint32_t i = 0; i < NUM_PERF_COUNTERS; i++) it->stats.perf[i] += stats.perf[i];
+        }
+    }
+
+    sort(reports.begin(), reports.end(), [](const ProfileZoneReport& a, const ProfileZoneReport& b)
+    {
+        return a.stats.totalNs > b.stats.totalNs;
+    });
+
+    return reports;
+}
+
+/**
+ * PrintProfileReport - Print call counts, total, average and max time for each zone.
+ *
+ * @param perThread Break stats down per thread.
+ */
+
+void PrintProfileReport(bool perThread)
+{
+    vector<ProfileZoneReport> reports = CollectProfileZones(perThread);
+    if (reports.empty()) return;
+
+    printf("\nProfile Zones:\n");
+    printf("%-32s %6s %10s %12s %12s %12s %14s\n",
+        "zone", "thread", "calls", "total ms", "avg us", "max us", "avg cycles");
+
+    for (auto& report : reports)
+    {
+        const ProfileZoneStats& s = report.stats;
+
+        printf("%-32s %6u %10llu %12.3f %12.3f %12.3f %14.0f\n",
+            report.name.c_str(),
+            report.threadIdx,
+            (unsigned long long)s.calls,
+            1e-6 * (double)s.totalNs,
+            1e-3 * (double)s.totalNs / (double)s.calls,
+            1e-3 * (double)s.maxNs,
+            (double)s.totalCycles / (double)s.calls);
+    }
+
+    printf("\n");
+}
+
+/**
+ * ResetProfiler - Clear accumulated stats on all threads. Sites stay registered.
+ */
+
+void ResetProfiler()
+{
+    lock_guard<mutex> lock(profilerMtx);
+
+    for (auto& pData : threadData)
+    {
+        fill(pData->zones.begin(), pData->zones.end(), ProfileZoneStats{});
+    }
+}
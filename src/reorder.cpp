@@ -0,0 +1,495 @@
+#include "reorder.h"
+
+/**
+ * BuildNeuronGraph - Undirected neuron graph of a synapse matrix. Each synapse r <- c adds
+ * an edge both ways, duplicates are merged into an edge weight and self synapses dropped.
+ *
+ * @param  offsets Row offsets (n + 1 entries).
+ * @param  colIdcs Column index of each entry.
+ * @param  n       Rows in matrix.
+ * @param  m       Columns in matrix.
+ * @return         Graph on max(n, m) vertices, unit vertex weights.
+ */
+
+NeuronGraph BuildNeuronGraph(const uint32_t* offsets, const uint32_t* colIdcs, uint32_t n, uint32_t m)
+{
+    PROFILE_ZONE_WORK("BuildNeuronGraph", offsets[n], "nnz");
+
+    uint32_t nv = max(n, m);
+    vector<uint32_t> rawOffsets(nv + 1, 0);
+
+    for (uint32_t r = 0; r < n; r++)
+    {
+        for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++)
+        {
+            if (colIdcs[i] == r) continue;
+            rawOffsets[r]++;
+            rawOffsets[colIdcs[i]]++;
+        }
+    }
+
+    uint32_t numRaw = ExclusiveScan(rawOffsets.data(), nv + 1);
+    vector<uint32_t> fillPos(rawOffsets.begin(), rawOffsets.end() - 1);
+    vector<uint32_t> raw(numRaw);
+
+    for (uint32_t r = 0; r < n; r++)
+    {
+        for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++)
+        {
+            uint32_t c = colIdcs[i];
+            if (c == r) continue;
+
+            raw[fillPos[r]++] = c;
+            raw[fillPos[c]++] = r;
+        }
+    }
+
+    // Sort each vertex's neighbors and count distinct ones, then scan and write them out.
+
+    NeuronGraph graph;
+    graph.n = nv;
+    graph.offsets.assign(nv + 1, 0);
+    graph.vertWeights.assign(nv, 1);
+
+    ParallelFor(0, nv, rowGrain, [&](uint32_t vBegin, uint32_t vEnd)
+    {
+        for (uint32_t v = vBegin; v < vEnd; v++)
+        {
+            uint32_t* first = raw.data() + rawOffsets[v];
+            uint32_t* last  = raw.data() + rawOffsets[v + 1];
+            sort(first, last);
+
+            uint32_t cnt = 0;
+            for (uint32_t* p = first; p < last; p++) cnt += p == first || *p != *(p - 1);
+            graph.offsets[v] = cnt;
+        }
+    });
+
+    uint32_t numEdges = ExclusiveScan(graph.offsets.data(), nv + 1);
+    graph.adj.resize(numEdges);
+    graph.edgeWeights.resize(numEdges);
+
+    ParallelFor(0, nv, rowGrain, [&](uint32_t vBegin, uint32_t vEnd)
+    {
+        for (uint32_t v = vBegin; v < vEnd; v++)
+        {
+            uint32_t e = graph.offsets[v] - 1;
+
+            for (uint32_t i = rawOffsets[v]; i < rawOffsets[v + 1]; i++)
+            {
+                if (i == rawOffsets[v] || raw[i] != raw[i - 1])
+                {
+                    e++;
+                    graph.adj[e]            = raw[i];
+                    graph.edgeWeights[e]    = 0;
+                }
+
+                graph.edgeWeights[e]++;
+            }
+        }
+    });
+
+    return graph;
+}
+
+/**
+ * Degree - Number of distinct neighbors of a vertex.
+ */
+
+static inline uint32_t Degree(const NeuronGraph& graph, uint32_t v)
+{
+    return graph.offsets[v + 1] - graph.offsets[v];
+}
+
+/**
+ * PseudoPeripheralVertex - Find a vertex near the edge of a component, a good RCM start.
+ * Repeatedly BFS and jump to the lowest degree vertex of the last level while the
+ * eccentricity keeps growing.
+ *
+ * @param  graph Graph.
+ * @param  start Any vertex of the component.
+ * @param  dist  Scratch, n entries all -1, left all -1 on return.
+ * @param  queue Scratch BFS queue.
+ * @return       Start vertex.
+ */
+
+static uint32_t PseudoPeripheralVertex(const NeuronGraph& graph, uint32_t start, vector<int32_t>& dist,
+    vector<uint32_t>& queue)
+{
+    int32_t ecc = -1;
+
+    for (uint32_t iter = 0; iter < 8; iter++)
+    {
+        queue.clear();
+        queue.push_back(start);
+        dist[start] = 0;
+
+        for (size_t head = 0; head < queue.size(); head++)
+        {
+            uint32_t v = queue[head];
+
+            for (uint32_t e = graph.offsets[v]; e < graph.offsets[v + 1]; e++)
+            {
+                uint32_t u = graph.adj[e];
+                if (dist[u] >= 0) continue;
+
+                dist[u] = dist[v] + 1;
+                queue.push_back(u);
+            }
+        }
+
+        int32_t lastLevel   = dist[queue.back()];
+        uint32_t next       = queue.back();
+
+        for (size_t i = queue.size(); i-- > 0 && dist[queue[i]] == lastLevel;)
+        {
+            if (Degree(graph, queue[i]) < Degree(graph, next)) next = queue[i];
+        }
+
+        for (auto v : queue) dist[v] = -1;
+
+        if (lastLevel <= ecc) break;
+
+        ecc     = lastLevel;
+        start   = next;
+    }
+
+    return start;
+}
+
+/**
+ * ReverseCuthillMcKee - Bandwidth reducing ordering. Each component is walked breadth first
+ * from a pseudo-peripheral vertex, visiting a vertex's unvisited neighbors in increasing
+ * degree order, and the final order is reversed.
+ *
+ * @param  graph Graph.
+ * @return       Vertices in their new order, order[new] = old.
+ */
+
+vector<uint32_t> ReverseCuthillMcKee(const NeuronGraph& graph)
+{
+    PROFILE_ZONE_WORK("ReverseCuthillMcKee", graph.adj.size(), "edge");
+
+    uint32_t n = graph.n;
+    vector<uint32_t> order;
+    vector<uint32_t> byDegree(n);
+    vector<uint8_t> visited(n, 0);
+    vector<int32_t> dist(n, -1);
+    vector<uint32_t> queue;
+    vector<uint32_t> nbrs;
+
+    order.reserve(n);
+
+    for (uint32_t v = 0; v < n; v++) byDegree[v] = v;
+    stable_sort(byDegree.begin(), byDegree.end(), [&](uint32_t a, uint32_t b)
+    {
+        return Degree(graph, a) < Degree(graph, b);
+    });
+
+    auto byDegreeLess = [&](uint32_t a, uint32_t b) { return Degree(graph, a) < Degree(graph, b); };
+
+    for (auto s : byDegree)
+    {
+        if (visited[s]) continue;
+
+        uint32_t start  = PseudoPeripheralVertex(graph, s, dist, queue);
+        size_t head     = order.size();
+        visited[start]  = 1;
+        order.push_back(start);
+
+        for (; head < order.size(); head++)
+        {
+            uint32_t v = order[head];
+            nbrs.clear();
+
+            for (uint32_t e = graph.offsets[v]; e < graph.offsets[v + 1]; e++)
+            {
+                uint32_t u = graph.adj[e];
+                if (visited[u]) continue;
+
+                visited[u] = 1;
+                nbrs.push_back(u);
+            }
+
+            stable_sort(nbrs.begin(), nbrs.end(), byDegreeLess);
+            order.insert(order.end(), nbrs.begin(), nbrs.end());
+        }
+    }
+
+    reverse(order.begin(), order.end());
+    return order;
+}
+
+/**
+ * CoarsenGraph - One level of heavy edge matching. Vertices are visited lightest degree
+ * first and matched with the unmatched neighbor they share the heaviest edge with, as long
+ * as the pair stays under maxVertWeight. Matched pairs collapse into one coarse vertex.
+ *
+ * @param  graph         Fine graph.
+ * @param  maxVertWeight Largest coarse vertex weight allowed.
+ * @param  cmap          Output coarse vertex of each fine vertex.
+ * @return               Coarse graph.
+ */
+
+static NeuronGraph CoarsenGraph(const NeuronGraph& graph, uint32_t maxVertWeight, vector<uint32_t>& cmap)
+{
+    uint32_t n = graph.n;
+    vector<uint32_t> byDegree(n);
+    vector<uint32_t> match(n, UINT32_MAX);
+
+    for (uint32_t v = 0; v < n; v++) byDegree[v] = v;
+    stable_sort(byDegree.begin(), byDegree.end(), [&](uint32_t a, uint32_t b)
+    {
+        return Degree(graph, a) < Degree(graph, b);
+    });
+
+    for (auto v : byDegree)
+    {
+        if (match[v] != UINT32_MAX) continue;
+
+        uint32_t best       = v;
+        uint32_t bestWeight = 0;
+
+        for (uint32_t e = graph.offsets[v]; e < graph.offsets[v + 1]; e++)
+        {
+            uint32_t u = graph.adj[e];
+
+            if (match[u] != UINT32_MAX || graph.vertWeights[v] + graph.vertWeights[u] > maxVertWeight) continue;
+            if (graph.edgeWeights[e] > bestWeight)
+            {
+                best        = u;
+                bestWeight  = graph.edgeWeights[e];
+            }
+        }
+
+        match[v]    = best;
+        match[best] = v;
+    }
+
+    // Number coarse vertices in fine order, the lower fine vertex of a pair owns it.
+
+    NeuronGraph coarse;
+    vector<uint32_t> members;
+    cmap.assign(n, UINT32_MAX);
+
+    for (uint32_t v = 0; v < n; v++)
+    {
+        if (cmap[v] != UINT32_MAX) continue;
+
+        cmap[v]         = (uint32_t)members.size() / 2;
+        cmap[match[v]]  = cmap[v];
+        members.push_back(v);
+        members.push_back(match[v]);
+    }
+
+    coarse.n = (uint32_t)members.size() / 2;
+    coarse.offsets.assign(coarse.n + 1, 0);
+    coarse.vertWeights.assign(coarse.n, 0);
+
+    vector<uint32_t> pos(coarse.n, UINT32_MAX);
+
+    for (uint32_t cv = 0; cv < coarse.n; cv++)
+    {
+        size_t rowStart = coarse.adj.size();
+
+        for (uint32_t k = 0; k < 2; k++)
+        {
+            uint32_t v = members[2 * cv + k];
+            if (k == 1 && v == members[2 * cv]) break;
+
+            coarse.vertWeights[cv] += graph.vertWeights[v];
+
+            for (uint32_t e = graph.offsets[v]; e < graph.offsets[v + 1]; e++)
+            {
+                uint32_t cu = cmap[graph.adj[e]];
+                if (cu == cv) continue;
+
+                if (pos[cu] == UINT32_MAX)
+                {
+                    pos[cu] = (uint32_t)coarse.adj.size();
+                    coarse.adj.push_back(cu);
+                    coarse.edgeWeights.push_back(0);
+                }
+
+                coarse.edgeWeights[pos[cu]] += graph.edgeWeights[e];
+            }
+        }
+
+        for (size_t e = rowStart; e < coarse.adj.size(); e++) pos[coarse.adj[e]] = UINT32_MAX;
+        coarse.offsets[cv + 1] = (uint32_t)coarse.adj.size();
+    }
+
+    return coarse;
+}
+
+/**
+ * RefinePartition - Greedy boundary refinement. Each vertex moves to the neighboring part
+ * it has the most edge weight to, if that beats its own part and the target stays within
+ * the balance limit.
+ *
+ * @param graph    Graph.
+ * @param parts    Part of each vertex, updated in place.
+ * @param numParts Number of parts.
+ */
+
+static void RefinePartition(const NeuronGraph& graph, vector<uint32_t>& parts, uint32_t numParts)
+{
+    vector<uint64_t> partWeights(numParts, 0);
+    uint64_t totalWeight = 0;
+
+    for (uint32_t v = 0; v < graph.n; v++)
+    {
+        partWeights[parts[v]]   += graph.vertWeights[v];
+        totalWeight             += graph.vertWeights[v];
+    }
+
+    uint64_t maxWeight = (uint64_t)ceil(reorderImbalance * (double)totalWeight / (double)numParts);
+
+    vector<uint32_t> conn(numParts, 0);
+    vector<uint32_t> touched;
+
+    for (uint32_t pass = 0; pass < reorderRefinePasses; pass++)
+    {
+        uint32_t numMoved = 0;
+
+        for (uint32_t v = 0; v < graph.n; v++)
+        {
+            uint32_t from = parts[v];
+            touched.clear();
+
+            for (uint32_t e = graph.offsets[v]; e < graph.offsets[v + 1]; e++)
+            {
+                uint32_t p = parts[graph.adj[e]];
+                if (conn[p] == 0) touched.push_back(p);
+                conn[p] += graph.edgeWeights[e];
+            }
+
+            uint32_t best       = from;
+            uint32_t bestConn   = conn[from];
+
+            for (auto p : touched)
+            {
+                if (conn[p] > bestConn && partWeights[p] + graph.vertWeights[v] <= maxWeight)
+                {
+                    best        = p;
+                    bestConn    = conn[p];
+                }
+            }
+
+            for (auto p : touched) conn[p] = 0;
+            if (best == from) continue;
+
+            parts[v]            = best;
+            partWeights[from]   -= graph.vertWeights[v];
+            partWeights[best]   += graph.vertWeights[v];
+            numMoved++;
+        }
+
+        if (numMoved == 0) break;
+    }
+}
+
+/**
+ * MultilevelPartition - Split a graph into balanced parts with few cut edges. The graph is
+ * coarsened by heavy edge matching, the coarsest graph is cut into equal weight runs of
+ * its RCM order, and the parts are projected back level by level with greedy refinement.
+ *
+ * @param  graph    Graph.
+ * @param  numParts Number of parts.
+ * @return          Part of each vertex.
+ */
+
+vector<uint32_t> MultilevelPartition(const NeuronGraph& graph, uint32_t numParts)
+{
+    PROFILE_ZONE_WORK("MultilevelPartition", graph.adj.size(), "edge");
+
+    if (numParts <= 1 || graph.n <= numParts) return vector<uint32_t>(graph.n, 0);
+
+    uint32_t maxVertWeight = max(1u, graph.n / numParts / 4);
+    vector<NeuronGraph> levels;
+    vector<vector<uint32_t>> cmaps;
+
+    while (true)
+    {
+        const NeuronGraph& fine = levels.empty() ? graph : levels.back();
+        if (fine.n <= numParts * reorderCoarsestVerts) break;
+
+        vector<uint32_t> cmap;
+        NeuronGraph coarse = CoarsenGraph(fine, maxVertWeight, cmap);
+
+        // Stop once matching stalls, for example on star-like graphs.
+
+        if ((double)coarse.n > 0.9 * (double)fine.n) break;
+
+        levels.push_back(move(coarse));
+        cmaps.push_back(move(cmap));
+    }
+
+    const NeuronGraph& coarsest = levels.empty() ? graph : levels.back();
+    vector<uint32_t> order      = ReverseCuthillMcKee(coarsest);
+    vector<uint32_t> parts(coarsest.n);
+    uint64_t totalWeight        = 0;
+    uint64_t prefix             = 0;
+
+    for (uint32_t v = 0; v < coarsest.n; v++) totalWeight += coarsest.vertWeights[v];
+
+    for (auto v : order)
+    {
+        parts[v]    = (uint32_t)min((uint64_t)numParts - 1, prefix * numParts / totalWeight);
+        prefix      += coarsest.vertWeights[v];
+    }
+
+    RefinePartition(coarsest, parts, numParts);
+
+    for (size_t l = levels.size(); l-- > 0;)
+    {
+        const NeuronGraph& fine = l == 0 ? graph : levels[l - 1];
+        vector<uint32_t> fineParts(fine.n);
+
+        for (uint32_t v = 0; v < fine.n; v++) fineParts[v] = parts[cmaps[l][v]];
+
+        parts.swap(fineParts);
+        RefinePartition(fine, parts, numParts);
+    }
+
+    return parts;
+}
+
+/**
+ * PartitionOrder - Order vertices part by part, RCM order within each part. Parts are sized
+ * so one part's activations stay cache resident while its rows are processed.
+ *
+ * @param  graph    Graph.
+ * @param  partSize Target vertices per part.
+ * @return          Vertices in their new order, order[new] = old.
+ */
+
+vector<uint32_t> PartitionOrder(const NeuronGraph& graph, uint32_t partSize)
+{
+    uint32_t numParts       = max(1u, (graph.n + partSize - 1) / partSize);
+    vector<uint32_t> parts  = MultilevelPartition(graph, numParts);
+    vector<uint32_t> rcm    = ReverseCuthillMcKee(graph);
+    vector<uint32_t> starts(numParts + 1, 0);
+
+    for (auto p : parts) starts[p]++;
+    ExclusiveScan(starts.data(), numParts + 1);
+
+    vector<uint32_t> order(graph.n);
+    for (auto v : rcm) order[starts[parts[v]]++] = v;
+
+    return order;
+}
+
+/**
+ * InvertPermutation - Invert a permutation, inv[perm[i]] = i.
+ *
+ * @param  perm Permutation.
+ * @return      Inverse permutation.
+ */
+
+vector<uint32_t> InvertPermutation(const vector<uint32_t>& perm)
+{
+    vector<uint32_t> inv(perm.size());
+    for (uint32_t i = 0; i < (uint32_t)perm.size(); i++) inv[perm[i]] = i;
+    return inv;
+}
@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include "roofline.h"
+#include "simd.h"
+
+static const size_t streamElems         = 1 << 23;
+static const uint32_t streamReps        = 5;
+static const uint64_t flopProbeIters    = 1 << 24;
+
+/**
+ * RunOnThreads - Run a function on a number of threads and wait for all of them.
+ *
+ * @param numThreads Number of threads.
+ * @param fn         Function taking the thread index.
+ */
+
+template<class F>
+static void RunOnThreads(uint32_t numThreads, F fn)
+{
+    vector<thread> threads;
+    for (uint32_t t = 1; t < numThreads; t++) threads.push_back(thread(fn, t));
+    fn(0);
+    for (auto& t : threads) t.join();
+}
+
+/**
+ * MeasureStreamBandwidth - STREAM triad style bandwidth probe, a[i] = b[i] + s * c[i] over
+ * arrays well beyond LLC size. Each thread works on its own slice and first touches it,
+ * so pages land on the thread's NUMA node. Bytes are counted STREAM style (2 reads and a
+ * write per element, no write-allocate traffic), best of several repetitions.
+ *
+ * @param  numThreads Number of threads.
+ * @return            Sustained memory bandwidth in GB/s.
+ */
+
+double MeasureStreamBandwidth(uint32_t numThreads)
+{
+    vector<double> a(streamElems);
+    vector<double> b(streamElems);
+    vector<double> c(streamElems);
+
+    size_t chunk = (streamElems + numThreads - 1) / numThreads;
+
+    RunOnThreads(numThreads, [&](uint32_t t)
+    {
+        size_t start    = min(streamElems, t * chunk);
+        size_t end      = min(streamElems, start + chunk);
+
+        for (size_t i = start; i < end; i++)
+        {
+            a[i] = 0.0;
+            b[i] = 1.0;
+            c[i] = 2.0;
+        }
+    });
+
+    double best = 0.0;
+
+    for (uint32_t rep = 0; rep < streamReps; rep++)
+    {
+        uint64_t t0 = GetNanoseconds();
+
+        RunOnThreads(numThreads, [&](uint32_t t)
+        {
+            size_t start    = min(streamElems, t * chunk);
+            size_t end      = min(streamElems, start + chunk);
+            double* pA      = a.data();
+            const double* pB = b.data();
+            const double* pC = c.data();
+
+            for (size_t i = start; i < end; i++) pA[i] = pB[i] + 3.0 * pC[i];
+        });
+
+        double secs = 1e-9 * (double)(GetNanoseconds() - t0);
+        best = max(best, 3.0 * sizeof(double) * (double)streamElems / secs * 1e-9);
+    }
+
+    return best;
+}
+
+#ifdef FTWT_HAS_AVX2_PATH
+
+/**
+ * FmaChainsAVX2 - Peak FLOP probe, 10 independent chains of 4-wide FMAs, enough to
+ * cover FMA latency on two FMA ports.
+ *
+ * @param  iters Iterations.
+ * @return       Checksum, so the work can't be optimized away.
+ */
+
+FTWT_TARGET_AVX2 static double FmaChainsAVX2(uint64_t iters)
+{
+    __m256d acc[10];
+    __m256d mul = _mm256_set1_pd(0.999999);
+    __m256d add = _mm256_set1_pd(1e-7);
+
+    for (uint32_t i = 0; i < 10; i++) acc[i] = _mm256_set1_pd((double)i);
+
+    for (uint64_t it = 0; it < iters; it++)
+    {
+        for (uint32_t i = 0; i < 10; i++) acc[i] = _mm256_fmadd_pd(acc[i], mul, add);
+    }
+
+    __m256d sum = acc[0];
+    for (uint32_t i = 1; i < 10; i++) sum = _mm256_add_pd(sum, acc[i]);
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+#endif
+
+/**
+ * FmaChainsScalar - Scalar fallback for the peak FLOP probe.
+ *
+ * @param  iters Iterations.
+ * @return       Checksum.
+ */
+
+static double FmaChainsScalar(uint64_t iters)
+{
+    double acc[10];
+    for (uint32_t i = 0; i < 10; i++) acc[i] = (double)i;
+
+    for (uint64_t it = 0; it < iters; it++)
+    {
+        for (uint32_t i = 0; i < 10; i++) acc[i] = acc[i] * 0.999999 + 1e-7;
+    }
+
+    double sum = 0.0;
+    for (uint32_t i = 0; i < 10; i++) sum += acc[i];
+    return sum;
+}
+
+/**
+ * MeasurePeakFlops - Peak double precision FLOP probe. Runs independent FMA chains on
+ * every thread using the widest SIMD path our kernels can use.
+ *
+ * @param  numThreads Number of threads.
+ * @return            Peak GFLOP/s.
+ */
+
+double MeasurePeakFlops(uint32_t numThreads)
+{
+    bool bAVX2          = CpuHasAVX2();
+    double flopsPerIter = bAVX2 ? 10.0 * 4.0 * 2.0 : 10.0 * 2.0;
+    uint64_t iters      = bAVX2 ? flopProbeIters : flopProbeIters / 4;
+    vector<double> sink(numThreads);
+
+    auto probe = [&](uint32_t t)
+    {
+#ifdef FTWT_HAS_AVX2_PATH
+        if (bAVX2)
+        {
+            sink[t] = FmaChainsAVX2(iters);
+            return;
+        }
+#endif
+        sink[t] = FmaChainsScalar(iters);
+    };
+
+    RunOnThreads(numThreads, probe);
+
+    uint64_t t0 = GetNanoseconds();
+    RunOnThreads(numThreads, probe);
+    double secs = 1e-9 * (double)(GetNanoseconds() - t0);
+
+    if (sink[0] == 42.0) printf(" ");
+
+    return flopsPerIter * (double)iters * (double)numThreads / secs * 1e-9;
+}
+
+/**
+ * MeasureRoofline - Measure the host's compute and memory roofs.
+ *
+ * @param  numThreads Number of threads to probe with, zero for all hardware threads.
+ * @return            Measured roofline.
+ */
+
+RooflineMachine MeasureRoofline(uint32_t numThreads)
+{
+    RooflineMachine machine;
+
+    machine.numThreads      = numThreads ? numThreads : max(1u, thread::hardware_concurrency());
+    machine.bandwidthGBs    = MeasureStreamBandwidth(machine.numThreads);
+    machine.peakGflops      = MeasurePeakFlops(machine.numThreads);
+
+    return machine;
+}
+
+/**
+ * PlotRoofline - Draw a log-log ASCII roofline with each kernel marked by a letter.
+ *
+ * @param machine Measured roofline.
+ * @param points  Kernel (intensity, GFLOP/s) points.
+ */
+
+static void PlotRoofline(const RooflineMachine& machine, const vector<pair<double, double>>& points)
+{
+    const int width     = 64;
+    const int height    = 16;
+    const double xMin   = log2(1.0 / 64.0);
+    const double xMax   = log2(64.0);
+    const double yMax   = log2(machine.peakGflops * 2.0);
+    const double yMin   = yMax - 14.0;
+
+    vector<string> grid(height, string(width, ' '));
+
+    for (int x = 0; x < width; x++)
+    {
+        double intensity = exp2(xMin + (xMax - xMin) * (x + 0.5) / width);
+        double roof = log2(machine.Attainable(intensity));
+        int y = (int)((roof - yMin) / (yMax - yMin) * height);
+        if (y >= 0 && y < height) grid[height - 1 - y][x] = intensity < machine.RidgeIntensity() ? '/' : '-';
+    }
+
+    for (size_t p = 0; p < points.size(); p++)
+    {
+        int x = (int)((log2(points[p].first) - xMin) / (xMax - xMin) * width);
+        int y = (int)((log2(points[p].second) - yMin) / (yMax - yMin) * height);
+        x = max(0, min(width - 1, x));
+        y = max(0, min(height - 1, y));
+        grid[height - 1 - y][x] = (char)('A' + p % 26);
+    }
+
+    printf("GFLOP/s (log2, top = %.3g)\n", exp2(yMax));
+
+    for (auto& row : grid) printf("  |%s\n", row.c_str());
+
+    printf("  +%s\n", string(width, '-').c_str());
+    printf("   1/64%*s1%*s64  FLOP/byte (log2)\n\n", width / 2 - 5, "", width / 2 - 3, "");
+}
+
+/**
+ * PrintRooflineReport - For every profiled kernel with FLOP/byte counts, report achieved
+ * GFLOP/s and GB/s against the measured roofline, whether it is memory or compute bound,
+ * and rank kernels by the time that would be saved by reaching the roof.
+ *
+ * @param machine Measured roofline.
+ */
+
+void PrintRooflineReport(const RooflineMachine& machine)
+{
+    vector<ProfileZoneReport> zones = CollectProfileZones(false);
+    vector<ProfileZoneReport> kernels;
+
+    for (auto& zone : zones)
+    {
+        if (zone.stats.flops > 0 && zone.stats.bytes > 0 && zone.stats.totalNs > 0) kernels.push_back(zone);
+    }
+
+    printf("\nRoofline: %u threads, peak %.2f GFLOP/s, STREAM triad %.2f GB/s, ridge %.3f FLOP/byte\n\n",
+        machine.numThreads, machine.peakGflops, machine.bandwidthGBs, machine.RidgeIntensity());
+
+    if (kernels.empty())
+    {
+        printf("No instrumented kernels ran.\n\n");
+        return;
+    }
+
+    struct KernelPoint
+    {
+        string name;
+        double secs;
+        double intensity;
+        double gflops;
+        double gbs;
+        double attainable;
+        double savings;
+    };
+
+    vector<KernelPoint> points;
+
+    for (auto& kernel : kernels)
+    {
+        KernelPoint point;
+        point.name          = kernel.name;
+        point.secs          = 1e-9 * (double)kernel.stats.totalNs;
+        point.intensity     = (double)kernel.stats.flops / (double)kernel.stats.bytes;
+        point.gflops        = 1e-9 * (double)kernel.stats.flops / point.secs;
+        point.gbs           = 1e-9 * (double)kernel.stats.bytes / point.secs;
+        point.attainable    = machine.Attainable(point.intensity);
+        point.savings       = point.secs * max(0.0, 1.0 - point.gflops / point.attainable);
+        points.push_back(point);
+    }
+
+    printf("   %-32s %10s %10s %10s %10s %9s %8s  %s\n",
+        "kernel", "time s", "FLOP/B", "GFLOP/s", "GB/s", "% roof", "bound", "");
+
+    vector<pair<double, double>> plotPoints;
+
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        KernelPoint& p = points[i];
+        plotPoints.push_back({ p.intensity, p.gflops });
+
+        printf("%c  %-32s %10.4f %10.3f %10.3f %10.3f %9.1f %8s\n", (char)('A' + i % 26), p.name.c_str(),
+            p.secs, p.intensity, p.gflops, p.gbs, 100.0 * p.gflops / p.attainable,
+            p.intensity < machine.RidgeIntensity() ? "memory" : "compute");
+    }
+
+    printf("\n");
+    PlotRoofline(machine, plotPoints);
+
+    // Rank by the time left on the table, i.e., how much faster the run would be if the
+    // kernel hit its roof.
+
+    sort(points.begin(), points.end(), [](const KernelPoint& a, const KernelPoint& b)
+    {
+        return a.savings > b.savings;
+    });
+
+    printf("Optimize next (time recoverable by reaching the roof):\n");
+
+    for (size_t i = 0; i < points.size() && i < 5; i++)
+    {
+        const KernelPoint& p = points[i];
+        bool bMemory = p.intensity < machine.RidgeIntensity();
+
+        printf("  %zu. %-32s %8.4f s  %s bound at %.1f%% of roof, %s\n", i + 1, p.name.c_str(), p.savings,
+            bMemory ? "memory" : "compute", 100.0 * p.gflops / p.attainable,
+            bMemory ? "cut bytes moved (format, precision, reuse) or raise bandwidth use" :
+                "vectorize / parallelize the arithmetic");
+    }
+
+    printf("\n");
+}
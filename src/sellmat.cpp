@@ -0,0 +1,115 @@
+#include "sellmat.h"
+
+#ifdef FTWT_HAS_AVX2_PATH
+
+/**
+ * SELLSpMVChunksAVX2 - AVX2 double precision SELL-8 SpMV. Each chunk's 8 rows are held in
+ * two 4-wide accumulators, one gather per 4 lanes per slot column.
+ *
+ * @param vals         Padded values.
+ * @param colIdcs      Padded column indices.
+ * @param chunkOffsets Slot offset of each chunk.
+ * @param rowPerm      Original row of each sorted row, sellPadRow for padding rows.
+ * @param x            Input vector.
+ * @param y            Output vector, indexed by original row.
+ * @param chBegin      First chunk.
+ * @param chEnd        One past last chunk.
+ */
+
+FTWT_TARGET_AVX2 void SELLSpMVChunksAVX2(const double* vals, const uint32_t* colIdcs, const uint32_t* chunkOffsets,
+    const uint32_t* rowPerm, const double* x, double* y, uint32_t chBegin, uint32_t chEnd)
+{
+    for (uint32_t ch = chBegin; ch < chEnd; ch++)
+    {
+        __m256d acc0 = _mm256_setzero_pd();
+        __m256d acc1 = _mm256_setzero_pd();
+
+        for (uint32_t s = chunkOffsets[ch]; s < chunkOffsets[ch + 1]; s += 8)
+        {
+            __m128i idx0 = _mm_loadu_si128((const __m128i*)(colIdcs + s));
+            __m128i idx1 = _mm_loadu_si128((const __m128i*)(colIdcs + s + 4));
+            acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(vals + s), _mm256_i32gather_pd(x, idx0, 8), acc0);
+            acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(vals + s + 4), _mm256_i32gather_pd(x, idx1, 8), acc1);
+        }
+
+        double acc[8];
+        _mm256_storeu_pd(acc, acc0);
+        _mm256_storeu_pd(acc + 4, acc1);
+
+        for (uint32_t l = 0; l < 8; l++)
+        {
+            uint32_t row = rowPerm[ch * 8 + l];
+            if (row != sellPadRow) y[row] = acc[l];
+        }
+    }
+}
+
+/**
+ * SELLPairChunksAVX2 - AVX2 double precision SELL-8 pairings. Post activations for a
+ * chunk's 8 rows sit in two registers for the whole slot loop, pre activations are
+ * gathered.
+ *
+ * @param colIdcs      Padded column indices.
+ * @param chunkOffsets Slot offset of each chunk.
+ * @param rowPerm      Original row of each sorted row, sellPadRow for padding rows.
+ * @param pre          Presynaptic activations per batch entry.
+ * @param post         Postsynaptic activations per batch entry.
+ * @param batchSize    Number of batch entries.
+ * @param pairings     Output pairings, same layout as the values.
+ * @param chBegin      First chunk.
+ * @param chEnd        One past last chunk.
+ */
+
+FTWT_TARGET_AVX2 void SELLPairChunksAVX2(const uint32_t* colIdcs, const uint32_t* chunkOffsets,
+    const uint32_t* rowPerm, const double* const* pre, const double* const* post, uint32_t batchSize,
+    double* pairings, uint32_t chBegin, uint32_t chEnd)
+{
+    __m256d batchSizeInv = _mm256_set1_pd(1.0 / (double)batchSize);
+
+    for (uint32_t ch = chBegin; ch < chEnd; ch++)
+    {
+        uint32_t begin  = chunkOffsets[ch];
+        uint32_t end    = chunkOffsets[ch + 1];
+
+        for (uint32_t s = begin; s < end; s++) pairings[s] = 0.0;
+
+        for (uint32_t b = 0; b < batchSize; b++)
+        {
+            double postLane[8];
+
+            for (uint32_t l = 0; l < 8; l++)
+            {
+                uint32_t row    = rowPerm[ch * 8 + l];
+                postLane[l]     = row == sellPadRow ? 0.0 : post[b][row];
+            }
+
+            __m256d post0   = _mm256_loadu_pd(postLane);
+            __m256d post1   = _mm256_loadu_pd(postLane + 4);
+
+            if (_mm256_movemask_pd(_mm256_or_pd(_mm256_cmp_pd(post0, _mm256_setzero_pd(), _CMP_NEQ_UQ),
+                _mm256_cmp_pd(post1, _mm256_setzero_pd(), _CMP_NEQ_UQ))) == 0)
+            {
+                continue;
+            }
+
+            const double* pPre = pre[b];
+
+            for (uint32_t s = begin; s < end; s += 8)
+            {
+                __m128i idx0 = _mm_loadu_si128((const __m128i*)(colIdcs + s));
+                __m128i idx1 = _mm_loadu_si128((const __m128i*)(colIdcs + s + 4));
+                _mm256_storeu_pd(pairings + s,
+                    _mm256_fmadd_pd(post0, _mm256_i32gather_pd(pPre, idx0, 8), _mm256_loadu_pd(pairings + s)));
+                _mm256_storeu_pd(pairings + s + 4,
+                    _mm256_fmadd_pd(post1, _mm256_i32gather_pd(pPre, idx1, 8), _mm256_loadu_pd(pairings + s + 4)));
+            }
+        }
+
+        for (uint32_t s = begin; s < end; s += 4)
+        {
+            _mm256_storeu_pd(pairings + s, _mm256_mul_pd(_mm256_loadu_pd(pairings + s), batchSizeInv));
+        }
+    }
+}
+
+#endif
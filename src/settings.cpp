@@ -3,9 +3,7 @@
 
 void NNSettings::Load()
 {
-    char pwdBuffer[256];
-    GetCurrentDirectory(256, pwdBuffer);
-    string pwd(pwdBuffer);
+    string pwd = GetWorkingDirectory();
 
     string settingsFile = pwd + "/resource/settings.txt";
 
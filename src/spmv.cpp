@@ -0,0 +1,222 @@
+#include <algorithm>
+#include "spmv.h"
+
+using namespace std;
+
+#ifdef FTWT_HAS_AVX2_PATH
+
+/**
+ * LoadIdx4 - Load four column indices as 32-bit lanes for a gather.
+ */
+
+FTWT_TARGET_AVX2 static inline __m128i LoadIdx4(const uint32_t* idcs)
+{
+    return _mm_loadu_si128((const __m128i*)idcs);
+}
+
+/**
+ * LoadIdx4 - Load four 16-bit column indices, zero extended to 32-bit lanes.
+ */
+
+FTWT_TARGET_AVX2 static inline __m128i LoadIdx4(const uint16_t* idcs)
+{
+    return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)idcs));
+}
+
+/**
+ * SpMVRowsGatherAVX2 - AVX2 double precision CSR rows. Gathers four x entries per nonzero
+ * block with vpgatherdd indices loaded from colIdcs, two accumulators per row.
+ *
+ * @param vals    Nonzero values.
+ * @param colIdcs Column index of each nonzero.
+ * @param offsets Row offsets into vals/colIdcs.
+ * @param x       Input vector.
+ * @param y       Output vector, rows [rBegin, rEnd) are overwritten.
+ * @param rBegin  First row.
+ * @param rEnd    One past last row.
+ */
+
+template<class IdxT>
+FTWT_TARGET_AVX2 static void SpMVRowsGatherAVX2(const double* vals, const IdxT* colIdcs, const uint32_t* offsets,
+    const double* x, double* y, uint32_t rBegin, uint32_t rEnd)
+{
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        uint32_t i      = offsets[r];
+        uint32_t end    = offsets[r + 1];
+        __m256d acc0    = _mm256_setzero_pd();
+        __m256d acc1    = _mm256_setzero_pd();
+
+        for (; i + 8 <= end; i += 8)
+        {
+            __m128i idx0 = LoadIdx4(colIdcs + i);
+            __m128i idx1 = LoadIdx4(colIdcs + i + 4);
+            acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(vals + i), _mm256_i32gather_pd(x, idx0, 8), acc0);
+            acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(vals + i + 4), _mm256_i32gather_pd(x, idx1, 8), acc1);
+        }
+
+        if (i + 4 <= end)
+        {
+            __m128i idx = LoadIdx4(colIdcs + i);
+            acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(vals + i), _mm256_i32gather_pd(x, idx, 8), acc0);
+            i += 4;
+        }
+
+        acc0        = _mm256_add_pd(acc0, acc1);
+        __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+        sum         = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+        double res  = _mm_cvtsd_f64(sum);
+
+        for (; i < end; i++) res += vals[i] * x[colIdcs[i]];
+
+        y[r] = res;
+    }
+}
+
+/**
+ * SpMVRowsAVX2 - AVX2 double precision CSR rows with 32-bit indices.
+ */
+
+void SpMVRowsAVX2(const double* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const double* x, double* y, uint32_t rBegin, uint32_t rEnd)
+{
+    SpMVRowsGatherAVX2(vals, colIdcs, offsets, x, y, rBegin, rEnd);
+}
+
+/**
+ * SpMVRowsAVX2 - AVX2 double precision CSR rows with 16-bit indices.
+ */
+
+void SpMVRowsAVX2(const double* vals, const uint16_t* colIdcs, const uint32_t* offsets,
+    const double* x, double* y, uint32_t rBegin, uint32_t rEnd)
+{
+    SpMVRowsGatherAVX2(vals, colIdcs, offsets, x, y, rBegin, rEnd);
+}
+
+/**
+ * SpMMRowsAVX2 - AVX2 double precision CSR rows times a row-major block of k vectors.
+ * Output rows are accumulated four vectors at a time while the nonzero's value sits
+ * broadcast in a register.
+ *
+ * @param vals    Nonzero values.
+ * @param colIdcs Column index of each nonzero.
+ * @param offsets Row offsets into vals/colIdcs.
+ * @param x       Input block (m x k, row-major).
+ * @param y       Output block (n x k, row-major), rows [rBegin, rEnd) are overwritten.
+ * @param k       Number of vectors in the block.
+ * @param rBegin  First row.
+ * @param rEnd    One past last row.
+ */
+
+FTWT_TARGET_AVX2 void SpMMRowsAVX2(const double* vals, const uint32_t* colIdcs, const uint32_t* offsets,
+    const double* x, double* y, uint32_t k, uint32_t rBegin, uint32_t rEnd)
+{
+    uint32_t kVec = k & ~3u;
+
+    for (uint32_t r = rBegin; r < rEnd; r++)
+    {
+        double* yRow = y + (size_t)r * k;
+        for (uint32_t j = 0; j < k; j++) yRow[j] = 0.0;
+
+        for (uint32_t i = offsets[r]; i < offsets[r + 1]; i++)
+        {
+            __m256d val         = _mm256_set1_pd(vals[i]);
+            const double* xRow  = x + (size_t)colIdcs[i] * k;
+            uint32_t j          = 0;
+
+            for (; j < kVec; j += 4)
+            {
+                _mm256_storeu_pd(yRow + j, _mm256_fmadd_pd(val, _mm256_loadu_pd(xRow + j), _mm256_loadu_pd(yRow + j)));
+            }
+
+            for (; j < k; j++) yRow[j] += vals[i] * xRow[j];
+        }
+    }
+}
+
+/**
+ * TileDotAVX2 - Dot product of one batch tile of post activations, held in four registers,
+ * with one column's tile of pre activations.
+ *
+ * @param  post0  Post activations 0-3 of the tile.
+ * @param  post1  Post activations 4-7.
+ * @param  post2  Post activations 8-11.
+ * @param  post3  Post activations 12-15.
+ * @param  preCol Pre activations of the column over the tile.
+ * @return        Tile pairing sum.
+ */
+
+FTWT_TARGET_AVX2 static inline double TileDotAVX2(__m256d post0, __m256d post1, __m256d post2, __m256d post3,
+    const double* preCol)
+{
+    __m256d acc0    = _mm256_mul_pd(post0, _mm256_loadu_pd(preCol));
+    __m256d acc1    = _mm256_mul_pd(post1, _mm256_loadu_pd(preCol + 4));
+    acc0            = _mm256_fmadd_pd(post2, _mm256_loadu_pd(preCol + 8), acc0);
+    acc1            = _mm256_fmadd_pd(post3, _mm256_loadu_pd(preCol + 12), acc1);
+    acc0            = _mm256_add_pd(acc0, acc1);
+    __m128d sum     = _mm_add_pd(_mm256_castpd256_pd128(acc0), _mm256_extractf128_pd(acc0, 1));
+    sum             = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+
+    return _mm_cvtsd_f64(sum);
+}
+
+/**
+ * TileRowPairingsAVX2 - AVX2 double precision pairings of one row over numTiles batch
+ * tiles, one sweep of the row per tile. The row's sixteen post activations for the tile
+ * stay in four registers, each entry's sixteen pre activations are four loads and FMAs,
+ * then one horizontal sum.
+ *
+ * @param pairings Row pairings, accumulated into.
+ * @param cols     Column index of each entry.
+ * @param len      Row length.
+ * @param postRow  Post activations of the row, numTiles * pairBatchTile entries.
+ * @param preTiles Pre activations, numTiles * pairBatchTile per column.
+ * @param numTiles Number of batch tiles.
+ */
+
+FTWT_TARGET_AVX2 void TileRowPairingsAVX2(double* pairings, const uint32_t* cols, size_t len, const double* postRow,
+    const double* preTiles, uint32_t numTiles)
+{
+    static_assert(pairBatchTile == 16, "TileRowPairingsAVX2 holds a tile in four registers");
+
+    size_t stride = (size_t)numTiles * pairBatchTile;
+
+    for (uint32_t t = 0; t < numTiles; t++)
+    {
+        const double* post  = postRow + (size_t)t * pairBatchTile;
+        const double* pre   = preTiles + (size_t)t * pairBatchTile;
+        __m256d post0       = _mm256_loadu_pd(post);
+        __m256d post1       = _mm256_loadu_pd(post + 4);
+        __m256d post2       = _mm256_loadu_pd(post + 8);
+        __m256d post3       = _mm256_loadu_pd(post + 12);
+
+        for (size_t i = 0; i < len; i++)
+        {
+            pairings[i] += TileDotAVX2(post0, post1, post2, post3, pre + cols[i] * stride);
+        }
+    }
+}
+
+/**
+ * AxpyAVX2 - AVX2 double precision y += a * x.
+ *
+ * @param a Scale.
+ * @param x Input row.
+ * @param y Output row, accumulated into.
+ * @param k Row length.
+ */
+
+FTWT_TARGET_AVX2 void AxpyAVX2(double a, const double* x, double* y, uint32_t k)
+{
+    __m256d va  = _mm256_set1_pd(a);
+    uint32_t j  = 0;
+
+    for (; j + 4 <= k; j += 4)
+    {
+        _mm256_storeu_pd(y + j, _mm256_fmadd_pd(va, _mm256_loadu_pd(x + j), _mm256_loadu_pd(y + j)));
+    }
+
+    for (; j < k; j++) y[j] += a * x[j];
+}
+
+#endif
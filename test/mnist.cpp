@@ -10,9 +10,10 @@ static const uint32_t inputSize     = 784;
 static const uint32_t outputSize    = 10;
 static const uint32_t numIterations = 10;
 static const uint32_t batchSize     = 100;
-static const uint32_t pulseLength   = 1;
+static const uint32_t testBlockSize = 64;
 static const double learnRate       = 0.01;
 static const double cullThresh      = 1e-8;
+static const double growActThresh   = 0.5;
 
 /**
  * generateSynapses - Randomly initialize synapse weights for MNIST NN.
@@ -20,9 +21,10 @@ static const double cullThresh      = 1e-8;
  * @return List of synapse (to, from, weight) triples.
  */
 
-vector<Triplet<double>> generateSynapses()
+template<class T>
+vector<Triplet<T>> generateSynapses()
 {
-    vector<Triplet<double>> triples;
+    vector<Triplet<T>> triples;
 
     for (uint32_t i = 0; i < inputSize; i++)
     {
@@ -31,10 +33,10 @@ vector<Triplet<double>> generateSynapses()
             double scale = 1.0;
 
             double offset = scale * (double)rand() / (double)RAND_MAX - (0.5 * scale);
-            triples.push_back({ i, inputSize + j, offset });
+            triples.push_back({ i, inputSize + j, (T)offset });
 
             offset = scale * (double)rand() / (double)RAND_MAX - (0.5 * scale);
-            triples.push_back({ inputSize + j, i, offset });
+            triples.push_back({ inputSize + j, i, (T)offset });
         }
     }
 
@@ -52,12 +54,13 @@ vector<Triplet<double>> generateSynapses()
  * @param assocPost List of postsynaptic activations to populate.
  */
 
+template<class T>
 void getAssocBatch(
     MNISTDataSet &data,
     uint32_t start,
     uint32_t batchSize, 
-    vector<vector<pair<uint32_t, double>>>& assocPre,
-    vector<vector<pair<uint32_t, double>>>& assocPost)
+    vector<vector<pair<uint32_t, T>>>& assocPre,
+    vector<vector<pair<uint32_t, T>>>& assocPost)
 {
     for (uint32_t i = 0; i < batchSize; i++)
     {
@@ -66,7 +69,7 @@ void getAssocBatch(
         for (uint32_t j = 0; j < inputSize; j++)
         {
             assocPre[i][j].first    = j;
-            assocPre[i][j].second   = data.data[start + i][j];
+            assocPre[i][j].second   = (T)data.data[start + i][j];
         }
 
         assocPost[i][0].first       = inputSize + data.labels[start + i];
@@ -75,33 +78,21 @@ void getAssocBatch(
 }
 
 /**
- * MNISTTest - MNIST test driver routine. Load data set. Loop over association batches
- * and train NN. Report statistics and training time. Test NN on test set and report
- * accuracy.
+ * MNISTTrain - Train the MNIST digit net on the training set, growing and culling synapses
+ * between passes.
+ *
+ * @param params    Test run parameters (seed, precision, renormalization interval, synapse
+ *                  growth weight).
+ * @param trainData MNIST training set.
+ * @param nn        Net to train.
+ * @param results   Training time, image count and synapses culled/grown.
  */
 
-void MNISTTest()
+template<class T>
+void MNISTTrain(TestParams &params, MNISTDataSet &trainData, NN<T> &nn, TestResults &results)
 {
-    MNISTDataSet trainData;
-    MNISTDataSet testData;
-
-    trainData.Init(trainImageFile.c_str(), trainLabelFile.data());
-    testData.Init(testImageFile.c_str(), testLabelFile.data());
-
-    srand((uint32_t)time(NULL));
-
-    NNCreateParams<double> params;
-    params.batchSize    = batchSize;
-    params.name         = "MNIST Digit Net";
-    params.numNeurons   = inputSize + outputSize;
-    params.synapsesIn   = generateSynapses();
-    params.learnRate    = learnRate;
-    params.cullThresh   = cullThresh;
-
-    NN<double> nn(params);
-    
-    vector<vector<pair<uint32_t, double>>> assocPre(batchSize);
-    vector<vector<pair<uint32_t, double>>> assocPost(batchSize);
+    vector<vector<pair<uint32_t, T>>> assocPre(batchSize);
+    vector<vector<pair<uint32_t, T>>> assocPost(batchSize);
 
     for (uint32_t i = 0; i < batchSize; i++)
     {
@@ -109,9 +100,12 @@ void MNISTTest()
         assocPost[i].resize(1);
     }
 
-    printf("Training MNIST Digit Images\n");
+    printf("Training MNIST Digit Images, %s precision, %s synapses\n", PrecisionName(params.precision),
+        SparseFormatName(nn.synapses.format));
     printf("Number of training set passes: %d\n", numIterations);
     printf("Training batch size: %d\n", batchSize);
+    printf("Pulses per batch: %u, %s activation, threshold %g\n", params.numPulses,
+        PulseActivationName(nn.pulseActivation), nn.pulseThresh);
 
     long long t1 = GetMilliseconds();
 
@@ -121,46 +115,169 @@ void MNISTTest()
 
         for (uint32_t j = 0; j < trainData.numImgs; j += batchSize)
         {
+            PROFILE_ZONE_WORK("MNISTTest::trainBatch", batchSize, "sample");
             getAssocBatch(trainData, j, batchSize, assocPre, assocPost);
-            nn.applyAssocs(assocPre, assocPost, pulseLength);
-            nn.computePairings();
+            nn.applyAssocs(assocPre, assocPost, params.numPulses);
+            if (params.growWeight > 0.0) results.synapsesGrown += nn.growSynapses((T)growActThresh, (T)params.growWeight);
             nn.updateSynapses();
         }
 
-        nn.cull();
+        size_t numCulled        = nn.cull();
+        results.synapsesCulled  += numCulled;
+        printf("Culled %zu synapses, %zu left\n", numCulled, nn.synapses.nnz());
+        nn.packSynapses();
+    }
+
+    double trainingTime = ((double)(GetMilliseconds() - t1)) / 1000.0;
+    printf("FTWT MNIST Training Time: %g sec\n", trainingTime);
+
+    results.trainTime   = trainingTime;
+    results.trainImages = (uint64_t)numIterations * trainData.numImgs;
+}
+
+/**
+ * MNISTTrainAndTest - Train the MNIST digit net with activations in T, or load a trained
+ * one, and report training time and test set accuracy. The trained net is saved if asked.
+ *
+ * @param params    Test run parameters (seed, precision, renormalization interval, synapse
+ *                  growth weight, net save/load paths).
+ * @param trainData MNIST training set.
+ * @param testData  MNIST test set.
+ * @param results   Training/test time, training image count and test accuracy.
+ */
+
+template<class T>
+void MNISTTrainAndTest(TestParams &params, MNISTDataSet &trainData, MNISTDataSet &testData, TestResults &results)
+{
+    srand(params.seed);
+
+    NN<T> nn;
+    string err;
+
+    results.synapsesCulled  = 0;
+    results.synapsesGrown   = 0;
+
+    if (!params.loadNetPath.empty())
+    {
+        long long t0 = GetMilliseconds();
+
+        if (!nn.load(params.loadNetPath, err))
+        {
+            printf("Failed to load net: %s\n", err.c_str());
+            return;
+        }
+
+        if (nn.inputNeurons.size() != inputSize || nn.outputNeurons.size() != outputSize)
+        {
+            printf("%s isn't an MNIST digit net\n", params.loadNetPath.c_str());
+            return;
+        }
+
+        printf("Loaded %s in %lld ms, %zu %s synapses, skipping training\n", params.loadNetPath.c_str(),
+            GetMilliseconds() - t0, nn.synapses.nnz(), SparseFormatName(nn.synapses.format));
+    }
+    else
+    {
+        NNCreateParams<T> nnParams;
+        nnParams.batchSize       = batchSize;
+        nnParams.name            = "MNIST Digit Net";
+        nnParams.numNeurons      = inputSize + outputSize;
+        nnParams.synapsesIn      = generateSynapses<T>();
+        nnParams.learnRate       = learnRate;
+        nnParams.cullThresh      = cullThresh;
+        nnParams.format          = PrecisionFormat(params.precision);
+        nnParams.renormInterval  = params.renormInterval;
+        nnParams.order           = params.order;
+        nnParams.pulseActivation = params.pulseActivation;
+        nnParams.pulseThresh     = params.pulseThresh;
+
+        nn = NN<T>(nnParams);
+
+        for (uint32_t i = 0; i < inputSize; i++) nn.inputNeurons.push_back(i);
+        for (uint32_t o = 0; o < outputSize; o++) nn.outputNeurons.push_back(inputSize + o);
+
+        MNISTTrain(params, trainData, nn, results);
+    }
+
+    if (!params.saveNetPath.empty())
+    {
+        if (nn.save(params.saveNetPath, err)) printf("Saved net to %s\n", params.saveNetPath.c_str());
+        else printf("Failed to save net: %s\n", err.c_str());
     }
 
     long long t2 = GetMilliseconds();
 
-    double trainingTime = ((double)(t2 - t1)) / 1000.0;
-    printf("FTWT MNIST Training Time: %g sec\n", trainingTime);
+    // Evaluate test images in blocks, neuron-major so the net is streamed once per block.
 
-    vector<double> testVec(inputSize + outputSize, 0.0);
+    vector<T> testBlock;
+    vector<T> res;
 
     uint32_t correctCnt = 0;
 
-    for (uint32_t i = 0; i < testData.numImgs; i++)
+    for (uint32_t i = 0; i < testData.numImgs; i += testBlockSize)
     {
-        memcpy(&testVec[0], &testData.data[i][0], inputSize * sizeof(double));
-        vector<double> res = nn.applyInput(testVec);
+        uint32_t blockSize = min(testBlockSize, testData.numImgs - i);
+        PROFILE_ZONE_WORK("MNISTTest::testBlock", blockSize, "sample");
+        testBlock.assign((size_t)nn.numNeurons * blockSize, 0.0);
+
+        for (uint32_t j = 0; j < inputSize; j++)
+        {
+            for (uint32_t k = 0; k < blockSize; k++) testBlock[nn.inputNeurons[j] * blockSize + k] = (T)testData.data[i + k][j];
+        }
 
-        double max = -50.0;
-        uint32_t outIdx = outputSize;
+        nn.applyInputBlock(testBlock, res, blockSize);
 
-        for (uint32_t i = 0; i < outputSize; i++)
+        for (uint32_t k = 0; k < blockSize; k++)
         {
-            if (res[inputSize + i] > max)
+            T max = -50.0;
+            uint32_t outIdx = outputSize;
+
+            for (uint32_t o = 0; o < outputSize; o++)
             {
-                max = res[inputSize + i];
-                outIdx = i;
+                if (res[nn.outputNeurons[o] * blockSize + k] > max)
+                {
+                    max = res[nn.outputNeurons[o] * blockSize + k];
+                    outIdx = o;
+                }
             }
-        }
 
-        uint32_t label = testData.labels[i];
+            uint32_t label = testData.labels[i + k];
 
-        if (label == outIdx) correctCnt++;
+            if (label == outIdx) correctCnt++;
+        }
     }
 
     double accuracy = 100.0 * (double)correctCnt / (double)testData.numImgs;
     printf("NN test accuracy=%g%%\n", accuracy);
+
+    results.testTime    = ((double)(GetMilliseconds() - t2)) / 1000.0;
+    results.accuracy    = accuracy;
+}
+
+/**
+ * MNISTTest - MNIST test driver routine. Load data set. Loop over association batches
+ * and train NN. Report statistics and training time. Test NN on test set and report
+ * accuracy. Data sets are loaded once and reused across benchmark runs. Fixed point
+ * precisions store Q1.14 weights with float activations. A net saved with --save-net can
+ * be tested again with --load-net, skipping training.
+ *
+ * @param params  Test run parameters (seed, precision, renormalization interval).
+ * @param results Training/test time, training image count and test accuracy.
+ */
+
+void MNISTTest(TestParams &params, TestResults &results)
+{
+    static MNISTDataSet trainData;
+    static MNISTDataSet testData;
+
+    if (trainData.numImgs == 0)
+    {
+        trainData.Init(trainImageFile.c_str(), trainLabelFile.data());
+        testData.Init(testImageFile.c_str(), testLabelFile.data());
+    }
+
+    if (params.precision == PRECISION_DOUBLE) MNISTTrainAndTest<double>(params, trainData, testData, results);
+    else MNISTTrainAndTest<float>(params, trainData, testData, results);
+
+    if (!params.bBench) PrintProfileReport();
 }
\ No newline at end of file
@@ -1,6 +1,14 @@
 #include "tests.h"
 
-void SimpleCrossTest()
+/**
+ * SimpleCrossTest - Train a 4 neuron network to map input 0 to output 3 and input 1 to
+ * output 2, then print the learned synapses and responses.
+ *
+ * @param params  Test run parameters.
+ * @param results Training time and image counts for the run.
+ */
+
+void SimpleCrossTest(TestParams &params, TestResults &results)
 {
     const uint32_t numNeurons   = 4;
     const uint32_t numIters     = 10;
@@ -15,13 +23,13 @@ void SimpleCrossTest()
     vector<vector<pair<uint32_t, double>>> assocPre2    = { { { 1, 1.0 } } };
     vector<vector<pair<uint32_t, double>>> assocPost2   = { { { 2, 1.0 } } };
 
-    NNCreateParams<double> params;
-    params.batchSize    = batchSize;
-    params.name         = "Simple 2x2 Net";
-    params.numNeurons   = numNeurons;
-    params.learnRate    = learnRate;
-    params.cullThresh   = cullThresh;
-    params.synapsesIn =
+    NNCreateParams<double> nnParams;
+    nnParams.batchSize  = batchSize;
+    nnParams.name       = "Simple 2x2 Net";
+    nnParams.numNeurons = numNeurons;
+    nnParams.learnRate  = learnRate;
+    nnParams.cullThresh = cullThresh;
+    nnParams.synapsesIn =
     {
         { 0, 2, 52.0 },
         { 2, 0, 45.0 },
@@ -33,19 +41,24 @@ void SimpleCrossTest()
         { 3, 1, 56.0 }
     };
 
-    NN<double> network(params);
+    NN<double> network(nnParams);
+
+    long long t1 = GetMilliseconds();
 
     for (uint32_t i = 0; i < numIters; i++)
     {
         network.applyAssocs(assocPre1, assocPost1, numPulses);
-        network.computePairings();
         network.updateSynapses();
 
         network.applyAssocs(assocPre2, assocPost2, numPulses);
-        network.computePairings();
         network.updateSynapses();
     }
 
+    long long t2 = GetMilliseconds();
+
+    results.trainTime   = ((double)(t2 - t1)) / 1000.0;
+    results.trainImages = 2 * numIters * batchSize;
+
     vector<double> test1 = { 1.0, 0.0, 0.0, 0.0 };
     vector<double> test2 = { 0.0, 1.0, 0.0, 0.0 };
 
@@ -57,5 +70,8 @@ void SimpleCrossTest()
     print(out1);
     print(out2);
 
-    __debugbreak();
+    results.accuracy    = 50.0 * ((out1[3] > out1[2] ? 1.0 : 0.0) + (out2[2] > out2[3] ? 1.0 : 0.0));
+    results.testTime    = ((double)(GetMilliseconds() - t2)) / 1000.0;
+
+    DebugTrap();
 }
\ No newline at end of file
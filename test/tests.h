@@ -2,9 +2,81 @@
 
 #include "ftwt.h"
 #include "nn.h"
+#include "graphio.h"
 #include "timer.h"
 #include "randomgraph.h"
 
-void SimpleCrossTest();
-void MNISTTest();
-void MNISTRandTest();
\ No newline at end of file
+enum Precision
+{
+    PRECISION_DOUBLE,
+    PRECISION_FLOAT,
+    PRECISION_FIXED16,
+    PRECISION_FIXED16_I32
+};
+
+struct TestParams
+{
+    uint32_t seed;
+    uint32_t numThreads;
+    bool bBench;
+    Precision precision;
+    uint32_t renormInterval;
+    NeuronOrder order;
+    double growWeight;
+    uint32_t numPulses;
+    PulseActivation pulseActivation;
+    double pulseThresh;
+    string saveNetPath;
+    string loadNetPath;
+    string synapsesPath;
+};
+
+struct TestResults
+{
+    double trainTime;
+    double testTime;
+    uint64_t trainImages;
+    uint64_t synapsesCulled;
+    uint64_t synapsesGrown;
+    double accuracy;
+};
+
+void SimpleCrossTest(TestParams &params, TestResults &results);
+void MNISTTest(TestParams &params, TestResults &results);
+void MNISTRandTest(TestParams &params, TestResults &results);
+
+/**
+ * PrecisionName - Printable name of a test precision, also the --precision argument.
+ *
+ * @param  precision Test precision.
+ * @return           Precision name.
+ */
+
+inline const char* PrecisionName(Precision precision)
+{
+    switch (precision)
+    {
+    case PRECISION_FLOAT:       return "float";
+    case PRECISION_FIXED16:     return "fixed16";
+    case PRECISION_FIXED16_I32: return "fixed16-i32";
+    default:                    return "double";
+    }
+}
+
+/**
+ * PrecisionFormat - Synapse storage format for a test precision. Fixed point weights keep
+ * float activations, the other precisions let the storage format be picked automatically.
+ *
+ * @param  precision Test precision.
+ * @return           Synapse storage format.
+ */
+
+inline SparseFormat PrecisionFormat(Precision precision)
+{
+    switch (precision)
+    {
+    case PRECISION_FIXED16:     return SPARSE_FIXED16;
+    case PRECISION_FIXED16_I32: return SPARSE_FIXED16_I32;
+    default:                    return SPARSE_AUTO;
+    }
+}